@@ -302,6 +302,11 @@ function Invoke-Native-UnitTests
             foreach ($GoogleTestsDir in $Projects) {
                 Invoke-Google-Tests $GoogleTestsDir corerun_tests.exe $CommandGTestsDefaultArguments
             }
+
+            if($env:SNAPX_CI_WINDOWS_DISABLE_MSVS_TESTS -ne 1) {
+                $BsdiffTestsDir = Join-Path $WorkingDir build\native\Windows\$Rid\${Configuration}\Snap.Bsdiff.Tests\${Configuration}
+                Invoke-Google-Tests $BsdiffTestsDir snap_bsdiff_tests.exe $CommandGTestsDefaultArguments
+            }
         }
         "Unix" {
             $Projects = @()
@@ -318,6 +323,11 @@ function Invoke-Native-UnitTests
                 Invoke-Google-Tests $GoogleTestsDir corerun_tests $CommandGTestsDefaultArguments
             }
 
+            if($env:SNAPX_CI_UNIX_DISABLE_GCC_TESTS -ne 1) {
+                $BsdiffTestsDir = Join-Path $WorkingDir build\native\Unix\$Rid\${Configuration}\Snap.Bsdiff.Tests
+                Invoke-Google-Tests $BsdiffTestsDir snap_bsdiff_tests $CommandGTestsDefaultArguments
+            }
+
         }
         default {
             Write-Error "Unsupported os platform: $OSPlatform"
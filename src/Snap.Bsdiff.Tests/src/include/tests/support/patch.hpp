@@ -0,0 +1,86 @@
+#pragma once
+
+#include "bsdiff/lib.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace snap::bsdiff::tests {
+
+// Packer that appends everything the diff writes to bytes. Headers are written as raw
+// int64_t values, the tests only compare the output of two diffs.
+class recording_packer final {
+  struct bsdiff_patch_packer m_packer;
+
+  static int append(void *state, const void *buffer, const size_t size) {
+    auto *bytes = static_cast<std::vector<uint8_t> *>(state);
+    const auto *p_buffer = static_cast<const uint8_t *>(buffer);
+    bytes->insert(bytes->end(), p_buffer, p_buffer + size);
+    return BSDIFF_SUCCESS;
+  }
+
+  static int write_new_size(void *state, const int64_t size) {
+    return append(state, &size, sizeof(size));
+  }
+
+  static int write_entry_header(void *state, const int64_t diff, const int64_t extra, const int64_t seek) {
+    const int64_t header[] = {diff, extra, seek};
+    return append(state, header, sizeof(header));
+  }
+
+  static int write_entry_data(void *state, const uint8_t *buffer, const size_t size) {
+    return append(state, buffer, size);
+  }
+
+  static int flush(void *) {
+    return BSDIFF_SUCCESS;
+  }
+
+public:
+  std::vector<uint8_t> bytes;
+
+  recording_packer() :
+      m_packer(),
+      bytes() {
+    m_packer.state = &bytes;
+    m_packer.write_new_size = write_new_size;
+    m_packer.write_entry_header = write_entry_header;
+    m_packer.write_entry_diff = write_entry_data;
+    m_packer.write_entry_extra = write_entry_data;
+    m_packer.flush = flush;
+  }
+
+  recording_packer(const recording_packer &) = delete;
+  recording_packer &operator=(const recording_packer &) = delete;
+
+  struct bsdiff_patch_packer *get() {
+    return &m_packer;
+  }
+};
+
+inline std::vector<uint8_t> random_bytes(const size_t size, const uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::vector<uint8_t> bytes(size);
+  for (auto &byte : bytes) {
+    byte = static_cast<uint8_t>(rng());
+  }
+  return bytes;
+}
+
+// Overwrites a byte in every thousand and inserts a block in the middle, roughly what a
+// rebuilt file looks like.
+inline std::vector<uint8_t> edit(const std::vector<uint8_t> &older, const uint32_t seed) {
+  std::mt19937 rng(seed);
+  const auto block = random_bytes(4096, seed + 1);
+  std::vector<uint8_t> newer(older.begin(), older.begin() + static_cast<std::ptrdiff_t>(older.size() / 2));
+  newer.insert(newer.end(), block.begin(), block.end());
+  newer.insert(newer.end(), older.begin() + static_cast<std::ptrdiff_t>(older.size() / 2), older.end());
+  for (size_t i = 0; i < newer.size() / 1000; i++) {
+    newer[rng() % newer.size()] = static_cast<uint8_t>(rng());
+  }
+  return newer;
+}
+
+}
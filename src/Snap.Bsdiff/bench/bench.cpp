@@ -0,0 +1,623 @@
+#include "bsdiff/diff.hpp"
+#include "bsdiff/lib.hpp"
+#include "bsdiff/packer.hpp"
+#include "bsdiff/stream.hpp"
+#include "bsdiff/suffix_array.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Benchmarks of the diff and patch phases over synthetic corpora. Results are written as
+// JSON unless --benchmark_format says otherwise, so runs can be compared with
+// compare.py from Google Benchmark.
+
+namespace {
+
+using buffer = std::vector<uint8_t>;
+
+enum class corpus_kind {
+  random,
+  text,
+  executable,
+  similar,
+  different,
+  zeros,
+  sparse,
+  tables
+};
+
+const std::pair<corpus_kind, const char *> corpus_kinds[] = {
+  { corpus_kind::random, "random" },
+  { corpus_kind::text, "text" },
+  { corpus_kind::executable, "executable" },
+  { corpus_kind::similar, "similar" },
+  { corpus_kind::different, "different" }
+};
+
+// Low entropy inputs, only suffix sorted. Long runs and repeats are the worst case of
+// prefix doubling.
+const std::pair<corpus_kind, const char *> low_entropy_kinds[] = {
+  { corpus_kind::zeros, "zeros" },
+  { corpus_kind::sparse, "sparse" },
+  { corpus_kind::tables, "tables" }
+};
+
+const size_t corpus_sizes[] = { 64 * 1024, 1024 * 1024, 8 * 1024 * 1024 };
+
+const std::pair<snap_bsdiff_packer_type, const char *> packer_types[] = {
+  { bsdiff_packer_type_bz2, "bz2" },
+  { bsdiff_packer_type_stored, "stored" },
+#if defined(SNAP_BSDIFF_ZSTD)
+  { bsdiff_packer_type_zstd, "zstd" },
+#endif
+#if defined(SNAP_BSDIFF_LZ4)
+  { bsdiff_packer_type_lz4, "lz4" },
+#endif
+};
+
+struct corpus {
+  buffer older;
+  buffer newer;
+};
+
+buffer random_bytes(std::mt19937 &rng, const size_t size) {
+  buffer data(size);
+  for (auto &c : data) {
+    c = static_cast<uint8_t>(rng());
+  }
+  return data;
+}
+
+buffer text_bytes(std::mt19937 &rng, const size_t size) {
+  static const char *const words[] = {
+    "snap ", "release ", "channel ", "package ", "update ", "delta ", "install ", "version ",
+    "the ", "of ", "and ", "to ", "a ", "in ", "is ", "\n"
+  };
+  buffer data;
+  data.reserve(size + 16);
+  while (data.size() < size) {
+    const std::string word = words[rng() % (sizeof words / sizeof words[0])];
+    data.insert(data.end(), word.begin(), word.end());
+  }
+  data.resize(size);
+  return data;
+}
+
+// x86 code calling into a table of functions, prefixed by an ELF header describing it as
+// .text. shift bytes inserted in the middle move every call target after them, which is
+// what a rebuilt executable looks like to bsdiff.
+buffer executable_bytes(const size_t size, const size_t shift) {
+  constexpr size_t text = 0x100;
+  constexpr size_t section_headers = 128;
+  const auto code_size = size > text + section_headers ? size - text - section_headers : 0;
+
+  std::mt19937 rng(7), padding_rng(11);
+  buffer data(text, 0);
+  auto shifted = false;
+  while (data.size() < text + code_size) {
+    if (!shifted && data.size() >= text + code_size / 2) {
+      const auto padding = random_bytes(padding_rng, shift);
+      data.insert(data.end(), padding.begin(), padding.end());
+      shifted = true;
+    }
+    if (rng() % 4 == 0) {
+      const auto target = static_cast<uint32_t>(text + (rng() % 1024) * 32);
+      const auto relative = target - static_cast<uint32_t>(data.size() + 5);
+      data.push_back(0xe8);
+      for (auto i = 0; i < 4; i++) {
+        data.push_back(static_cast<uint8_t>(relative >> (8 * i)));
+      }
+    } else {
+      uint8_t c;
+      do {
+        c = static_cast<uint8_t>(rng());
+      } while (c == 0xe8 || c == 0xe9);
+      data.push_back(c);
+    }
+  }
+
+  const auto put = [&](const size_t offset, const uint64_t value, const int bytes) {
+    for (auto i = 0; i < bytes; i++) {
+      data[offset + static_cast<size_t>(i)] = static_cast<uint8_t>(value >> (8 * i));
+    }
+  };
+
+  // ELF64 header with two section headers, the second one SHF_ALLOC | SHF_EXECINSTR.
+  const auto sh = data.size();
+  data.resize(sh + section_headers, 0);
+  data[0] = 0x7f;
+  data[1] = 'E';
+  data[2] = 'L';
+  data[3] = 'F';
+  data[4] = 2;
+  data[5] = 1;
+  put(18, 62, 2);
+  put(40, sh, 8);
+  put(58, 64, 2);
+  put(60, 2, 2);
+  put(sh + 64 + 4, 1, 4);
+  put(sh + 64 + 8, 6, 8);
+  put(sh + 64 + 24, text, 8);
+  put(sh + 64 + 32, sh - text, 8);
+  return data;
+}
+
+// Zero filled, with a random 4 KiB page in every four, like the padding of a resource file.
+buffer sparse_bytes(std::mt19937 &rng, const size_t size) {
+  buffer data(size, 0);
+  for (size_t i = 0; i < size; i++) {
+    if ((i / 4096) % 4 == 0) {
+      data[i] = static_cast<uint8_t>(rng());
+    }
+  }
+  return data;
+}
+
+// A 1 KiB table repeated over and over.
+buffer table_bytes(const size_t size) {
+  buffer data(size);
+  for (size_t i = 0; i < size; i++) {
+    data[i] = static_cast<uint8_t>((i % 1024) * 7);
+  }
+  return data;
+}
+
+// Overwrites a byte in every 1000 and inserts a block every 64 KiB, roughly what a
+// recompiled assembly or an edited document looks like.
+buffer edit(std::mt19937 &rng, const buffer &older, const size_t stride) {
+  auto newer = older;
+  for (size_t i = 0; i < newer.size() / stride; i++) {
+    newer[rng() % newer.size()] = static_cast<uint8_t>(rng());
+  }
+  for (size_t offset = newer.size() / 3; offset < newer.size(); offset += 64 * 1024) {
+    const auto block = random_bytes(rng, 64);
+    newer.insert(newer.begin() + static_cast<std::ptrdiff_t>(offset), block.begin(), block.end());
+  }
+  return newer;
+}
+
+const corpus &get_corpus(const corpus_kind kind, const size_t size) {
+  static std::map<std::pair<corpus_kind, size_t>, corpus> cache;
+  auto &entry = cache[{ kind, size }];
+  if (!entry.older.empty()) {
+    return entry;
+  }
+
+  std::mt19937 rng(static_cast<uint32_t>(size) ^ static_cast<uint32_t>(kind));
+  switch (kind) {
+    case corpus_kind::random:
+      entry.older = random_bytes(rng, size);
+      entry.newer = edit(rng, entry.older, 1000);
+      break;
+    case corpus_kind::text:
+      entry.older = text_bytes(rng, size);
+      entry.newer = edit(rng, entry.older, 1000);
+      break;
+    case corpus_kind::executable:
+      entry.older = executable_bytes(size, 0);
+      entry.newer = executable_bytes(size, 4096);
+      break;
+    case corpus_kind::similar:
+      entry.older = random_bytes(rng, size);
+      entry.newer = edit(rng, entry.older, 100000);
+      break;
+    case corpus_kind::different:
+      entry.older = random_bytes(rng, size);
+      entry.newer = random_bytes(rng, size);
+      break;
+    case corpus_kind::zeros:
+      entry.older = buffer(size, 0);
+      entry.newer = edit(rng, entry.older, 1000);
+      break;
+    case corpus_kind::sparse:
+      entry.older = sparse_bytes(rng, size);
+      entry.newer = edit(rng, entry.older, 1000);
+      break;
+    case corpus_kind::tables:
+      entry.older = table_bytes(size);
+      entry.newer = edit(rng, entry.older, 1000);
+      break;
+  }
+  return entry;
+}
+
+// Diffs a corpus into a patch written by packer.
+buffer make_patch(const corpus &files, const snap_bsdiff_packer_type packer, const snap_bsdiff_filter_type filter,
+                  const snap_bsdiff_engine_type engine = bsdiff_engine_type_prematch) {
+  snap_bsdiff_diff_ctx ctx = {};
+  ctx.older = files.older.data();
+  ctx.older_size = files.older.size();
+  ctx.newer = files.newer.data();
+  ctx.newer_size = files.newer.size();
+  ctx.packer.type = packer;
+  ctx.filter = filter;
+  ctx.engine = engine;
+  if (snap_bsdiff_diff(&ctx) != 1) {
+    return buffer();
+  }
+  buffer patch(ctx.patch, ctx.patch + ctx.patch_size);
+  snap_bsdiff_diff_free(&ctx);
+  return patch;
+}
+
+void set_processed(benchmark::State &state, const corpus &files) {
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(files.newer.size()));
+}
+
+// Suffix sort of older, the first phase of a diff, on thread_count threads (0 for all cores).
+// Every corpus is below 4 GiB, so its suffix array holds 32-bit entries like the one a diff
+// builds.
+void bench_suffix_sort(benchmark::State &state, const corpus_kind kind, const size_t size, const uint32_t thread_count) {
+  const auto &files = get_corpus(kind, size);
+  std::vector<uint32_t> sa(files.older.size() + 1);
+  for (auto _ : state) {
+    if (snap::bsdiff::suffix_array_build(files.older.data(), static_cast<int64_t>(files.older.size()), sa.data(),
+                                         thread_count) != BSDIFF_SUCCESS) {
+      state.SkipWithError("suffix_array_build failed");
+      break;
+    }
+    benchmark::DoNotOptimize(sa.data());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(files.older.size()));
+}
+
+// qsufsort from bsdiff 4.3, the single threaded sort used before suffix_array_build, kept as
+// the baseline of bench_suffix_sort.
+//
+// Copyright 2003-2005 Colin Percival. All rights reserved.
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted providing that the following conditions are met: 1. Redistributions of source
+// code must retain the above copyright notice, this list of conditions and the following
+// disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or other
+// materials provided with the distribution.
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+// PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+void qsufsort_split(int64_t *sa, int64_t *rank, const int64_t start, const int64_t len, const int64_t h) {
+  if (len < 16) {
+    for (int64_t k = start, j; k < start + len; k += j) {
+      j = 1;
+      auto x = rank[sa[k] + h];
+      for (int64_t i = 1; k + i < start + len; i++) {
+        if (rank[sa[k + i] + h] < x) {
+          x = rank[sa[k + i] + h];
+          j = 0;
+        }
+        if (rank[sa[k + i] + h] == x) {
+          std::swap(sa[k + j], sa[k + i]);
+          j++;
+        }
+      }
+      for (int64_t i = 0; i < j; i++) {
+        rank[sa[k + i]] = k + j - 1;
+      }
+      if (j == 1) {
+        sa[k] = -1;
+      }
+    }
+    return;
+  }
+
+  const auto x = rank[sa[start + len / 2] + h];
+  int64_t jj = 0, kk = 0;
+  for (auto i = start; i < start + len; i++) {
+    if (rank[sa[i] + h] < x) {
+      jj++;
+    }
+    if (rank[sa[i] + h] == x) {
+      kk++;
+    }
+  }
+  jj += start;
+  kk += jj;
+
+  int64_t i = start, j = 0, k = 0;
+  while (i < jj) {
+    if (rank[sa[i] + h] < x) {
+      i++;
+    } else if (rank[sa[i] + h] == x) {
+      std::swap(sa[i], sa[jj + j]);
+      j++;
+    } else {
+      std::swap(sa[i], sa[kk + k]);
+      k++;
+    }
+  }
+  while (jj + j < kk) {
+    if (rank[sa[jj + j] + h] == x) {
+      j++;
+    } else {
+      std::swap(sa[jj + j], sa[kk + k]);
+      k++;
+    }
+  }
+
+  if (jj > start) {
+    qsufsort_split(sa, rank, start, jj - start, h);
+  }
+  for (i = 0; i < kk - jj; i++) {
+    rank[sa[jj + i]] = kk - 1;
+  }
+  if (jj == kk - 1) {
+    sa[jj] = -1;
+  }
+  if (start + len > kk) {
+    qsufsort_split(sa, rank, kk, start + len - kk, h);
+  }
+}
+
+void qsufsort(int64_t *sa, int64_t *rank, const uint8_t *buffer, const int64_t size) {
+  int64_t buckets[256] = {};
+  for (int64_t i = 0; i < size; i++) {
+    buckets[buffer[i]]++;
+  }
+  for (auto i = 1; i < 256; i++) {
+    buckets[i] += buckets[i - 1];
+  }
+  for (auto i = 255; i > 0; i--) {
+    buckets[i] = buckets[i - 1];
+  }
+  buckets[0] = 0;
+
+  for (int64_t i = 0; i < size; i++) {
+    sa[++buckets[buffer[i]]] = i;
+  }
+  sa[0] = size;
+  for (int64_t i = 0; i < size; i++) {
+    rank[i] = buckets[buffer[i]];
+  }
+  rank[size] = 0;
+  for (auto i = 1; i < 256; i++) {
+    if (buckets[i] == buckets[i - 1] + 1) {
+      sa[buckets[i]] = -1;
+    }
+  }
+  sa[0] = -1;
+
+  for (int64_t h = 1; sa[0] != -(size + 1); h += h) {
+    int64_t len = 0, i = 0;
+    while (i < size + 1) {
+      if (sa[i] < 0) {
+        len -= sa[i];
+        i -= sa[i];
+      } else {
+        if (len != 0) {
+          sa[i - len] = -len;
+        }
+        len = rank[sa[i]] + 1 - i;
+        qsufsort_split(sa, rank, i, len, h);
+        i += len;
+        len = 0;
+      }
+    }
+    if (len != 0) {
+      sa[i - len] = -len;
+    }
+  }
+
+  for (int64_t i = 0; i < size + 1; i++) {
+    sa[rank[i]] = i;
+  }
+}
+
+void bench_suffix_sort_reference(benchmark::State &state, const corpus_kind kind, const size_t size) {
+  const auto &files = get_corpus(kind, size);
+  std::vector<int64_t> sa(files.older.size() + 1), rank(files.older.size() + 1);
+  for (auto _ : state) {
+    qsufsort(sa.data(), rank.data(), files.older.data(), static_cast<int64_t>(files.older.size()));
+    benchmark::DoNotOptimize(sa.data());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(files.older.size()));
+}
+
+// Scan of newer against a prebuilt suffix array, written uncompressed to a null stream. The
+// prematch engine hashes blocks first and scans only what they leave.
+void bench_scan(benchmark::State &state, const corpus_kind kind, const size_t size, const snap_bsdiff_engine_type engine) {
+  const auto &files = get_corpus(kind, size);
+  std::vector<uint32_t> sa(files.older.size() + 1);
+  snap::bsdiff::suffix_array_build(files.older.data(), static_cast<int64_t>(files.older.size()), sa.data(), 0);
+
+  const snap_bsdiff_packer_options stored = { bsdiff_packer_type_stored, 0, 0, 0 };
+  const snap::bsdiff::diff_options options = { 0, sa.data(), sizeof(uint32_t), 0, nullptr, nullptr, engine };
+  for (auto _ : state) {
+    struct bsdiff_stream patchfile = { nullptr };
+    struct bsdiff_patch_packer packer = { nullptr };
+    auto ret = snap::bsdiff::open_null_stream(&patchfile);
+    if (ret == BSDIFF_SUCCESS) {
+      ret = snap::bsdiff::open_patch_writer(&stored, 1, nullptr, nullptr, nullptr, &patchfile, &packer);
+    }
+    if (ret == BSDIFF_SUCCESS) {
+      ret = snap::bsdiff::diff(nullptr, files.older.data(), static_cast<int64_t>(files.older.size()), files.newer.data(),
+                               static_cast<int64_t>(files.newer.size()), &packer, &options);
+    }
+    bsdiff_close_patch_packer(&packer);
+    bsdiff_close_stream(&patchfile);
+    if (ret != BSDIFF_SUCCESS) {
+      state.SkipWithError("diff failed");
+      break;
+    }
+  }
+  set_processed(state, files);
+}
+
+// Compression of the entries of a diff: an uncompressed patch is replayed into packer.
+void bench_compress(benchmark::State &state, const corpus_kind kind, const size_t size, const snap_bsdiff_packer_type type) {
+  const auto &files = get_corpus(kind, size);
+  auto stored = make_patch(files, bsdiff_packer_type_stored, bsdiff_filter_type_none);
+  const snap_bsdiff_packer_options options = { type, 0, 0, 0 };
+  buffer chunk;
+  int64_t patch_size = 0;
+
+  for (auto _ : state) {
+    struct bsdiff_stream input = { nullptr }, output = { nullptr };
+    struct bsdiff_patch_packer reader = { nullptr }, writer = { nullptr };
+    auto ret = bsdiff_open_memory_stream(BSDIFF_MODE_READ, stored.data(), stored.size(), &input);
+    if (ret == BSDIFF_SUCCESS) {
+      ret = snap::bsdiff::open_allocator_stream(nullptr, &output);
+    }
+    if (ret == BSDIFF_SUCCESS) {
+      ret = snap::bsdiff::open_patch_reader(&input, 1, &reader);
+    }
+    if (ret == BSDIFF_SUCCESS) {
+      ret = snap::bsdiff::open_patch_writer(&options, 0, nullptr, nullptr, nullptr, &output, &writer);
+    }
+
+    int64_t newer_size = 0, position = 0;
+    if (ret == BSDIFF_SUCCESS && (ret = reader.read_new_size(reader.state, &newer_size)) == BSDIFF_SUCCESS) {
+      ret = writer.write_new_size(writer.state, newer_size);
+    }
+    while (ret == BSDIFF_SUCCESS && position < newer_size) {
+      int64_t diff = 0, extra = 0, seek = 0;
+      size_t readed = 0;
+      if ((ret = reader.read_entry_header(reader.state, &diff, &extra, &seek)) != BSDIFF_SUCCESS
+          || (ret = writer.write_entry_header(writer.state, diff, extra, seek)) != BSDIFF_SUCCESS) {
+        break;
+      }
+      chunk.resize(static_cast<size_t>(diff));
+      if ((ret = reader.read_entry_diff(reader.state, chunk.data(), chunk.size(), &readed)) != BSDIFF_SUCCESS
+          || (ret = writer.write_entry_diff(writer.state, chunk.data(), chunk.size())) != BSDIFF_SUCCESS) {
+        break;
+      }
+      chunk.resize(static_cast<size_t>(extra));
+      if ((ret = reader.read_entry_extra(reader.state, chunk.data(), chunk.size(), &readed)) != BSDIFF_SUCCESS
+          || (ret = writer.write_entry_extra(writer.state, chunk.data(), chunk.size())) != BSDIFF_SUCCESS) {
+        break;
+      }
+      position += diff + extra;
+    }
+    if (ret == BSDIFF_SUCCESS && (ret = writer.flush(writer.state)) == BSDIFF_SUCCESS) {
+      output.tell(output.state, &patch_size);
+    }
+
+    bsdiff_close_patch_packer(&writer);
+    bsdiff_close_patch_packer(&reader);
+    bsdiff_close_stream(&output);
+    bsdiff_close_stream(&input);
+    if (ret != BSDIFF_SUCCESS) {
+      state.SkipWithError("compression failed");
+      break;
+    }
+  }
+  set_processed(state, files);
+  state.counters["patch_bytes"] = static_cast<double>(patch_size);
+}
+
+// Whole diff through the public API, all phases together.
+void bench_diff(benchmark::State &state, const corpus_kind kind, const size_t size, const snap_bsdiff_packer_type type,
+                const snap_bsdiff_filter_type filter, const snap_bsdiff_engine_type engine) {
+  const auto &files = get_corpus(kind, size);
+  size_t patch_size = 0;
+  for (auto _ : state) {
+    const auto patch = make_patch(files, type, filter, engine);
+    if (patch.empty()) {
+      state.SkipWithError("snap_bsdiff_diff failed");
+      break;
+    }
+    patch_size = patch.size();
+  }
+  set_processed(state, files);
+  state.counters["patch_bytes"] = static_cast<double>(patch_size);
+}
+
+// Apply of a patch made by packer, newer is written to memory.
+void bench_apply(benchmark::State &state, const corpus_kind kind, const size_t size, const snap_bsdiff_packer_type type) {
+  const auto &files = get_corpus(kind, size);
+  const auto patch = make_patch(files, type, bsdiff_filter_type_none);
+  for (auto _ : state) {
+    snap_bsdiff_patch_ctx ctx = {
+      nullptr, files.older.data(), files.older.size(), nullptr, 0, patch.data(), patch.size(), bsdiff_status_type_success, {},
+      0, {}, 0, {}
+    };
+    if (snap_bsdiff_patch(&ctx) != 1) {
+      state.SkipWithError("snap_bsdiff_patch failed");
+      break;
+    }
+    benchmark::DoNotOptimize(ctx.newer);
+    snap_bsdiff_patch_free(&ctx);
+  }
+  set_processed(state, files);
+  state.counters["patch_bytes"] = static_cast<double>(patch.size());
+}
+
+void register_suffix_sort(const corpus_kind kind, const std::string &suffix, const size_t size) {
+  benchmark::RegisterBenchmark(("suffix_sort" + suffix).c_str(), bench_suffix_sort, kind, size, 0u)
+    ->Unit(benchmark::kMillisecond);
+  benchmark::RegisterBenchmark(("suffix_sort" + suffix + "/1_thread").c_str(), bench_suffix_sort, kind, size, 1u)
+    ->Unit(benchmark::kMillisecond);
+  benchmark::RegisterBenchmark(("suffix_sort" + suffix + "/qsufsort").c_str(), bench_suffix_sort_reference, kind, size)
+    ->Unit(benchmark::kMillisecond);
+}
+
+void register_benchmarks() {
+  for (const auto &kind : low_entropy_kinds) {
+    for (const auto size : corpus_sizes) {
+      register_suffix_sort(kind.first, std::string("/") + kind.second + "/" + std::to_string(size), size);
+    }
+  }
+
+  for (const auto &kind : corpus_kinds) {
+    for (const auto size : corpus_sizes) {
+      // Nothing matches between different files, bsdiff's scan is quadratic there.
+      if (kind.first == corpus_kind::different && size > 1024 * 1024) {
+        continue;
+      }
+      const auto suffix = std::string("/") + kind.second + "/" + std::to_string(size);
+      register_suffix_sort(kind.first, suffix, size);
+      benchmark::RegisterBenchmark(("scan" + suffix).c_str(), bench_scan, kind.first, size, bsdiff_engine_type_prematch)
+        ->Unit(benchmark::kMillisecond);
+      benchmark::RegisterBenchmark(("scan" + suffix + "/suffix_array").c_str(), bench_scan, kind.first, size,
+                                   bsdiff_engine_type_suffix_array)
+        ->Unit(benchmark::kMillisecond);
+      for (const auto &packer : packer_types) {
+        const auto name = suffix + "/" + packer.second;
+        benchmark::RegisterBenchmark(("compress" + name).c_str(), bench_compress, kind.first, size, packer.first)
+          ->Unit(benchmark::kMillisecond);
+        benchmark::RegisterBenchmark(("diff" + name).c_str(), bench_diff, kind.first, size, packer.first,
+                                     bsdiff_filter_type_none, bsdiff_engine_type_prematch)
+          ->Unit(benchmark::kMillisecond);
+        benchmark::RegisterBenchmark(("apply" + name).c_str(), bench_apply, kind.first, size, packer.first)
+          ->Unit(benchmark::kMillisecond);
+      }
+      benchmark::RegisterBenchmark(("diff" + suffix + "/bz2/rolling_hash").c_str(), bench_diff, kind.first, size,
+                                   bsdiff_packer_type_bz2, bsdiff_filter_type_none, bsdiff_engine_type_rolling_hash)
+        ->Unit(benchmark::kMillisecond);
+#if defined(SNAP_BSDIFF_ZSTD)
+      if (kind.first == corpus_kind::executable) {
+        benchmark::RegisterBenchmark(("diff" + suffix + "/zstd/filtered").c_str(), bench_diff, kind.first, size,
+                                     bsdiff_packer_type_zstd, bsdiff_filter_type_executable, bsdiff_engine_type_prematch)
+          ->Unit(benchmark::kMillisecond);
+      }
+#endif
+    }
+  }
+}
+
+}
+
+int main(int argc, char **argv) {
+  // JSON by default, a --benchmark_format given on the command line comes later and wins.
+  std::vector<char *> arguments(argv, argv + argc);
+  std::string format = "--benchmark_format=json";
+  arguments.insert(arguments.begin() + 1, &format[0]);
+  auto count = static_cast<int>(arguments.size());
+
+  register_benchmarks();
+  benchmark::Initialize(&count, arguments.data());
+  if (benchmark::ReportUnrecognizedArguments(count, arguments.data())) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
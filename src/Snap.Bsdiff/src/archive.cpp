@@ -0,0 +1,295 @@
+#include "bsdiff/archive.hpp"
+#include "bsdiff/lib.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(SNAP_BSDIFF_ZLIB)
+#include <zlib.h>
+#endif
+
+namespace {
+
+#if defined(SNAP_BSDIFF_ZLIB)
+
+uint64_t load_le(const uint8_t *data, const size_t size, const uint64_t offset, const int bytes) {
+  if (offset > size || static_cast<uint64_t>(bytes) > size - offset) {
+    return 0;
+  }
+  uint64_t value = 0;
+  for (auto i = bytes - 1; i >= 0; --i) {
+    value = (value << 8) | data[offset + static_cast<uint64_t>(i)];
+  }
+  return value;
+}
+
+constexpr uint32_t zip_end_signature = 0x06054b50;
+constexpr uint32_t zip_central_signature = 0x02014b50;
+constexpr uint32_t zip_local_signature = 0x04034b50;
+constexpr uint64_t zip_end_size = 22;
+constexpr uint64_t zip_method_deflate = 8;
+// Levels tried in order, the zlib default first since most archivers use it.
+constexpr int zlib_levels[] = { 6, 9, 1, 5, 4, 3, 2, 7, 8 };
+
+// Raw deflate with the parameters of every common zip writer built on zlib.
+bool deflate_entry(const uint8_t *data, const size_t size, const int level, std::vector<uint8_t> &compressed) {
+  z_stream stream = {};
+  if (deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return false;
+  }
+
+  compressed.resize(deflateBound(&stream, static_cast<uLong>(size)));
+  stream.next_in = const_cast<Bytef *>(data);
+  stream.avail_in = static_cast<uInt>(size);
+  stream.next_out = compressed.data();
+  stream.avail_out = static_cast<uInt>(compressed.size());
+
+  const auto ret = deflate(&stream, Z_FINISH);
+  compressed.resize(stream.total_out);
+  deflateEnd(&stream);
+
+  return ret == Z_STREAM_END;
+}
+
+bool inflate_entry(const uint8_t *data, const snap::bsdiff::archive_entry &entry, uint8_t *output) {
+  z_stream stream = {};
+  if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+    return false;
+  }
+
+  stream.next_in = const_cast<Bytef *>(data + entry.offset);
+  stream.avail_in = static_cast<uInt>(entry.compressed_size);
+  stream.next_out = output;
+  stream.avail_out = static_cast<uInt>(entry.uncompressed_size);
+
+  const auto ret = inflate(&stream, Z_FINISH);
+  const auto complete = ret == Z_STREAM_END
+                        && stream.total_in == static_cast<uLong>(entry.compressed_size)
+                        && stream.total_out == static_cast<uLong>(entry.uncompressed_size);
+  inflateEnd(&stream);
+
+  return complete;
+}
+
+// Reads the central directory. Entries that are not deflated, use zip64 or whose local
+// header disagrees are left alone.
+std::vector<snap::bsdiff::archive_entry> read_zip(const uint8_t *data, const size_t size) {
+  std::vector<snap::bsdiff::archive_entry> entries;
+  if (size < zip_end_size) {
+    return entries;
+  }
+
+  // The end record is followed by a comment of at most 64 KiB.
+  auto end = static_cast<uint64_t>(size) - zip_end_size;
+  const auto first = end > 0xffff ? end - 0xffff : 0;
+  while (load_le(data, size, end, 4) != zip_end_signature) {
+    if (end == first) {
+      return entries;
+    }
+    end--;
+  }
+
+  const auto count = load_le(data, size, end + 10, 2);
+  auto header = load_le(data, size, end + 16, 4);
+  for (uint64_t i = 0; i < count; i++) {
+    if (load_le(data, size, header, 4) != zip_central_signature) {
+      break;
+    }
+
+    const auto method = load_le(data, size, header + 10, 2);
+    const auto compressed_size = load_le(data, size, header + 20, 4);
+    const auto uncompressed_size = load_le(data, size, header + 24, 4);
+    const auto local = load_le(data, size, header + 42, 4);
+    header += 46 + load_le(data, size, header + 28, 2) + load_le(data, size, header + 30, 2)
+              + load_le(data, size, header + 32, 2);
+
+    if (method != zip_method_deflate || compressed_size == 0xffffffff || uncompressed_size == 0xffffffff
+        || load_le(data, size, local, 4) != zip_local_signature) {
+      continue;
+    }
+
+    const auto offset = local + 30 + load_le(data, size, local + 26, 2) + load_le(data, size, local + 28, 2);
+    if (offset > size || compressed_size > size - offset) {
+      continue;
+    }
+
+    entries.push_back({ static_cast<int64_t>(offset), static_cast<int64_t>(compressed_size),
+                        static_cast<int64_t>(uncompressed_size), 0 });
+  }
+
+  std::sort(entries.begin(), entries.end(), [](const auto &lhs, const auto &rhs) {
+    return lhs.offset < rhs.offset;
+  });
+
+  // Overlapping entries would be expanded twice, such archives are left alone.
+  for (size_t i = 1; i < entries.size(); i++) {
+    if (entries[i].offset < entries[i - 1].offset + entries[i - 1].compressed_size) {
+      entries.clear();
+    }
+  }
+
+  return entries;
+}
+
+#endif
+
+}
+
+bool snap::bsdiff::archive_supported() {
+#if defined(SNAP_BSDIFF_ZLIB)
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::vector<snap::bsdiff::archive_entry> snap::bsdiff::find_archive_entries(const uint8_t *data, const size_t size,
+                                                                            const bool recompress) {
+  std::vector<archive_entry> found;
+#if defined(SNAP_BSDIFF_ZLIB)
+  std::vector<uint8_t> uncompressed, compressed;
+  for (auto entry : read_zip(data, size)) {
+    uncompressed.resize(static_cast<size_t>(entry.uncompressed_size));
+    if (!inflate_entry(data, entry, uncompressed.data())) {
+      continue;
+    }
+
+    if (!recompress) {
+      found.push_back(entry);
+      continue;
+    }
+
+    for (const auto level : zlib_levels) {
+      if (deflate_entry(uncompressed.data(), uncompressed.size(), level, compressed)
+          && compressed.size() == static_cast<size_t>(entry.compressed_size)
+          && std::memcmp(compressed.data(), data + entry.offset, compressed.size()) == 0) {
+        entry.level = level;
+        found.push_back(entry);
+        break;
+      }
+    }
+  }
+#else
+  (void)data;
+  (void)size;
+  (void)recompress;
+#endif
+  return found;
+}
+
+int snap::bsdiff::archive_expand(const uint8_t *data, const size_t size, const std::vector<archive_entry> &entries,
+                                 std::vector<uint8_t> &expanded) {
+#if defined(SNAP_BSDIFF_ZLIB)
+  auto expanded_size = static_cast<int64_t>(size);
+  int64_t end = 0;
+  for (const auto &entry : entries) {
+    if (entry.offset < end || entry.compressed_size < 0 || entry.uncompressed_size < 0
+        || entry.offset > static_cast<int64_t>(size) || entry.compressed_size > static_cast<int64_t>(size) - entry.offset) {
+      return BSDIFF_CORRUPT_PATCH;
+    }
+    end = entry.offset + entry.compressed_size;
+    expanded_size += entry.uncompressed_size - entry.compressed_size;
+  }
+
+  expanded.resize(static_cast<size_t>(expanded_size));
+
+  int64_t position = 0;
+  auto *output = expanded.data();
+  for (const auto &entry : entries) {
+    const auto copy = static_cast<size_t>(entry.offset - position);
+    std::memcpy(output, data + position, copy);
+    output += copy;
+    if (!inflate_entry(data, entry, output)) {
+      return BSDIFF_CORRUPT_PATCH;
+    }
+    output += entry.uncompressed_size;
+    position = entry.offset + entry.compressed_size;
+  }
+  std::memcpy(output, data + position, size - static_cast<size_t>(position));
+
+  return BSDIFF_SUCCESS;
+#else
+  (void)data;
+  (void)size;
+  (void)entries;
+  (void)expanded;
+  return bsdiff_status_type_unsupported;
+#endif
+}
+
+snap::bsdiff::archive_encoder::archive_encoder(const std::vector<archive_entry> &entries) :
+    m_entries(entries),
+    m_starts(),
+    m_entry(0),
+    m_position(0),
+    m_buffer(),
+    m_compressed() {
+  int64_t shift = 0;
+  m_starts.reserve(entries.size());
+  for (const auto &entry : entries) {
+    m_starts.push_back(entry.offset + shift);
+    shift += entry.uncompressed_size - entry.compressed_size;
+  }
+}
+
+// Compresses the current entry once all of its bytes have arrived, and any empty entries
+// that follow it.
+int snap::bsdiff::archive_encoder::compress_ready(const emit_function &emit) {
+  while (m_entry < m_entries.size() && m_position == m_starts[m_entry] + m_entries[m_entry].uncompressed_size) {
+    const auto &entry = m_entries[m_entry];
+#if defined(SNAP_BSDIFF_ZLIB)
+    if (!deflate_entry(m_buffer.data(), m_buffer.size(), entry.level, m_compressed)
+        || m_compressed.size() != static_cast<size_t>(entry.compressed_size)) {
+      return BSDIFF_CORRUPT_PATCH;
+    }
+#else
+    (void)entry;
+    return bsdiff_status_type_unsupported;
+#endif
+
+    int ret;
+    if ((ret = emit(m_compressed.data(), m_compressed.size())) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+    m_buffer.clear();
+    m_entry++;
+  }
+  return BSDIFF_SUCCESS;
+}
+
+int snap::bsdiff::archive_encoder::write(const uint8_t *data, size_t size, const emit_function &emit) {
+  int ret;
+  while (size > 0) {
+    if ((ret = compress_ready(emit)) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+
+    size_t len;
+    if (m_entry < m_entries.size() && m_position >= m_starts[m_entry]) {
+      const auto remaining = m_starts[m_entry] + m_entries[m_entry].uncompressed_size - m_position;
+      len = static_cast<size_t>(std::min<int64_t>(remaining, static_cast<int64_t>(size)));
+      m_buffer.insert(m_buffer.end(), data, data + len);
+    } else {
+      len = m_entry < m_entries.size()
+        ? static_cast<size_t>(std::min<int64_t>(m_starts[m_entry] - m_position, static_cast<int64_t>(size)))
+        : size;
+      if ((ret = emit(data, len)) != BSDIFF_SUCCESS) {
+        return ret;
+      }
+    }
+
+    data += len;
+    size -= len;
+    m_position += static_cast<int64_t>(len);
+  }
+
+  return compress_ready(emit);
+}
+
+int snap::bsdiff::archive_encoder::finish(const emit_function &emit) {
+  int ret;
+  if ((ret = compress_ready(emit)) != BSDIFF_SUCCESS) {
+    return ret;
+  }
+  return m_entry == m_entries.size() ? BSDIFF_SUCCESS : BSDIFF_CORRUPT_PATCH;
+}
@@ -0,0 +1,70 @@
+#include "bsdiff/async.hpp"
+#include "bsdiff/lib.hpp"
+#include "bsdiff/thread_pool.hpp"
+
+#include <chrono>
+#include <new>
+#include <system_error>
+
+namespace {
+
+using snap::bsdiff::thread_pool;
+
+thread_pool &async_pool() {
+  // Never destroyed: joining the workers from static destructors can deadlock while the
+  // library is unloaded, and work still running at exit is abandoned either way.
+  static auto *pool = new thread_pool(0);
+  return *pool;
+}
+
+}
+
+snap::bsdiff::async_operation::async_operation() :
+    m_mutex(),
+    m_completed_changed(),
+    m_completed(false),
+    m_result(0) {
+}
+
+void snap::bsdiff::async_operation::complete(const int32_t result) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_completed = true;
+    m_result = result;
+  }
+
+  m_completed_changed.notify_all();
+}
+
+bool snap::bsdiff::async_operation::wait(const uint32_t timeout_ms, int32_t *result) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (timeout_ms == UINT32_MAX) {
+    m_completed_changed.wait(lock, [this] { return m_completed; });
+  } else if (timeout_ms > 0) {
+    m_completed_changed.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this] { return m_completed; });
+  }
+
+  if (m_completed) {
+    *result = m_result;
+  }
+
+  return m_completed;
+}
+
+int snap::bsdiff::run_async(const std::shared_ptr<async_operation> &operation, std::function<int32_t()> work,
+                            std::function<void(int32_t)> on_complete) {
+  try {
+    async_pool().submit([operation, work = std::move(work), on_complete = std::move(on_complete)] {
+      const auto result = work();
+      on_complete(result);
+      operation->complete(result);
+    });
+  } catch (const std::bad_alloc &) {
+    return BSDIFF_OUT_OF_MEMORY;
+  } catch (const std::system_error &) {
+    // The workers could not be started.
+    return BSDIFF_ERROR;
+  }
+
+  return BSDIFF_SUCCESS;
+}
@@ -0,0 +1,40 @@
+#include "bsdiff/batch.hpp"
+#include "bsdiff/parallel.hpp"
+#include "bsdiff/thread_pool.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+void snap::bsdiff::run_batch(const size_t count, const batch_options &options,
+                             const std::function<uint64_t(size_t)> &estimate,
+                             const std::function<void(size_t)> &run) {
+  if (count == 0) {
+    return;
+  }
+
+  std::vector<uint64_t> estimates(count);
+  for (size_t i = 0; i < count; i++) {
+    estimates[i] = estimate(i);
+  }
+
+  // Largest first keeps a big item from being started last and dominating the tail.
+  std::vector<size_t> order(count);
+  std::iota(order.begin(), order.end(), size_t(0));
+  std::stable_sort(order.begin(), order.end(), [&](const size_t lhs, const size_t rhs) {
+    return estimates[lhs] > estimates[rhs];
+  });
+
+  memory_budget budget(options.max_memory_bytes);
+  thread_pool pool(static_cast<uint32_t>(std::min<size_t>(resolve_thread_count(options.thread_count), count)));
+
+  for (const auto index : order) {
+    pool.submit([&, index] {
+      const auto granted = budget.acquire(estimates[index]);
+      run(index);
+      budget.release(granted);
+    });
+  }
+
+  pool.wait();
+}
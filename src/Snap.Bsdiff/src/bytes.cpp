@@ -0,0 +1,67 @@
+#include "bsdiff/bytes.hpp"
+
+namespace {
+
+size_t common_prefix_portable(const uint8_t *a, const uint8_t *b, const size_t size) {
+  size_t i = 0;
+  while (i < size && a[i] == b[i]) {
+    i++;
+  }
+  return i;
+}
+
+size_t count_equal_portable(const uint8_t *a, const uint8_t *b, const size_t size) {
+  size_t count = 0;
+  for (size_t i = 0; i < size; i++) {
+    count += a[i] == b[i] ? 1 : 0;
+  }
+  return count;
+}
+
+uint64_t equal_mask_portable(const uint8_t *a, const uint8_t *b) {
+  uint64_t mask = 0;
+  for (size_t i = 0; i < 64; i++) {
+    mask |= static_cast<uint64_t>(a[i] == b[i] ? 1 : 0) << i;
+  }
+  return mask;
+}
+
+void add_portable(uint8_t *dst, const uint8_t *src, const size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    dst[i] = static_cast<uint8_t>(dst[i] + src[i]);
+  }
+}
+
+void subtract_portable(uint8_t *dst, const uint8_t *a, const uint8_t *b, const size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    dst[i] = static_cast<uint8_t>(a[i] - b[i]);
+  }
+}
+
+const snap::bsdiff::byte_kernel_set &select_kernels() {
+#if defined(SNAP_BSDIFF_X86)
+  const auto &features = snap::bsdiff::cpu_features();
+  if (features.avx2) {
+    return snap::bsdiff::byte_kernels_avx2;
+  }
+  if (features.sse41) {
+    return snap::bsdiff::byte_kernels_sse41;
+  }
+#endif
+  return snap::bsdiff::byte_kernels_portable;
+}
+
+}
+
+const snap::bsdiff::byte_kernel_set snap::bsdiff::byte_kernels_portable = {
+  common_prefix_portable,
+  count_equal_portable,
+  equal_mask_portable,
+  add_portable,
+  subtract_portable
+};
+
+const snap::bsdiff::byte_kernel_set &snap::bsdiff::byte_kernels() {
+  static const auto &kernels = select_kernels();
+  return kernels;
+}
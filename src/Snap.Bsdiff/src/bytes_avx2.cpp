@@ -0,0 +1,84 @@
+#include "bsdiff/bytes.hpp"
+
+#if defined(SNAP_BSDIFF_X86)
+
+#include <immintrin.h>
+
+namespace {
+
+using snap::bsdiff::popcount64;
+
+SNAP_BSDIFF_TARGET("avx2")
+inline uint32_t equal_bits(const uint8_t *a, const uint8_t *b) {
+  const auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a));
+  const auto y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b));
+  return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+}
+
+SNAP_BSDIFF_TARGET("avx2")
+size_t common_prefix_avx2(const uint8_t *a, const uint8_t *b, const size_t size) {
+  size_t i = 0;
+  while (i + 32 <= size && equal_bits(a + i, b + i) == 0xffffffffu) {
+    i += 32;
+  }
+  while (i < size && a[i] == b[i]) {
+    i++;
+  }
+  return i;
+}
+
+SNAP_BSDIFF_TARGET("avx2")
+size_t count_equal_avx2(const uint8_t *a, const uint8_t *b, const size_t size) {
+  size_t count = 0;
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    count += popcount64(equal_bits(a + i, b + i) | static_cast<uint64_t>(equal_bits(a + i + 32, b + i + 32)) << 32);
+  }
+  for (; i < size; i++) {
+    count += a[i] == b[i] ? 1 : 0;
+  }
+  return count;
+}
+
+SNAP_BSDIFF_TARGET("avx2")
+uint64_t equal_mask_avx2(const uint8_t *a, const uint8_t *b) {
+  return equal_bits(a, b) | static_cast<uint64_t>(equal_bits(a + 32, b + 32)) << 32;
+}
+
+SNAP_BSDIFF_TARGET("avx2")
+void add_avx2(uint8_t *dst, const uint8_t *src, const size_t size) {
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    const auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + i));
+    const auto y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_add_epi8(x, y));
+  }
+  for (; i < size; i++) {
+    dst[i] = static_cast<uint8_t>(dst[i] + src[i]);
+  }
+}
+
+SNAP_BSDIFF_TARGET("avx2")
+void subtract_avx2(uint8_t *dst, const uint8_t *a, const uint8_t *b, const size_t size) {
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    const auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+    const auto y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_sub_epi8(x, y));
+  }
+  for (; i < size; i++) {
+    dst[i] = static_cast<uint8_t>(a[i] - b[i]);
+  }
+}
+
+}
+
+const snap::bsdiff::byte_kernel_set snap::bsdiff::byte_kernels_avx2 = {
+  common_prefix_avx2,
+  count_equal_avx2,
+  equal_mask_avx2,
+  add_avx2,
+  subtract_avx2
+};
+
+#endif
@@ -0,0 +1,91 @@
+#include "bsdiff/bytes.hpp"
+
+#if defined(SNAP_BSDIFF_X86)
+
+#include <immintrin.h>
+
+namespace {
+
+using snap::bsdiff::popcount64;
+
+SNAP_BSDIFF_TARGET("sse4.1")
+inline uint32_t equal_bits(const uint8_t *a, const uint8_t *b) {
+  const auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a));
+  const auto y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b));
+  return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)));
+}
+
+SNAP_BSDIFF_TARGET("sse4.1")
+size_t common_prefix_sse41(const uint8_t *a, const uint8_t *b, const size_t size) {
+  size_t i = 0;
+  while (i + 16 <= size && equal_bits(a + i, b + i) == 0xffff) {
+    i += 16;
+  }
+  while (i < size && a[i] == b[i]) {
+    i++;
+  }
+  return i;
+}
+
+SNAP_BSDIFF_TARGET("sse4.1")
+size_t count_equal_sse41(const uint8_t *a, const uint8_t *b, const size_t size) {
+  size_t count = 0;
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    const uint64_t mask = equal_bits(a + i, b + i)
+      | static_cast<uint64_t>(equal_bits(a + i + 16, b + i + 16)) << 16
+      | static_cast<uint64_t>(equal_bits(a + i + 32, b + i + 32)) << 32
+      | static_cast<uint64_t>(equal_bits(a + i + 48, b + i + 48)) << 48;
+    count += popcount64(mask);
+  }
+  for (; i < size; i++) {
+    count += a[i] == b[i] ? 1 : 0;
+  }
+  return count;
+}
+
+SNAP_BSDIFF_TARGET("sse4.1")
+uint64_t equal_mask_sse41(const uint8_t *a, const uint8_t *b) {
+  return equal_bits(a, b)
+    | static_cast<uint64_t>(equal_bits(a + 16, b + 16)) << 16
+    | static_cast<uint64_t>(equal_bits(a + 32, b + 32)) << 32
+    | static_cast<uint64_t>(equal_bits(a + 48, b + 48)) << 48;
+}
+
+SNAP_BSDIFF_TARGET("sse4.1")
+void add_sse41(uint8_t *dst, const uint8_t *src, const size_t size) {
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    const auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+    const auto y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_add_epi8(x, y));
+  }
+  for (; i < size; i++) {
+    dst[i] = static_cast<uint8_t>(dst[i] + src[i]);
+  }
+}
+
+SNAP_BSDIFF_TARGET("sse4.1")
+void subtract_sse41(uint8_t *dst, const uint8_t *a, const uint8_t *b, const size_t size) {
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    const auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+    const auto y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_sub_epi8(x, y));
+  }
+  for (; i < size; i++) {
+    dst[i] = static_cast<uint8_t>(a[i] - b[i]);
+  }
+}
+
+}
+
+const snap::bsdiff::byte_kernel_set snap::bsdiff::byte_kernels_sse41 = {
+  common_prefix_sse41,
+  count_equal_sse41,
+  equal_mask_sse41,
+  add_sse41,
+  subtract_sse41
+};
+
+#endif
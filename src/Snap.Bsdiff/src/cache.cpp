@@ -0,0 +1,176 @@
+#include "bsdiff/cache.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <new>
+#include <system_error>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+// Part of every key, bump it whenever the patches written for the same options change.
+constexpr uint32_t cache_format_version = 1;
+
+constexpr char entry_extension[] = ".patch";
+constexpr char temporary_extension[] = ".tmp";
+
+// Temporary files this old were left behind by a process that died while inserting.
+constexpr auto abandoned_age = std::chrono::hours(1);
+
+void append(snap::bsdiff::sha256 &hash, const uint64_t value) {
+  uint8_t bytes[sizeof(value)];
+  for (size_t i = 0; i < sizeof(value); i++) {
+    bytes[i] = static_cast<uint8_t>(value >> (8 * i));
+  }
+  hash.update(bytes, sizeof(bytes));
+}
+
+bool has_extension(const std::filesystem::path &path, const char *extension) {
+  return path.extension() == extension;
+}
+
+}
+
+snap::bsdiff::diff_cache_key snap::bsdiff::make_diff_cache_key(const uint8_t older_sha256[sha256_digest_size],
+                                                               const uint8_t newer_sha256[sha256_digest_size],
+                                                               const snap_bsdiff_packer_options &packer,
+                                                               const snap_bsdiff_filter_type filter,
+                                                               const snap_bsdiff_engine_type engine,
+                                                               const uint64_t max_memory_bytes) {
+  sha256 hash;
+  append(hash, cache_format_version);
+  hash.update(older_sha256, sha256_digest_size);
+  hash.update(newer_sha256, sha256_digest_size);
+  append(hash, static_cast<uint64_t>(packer.type));
+  append(hash, static_cast<uint64_t>(static_cast<int64_t>(packer.level)));
+  append(hash, packer.window_log);
+  append(hash, packer.block_size);
+  append(hash, static_cast<uint64_t>(filter));
+  append(hash, static_cast<uint64_t>(engine));
+  append(hash, max_memory_bytes);
+
+  diff_cache_key key = {};
+  hash.finish(key.digest);
+  return key;
+}
+
+snap::bsdiff::diff_cache::diff_cache(const char *path, const uint64_t max_bytes) :
+    m_path(path != nullptr ? path : ""),
+    m_max_bytes(max_bytes) {
+}
+
+std::string snap::bsdiff::diff_cache::entry_path(const diff_cache_key &key) const {
+  static constexpr char hex[] = "0123456789abcdef";
+  std::string name;
+  name.reserve(2 * sizeof(key.digest) + sizeof(entry_extension));
+  for (const auto byte : key.digest) {
+    name.push_back(hex[byte >> 4]);
+    name.push_back(hex[byte & 0x0f]);
+  }
+  name += entry_extension;
+  return (std::filesystem::path(m_path) / name).string();
+}
+
+bool snap::bsdiff::diff_cache::find(const diff_cache_key &key, mapped_file &file) const {
+  if (!enabled()) {
+    return false;
+  }
+
+  try {
+    const auto path = entry_path(key);
+    if (file.open(path.c_str()) != BSDIFF_SUCCESS) {
+      return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+    return true;
+  } catch (const std::bad_alloc &) {
+    return false;
+  }
+}
+
+void snap::bsdiff::diff_cache::insert(const diff_cache_key &key, const uint8_t *patch, const size_t patch_size) const {
+  if (!enabled()) {
+    return;
+  }
+
+  try {
+    std::error_code ec;
+    std::filesystem::create_directories(m_path, ec);
+
+    const auto path = entry_path(key);
+    const auto tmp_path = temporary_path(path);
+    auto *file = std::fopen(tmp_path.c_str(), "wb");
+    if (file == nullptr) {
+      return;
+    }
+
+    const auto written = patch_size == 0 || std::fwrite(patch, patch_size, 1, file) == 1;
+    if (std::fclose(file) != 0 || !written || replace_file(tmp_path, path) != BSDIFF_SUCCESS) {
+      std::remove(tmp_path.c_str());
+      return;
+    }
+
+    if (m_max_bytes > 0) {
+      evict();
+    }
+  } catch (const std::bad_alloc &) {
+  }
+}
+
+void snap::bsdiff::diff_cache::evict() const {
+  using entry = std::tuple<std::filesystem::file_time_type, uint64_t, std::filesystem::path>;
+
+  std::error_code ec;
+  const auto now = std::filesystem::file_time_type::clock::now();
+  std::vector<entry> entries;
+  uint64_t total = 0;
+
+  for (std::filesystem::directory_iterator it(m_path, ec), end; !ec && it != end; it.increment(ec)) {
+    const auto &path = it->path();
+    const auto used = it->last_write_time(ec);
+    if (ec) {
+      // Another process evicted or replaced it meanwhile.
+      ec.clear();
+      continue;
+    }
+
+    if (has_extension(path, temporary_extension)) {
+      if (now - used > abandoned_age) {
+        std::filesystem::remove(path, ec);
+        ec.clear();
+      }
+      continue;
+    }
+
+    const auto size = it->file_size(ec);
+    if (ec || !has_extension(path, entry_extension)) {
+      ec.clear();
+      continue;
+    }
+
+    entries.emplace_back(used, size, path);
+    total += size;
+  }
+
+  if (total <= m_max_bytes) {
+    return;
+  }
+
+  // Oldest first. Removing an entry another process is reading is fine, its mapping stays
+  // valid, and where the platform refuses the entry is simply kept for now.
+  std::sort(entries.begin(), entries.end());
+  for (const auto &[used, size, path] : entries) {
+    if (total <= m_max_bytes) {
+      break;
+    }
+    if (std::filesystem::remove(path, ec)) {
+      total -= size;
+    }
+    ec.clear();
+  }
+}
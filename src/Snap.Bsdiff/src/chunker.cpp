@@ -0,0 +1,71 @@
+#include "bsdiff/chunker.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+
+// Random value per byte for the gear hash. Derived from a fixed seed with splitmix64, so
+// the table, and with it every cut point, never changes.
+constexpr std::array<uint64_t, 256> make_gear_table() {
+  std::array<uint64_t, 256> table = {};
+  uint64_t state = 0x5eed5eed5eed5eedULL;
+  for (auto &value : table) {
+    state += 0x9e3779b97f4a7c15ULL;
+    auto z = state;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    value = z ^ (z >> 31);
+  }
+  return table;
+}
+
+constexpr auto gear_table = make_gear_table();
+
+int log2(uint32_t value) {
+  auto bits = 0;
+  while (value > 1) {
+    value >>= 1;
+    bits++;
+  }
+  return bits;
+}
+
+// Mask over the top bits of the hash, which depend on the most recent 64 bytes.
+uint64_t cut_mask(const int bits) {
+  return bits <= 0 ? 0 : ~uint64_t{ 0 } << (64 - std::min(bits, 63));
+}
+
+}
+
+size_t snap::bsdiff::next_chunk(const uint8_t *data, const size_t size, const chunk_params &params) {
+  if (size <= params.min_size) {
+    return size;
+  }
+
+  // Before the average size a cut needs two more zero bits, after it two less. That pulls
+  // chunk sizes towards the average without a second pass.
+  const auto bits = log2(params.avg_size);
+  const auto mask_small = cut_mask(bits + 2);
+  const auto mask_large = cut_mask(bits - 2);
+
+  const auto end = std::min<size_t>(size, params.max_size);
+  const auto normal = std::min<size_t>(end, params.avg_size);
+
+  uint64_t hash = 0;
+  auto i = static_cast<size_t>(params.min_size);
+  for (; i < normal; i++) {
+    hash = (hash << 1) + gear_table[data[i]];
+    if ((hash & mask_small) == 0) {
+      return i + 1;
+    }
+  }
+  for (; i < end; i++) {
+    hash = (hash << 1) + gear_table[data[i]];
+    if ((hash & mask_large) == 0) {
+      return i + 1;
+    }
+  }
+
+  return end;
+}
@@ -0,0 +1,37 @@
+#include "bsdiff/codec.hpp"
+
+#include <new>
+
+namespace {
+
+class stored_codec final : public snap::bsdiff::patch_codec {
+public:
+  explicit stored_codec(struct bsdiff_stream *stream) : m_stream(stream) {
+  }
+
+  stored_codec(const stored_codec &) = delete;
+  stored_codec &operator=(const stored_codec &) = delete;
+
+  int write(const uint8_t *data, const size_t size) override {
+    return size > 0 ? m_stream->write(m_stream->state, data, size) : BSDIFF_SUCCESS;
+  }
+
+  int finish() override {
+    return BSDIFF_SUCCESS;
+  }
+
+  int read(uint8_t *data, const size_t size, size_t *readed) override {
+    *readed = 0;
+    return size > 0 ? m_stream->read(m_stream->state, data, size, readed) : BSDIFF_SUCCESS;
+  }
+
+private:
+  struct bsdiff_stream *m_stream;
+};
+
+}
+
+int snap::bsdiff::open_stored_codec(int, struct bsdiff_stream *stream, std::unique_ptr<patch_codec> &codec) {
+  codec.reset(new (std::nothrow) stored_codec(stream));
+  return codec != nullptr ? BSDIFF_SUCCESS : BSDIFF_OUT_OF_MEMORY;
+}
@@ -0,0 +1,284 @@
+#include "bsdiff/codec.hpp"
+#include "bsdiff/parallel.hpp"
+#include "bsdiff/thread_pool.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <vector>
+
+namespace {
+
+// Every block is one complete codec frame, preceded by a skippable frame that holds the
+// compressed and decompressed size of the block. zstd and lz4 decoders skip such frames and
+// continue with the next frame, so the result is still a single valid stream for readers
+// that decode it sequentially, while this reader can hand out whole blocks to threads.
+constexpr uint32_t skippable_frame_magic = 0x184D2A5B;
+constexpr size_t skippable_frame_size = 8 + 16;
+// Guards allocations made for corrupt block headers.
+constexpr uint64_t block_size_max = 1u << 30;
+// Blocks in flight per thread, bounds memory while keeping every thread busy.
+constexpr size_t blocks_per_thread = 2;
+
+void write_le(uint8_t *buffer, uint64_t value, const size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    buffer[i] = static_cast<uint8_t>(value & 0xff);
+    value >>= 8;
+  }
+}
+
+uint64_t read_le(const uint8_t *buffer, const size_t size) {
+  uint64_t value = 0;
+  for (size_t i = size; i > 0; --i) {
+    value = (value << 8) | buffer[i - 1];
+  }
+  return value;
+}
+
+struct block_job {
+  std::vector<uint8_t> input;
+  std::vector<uint8_t> output;
+  int status;
+  bool done;
+
+  block_job() :
+      input(),
+      output(),
+      status(BSDIFF_SUCCESS),
+      done(false) {
+  }
+};
+
+class block_codec final : public snap::bsdiff::patch_codec {
+public:
+  block_codec(const int mode, struct bsdiff_stream *stream, const snap::bsdiff::block_format *format, const int32_t level,
+              const uint32_t window_log, const uint32_t block_size, const uint32_t thread_count) :
+    m_mode(mode), m_stream(stream), m_format(format), m_level(level), m_window_log(window_log), m_block_size(block_size),
+    m_max_in_flight(snap::bsdiff::resolve_thread_count(thread_count) * blocks_per_thread),
+    m_pool(), m_mutex(), m_done(), m_jobs(), m_current(), m_current_pos(0), m_status(BSDIFF_SUCCESS), m_eof(false) {
+    if (snap::bsdiff::resolve_thread_count(thread_count) > 1) {
+      m_pool = std::make_unique<snap::bsdiff::thread_pool>(thread_count);
+    }
+  }
+
+  block_codec(const block_codec &) = delete;
+  block_codec &operator=(const block_codec &) = delete;
+
+  ~block_codec() override {
+    if (m_pool != nullptr) {
+      m_pool->wait();
+    }
+  }
+
+  int write(const uint8_t *data, size_t size) override {
+    while (size > 0 && m_status == BSDIFF_SUCCESS) {
+      if (m_current.capacity() < m_block_size) {
+        m_current.reserve(m_block_size);
+      }
+      const auto count = std::min(size, m_block_size - m_current.size());
+      m_current.insert(m_current.end(), data, data + count);
+      data += count;
+      size -= count;
+      if (m_current.size() == m_block_size) {
+        submit_block();
+      }
+    }
+    return m_status;
+  }
+
+  int finish() override {
+    if (m_status == BSDIFF_SUCCESS && !m_current.empty()) {
+      submit_block();
+    }
+    while (m_status == BSDIFF_SUCCESS && !m_jobs.empty()) {
+      write_front();
+    }
+    return m_status;
+  }
+
+  int read(uint8_t *data, const size_t size, size_t *readed) override {
+    size_t produced = 0;
+    while (produced < size && m_status == BSDIFF_SUCCESS) {
+      if (m_current_pos == m_current.size()) {
+        fill_pipeline();
+        if (m_status != BSDIFF_SUCCESS || m_jobs.empty()) {
+          break;
+        }
+        auto job = take_front();
+        if (job->status != BSDIFF_SUCCESS) {
+          m_status = job->status;
+          break;
+        }
+        m_current = std::move(job->output);
+        m_current_pos = 0;
+        continue;
+      }
+
+      const auto count = std::min(size - produced, m_current.size() - m_current_pos);
+      std::memcpy(data + produced, m_current.data() + m_current_pos, count);
+      m_current_pos += count;
+      produced += count;
+    }
+
+    *readed = produced;
+    if (m_status != BSDIFF_SUCCESS) {
+      return m_status;
+    }
+    return produced == size ? BSDIFF_SUCCESS : BSDIFF_END_OF_FILE;
+  }
+
+private:
+  void run(block_job *job) {
+    int status;
+    try {
+      if (m_mode == BSDIFF_MODE_READ) {
+        // The output was sized from the block header.
+        status = m_format->decompress(job->input.data(), job->input.size(), job->output.data(), job->output.size());
+      } else {
+        status = m_format->compress(m_level, m_window_log, job->input.data(), job->input.size(), job->output);
+      }
+    } catch (const std::bad_alloc &) {
+      status = BSDIFF_OUT_OF_MEMORY;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    job->status = status;
+    job->done = true;
+    m_done.notify_all();
+  }
+
+  void submit(std::unique_ptr<block_job> job) {
+    auto *p_job = job.get();
+    m_jobs.push_back(std::move(job));
+    if (m_pool != nullptr) {
+      m_pool->submit([this, p_job]() { run(p_job); });
+    } else {
+      run(p_job);
+    }
+  }
+
+  std::unique_ptr<block_job> take_front() {
+    std::unique_ptr<block_job> job = std::move(m_jobs.front());
+    m_jobs.pop_front();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [&job]() { return job->done; });
+    return job;
+  }
+
+  void submit_block() {
+    try {
+      auto job = std::make_unique<block_job>();
+      job->input = std::move(m_current);
+      m_current = std::vector<uint8_t>();
+      submit(std::move(job));
+    } catch (const std::bad_alloc &) {
+      m_status = BSDIFF_OUT_OF_MEMORY;
+      return;
+    }
+    while (m_status == BSDIFF_SUCCESS && m_jobs.size() > m_max_in_flight) {
+      write_front();
+    }
+  }
+
+  // Blocks are written in submission order, whichever thread finishes first.
+  void write_front() {
+    auto job = take_front();
+    if (job->status != BSDIFF_SUCCESS) {
+      m_status = job->status;
+      return;
+    }
+
+    uint8_t header[skippable_frame_size];
+    write_le(header, skippable_frame_magic, 4);
+    write_le(header + 4, 16, 4);
+    write_le(header + 8, job->output.size(), 8);
+    write_le(header + 16, job->input.size(), 8);
+
+    if ((m_status = m_stream->write(m_stream->state, header, sizeof header)) != BSDIFF_SUCCESS) {
+      return;
+    }
+    m_status = m_stream->write(m_stream->state, job->output.data(), job->output.size());
+  }
+
+  // Reads block headers ahead of the consumer and queues their decompression.
+  void fill_pipeline() {
+    while (!m_eof && m_status == BSDIFF_SUCCESS && m_jobs.size() < m_max_in_flight) {
+      uint8_t header[skippable_frame_size];
+      size_t readed = 0;
+      auto ret = m_stream->read(m_stream->state, header, sizeof header, &readed);
+      if (ret == BSDIFF_END_OF_FILE && readed == 0) {
+        m_eof = true;
+        break;
+      }
+      if (ret != BSDIFF_SUCCESS && ret != BSDIFF_END_OF_FILE) {
+        m_status = ret;
+        break;
+      }
+
+      const auto compressed_size = read_le(header + 8, 8);
+      const auto size = read_le(header + 16, 8);
+      if (readed != sizeof header
+          || read_le(header, 4) != skippable_frame_magic
+          || read_le(header + 4, 4) != 16
+          || compressed_size > block_size_max
+          || size > block_size_max) {
+        m_status = BSDIFF_CORRUPT_PATCH;
+        break;
+      }
+
+      try {
+        auto job = std::make_unique<block_job>();
+        job->input.resize(static_cast<size_t>(compressed_size));
+        job->output.resize(static_cast<size_t>(size));
+        ret = m_stream->read(m_stream->state, job->input.data(), job->input.size(), &readed);
+        if (ret != BSDIFF_SUCCESS || readed != job->input.size()) {
+          m_status = ret == BSDIFF_END_OF_FILE || ret == BSDIFF_SUCCESS ? BSDIFF_CORRUPT_PATCH : ret;
+          break;
+        }
+        submit(std::move(job));
+      } catch (const std::bad_alloc &) {
+        m_status = BSDIFF_OUT_OF_MEMORY;
+      }
+    }
+  }
+
+  int m_mode;
+  struct bsdiff_stream *m_stream;
+  const snap::bsdiff::block_format *m_format;
+  int32_t m_level;
+  uint32_t m_window_log;
+  size_t m_block_size;
+  size_t m_max_in_flight;
+  std::unique_ptr<snap::bsdiff::thread_pool> m_pool;
+  std::mutex m_mutex;
+  std::condition_variable m_done;
+  std::deque<std::unique_ptr<block_job>> m_jobs;
+  std::vector<uint8_t> m_current;
+  size_t m_current_pos;
+  int m_status;
+  bool m_eof;
+};
+
+}
+
+int snap::bsdiff::open_block_codec(const int mode, struct bsdiff_stream *stream, const block_format *format, const int32_t level,
+                                   const uint32_t window_log, const uint32_t block_size, const uint32_t thread_count,
+                                   std::unique_ptr<patch_codec> &codec) {
+  if (format == nullptr || block_size > block_size_max) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  try {
+    codec = std::make_unique<block_codec>(mode, stream, format, level, window_log, block_size, thread_count);
+  } catch (const std::bad_alloc &) {
+    return BSDIFF_OUT_OF_MEMORY;
+  } catch (const std::system_error &) {
+    return BSDIFF_ERROR;
+  }
+
+  return BSDIFF_SUCCESS;
+}
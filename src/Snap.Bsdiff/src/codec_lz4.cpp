@@ -0,0 +1,216 @@
+#ifdef SNAP_BSDIFF_LZ4
+
+#include "bsdiff/codec.hpp"
+
+#include <algorithm>
+#include <lz4frame.h>
+#include <new>
+#include <vector>
+
+namespace {
+
+// Input handed to the compressor per call, the output buffer is sized for this.
+constexpr size_t lz4_chunk_size = 64 * 1024;
+
+void configure(LZ4F_preferences_t &preferences, const int32_t level) {
+  // Linked 4 MiB blocks compress best, decoding speed is the same either way.
+  preferences.frameInfo.blockSizeID = LZ4F_max4MB;
+  preferences.frameInfo.blockMode = LZ4F_blockLinked;
+  preferences.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+  preferences.compressionLevel = level;
+}
+
+class lz4_codec final : public snap::bsdiff::patch_codec {
+public:
+  explicit lz4_codec(struct bsdiff_stream *stream) :
+    m_stream(stream), m_cctx(nullptr), m_dctx(nullptr), m_preferences(), m_started(false),
+    m_buffer(), m_input_pos(0), m_input_size(0), m_eof(false) {
+  }
+
+  ~lz4_codec() override {
+    if (m_cctx != nullptr) {
+      LZ4F_freeCompressionContext(m_cctx);
+    }
+    if (m_dctx != nullptr) {
+      LZ4F_freeDecompressionContext(m_dctx);
+    }
+  }
+
+  int open_writer(const int32_t level) {
+    if (LZ4F_isError(LZ4F_createCompressionContext(&m_cctx, LZ4F_VERSION))) {
+      return BSDIFF_OUT_OF_MEMORY;
+    }
+
+    configure(m_preferences, level);
+
+    try {
+      m_buffer.resize(std::max<size_t>(LZ4F_compressBound(lz4_chunk_size, &m_preferences), LZ4F_HEADER_SIZE_MAX));
+    } catch (const std::bad_alloc &) {
+      return BSDIFF_OUT_OF_MEMORY;
+    }
+
+    return BSDIFF_SUCCESS;
+  }
+
+  int open_reader() {
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&m_dctx, LZ4F_VERSION))) {
+      return BSDIFF_OUT_OF_MEMORY;
+    }
+
+    try {
+      m_buffer.resize(lz4_chunk_size);
+    } catch (const std::bad_alloc &) {
+      return BSDIFF_OUT_OF_MEMORY;
+    }
+
+    return BSDIFF_SUCCESS;
+  }
+
+  int write(const uint8_t *data, size_t size) override {
+    int ret;
+    if ((ret = begin()) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+
+    while (size > 0) {
+      const auto chunk = std::min(size, lz4_chunk_size);
+      const auto written = LZ4F_compressUpdate(m_cctx, m_buffer.data(), m_buffer.size(), data, chunk, nullptr);
+      if ((ret = emit(written)) != BSDIFF_SUCCESS) {
+        return ret;
+      }
+      data += chunk;
+      size -= chunk;
+    }
+
+    return BSDIFF_SUCCESS;
+  }
+
+  int finish() override {
+    int ret;
+    if ((ret = begin()) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+    return emit(LZ4F_compressEnd(m_cctx, m_buffer.data(), m_buffer.size(), nullptr));
+  }
+
+  int read(uint8_t *data, const size_t size, size_t *readed) override {
+    size_t produced = 0;
+    while (produced < size) {
+      if (m_input_pos == m_input_size) {
+        if (m_eof) {
+          break;
+        }
+        m_input_pos = 0;
+        m_input_size = 0;
+        const auto ret = m_stream->read(m_stream->state, m_buffer.data(), m_buffer.size(), &m_input_size);
+        if (ret == BSDIFF_END_OF_FILE) {
+          m_eof = true;
+        } else if (ret != BSDIFF_SUCCESS) {
+          *readed = produced;
+          return ret;
+        }
+        if (m_input_size == 0) {
+          continue;
+        }
+      }
+
+      auto output_size = size - produced;
+      auto input_size = m_input_size - m_input_pos;
+      const auto hint = LZ4F_decompress(m_dctx, data + produced, &output_size, m_buffer.data() + m_input_pos, &input_size, nullptr);
+      if (LZ4F_isError(hint)) {
+        *readed = produced;
+        return BSDIFF_CORRUPT_PATCH;
+      }
+      produced += output_size;
+      m_input_pos += input_size;
+    }
+
+    *readed = produced;
+    return produced == size ? BSDIFF_SUCCESS : BSDIFF_END_OF_FILE;
+  }
+
+private:
+  // The frame header is written lazily so nothing reaches the stream before the packer header.
+  int begin() {
+    if (m_started) {
+      return BSDIFF_SUCCESS;
+    }
+    m_started = true;
+    return emit(LZ4F_compressBegin(m_cctx, m_buffer.data(), m_buffer.size(), &m_preferences));
+  }
+
+  int emit(const size_t written) {
+    if (LZ4F_isError(written)) {
+      return BSDIFF_ERROR;
+    }
+    return written > 0 ? m_stream->write(m_stream->state, m_buffer.data(), written) : BSDIFF_SUCCESS;
+  }
+
+  struct bsdiff_stream *m_stream;
+  LZ4F_cctx *m_cctx;
+  LZ4F_dctx *m_dctx;
+  LZ4F_preferences_t m_preferences;
+  bool m_started;
+  std::vector<uint8_t> m_buffer;
+  size_t m_input_pos;
+  size_t m_input_size;
+  bool m_eof;
+};
+
+int compress_block(const int32_t level, uint32_t, const uint8_t *data, const size_t size, std::vector<uint8_t> &frame) {
+  LZ4F_preferences_t preferences = {};
+  configure(preferences, level);
+  preferences.frameInfo.contentSize = size;
+
+  frame.resize(LZ4F_compressFrameBound(size, &preferences));
+  const auto written = LZ4F_compressFrame(frame.data(), frame.size(), data, size, &preferences);
+  if (LZ4F_isError(written)) {
+    return BSDIFF_ERROR;
+  }
+  frame.resize(written);
+
+  return BSDIFF_SUCCESS;
+}
+
+int decompress_block(const uint8_t *frame, const size_t frame_size, uint8_t *data, const size_t size) {
+  LZ4F_dctx *dctx = nullptr;
+  if (LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION))) {
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  size_t consumed = 0, produced = 0, hint = 1;
+  while (hint != 0 && !LZ4F_isError(hint) && consumed < frame_size) {
+    auto output_size = size - produced;
+    auto input_size = frame_size - consumed;
+    hint = LZ4F_decompress(dctx, data + produced, &output_size, frame + consumed, &input_size, nullptr);
+    if (output_size == 0 && input_size == 0) {
+      break;
+    }
+    produced += output_size;
+    consumed += input_size;
+  }
+
+  LZ4F_freeDecompressionContext(dctx);
+
+  return hint == 0 && consumed == frame_size && produced == size ? BSDIFF_SUCCESS : BSDIFF_CORRUPT_PATCH;
+}
+
+}
+
+const snap::bsdiff::block_format snap::bsdiff::lz4_block_format = { compress_block, decompress_block };
+
+int snap::bsdiff::open_lz4_codec(const int mode, struct bsdiff_stream *stream, const int32_t level, std::unique_ptr<patch_codec> &codec) {
+  std::unique_ptr<lz4_codec> lz4(new (std::nothrow) lz4_codec(stream));
+  if (lz4 == nullptr) {
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  const auto ret = mode == BSDIFF_MODE_WRITE ? lz4->open_writer(level) : lz4->open_reader();
+  if (ret == BSDIFF_SUCCESS) {
+    codec = std::move(lz4);
+  }
+
+  return ret;
+}
+
+#endif
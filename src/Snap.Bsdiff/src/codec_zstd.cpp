@@ -0,0 +1,211 @@
+#ifdef SNAP_BSDIFF_ZSTD
+
+#include "bsdiff/codec.hpp"
+
+#include <memory>
+#include <new>
+#include <vector>
+#include <zstd.h>
+
+namespace {
+
+// Windows above this need the decoder limit raised explicitly.
+constexpr uint32_t zstd_default_window_log_max = 27;
+constexpr uint32_t zstd_window_log_min = 10;
+constexpr uint32_t zstd_window_log_max = 31;
+
+int configure(ZSTD_CCtx *cctx, const int32_t level, const uint32_t window_log) {
+  if (ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1))
+      || (level != 0 && ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level)))) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  if (window_log > 0
+      && (ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_enableLongDistanceMatching, 1))
+          || ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_windowLog, static_cast<int>(window_log))))) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  return BSDIFF_SUCCESS;
+}
+
+class zstd_codec final : public snap::bsdiff::patch_codec {
+public:
+  explicit zstd_codec(struct bsdiff_stream *stream) :
+    m_stream(stream), m_cctx(nullptr), m_dctx(nullptr), m_buffer(), m_input_pos(0), m_input_size(0), m_eof(false) {
+  }
+
+  ~zstd_codec() override {
+    ZSTD_freeCCtx(m_cctx);
+    ZSTD_freeDCtx(m_dctx);
+  }
+
+  int open_writer(const int32_t level, const uint32_t window_log) {
+    if ((m_cctx = ZSTD_createCCtx()) == nullptr) {
+      return BSDIFF_OUT_OF_MEMORY;
+    }
+
+    int ret;
+    if ((ret = configure(m_cctx, level, window_log)) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+
+    try {
+      m_buffer.resize(ZSTD_CStreamOutSize());
+    } catch (const std::bad_alloc &) {
+      return BSDIFF_OUT_OF_MEMORY;
+    }
+
+    return BSDIFF_SUCCESS;
+  }
+
+  int open_reader(const uint32_t window_log) {
+    if ((m_dctx = ZSTD_createDCtx()) == nullptr) {
+      return BSDIFF_OUT_OF_MEMORY;
+    }
+
+    if (window_log > zstd_default_window_log_max
+        && ZSTD_isError(ZSTD_DCtx_setParameter(m_dctx, ZSTD_d_windowLogMax, static_cast<int>(window_log)))) {
+      return BSDIFF_INVALID_ARG;
+    }
+
+    try {
+      m_buffer.resize(ZSTD_DStreamInSize());
+    } catch (const std::bad_alloc &) {
+      return BSDIFF_OUT_OF_MEMORY;
+    }
+
+    return BSDIFF_SUCCESS;
+  }
+
+  int write(const uint8_t *data, const size_t size) override {
+    ZSTD_inBuffer input = { data, size, 0 };
+    while (input.pos < input.size) {
+      int ret;
+      if ((ret = compress(&input, ZSTD_e_continue, nullptr)) != BSDIFF_SUCCESS) {
+        return ret;
+      }
+    }
+    return BSDIFF_SUCCESS;
+  }
+
+  int finish() override {
+    ZSTD_inBuffer input = { nullptr, 0, 0 };
+    size_t remaining;
+    do {
+      int ret;
+      if ((ret = compress(&input, ZSTD_e_end, &remaining)) != BSDIFF_SUCCESS) {
+        return ret;
+      }
+    } while (remaining != 0);
+    return BSDIFF_SUCCESS;
+  }
+
+  int read(uint8_t *data, const size_t size, size_t *readed) override {
+    ZSTD_outBuffer output = { data, size, 0 };
+    while (output.pos < output.size) {
+      if (m_input_pos == m_input_size) {
+        if (m_eof) {
+          break;
+        }
+        m_input_pos = 0;
+        m_input_size = 0;
+        const auto ret = m_stream->read(m_stream->state, m_buffer.data(), m_buffer.size(), &m_input_size);
+        if (ret == BSDIFF_END_OF_FILE) {
+          m_eof = true;
+        } else if (ret != BSDIFF_SUCCESS) {
+          *readed = output.pos;
+          return ret;
+        }
+        if (m_input_size == 0) {
+          continue;
+        }
+      }
+
+      ZSTD_inBuffer input = { m_buffer.data(), m_input_size, m_input_pos };
+      const auto hint = ZSTD_decompressStream(m_dctx, &output, &input);
+      m_input_pos = input.pos;
+      if (ZSTD_isError(hint)) {
+        *readed = output.pos;
+        return BSDIFF_CORRUPT_PATCH;
+      }
+    }
+
+    *readed = output.pos;
+    return output.pos == output.size ? BSDIFF_SUCCESS : BSDIFF_END_OF_FILE;
+  }
+
+private:
+  int compress(ZSTD_inBuffer *input, const ZSTD_EndDirective directive, size_t *remaining) {
+    ZSTD_outBuffer output = { m_buffer.data(), m_buffer.size(), 0 };
+    const auto hint = ZSTD_compressStream2(m_cctx, &output, input, directive);
+    if (ZSTD_isError(hint)) {
+      return BSDIFF_ERROR;
+    }
+    if (remaining != nullptr) {
+      *remaining = hint;
+    }
+    return output.pos > 0 ? m_stream->write(m_stream->state, m_buffer.data(), output.pos) : BSDIFF_SUCCESS;
+  }
+
+  struct bsdiff_stream *m_stream;
+  ZSTD_CCtx *m_cctx;
+  ZSTD_DCtx *m_dctx;
+  std::vector<uint8_t> m_buffer;
+  size_t m_input_pos;
+  size_t m_input_size;
+  bool m_eof;
+};
+
+int compress_block(const int32_t level, const uint32_t window_log, const uint8_t *data, const size_t size,
+                   std::vector<uint8_t> &frame) {
+  std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx *)> cctx(ZSTD_createCCtx(), ZSTD_freeCCtx);
+  if (cctx == nullptr) {
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  int ret;
+  if ((ret = configure(cctx.get(), level, window_log)) != BSDIFF_SUCCESS) {
+    return ret;
+  }
+
+  frame.resize(ZSTD_compressBound(size));
+  const auto written = ZSTD_compress2(cctx.get(), frame.data(), frame.size(), data, size);
+  if (ZSTD_isError(written)) {
+    return BSDIFF_ERROR;
+  }
+  frame.resize(written);
+
+  return BSDIFF_SUCCESS;
+}
+
+int decompress_block(const uint8_t *frame, const size_t frame_size, uint8_t *data, const size_t size) {
+  // Single pass decoding into the final buffer, the window size limit does not apply.
+  const auto written = ZSTD_decompress(data, size, frame, frame_size);
+  return !ZSTD_isError(written) && written == size ? BSDIFF_SUCCESS : BSDIFF_CORRUPT_PATCH;
+}
+
+}
+
+const snap::bsdiff::block_format snap::bsdiff::zstd_block_format = { compress_block, decompress_block };
+
+int snap::bsdiff::open_zstd_codec(const int mode, struct bsdiff_stream *stream, const int32_t level, const uint32_t window_log,
+                                  std::unique_ptr<patch_codec> &codec) {
+  if (window_log != 0 && (window_log < zstd_window_log_min || window_log > zstd_window_log_max)) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  std::unique_ptr<zstd_codec> zstd(new (std::nothrow) zstd_codec(stream));
+  if (zstd == nullptr) {
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  const auto ret = mode == BSDIFF_MODE_WRITE ? zstd->open_writer(level, window_log) : zstd->open_reader(window_log);
+  if (ret == BSDIFF_SUCCESS) {
+    codec = std::move(zstd);
+  }
+
+  return ret;
+}
+
+#endif
@@ -0,0 +1,245 @@
+#include "bsdiff/compose.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace {
+
+// Largest read or write handed to a packer at once, bz2 counts in int.
+constexpr size_t compose_io_size = 1024 * 1024;
+
+void log_error(struct bsdiff_ctx *ctx, const char *errmsg) {
+  if (ctx != nullptr && ctx->log_error != nullptr) {
+    ctx->log_error(ctx->opaque, errmsg);
+  }
+}
+
+using read_function = int (*)(void *state, void *buffer, size_t size, size_t *readed);
+using write_function = int (*)(void *state, const uint8_t *buffer, size_t size);
+
+int read_fully(const read_function read, void *state, uint8_t *buffer, const int64_t size) {
+  for (auto remaining = size; remaining > 0;) {
+    const auto len = static_cast<size_t>(std::min<int64_t>(remaining, static_cast<int64_t>(compose_io_size)));
+    size_t readed = 0;
+    int ret;
+    if ((ret = read(state, buffer, len, &readed)) != BSDIFF_SUCCESS || readed != len) {
+      return ret != BSDIFF_SUCCESS && ret != BSDIFF_END_OF_FILE ? ret : BSDIFF_CORRUPT_PATCH;
+    }
+    buffer += len;
+    remaining -= static_cast<int64_t>(len);
+  }
+  return BSDIFF_SUCCESS;
+}
+
+int write_fully(const write_function write, void *state, const uint8_t *buffer, const int64_t size) {
+  for (auto remaining = size; remaining > 0;) {
+    const auto len = static_cast<size_t>(std::min<int64_t>(remaining, static_cast<int64_t>(compose_io_size)));
+    int ret;
+    if ((ret = write(state, buffer, len)) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+    buffer += len;
+    remaining -= static_cast<int64_t>(len);
+  }
+  return BSDIFF_SUCCESS;
+}
+
+}
+
+snap::bsdiff::patch_chain::patch_chain() :
+    m_segments(),
+    m_delta(),
+    m_size(0),
+    m_count(0),
+    m_digests() {
+}
+
+void snap::bsdiff::patch_chain::append(std::vector<segment> &segments, const segment &run) {
+  if (run.length == 0) {
+    return;
+  }
+  if (!segments.empty()) {
+    auto &last = segments.back();
+    if (last.literal == run.literal && (run.literal || last.older_offset + last.length == run.older_offset)) {
+      last.length += run.length;
+      return;
+    }
+  }
+  segments.push_back(run);
+}
+
+// Resolves older[older_pos, older_pos + length) of the patch being added, which is the
+// output of the chain so far, into runs of the first older file. The delta bytes of the
+// chain are added to those of the patch, already in delta at newer_pos.
+int snap::bsdiff::patch_chain::map(int64_t older_pos, int64_t length, int64_t newer_pos, std::vector<segment> &segments,
+                                   std::vector<uint8_t> &delta) const {
+  // The first patch is applied to the first older file itself.
+  if (m_count == 0) {
+    append(segments, { newer_pos, length, older_pos, false });
+    return BSDIFF_SUCCESS;
+  }
+
+  // Bytes before the start of older read as zero, what remains is the diff byte.
+  if (older_pos < 0) {
+    const auto len = std::min(length, -older_pos);
+    append(segments, { newer_pos, len, 0, true });
+    older_pos += len;
+    newer_pos += len;
+    length -= len;
+  }
+
+  auto it = std::upper_bound(m_segments.begin(), m_segments.end(), older_pos, [](const int64_t position, const segment &run) {
+    return position < run.newer_offset;
+  });
+  if (it != m_segments.begin()) {
+    --it;
+  }
+
+  for (; length > 0 && older_pos < m_size && it != m_segments.end(); ++it) {
+    const auto skip = older_pos - it->newer_offset;
+    const auto len = std::min(length, it->length - skip);
+    if (len <= 0) {
+      continue;
+    }
+
+    auto *dst = delta.data() + newer_pos;
+    const auto *src = m_delta.data() + older_pos;
+    for (int64_t i = 0; i < len; i++) {
+      dst[i] = static_cast<uint8_t>(dst[i] + src[i]);
+    }
+    append(segments, { newer_pos, len, it->older_offset + skip, it->literal });
+
+    older_pos += len;
+    newer_pos += len;
+    length -= len;
+  }
+
+  // Bytes past the end of older read as zero as well.
+  append(segments, { newer_pos, length, 0, true });
+
+  return BSDIFF_SUCCESS;
+}
+
+int snap::bsdiff::patch_chain::add(struct bsdiff_ctx *ctx, struct bsdiff_patch_packer *packer, const patch_digests &digests) {
+  int ret;
+  int64_t newer_size = 0;
+  if ((ret = packer->read_new_size(packer->state, &newer_size)) != BSDIFF_SUCCESS) {
+    log_error(ctx, "Failed to read new file size from patch.");
+    return ret;
+  }
+
+  if (newer_size < 0) {
+    log_error(ctx, "Corrupt patch: negative new file size.");
+    return BSDIFF_CORRUPT_PATCH;
+  }
+
+  if (m_count > 0 && digests.present
+      && (digests.older_size != m_size
+          || (m_digests.present && std::memcmp(digests.older_sha256, m_digests.newer_sha256, sizeof digests.older_sha256) != 0))) {
+    log_error(ctx, "Patch was not made from the output of the previous patch.");
+    return bsdiff_status_type_digest_mismatch;
+  }
+
+  std::vector<segment> segments;
+  std::vector<uint8_t> delta;
+  try {
+    delta.resize(static_cast<size_t>(newer_size));
+
+    int64_t older_pos = 0;
+    int64_t newer_pos = 0;
+    while (newer_pos < newer_size) {
+      int64_t diff_len = 0, extra_len = 0, seek_len = 0;
+      if ((ret = packer->read_entry_header(packer->state, &diff_len, &extra_len, &seek_len)) != BSDIFF_SUCCESS) {
+        log_error(ctx, "Failed to read patch entry header.");
+        return ret;
+      }
+
+      if (diff_len < 0 || extra_len < 0 || diff_len > newer_size - newer_pos
+          || extra_len > newer_size - newer_pos - diff_len) {
+        log_error(ctx, "Corrupt patch: entry exceeds new file size.");
+        return BSDIFF_CORRUPT_PATCH;
+      }
+
+      if ((ret = read_fully(packer->read_entry_diff, packer->state, delta.data() + newer_pos, diff_len)) != BSDIFF_SUCCESS) {
+        log_error(ctx, "Corrupt patch: truncated diff block.");
+        return ret;
+      }
+      if ((ret = map(older_pos, diff_len, newer_pos, segments, delta)) != BSDIFF_SUCCESS) {
+        return ret;
+      }
+      newer_pos += diff_len;
+
+      if ((ret = read_fully(packer->read_entry_extra, packer->state, delta.data() + newer_pos, extra_len)) != BSDIFF_SUCCESS) {
+        log_error(ctx, "Corrupt patch: truncated extra block.");
+        return ret;
+      }
+      append(segments, { newer_pos, extra_len, 0, true });
+      newer_pos += extra_len;
+
+      older_pos += diff_len + seek_len;
+    }
+  } catch (const std::bad_alloc &) {
+    log_error(ctx, "Failed to allocate memory.");
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  m_segments.swap(segments);
+  m_delta.swap(delta);
+  m_size = newer_size;
+
+  if (m_count == 0) {
+    m_digests = digests;
+  } else {
+    m_digests.present = m_digests.present && digests.present;
+    std::memcpy(m_digests.newer_sha256, digests.newer_sha256, sizeof m_digests.newer_sha256);
+  }
+  m_count++;
+
+  return BSDIFF_SUCCESS;
+}
+
+int snap::bsdiff::patch_chain::write(struct bsdiff_ctx *ctx, struct bsdiff_patch_packer *packer) const {
+  int ret;
+  if ((ret = packer->write_new_size(packer->state, m_size)) != BSDIFF_SUCCESS) {
+    log_error(ctx, "Failed to write patch header.");
+    return ret;
+  }
+
+  // Every entry takes one run of older followed by the literals up to the next one, and
+  // seeks to where the next run starts.
+  int64_t older_pos = 0;
+  for (size_t i = 0; i < m_segments.size();) {
+    const auto newer_offset = m_segments[i].newer_offset;
+    int64_t diff_len = 0, extra_len = 0;
+    if (!m_segments[i].literal) {
+      if (m_segments[i].older_offset != older_pos) {
+        if ((ret = packer->write_entry_header(packer->state, 0, 0, m_segments[i].older_offset - older_pos)) != BSDIFF_SUCCESS) {
+          log_error(ctx, "Failed to write patch entry.");
+          return ret;
+        }
+        older_pos = m_segments[i].older_offset;
+      }
+      diff_len = m_segments[i++].length;
+    }
+    for (; i < m_segments.size() && m_segments[i].literal; i++) {
+      extra_len += m_segments[i].length;
+    }
+
+    auto seek_len = diff_len;
+    if (i < m_segments.size()) {
+      seek_len = m_segments[i].older_offset - older_pos;
+    }
+    seek_len -= diff_len;
+
+    if ((ret = packer->write_entry_header(packer->state, diff_len, extra_len, seek_len)) != BSDIFF_SUCCESS
+        || (ret = write_fully(packer->write_entry_diff, packer->state, m_delta.data() + newer_offset, diff_len)) != BSDIFF_SUCCESS
+        || (ret = write_fully(packer->write_entry_extra, packer->state, m_delta.data() + newer_offset + diff_len, extra_len)) != BSDIFF_SUCCESS) {
+      log_error(ctx, "Failed to write patch entry.");
+      return ret;
+    }
+    older_pos += diff_len + seek_len;
+  }
+
+  return packer->flush(packer->state);
+}
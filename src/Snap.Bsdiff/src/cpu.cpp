@@ -0,0 +1,78 @@
+#include "bsdiff/cpu.hpp"
+
+#include <cstdint>
+
+#if defined(SNAP_BSDIFF_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace {
+
+#if defined(SNAP_BSDIFF_X86)
+
+void cpuid(const uint32_t leaf, const uint32_t subleaf, uint32_t registers[4]) {
+#if defined(_MSC_VER)
+  int values[4];
+  __cpuidex(values, static_cast<int>(leaf), static_cast<int>(subleaf));
+  for (int i = 0; i < 4; i++) {
+    registers[i] = static_cast<uint32_t>(values[i]);
+  }
+#else
+  __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+// AVX state has to be enabled by the OS as well, otherwise the registers are not saved on
+// a context switch.
+bool os_saves_avx_state() {
+#if defined(_MSC_VER)
+  return (_xgetbv(0) & 0x6) == 0x6;
+#else
+  uint32_t eax, edx;
+  __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return (eax & 0x6) == 0x6;
+#endif
+}
+
+snap::bsdiff::cpu_feature_set detect() {
+  snap::bsdiff::cpu_feature_set features = {};
+
+  uint32_t registers[4];
+  cpuid(0, 0, registers);
+  const auto max_leaf = registers[0];
+  if (max_leaf < 1) {
+    return features;
+  }
+
+  cpuid(1, 0, registers);
+  features.sse41 = (registers[2] & (1u << 19)) != 0;
+  const auto avx = (registers[2] & (1u << 28)) != 0;
+  const auto osxsave = (registers[2] & (1u << 27)) != 0;
+
+  if (max_leaf >= 7) {
+    cpuid(7, 0, registers);
+    features.avx2 = avx && osxsave && (registers[1] & (1u << 5)) != 0 && os_saves_avx_state();
+    features.sha = features.sse41 && (registers[1] & (1u << 29)) != 0;
+  }
+
+  return features;
+}
+
+#else
+
+snap::bsdiff::cpu_feature_set detect() {
+  return {};
+}
+
+#endif
+
+}
+
+const snap::bsdiff::cpu_feature_set &snap::bsdiff::cpu_features() {
+  static const cpu_feature_set features = detect();
+  return features;
+}
@@ -0,0 +1,562 @@
+#include "bsdiff/diff.hpp"
+#include "bsdiff/bytes.hpp"
+#include "bsdiff/prematch.hpp"
+#include "bsdiff/progress.hpp"
+#include "bsdiff/suffix_array.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <vector>
+
+namespace {
+
+using snap::bsdiff::block_match;
+using snap::bsdiff::byte_kernel_set;
+using snap::bsdiff::byte_kernels;
+using snap::bsdiff::find_block_matches;
+using snap::bsdiff::popcount64;
+using snap::bsdiff::prematch_min_older_size;
+using snap::bsdiff::progress_reporter;
+using snap::bsdiff::reverse_bits64;
+using snap::bsdiff::stats_recorder;
+using snap::bsdiff::suffix_array_build;
+using snap::bsdiff::suffix_array_width;
+
+// Suffix array and rank entries of width bytes each plus one group marker byte per position
+// of older.
+constexpr uint64_t sa_bytes_per_byte(const size_t width) {
+  return 2 * width + 1;
+}
+// Smallest window of older a windowed diff is willing to sort.
+constexpr int64_t min_window_size = 64 * 1024;
+// Shortest match along a prematched run that stands in for a search. A match elsewhere in
+// older would have to be longer still to start an entry of its own.
+constexpr int64_t min_hinted_length = 64;
+
+void log_error(struct bsdiff_ctx *ctx, const char *errmsg) {
+  if (ctx != nullptr && ctx->log_error != nullptr) {
+    ctx->log_error(ctx->opaque, errmsg);
+  }
+}
+
+int64_t match_length(const uint8_t *older, const int64_t older_size, const uint8_t *newer, const int64_t newer_size) {
+  return static_cast<int64_t>(byte_kernels().common_prefix(older, newer, static_cast<size_t>(std::min(older_size, newer_size))));
+}
+
+// Length of the extension of a match over size bytes that maximizes twice the agreeing
+// bytes minus the length, the shortest one on ties and 0 unless it is positive. Backward
+// extensions read older and newer downwards from the byte before them. Agreement is
+// compared 64 bytes at a time, chunks that can't beat the best so far or that agree
+// completely are settled from the mask alone.
+int64_t extension_length(const byte_kernel_set &kernels, const uint8_t *older, const uint8_t *newer, const int64_t size,
+                         const bool backward) {
+  int64_t value = 0, best_value = 0, best_len = 0;
+  for (int64_t begin = 0; begin < size; begin += 64) {
+    const auto chunk = std::min<int64_t>(size - begin, 64);
+    uint64_t mask = 0;
+    if (chunk == 64) {
+      mask = backward
+        ? reverse_bits64(kernels.equal_mask(older - begin - 64, newer - begin - 64))
+        : kernels.equal_mask(older + begin, newer + begin);
+    } else {
+      for (int64_t i = 0; i < chunk; i++) {
+        const auto equal = backward ? older[-begin - 1 - i] == newer[-begin - 1 - i] : older[begin + i] == newer[begin + i];
+        mask |= static_cast<uint64_t>(equal ? 1 : 0) << i;
+      }
+    }
+
+    const auto full = chunk == 64 ? ~uint64_t(0) : (uint64_t(1) << chunk) - 1;
+    if (value + chunk <= best_value) {
+      value += 2 * static_cast<int64_t>(popcount64(mask)) - chunk;
+      continue;
+    }
+    if (mask == full) {
+      value += chunk;
+      best_value = value;
+      best_len = begin + chunk;
+      continue;
+    }
+
+    for (int64_t i = 0; i < chunk; i++) {
+      value += (mask >> i) & 1 ? 1 : -1;
+      if (value > best_value) {
+        best_value = value;
+        best_len = begin + i + 1;
+      }
+    }
+  }
+
+  return best_len;
+}
+
+// Binary search of the suffix array for the longest match of newer within older.
+template<typename Index>
+int64_t search(const Index *sa, const uint8_t *older, const int64_t older_size,
+               const uint8_t *newer, const int64_t newer_size, int64_t first, int64_t last, int64_t *pos) {
+  while (last - first >= 2) {
+    const auto middle = first + (last - first) / 2;
+    const auto suffix = static_cast<int64_t>(sa[middle]);
+    const auto len = static_cast<size_t>(std::min(older_size - suffix, newer_size));
+    if (std::memcmp(older + suffix, newer, len) < 0) {
+      first = middle;
+    } else {
+      last = middle;
+    }
+  }
+
+  const auto first_suffix = static_cast<int64_t>(sa[first]);
+  const auto last_suffix = static_cast<int64_t>(sa[last]);
+  const auto first_len = match_length(older + first_suffix, older_size - first_suffix, newer, newer_size);
+  const auto last_len = match_length(older + last_suffix, older_size - last_suffix, newer, newer_size);
+  if (first_len > last_len) {
+    *pos = first_suffix;
+    return first_len;
+  }
+
+  *pos = last_suffix;
+  return last_len;
+}
+
+class entry_writer final {
+  struct bsdiff_patch_packer *m_packer;
+  stats_recorder &m_stats;
+  std::vector<uint8_t> m_diff;
+
+public:
+  entry_writer(struct bsdiff_patch_packer *packer, stats_recorder &stats) :
+      m_packer(packer),
+      m_stats(stats),
+      m_diff() {
+  }
+
+  entry_writer(const entry_writer &) = delete;
+  entry_writer &operator=(const entry_writer &) = delete;
+
+  ~entry_writer() {
+    m_stats.released(m_diff.capacity());
+  }
+
+  int write(const uint8_t *older, const int64_t older_pos, const uint8_t *newer, const int64_t newer_pos,
+            const int64_t diff_len, const int64_t extra_len, const int64_t seek_len) {
+    int ret;
+    if ((ret = m_packer->write_entry_header(m_packer->state, diff_len, extra_len, seek_len)) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+
+    const auto capacity = m_diff.capacity();
+    m_diff.resize(static_cast<size_t>(diff_len));
+    m_stats.allocated(m_diff.capacity() - capacity);
+    byte_kernels().subtract(m_diff.data(), newer + newer_pos, older + older_pos, static_cast<size_t>(diff_len));
+
+    if ((ret = m_packer->write_entry_diff(m_packer->state, m_diff.data(), m_diff.size())) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+
+    return m_packer->write_entry_extra(m_packer->state, newer + newer_pos + diff_len, static_cast<size_t>(extra_len));
+  }
+};
+
+// Match of newer + scan along the diagonal of the prematched run that covers scan, or -1
+// when there is none or it ends within min_hinted_length, so the suffix array is searched.
+// hint is the first run that may cover scan and is advanced past the runs scan has left.
+int64_t hinted_match(const std::vector<block_match> &matches, size_t &hint, const uint8_t *older,
+                     const int64_t older_size, const uint8_t *newer, const int64_t newer_size, const int64_t scan,
+                     int64_t *pos) {
+  while (hint < matches.size() && matches[hint].newer_pos + matches[hint].length <= scan) {
+    hint++;
+  }
+  if (hint == matches.size() || matches[hint].newer_pos > scan) {
+    return -1;
+  }
+
+  const auto older_pos = matches[hint].older_pos + (scan - matches[hint].newer_pos);
+  const auto len = match_length(older + older_pos, older_size - older_pos, newer + scan, newer_size - scan);
+  if (len < min_hinted_length) {
+    return -1;
+  }
+
+  *pos = older_pos;
+  return len;
+}
+
+// end_pos, when set, overrides the seek of the last entry so that the next entry starts at
+// that position of older. Windowed diffs use it to chain windows. matches are the runs of a
+// prematched diff, within them the search follows the run instead of the suffix array.
+// newer_offset is the position of newer within the whole file, for progress.
+template<typename Index>
+int scan(const Index *sa, const uint8_t *older, const int64_t older_size, const uint8_t *newer, const int64_t newer_size,
+         const std::vector<block_match> &matches, entry_writer &writer, progress_reporter &progress,
+         const int64_t newer_offset = 0, const int64_t *end_pos = nullptr) {
+  int ret;
+  const auto &kernels = byte_kernels();
+  int64_t scan = 0, len = 0, pos = 0;
+  int64_t last_scan = 0, last_pos = 0, last_offset = 0;
+  size_t hint = 0;
+
+  while (scan < newer_size) {
+    int64_t old_score = 0;
+
+    for (auto scsc = scan += len; scan < newer_size; scan++) {
+      // Stretches without a good match search once per byte, so this is the place to poll.
+      if ((ret = progress.update(static_cast<uint64_t>(newer_offset + scan))) != BSDIFF_SUCCESS) {
+        return ret;
+      }
+
+      len = hinted_match(matches, hint, older, older_size, newer, newer_size, scan, &pos);
+      if (len < 0) {
+        len = search(sa, older, older_size, newer + scan, newer_size - scan, 0, older_size, &pos);
+      }
+
+      // Bytes of the new match that the previous offset already covers.
+      const auto score_end = std::min(scan + len, older_size - last_offset);
+      if (scsc < score_end) {
+        old_score += static_cast<int64_t>(kernels.count_equal(older + scsc + last_offset, newer + scsc,
+                                                              static_cast<size_t>(score_end - scsc)));
+      }
+      scsc = std::max(scsc, scan + len);
+
+      if ((len == old_score && len != 0) || len > old_score + 8) {
+        break;
+      }
+
+      if (scan + last_offset < older_size && older[scan + last_offset] == newer[scan]) {
+        old_score--;
+      }
+    }
+
+    if (len == old_score && scan != newer_size) {
+      continue;
+    }
+
+    // Extend the previous match forwards and the current match backwards as long as
+    // at least half of the bytes agree.
+    auto len_forward = extension_length(kernels, older + last_pos, newer + last_scan,
+                                        std::min(scan - last_scan, older_size - last_pos), false);
+
+    int64_t len_backward = 0;
+    if (scan < newer_size) {
+      len_backward = extension_length(kernels, older + pos, newer + scan, std::min(scan - last_scan, pos), true);
+    }
+
+    if (last_scan + len_forward > scan - len_backward) {
+      const auto overlap = (last_scan + len_forward) - (scan - len_backward);
+      int64_t score = 0, best_split_score = 0, len_split = 0;
+      for (int64_t i = 0; i < overlap; i++) {
+        if (newer[last_scan + len_forward - overlap + i] == older[last_pos + len_forward - overlap + i]) {
+          score++;
+        }
+        if (newer[scan - len_backward + i] == older[pos - len_backward + i]) {
+          score--;
+        }
+        if (score > best_split_score) {
+          best_split_score = score;
+          len_split = i + 1;
+        }
+      }
+
+      len_forward += len_split - overlap;
+      len_backward -= len_split;
+    }
+
+    const auto next_pos = scan < newer_size || end_pos == nullptr ? pos - len_backward : *end_pos;
+
+    if ((ret = writer.write(older, last_pos, newer, last_scan,
+                            len_forward,
+                            (scan - len_backward) - (last_scan + len_forward),
+                            next_pos - (last_pos + len_forward))) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+
+    last_scan = scan - len_backward;
+    last_pos = pos - len_backward;
+    last_offset = pos - scan;
+  }
+
+  return BSDIFF_SUCCESS;
+}
+
+// Writes the entries of the rolling hash engine. Each match is extended into the gaps
+// around it as far as bsdiff's scan would, the rest of a gap goes to the extra block.
+int scan_rolling_hash(const uint8_t *older, const int64_t older_size, const uint8_t *newer, const int64_t newer_size,
+                      const std::vector<block_match> &matches, entry_writer &writer, progress_reporter &progress) {
+  int ret;
+  const auto &kernels = byte_kernels();
+
+  // Start of the diff block of the next entry, in older and newer.
+  int64_t older_begin = 0, newer_begin = 0;
+  if (!matches.empty()) {
+    const auto &first = matches.front();
+    const auto back = extension_length(kernels, older + first.older_pos, newer + first.newer_pos,
+                                       std::min(first.newer_pos, first.older_pos), true);
+    older_begin = first.older_pos - back;
+    newer_begin = first.newer_pos - back;
+  }
+
+  // Whatever precedes the first match is extra data.
+  if (newer_begin > 0 || older_begin > 0 || matches.empty()) {
+    if ((ret = writer.write(older, 0, newer, 0, 0, matches.empty() ? newer_size : newer_begin,
+                            older_begin)) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+  }
+
+  for (size_t i = 0; i < matches.size(); i++) {
+    const auto &match = matches[i];
+    const auto older_end = match.older_pos + match.length;
+    const auto newer_end = match.newer_pos + match.length;
+    const auto gap = (i + 1 < matches.size() ? matches[i + 1].newer_pos : newer_size) - newer_end;
+
+    const auto forward = extension_length(kernels, older + older_end, newer + newer_end,
+                                          std::min(gap, older_size - older_end), false);
+    int64_t next_older = older_end + forward, next_newer = newer_end + gap;
+    if (i + 1 < matches.size()) {
+      const auto &next = matches[i + 1];
+      const auto back = extension_length(kernels, older + next.older_pos, newer + next.newer_pos,
+                                         std::min(gap - forward, next.older_pos), true);
+      next_older = next.older_pos - back;
+      next_newer = next.newer_pos - back;
+    }
+
+    const auto diff_len = newer_end + forward - newer_begin;
+    if ((ret = writer.write(older, older_begin, newer, newer_begin, diff_len, next_newer - (newer_begin + diff_len),
+                            next_older - (older_begin + diff_len))) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+
+    if ((ret = progress.update(static_cast<uint64_t>(next_newer))) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+
+    older_begin = next_older;
+    newer_begin = next_newer;
+  }
+
+  return BSDIFF_SUCCESS;
+}
+
+// Diffs consecutive windows of newer against a window of older around the proportionally
+// matching position, so only one window of older is ever sorted. Matches outside the
+// window are missed, which costs patch size, but the entries are plain bsdiff entries.
+template<typename Index>
+int diff_windowed(struct bsdiff_ctx *ctx, const uint8_t *older, const int64_t older_size, const uint8_t *newer,
+                  const int64_t newer_size, const uint32_t thread_count, const uint64_t max_memory_bytes,
+                  entry_writer &writer, progress_reporter &progress, stats_recorder &stats) {
+  // Each byte of the older window costs sa_bytes_per_byte, the newer window is half as long
+  // and bounds the diff block buffer.
+  constexpr auto window_bytes_per_byte = sa_bytes_per_byte(sizeof(Index));
+  const auto budget_window = max_memory_bytes > window_bytes_per_byte
+    ? static_cast<int64_t>((max_memory_bytes - window_bytes_per_byte) * 2 / (2 * window_bytes_per_byte + 1)) : 0;
+  if (budget_window < min_window_size) {
+    log_error(ctx, "Memory budget is too small for a windowed diff.");
+    return BSDIFF_INVALID_ARG;
+  }
+
+  const auto older_window = std::min(budget_window, older_size);
+  const auto newer_window = budget_window / 2;
+
+  const auto window_begin = [&](const int64_t newer_begin) {
+    const auto newer_center = newer_begin + std::min(newer_window, newer_size - newer_begin) / 2;
+    const auto center = static_cast<int64_t>(static_cast<double>(newer_center) * static_cast<double>(older_size)
+                                             / static_cast<double>(newer_size));
+    return std::clamp<int64_t>(center - older_window / 2, 0, older_size - older_window);
+  };
+
+  std::vector<Index> sa;
+  try {
+    sa.resize(static_cast<size_t>(older_window) + 1);
+  } catch (const std::bad_alloc &) {
+    log_error(ctx, "Failed to allocate suffix array.");
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+  stats.allocated(static_cast<uint64_t>(older_window + 1) * window_bytes_per_byte);
+
+  int ret;
+  int64_t sorted_begin = -1;
+  for (int64_t newer_begin = 0; newer_begin < newer_size; newer_begin += newer_window) {
+    const auto newer_len = std::min(newer_window, newer_size - newer_begin);
+    const auto older_begin = window_begin(newer_begin);
+
+    // The window of older only moves when older does not fit the budget as a whole.
+    if (older_begin != sorted_begin) {
+      stats.begin();
+      if ((ret = suffix_array_build(older + older_begin, older_window, sa.data(), thread_count, &progress)) != BSDIFF_SUCCESS) {
+        log_error(ctx, "Failed to build suffix array.");
+        return ret;
+      }
+      stats.end(&snap_bsdiff_stats::sort);
+      sorted_begin = older_begin;
+    }
+
+    // The last entry of the window seeks to where the next window of older begins.
+    const auto next_begin = newer_begin + newer_len;
+    const int64_t end_pos = next_begin < newer_size ? window_begin(next_begin) - older_begin : 0;
+
+    stats.begin();
+    if ((ret = scan(sa.data(), older + older_begin, older_window, newer + newer_begin, newer_len, {}, writer, progress,
+                    newer_begin, &end_pos)) != BSDIFF_SUCCESS) {
+      log_error(ctx, "Failed to write patch entry.");
+      return ret;
+    }
+    stats.end_interleaved(&snap_bsdiff_stats::scan);
+  }
+
+  stats.released(static_cast<uint64_t>(older_window + 1) * window_bytes_per_byte);
+
+  return BSDIFF_SUCCESS;
+}
+
+template<typename Index>
+int diff_entries(struct bsdiff_ctx *ctx, const uint8_t *older, const int64_t older_size, const uint8_t *newer,
+                 const int64_t newer_size, struct bsdiff_patch_packer *packer, const Index *sa, const uint32_t thread_count,
+                 const uint64_t max_memory_bytes, const bool windowed, const snap_bsdiff_engine_type engine,
+                 progress_reporter &progress, stats_recorder &stats) {
+  int ret;
+  std::vector<Index> sa_buffer;
+  std::vector<block_match> matches;
+  const auto rolling_hash = engine == bsdiff_engine_type_rolling_hash;
+  if (rolling_hash || (engine == bsdiff_engine_type_prematch && !windowed && older_size >= prematch_min_older_size)) {
+    // Runs of newer that are unchanged since older are matched by hash. The rolling hash
+    // engine keeps all it finds, the scan of the prematch engine follows them instead of
+    // searching the suffix array. The hash table is gone before the sort allocates.
+    try {
+      stats.begin();
+      find_block_matches(older, older_size, newer, newer_size, rolling_hash, matches, stats);
+      stats.end(&snap_bsdiff_stats::sort);
+    } catch (const std::bad_alloc &) {
+      log_error(ctx, "Failed to allocate block hash table.");
+      return BSDIFF_OUT_OF_MEMORY;
+    }
+  }
+
+  if (sa == nullptr && !windowed && !rolling_hash) {
+    try {
+      sa_buffer.resize(static_cast<size_t>(older_size) + 1);
+    } catch (const std::bad_alloc &) {
+      log_error(ctx, "Failed to allocate suffix array.");
+      return BSDIFF_OUT_OF_MEMORY;
+    }
+
+    // The sort keeps a rank and a group marker per byte next to the suffix array, both are
+    // gone once it returns.
+    const auto sort_bytes = static_cast<uint64_t>(older_size + 1) * sa_bytes_per_byte(sizeof(Index));
+    const auto sa_bytes = static_cast<uint64_t>(older_size + 1) * sizeof(Index);
+    stats.allocated(sort_bytes);
+    stats.begin();
+    if ((ret = suffix_array_build(older, older_size, sa_buffer.data(), thread_count, &progress)) != BSDIFF_SUCCESS) {
+      log_error(ctx, "Failed to build suffix array.");
+      return ret;
+    }
+    stats.end(&snap_bsdiff_stats::sort);
+    stats.released(sort_bytes - sa_bytes);
+
+    sa = sa_buffer.data();
+  }
+
+  stats.begin();
+  if ((ret = packer->write_new_size(packer->state, newer_size)) != BSDIFF_SUCCESS) {
+    log_error(ctx, "Failed to write new file size.");
+    return ret;
+  }
+
+  try {
+    entry_writer writer(packer, stats);
+    if (windowed) {
+      stats.end_interleaved(&snap_bsdiff_stats::scan);
+      if ((ret = diff_windowed<Index>(ctx, older, older_size, newer, newer_size, thread_count, max_memory_bytes, writer,
+                                      progress, stats)) != BSDIFF_SUCCESS) {
+        return ret;
+      }
+      stats.begin();
+    } else if ((ret = rolling_hash
+                      ? scan_rolling_hash(older, older_size, newer, newer_size, matches, writer, progress)
+                      : scan(sa, older, older_size, newer, newer_size, matches, writer, progress)) != BSDIFF_SUCCESS) {
+      log_error(ctx, "Failed to write patch entry.");
+      return ret;
+    }
+  } catch (const std::bad_alloc &) {
+    log_error(ctx, "Failed to allocate diff buffer.");
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  if ((ret = progress.report(static_cast<uint64_t>(newer_size))) != BSDIFF_SUCCESS) {
+    return ret;
+  }
+  stats.end_interleaved(&snap_bsdiff_stats::scan);
+
+  // Blocks still buffered by the packer are compressed here.
+  stats.begin();
+  if ((ret = packer->flush(packer->state)) != BSDIFF_SUCCESS) {
+    return ret;
+  }
+  stats.end(&snap_bsdiff_stats::compress);
+
+  if (!sa_buffer.empty()) {
+    stats.released(static_cast<uint64_t>(sa_buffer.size()) * sizeof(Index));
+  }
+
+  return BSDIFF_SUCCESS;
+}
+
+}
+
+uint64_t snap::bsdiff::diff_memory_estimate(const uint64_t older_size, const uint64_t newer_size,
+                                            const snap_bsdiff_engine_type engine) {
+  if (engine == bsdiff_engine_type_rolling_hash) {
+    // The block hash table holds fewer than four slots of four bytes per 64 byte block.
+    return older_size / 4 + newer_size;
+  }
+  // The suffix sort of older and the diff block buffer which is bounded by newer.
+  return (older_size + 1) * sa_bytes_per_byte(suffix_array_width(static_cast<int64_t>(older_size))) + newer_size;
+}
+
+int snap::bsdiff::diff(struct bsdiff_ctx *ctx, const uint8_t *older, const int64_t older_size, const uint8_t *newer, const int64_t newer_size,
+                       struct bsdiff_patch_packer *packer, const diff_options *options) {
+  if ((older == nullptr && older_size > 0) || older_size < 0
+      || (newer == nullptr && newer_size > 0) || newer_size < 0
+      || packer == nullptr) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  const auto engine = options != nullptr ? options->engine : bsdiff_engine_type_prematch;
+  if (engine != bsdiff_engine_type_prematch && engine != bsdiff_engine_type_suffix_array
+      && engine != bsdiff_engine_type_rolling_hash) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  const auto index_width = options != nullptr && options->index_width != 0 ? options->index_width
+                                                                            : suffix_array_width(older_size);
+  if (index_width != sizeof(int64_t) && index_width != suffix_array_width(older_size)) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  const auto thread_count = options != nullptr ? options->thread_count : 0u;
+  const void *sa = options != nullptr ? options->suffix_array : nullptr;
+  const auto max_memory_bytes = options != nullptr ? options->max_memory_bytes : 0u;
+  progress_reporter progress(options != nullptr ? options->progress : nullptr, static_cast<uint64_t>(newer_size));
+  const auto windowed = engine != bsdiff_engine_type_rolling_hash && sa == nullptr && max_memory_bytes > 0
+    && diff_memory_estimate(static_cast<uint64_t>(older_size), static_cast<uint64_t>(newer_size)) > max_memory_bytes;
+
+  stats_recorder no_stats(nullptr);
+  auto &stats = options != nullptr && options->stats != nullptr ? *options->stats : no_stats;
+  const auto run = [&](struct bsdiff_patch_packer *target) {
+    return index_width == sizeof(uint32_t)
+      ? diff_entries(ctx, older, older_size, newer, newer_size, target, static_cast<const uint32_t *>(sa), thread_count,
+                     max_memory_bytes, windowed, engine, progress, stats)
+      : diff_entries(ctx, older, older_size, newer, newer_size, target, static_cast<const int64_t *>(sa), thread_count,
+                     max_memory_bytes, windowed, engine, progress, stats);
+  };
+  if (!stats.enabled()) {
+    return run(packer);
+  }
+
+  // Entries are counted and packer calls timed on their way to the caller's packer.
+  struct bsdiff_patch_packer counted = { nullptr };
+  auto ret = open_stats_packer(packer, &stats, &counted);
+  if (ret == BSDIFF_SUCCESS) {
+    ret = run(&counted);
+  }
+  bsdiff_close_patch_packer(&counted);
+
+  return ret;
+}
@@ -0,0 +1,282 @@
+#include "bsdiff/file.hpp"
+
+#include <bsdiff.h>
+
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <thread>
+#include <vector>
+
+#if defined(SNAP_PLATFORM_WINDOWS)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(SNAP_PLATFORM_LINUX)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(SNAP_PLATFORM_WINDOWS)
+#define snap_bsdiff_getpid ::GetCurrentProcessId
+#elif defined(SNAP_PLATFORM_LINUX)
+#define snap_bsdiff_getpid ::getpid
+#endif
+
+namespace {
+
+constexpr size_t file_sink_buffer_size = 1024 * 1024;
+
+struct file_sink_state {
+  std::FILE *file;
+  std::vector<uint8_t> buffer;
+  size_t used;
+};
+
+int file_sink_drain(file_sink_state *p_state) {
+  if (p_state->used > 0 && std::fwrite(p_state->buffer.data(), 1, p_state->used, p_state->file) != p_state->used) {
+    return BSDIFF_FILE_ERROR;
+  }
+  p_state->used = 0;
+  return BSDIFF_SUCCESS;
+}
+
+void file_sink_close(void *state) {
+  auto *p_state = static_cast<file_sink_state *>(state);
+  std::fclose(p_state->file);
+  delete p_state;
+}
+
+int file_sink_get_mode(void *) {
+  return BSDIFF_MODE_WRITE;
+}
+
+int file_sink_seek(void *, int64_t, int) {
+  return BSDIFF_INVALID_ARG;
+}
+
+int file_sink_tell(void *, int64_t *) {
+  return BSDIFF_INVALID_ARG;
+}
+
+int file_sink_read(void *, void *, size_t, size_t *) {
+  return BSDIFF_INVALID_ARG;
+}
+
+int file_sink_write(void *state, const void *buffer, const size_t size) {
+  auto *p_state = static_cast<file_sink_state *>(state);
+  const auto *p_buffer = static_cast<const uint8_t *>(buffer);
+
+  if (p_state->used + size <= p_state->buffer.size()) {
+    std::memcpy(p_state->buffer.data() + p_state->used, p_buffer, size);
+    p_state->used += size;
+    return BSDIFF_SUCCESS;
+  }
+
+  int ret;
+  if ((ret = file_sink_drain(p_state)) != BSDIFF_SUCCESS) {
+    return ret;
+  }
+
+  // Large writes skip the buffer.
+  if (size >= p_state->buffer.size()) {
+    return std::fwrite(p_buffer, 1, size, p_state->file) == size ? BSDIFF_SUCCESS : BSDIFF_FILE_ERROR;
+  }
+
+  std::memcpy(p_state->buffer.data(), p_buffer, size);
+  p_state->used = size;
+  return BSDIFF_SUCCESS;
+}
+
+int file_sink_flush(void *state) {
+  auto *p_state = static_cast<file_sink_state *>(state);
+  int ret;
+  if ((ret = file_sink_drain(p_state)) != BSDIFF_SUCCESS) {
+    return ret;
+  }
+  return std::fflush(p_state->file) == 0 ? BSDIFF_SUCCESS : BSDIFF_FILE_ERROR;
+}
+
+int file_sink_get_buffer(void *, const void **, size_t *) {
+  return BSDIFF_INVALID_ARG;
+}
+
+}
+
+snap::bsdiff::mapped_file::mapped_file() :
+    m_data(nullptr),
+    m_size(0),
+#if defined(SNAP_PLATFORM_WINDOWS)
+    m_file(INVALID_HANDLE_VALUE),
+    m_mapping(nullptr)
+#elif defined(SNAP_PLATFORM_LINUX)
+    m_fd(-1)
+#endif
+{
+}
+
+snap::bsdiff::mapped_file::~mapped_file() {
+  close();
+}
+
+int snap::bsdiff::mapped_file::open(const char *path) {
+  close();
+
+  if (path == nullptr) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+#if defined(SNAP_PLATFORM_WINDOWS)
+  m_file = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (m_file == INVALID_HANDLE_VALUE) {
+    return BSDIFF_FILE_ERROR;
+  }
+
+  LARGE_INTEGER size;
+  if (!::GetFileSizeEx(m_file, &size)) {
+    close();
+    return BSDIFF_FILE_ERROR;
+  }
+
+  if (static_cast<uint64_t>(size.QuadPart) > SIZE_MAX) {
+    close();
+    return BSDIFF_SIZE_TOO_LARGE;
+  }
+
+  m_size = static_cast<size_t>(size.QuadPart);
+  if (m_size == 0) {
+    // Empty files cannot be mapped.
+    return BSDIFF_SUCCESS;
+  }
+
+  m_mapping = ::CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (m_mapping == nullptr) {
+    close();
+    return BSDIFF_FILE_ERROR;
+  }
+
+  m_data = static_cast<const uint8_t *>(::MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+  if (m_data == nullptr) {
+    close();
+    return BSDIFF_FILE_ERROR;
+  }
+#elif defined(SNAP_PLATFORM_LINUX)
+  m_fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (m_fd == -1) {
+    return BSDIFF_FILE_ERROR;
+  }
+
+  struct stat st = {};
+  if (::fstat(m_fd, &st) != 0) {
+    close();
+    return BSDIFF_FILE_ERROR;
+  }
+
+  m_size = static_cast<size_t>(st.st_size);
+  if (m_size == 0) {
+    // Empty files cannot be mapped.
+    return BSDIFF_SUCCESS;
+  }
+
+  auto *data = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+  if (data == MAP_FAILED) {
+    close();
+    return BSDIFF_FILE_ERROR;
+  }
+
+  m_data = static_cast<const uint8_t *>(data);
+#endif
+
+  return BSDIFF_SUCCESS;
+}
+
+void snap::bsdiff::mapped_file::close() {
+#if defined(SNAP_PLATFORM_WINDOWS)
+  if (m_data != nullptr) {
+    ::UnmapViewOfFile(m_data);
+  }
+  if (m_mapping != nullptr) {
+    ::CloseHandle(m_mapping);
+    m_mapping = nullptr;
+  }
+  if (m_file != INVALID_HANDLE_VALUE) {
+    ::CloseHandle(m_file);
+    m_file = INVALID_HANDLE_VALUE;
+  }
+#elif defined(SNAP_PLATFORM_LINUX)
+  if (m_data != nullptr) {
+    ::munmap(const_cast<uint8_t *>(m_data), m_size);
+  }
+  if (m_fd != -1) {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+#endif
+  m_data = nullptr;
+  m_size = 0;
+}
+
+std::string snap::bsdiff::temporary_path(const std::string &path) {
+  const auto thread_id = std::hash<std::thread::id>{}(std::this_thread::get_id());
+  return path + "." + std::to_string(snap_bsdiff_getpid()) + "." + std::to_string(thread_id) + ".tmp";
+}
+
+int snap::bsdiff::replace_file(const std::string &source, const std::string &destination) {
+#if defined(SNAP_PLATFORM_WINDOWS)
+  if (!::MoveFileExA(source.c_str(), destination.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+    return BSDIFF_FILE_ERROR;
+  }
+#elif defined(SNAP_PLATFORM_LINUX)
+  if (std::rename(source.c_str(), destination.c_str()) != 0) {
+    return BSDIFF_FILE_ERROR;
+  }
+#endif
+  return BSDIFF_SUCCESS;
+}
+
+int snap::bsdiff::open_file_sink(const char *path, struct bsdiff_stream *stream) {
+  if (path == nullptr || stream == nullptr) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  auto *p_state = new (std::nothrow) file_sink_state{ nullptr, {}, 0 };
+  if (p_state == nullptr) {
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  try {
+    p_state->buffer.resize(file_sink_buffer_size);
+  } catch (const std::bad_alloc &) {
+    delete p_state;
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  if ((p_state->file = std::fopen(path, "wb")) == nullptr) {
+    delete p_state;
+    return BSDIFF_FILE_ERROR;
+  }
+
+  // Everything reaching the file is already buffered here.
+  std::setvbuf(p_state->file, nullptr, _IONBF, 0);
+
+  std::memset(stream, 0, sizeof(*stream));
+  stream->state = p_state;
+  stream->close = file_sink_close;
+  stream->get_mode = file_sink_get_mode;
+  stream->seek = file_sink_seek;
+  stream->tell = file_sink_tell;
+  stream->read = file_sink_read;
+  stream->write = file_sink_write;
+  stream->flush = file_sink_flush;
+  stream->get_buffer = file_sink_get_buffer;
+
+  return BSDIFF_SUCCESS;
+}
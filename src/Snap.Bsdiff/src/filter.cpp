@@ -0,0 +1,310 @@
+#include "bsdiff/filter.hpp"
+#include "bsdiff/lib.hpp"
+
+#include <algorithm>
+
+namespace {
+
+uint64_t load_le(const uint8_t *data, const size_t size, const uint64_t offset, const int bytes) {
+  if (offset > size || static_cast<uint64_t>(bytes) > size - offset) {
+    return 0;
+  }
+  uint64_t value = 0;
+  for (auto i = bytes - 1; i >= 0; --i) {
+    value = (value << 8) | data[offset + static_cast<uint64_t>(i)];
+  }
+  return value;
+}
+
+uint32_t load_le32(const uint8_t *data) {
+  return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8)
+         | (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+void store_le32(uint8_t *data, const uint32_t value) {
+  data[0] = static_cast<uint8_t>(value);
+  data[1] = static_cast<uint8_t>(value >> 8);
+  data[2] = static_cast<uint8_t>(value >> 16);
+  data[3] = static_cast<uint8_t>(value >> 24);
+}
+
+// Header fields are read through this, anything outside of the file reads as zero so a
+// truncated or hostile image yields no ranges instead of reading out of bounds.
+class image final {
+  const uint8_t *m_data;
+  size_t m_size;
+
+public:
+  image(const uint8_t *data, const size_t size) : m_data(data), m_size(size) {}
+
+  uint64_t u8(const uint64_t offset) const { return load_le(m_data, m_size, offset, 1); }
+  uint64_t u16(const uint64_t offset) const { return load_le(m_data, m_size, offset, 2); }
+  uint64_t u32(const uint64_t offset) const { return load_le(m_data, m_size, offset, 4); }
+  uint64_t u64(const uint64_t offset) const { return load_le(m_data, m_size, offset, 8); }
+  size_t size() const { return m_size; }
+};
+
+void add_range(snap::bsdiff::executable_layout &layout, const image &file, const uint64_t offset, const uint64_t size) {
+  if (offset >= file.size() || size == 0) {
+    return;
+  }
+  const auto end = offset + std::min<uint64_t>(size, file.size() - offset);
+  layout.ranges.push_back({ static_cast<int64_t>(offset), static_cast<int64_t>(end - offset) });
+}
+
+snap::bsdiff::filter_arch elf_arch(const uint64_t machine) {
+  switch (machine) {
+    case 3:   // EM_386
+    case 62:  // EM_X86_64
+      return snap::bsdiff::filter_arch::x86;
+    case 183: // EM_AARCH64
+      return snap::bsdiff::filter_arch::arm64;
+    default:
+      return snap::bsdiff::filter_arch::none;
+  }
+}
+
+// Code is taken from the sections flagged SHF_EXECINSTR, or from the PF_X segments when
+// the section headers were stripped.
+void detect_elf(const image &file, snap::bsdiff::executable_layout &layout) {
+  const auto is64 = file.u8(4) == 2;
+  if ((file.u8(4) != 1 && !is64) || file.u8(5) != 1) {
+    return;
+  }
+
+  layout.arch = elf_arch(file.u16(18));
+  if (layout.arch == snap::bsdiff::filter_arch::none) {
+    return;
+  }
+
+  const auto section_offset = is64 ? file.u64(40) : file.u32(32);
+  const auto section_size = file.u16(is64 ? 58 : 46);
+  const auto section_count = file.u16(is64 ? 60 : 48);
+  for (uint64_t i = 0; i < section_count && section_offset < file.size(); i++) {
+    const auto header = section_offset + i * section_size;
+    const auto type = file.u32(header + 4);
+    const auto flags = is64 ? file.u64(header + 8) : file.u32(header + 8);
+    constexpr uint64_t shf_execinstr = 0x4;
+    constexpr uint64_t sht_nobits = 8;
+    if ((flags & shf_execinstr) != 0 && type != sht_nobits) {
+      add_range(layout, file, is64 ? file.u64(header + 24) : file.u32(header + 16),
+                is64 ? file.u64(header + 32) : file.u32(header + 20));
+    }
+  }
+
+  if (!layout.ranges.empty()) {
+    return;
+  }
+
+  const auto program_offset = is64 ? file.u64(32) : file.u32(28);
+  const auto program_size = file.u16(is64 ? 54 : 42);
+  const auto program_count = file.u16(is64 ? 56 : 44);
+  for (uint64_t i = 0; i < program_count && program_offset < file.size(); i++) {
+    const auto header = program_offset + i * program_size;
+    const auto flags = is64 ? file.u32(header + 4) : file.u32(header + 24);
+    constexpr uint64_t pt_load = 1;
+    constexpr uint64_t pf_x = 0x1;
+    if (file.u32(header) == pt_load && (flags & pf_x) != 0) {
+      add_range(layout, file, is64 ? file.u64(header + 8) : file.u32(header + 4),
+                is64 ? file.u64(header + 32) : file.u32(header + 16));
+    }
+  }
+}
+
+// Code is taken from the sections flagged as code or executable. 32-bit images with a CLR
+// header are IL assemblies without native code, the filter would only add noise to them.
+void detect_pe(const image &file, snap::bsdiff::executable_layout &layout) {
+  const auto pe_offset = file.u32(0x3c);
+  if (file.u32(pe_offset) != 0x00004550) {
+    return;
+  }
+
+  const auto machine = file.u16(pe_offset + 4);
+  switch (machine) {
+    case 0x14c:  // IMAGE_FILE_MACHINE_I386
+    case 0x8664: // IMAGE_FILE_MACHINE_AMD64
+      layout.arch = snap::bsdiff::filter_arch::x86;
+      break;
+    case 0xaa64: // IMAGE_FILE_MACHINE_ARM64
+      layout.arch = snap::bsdiff::filter_arch::arm64;
+      break;
+    default:
+      return;
+  }
+
+  const auto section_count = file.u16(pe_offset + 6);
+  const auto optional_size = file.u16(pe_offset + 20);
+  const auto optional_offset = pe_offset + 24;
+
+  const auto pe32_plus = file.u16(optional_offset) == 0x20b;
+  const auto directory_count = file.u32(optional_offset + (pe32_plus ? 108 : 92));
+  const auto directories = optional_offset + (pe32_plus ? 112 : 96);
+  constexpr uint64_t clr_directory = 14;
+  if (machine == 0x14c && directory_count > clr_directory && file.u32(directories + clr_directory * 8) != 0) {
+    layout.arch = snap::bsdiff::filter_arch::none;
+    return;
+  }
+
+  const auto sections = optional_offset + optional_size;
+  for (uint64_t i = 0; i < section_count; i++) {
+    const auto header = sections + i * 40;
+    const auto characteristics = file.u32(header + 36);
+    constexpr uint64_t scn_cnt_code = 0x20;
+    constexpr uint64_t scn_mem_execute = 0x20000000;
+    if ((characteristics & (scn_cnt_code | scn_mem_execute)) != 0) {
+      add_range(layout, file, file.u32(header + 20), file.u32(header + 16));
+    }
+  }
+}
+
+// Bytes taken by the instruction at data, which lies at offset in the file. The opcode is
+// never rewritten, so encoder and decoder always step through the same instructions.
+size_t instruction_size(const snap::bsdiff::filter_arch arch, const uint8_t *data, const int64_t offset) {
+  if (arch == snap::bsdiff::filter_arch::x86) {
+    return data[0] == 0xe8 || data[0] == 0xe9 ? 5 : 1;
+  }
+  return offset % 4 == 0 ? 4 : 1;
+}
+
+void convert(const snap::bsdiff::filter_arch arch, uint8_t *instruction, const int64_t offset, const bool encode) {
+  if (arch == snap::bsdiff::filter_arch::x86) {
+    // Only near targets, whose displacement ends in 0x00 or 0xff, are rewritten. The result
+    // is kept as a sign extended 25 bit value, so it again ends in 0x00 or 0xff and the
+    // decoder recognizes it.
+    if (instruction[4] != 0x00 && instruction[4] != 0xff) {
+      return;
+    }
+    const auto position = static_cast<uint32_t>(offset + 5);
+    auto value = load_le32(instruction + 1);
+    value = (encode ? value + position : value - position) & 0x01ffffff;
+    if ((value & 0x01000000) != 0) {
+      value |= 0xff000000;
+    }
+    store_le32(instruction + 1, value);
+    return;
+  }
+
+  const auto value = load_le32(instruction);
+  if ((value & 0xfc000000) != 0x94000000) {
+    return;
+  }
+  const auto position = static_cast<uint32_t>(offset >> 2);
+  const auto target = encode ? value + position : value - position;
+  store_le32(instruction, 0x94000000 | (target & 0x03ffffff));
+}
+
+}
+
+snap::bsdiff::executable_layout snap::bsdiff::detect_executable(const uint8_t *data, const size_t size) {
+  executable_layout layout = { filter_arch::none, {} };
+  const image file(data, size);
+
+  if (file.u32(0) == 0x464c457f) {
+    detect_elf(file, layout);
+  } else if (file.u16(0) == 0x5a4d) {
+    detect_pe(file, layout);
+  }
+
+  if (layout.ranges.empty()) {
+    layout.arch = filter_arch::none;
+    return layout;
+  }
+
+  std::sort(layout.ranges.begin(), layout.ranges.end(), [](const filter_range &lhs, const filter_range &rhs) {
+    return lhs.offset < rhs.offset;
+  });
+
+  // Overlapping or adjacent sections are merged.
+  size_t count = 0;
+  for (const auto &range : layout.ranges) {
+    if (count > 0 && range.offset <= layout.ranges[count - 1].offset + layout.ranges[count - 1].size) {
+      auto &last = layout.ranges[count - 1];
+      last.size = std::max(last.size, range.offset + range.size - last.offset);
+    } else {
+      layout.ranges[count++] = range;
+    }
+  }
+  layout.ranges.resize(count);
+
+  return layout;
+}
+
+void snap::bsdiff::filter_encode(const executable_layout &layout, uint8_t *data, const size_t size) {
+  for (const auto &range : layout.ranges) {
+    const auto end = std::min<int64_t>(range.offset + range.size, static_cast<int64_t>(size));
+    for (auto offset = range.offset; offset < end;) {
+      const auto length = static_cast<int64_t>(instruction_size(layout.arch, data + offset, offset));
+      // An instruction cut off by the end of the section ends it, the decoder does the same.
+      if (offset + length > end) {
+        break;
+      }
+      if (length > 1) {
+        convert(layout.arch, data + offset, offset, true);
+      }
+      offset += length;
+    }
+  }
+}
+
+void snap::bsdiff::filter_encode_as(const filter_arch arch, uint8_t *data, const size_t size) {
+  const auto layout = detect_executable(data, size);
+  if (layout.arch == arch) {
+    filter_encode(layout, data, size);
+  }
+}
+
+snap::bsdiff::filter_decoder::filter_decoder(const executable_layout &layout) :
+    m_layout(layout),
+    m_range(0),
+    m_buffer(),
+    m_base(0),
+    m_next(0) {
+}
+
+int snap::bsdiff::filter_decoder::write(const uint8_t *data, const size_t size, const emit_function &emit) {
+  m_buffer.insert(m_buffer.end(), data, data + size);
+  return drain(false, emit);
+}
+
+int snap::bsdiff::filter_decoder::finish(const emit_function &emit) {
+  return drain(true, emit);
+}
+
+int snap::bsdiff::filter_decoder::drain(const bool final, const emit_function &emit) {
+  const auto &ranges = m_layout.ranges;
+  const auto end_of_data = m_base + static_cast<int64_t>(m_buffer.size());
+
+  while (m_next < end_of_data) {
+    if (m_range == ranges.size() || m_next < ranges[m_range].offset) {
+      m_next = m_range == ranges.size() ? end_of_data : std::min(end_of_data, ranges[m_range].offset);
+      continue;
+    }
+
+    const auto range_end = ranges[m_range].offset + ranges[m_range].size;
+    auto *instruction = m_buffer.data() + (m_next - m_base);
+    const auto length = static_cast<int64_t>(instruction_size(m_layout.arch, instruction, m_next));
+    if (m_next + length > range_end) {
+      m_range++;
+      continue;
+    }
+    if (m_next + length > end_of_data) {
+      break;
+    }
+    if (length > 1) {
+      convert(m_layout.arch, instruction, m_next, false);
+    }
+    m_next += length;
+  }
+
+  const auto count = static_cast<size_t>((final ? end_of_data : m_next) - m_base);
+  if (count == 0) {
+    return BSDIFF_SUCCESS;
+  }
+
+  const auto ret = emit(m_buffer.data(), count);
+  m_buffer.erase(m_buffer.begin(), m_buffer.begin() + static_cast<std::ptrdiff_t>(count));
+  m_base += static_cast<int64_t>(count);
+  m_next = std::max(m_next, m_base);
+
+  return ret;
+}
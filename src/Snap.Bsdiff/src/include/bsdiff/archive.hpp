@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace snap::bsdiff {
+
+// A deflate compressed entry of a zip archive.
+struct archive_entry {
+  // Offset and size of the compressed bytes in the archive.
+  int64_t offset;
+  int64_t compressed_size;
+  int64_t uncompressed_size;
+  // zlib level that compresses the entry back to the same bytes.
+  int32_t level;
+};
+
+// How the archive filter rewrote the two files of a patch. Entries are sorted by offset.
+struct archive_layout {
+  // Entries of older that are replaced by their uncompressed bytes, level is unused.
+  std::vector<archive_entry> older;
+  // Entries of newer that are replaced by their uncompressed bytes and compressed again
+  // while the patch is applied.
+  std::vector<archive_entry> newer;
+  // Size of newer itself, the patch produces the expanded form.
+  int64_t newer_size;
+};
+
+// Whether the archive filter changed either file.
+inline bool archive_expanded(const archive_layout &layout) {
+  return !layout.older.empty() || !layout.newer.empty();
+}
+
+// Whether the library was built with zlib, the archive filter is unavailable otherwise.
+bool archive_supported();
+
+// Returns the deflate entries of a zip archive, nothing for any other file. With
+// recompress only entries that zlib reproduces bit for bit are returned, level then holds
+// the level that does. Throws std::bad_alloc.
+std::vector<archive_entry> find_archive_entries(const uint8_t *data, size_t size, bool recompress);
+
+// Writes data to expanded with every entry replaced by its uncompressed bytes. Fails with
+// BSDIFF_CORRUPT_PATCH when an entry does not lie within data or does not inflate to its
+// size. Throws std::bad_alloc.
+int archive_expand(const uint8_t *data, size_t size, const std::vector<archive_entry> &entries,
+                   std::vector<uint8_t> &expanded);
+
+// Turns an expanded file, produced front to back, back into the archive. The bytes of an
+// entry are held until the entry is complete, everything else passes straight through.
+class archive_encoder final {
+public:
+  using emit_function = std::function<int(const uint8_t *data, size_t size)>;
+
+  // Throws std::bad_alloc.
+  explicit archive_encoder(const std::vector<archive_entry> &entries);
+
+  // Encodes data, which continues the expanded file. Throws std::bad_alloc.
+  int write(const uint8_t *data, size_t size, const emit_function &emit);
+  // Fails with BSDIFF_CORRUPT_PATCH when the expanded file ended inside an entry.
+  int finish(const emit_function &emit);
+
+private:
+  int compress_ready(const emit_function &emit);
+
+  const std::vector<archive_entry> &m_entries;
+  // Offset of every entry in the expanded file.
+  std::vector<int64_t> m_starts;
+  size_t m_entry;
+  int64_t m_position;
+  std::vector<uint8_t> m_buffer;
+  std::vector<uint8_t> m_compressed;
+};
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace snap::bsdiff {
+
+// Completion state of work started by run_async, shared between the worker running it and
+// the handle of the caller so either side may go away first.
+class async_operation final {
+  std::mutex m_mutex;
+  std::condition_variable m_completed_changed;
+  bool m_completed;
+  int32_t m_result;
+
+public:
+  async_operation();
+  async_operation(const async_operation &) = delete;
+  async_operation &operator=(const async_operation &) = delete;
+
+  void complete(int32_t result);
+  // Waits up to timeout_ms, 0 only polls and UINT32_MAX waits until completion. Returns
+  // whether the work has completed and sets result if so.
+  bool wait(uint32_t timeout_ms, int32_t *result);
+};
+
+// Runs work on the worker pool of the library, which starts with one worker per hardware
+// thread on first use and lives until the process exits. on_complete is called on the
+// worker with the result of work before operation completes, so a caller that waited for
+// operation knows that on_complete has returned.
+int run_async(const std::shared_ptr<async_operation> &operation, std::function<int32_t()> work,
+              std::function<void(int32_t)> on_complete);
+
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace snap::bsdiff {
+
+struct batch_options {
+  // Concurrent items, 0 uses all hardware threads.
+  uint32_t thread_count;
+  // Upper bound for the summed memory estimate of running items, 0 means unlimited.
+  uint64_t max_memory_bytes;
+};
+
+// Calls run(i) for every item on a work-stealing pool. Items are started largest estimate
+// first and each one holds estimate(i) bytes of the memory budget while it runs.
+void run_batch(size_t count, const batch_options &options,
+               const std::function<uint64_t(size_t)> &estimate,
+               const std::function<void(size_t)> &run);
+
+}
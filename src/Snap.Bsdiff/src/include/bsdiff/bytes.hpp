@@ -0,0 +1,53 @@
+#pragma once
+
+#include "bsdiff/cpu.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace snap::bsdiff {
+
+// The byte loops of the diff scan and of applying a patch. Every set computes exactly the
+// same results, they only differ in the instructions used.
+struct byte_kernel_set {
+  // Length of the common prefix of a and b, at most size.
+  size_t (*common_prefix)(const uint8_t *a, const uint8_t *b, size_t size);
+  // Number of positions at which a and b hold the same byte.
+  size_t (*count_equal)(const uint8_t *a, const uint8_t *b, size_t size);
+  // Bit i is set when a[i] == b[i], for the 64 bytes at a and b.
+  uint64_t (*equal_mask)(const uint8_t *a, const uint8_t *b);
+  // dst[i] += src[i], wrapping around.
+  void (*add)(uint8_t *dst, const uint8_t *src, size_t size);
+  // dst[i] = a[i] - b[i], wrapping around.
+  void (*subtract)(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t size);
+};
+
+extern const byte_kernel_set byte_kernels_portable;
+
+#if defined(SNAP_BSDIFF_X86)
+// Requires cpu_features().sse41.
+extern const byte_kernel_set byte_kernels_sse41;
+// Requires cpu_features().avx2.
+extern const byte_kernel_set byte_kernels_avx2;
+#endif
+
+// The set for the widest instruction set of the CPU, selected once.
+const byte_kernel_set &byte_kernels();
+
+inline uint64_t popcount64(uint64_t value) {
+  value = value - ((value >> 1) & 0x5555555555555555ULL);
+  value = (value & 0x3333333333333333ULL) + ((value >> 2) & 0x3333333333333333ULL);
+  value = (value + (value >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return (value * 0x0101010101010101ULL) >> 56;
+}
+
+inline uint64_t reverse_bits64(uint64_t value) {
+  value = ((value >> 1) & 0x5555555555555555ULL) | ((value & 0x5555555555555555ULL) << 1);
+  value = ((value >> 2) & 0x3333333333333333ULL) | ((value & 0x3333333333333333ULL) << 2);
+  value = ((value >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((value & 0x0f0f0f0f0f0f0f0fULL) << 4);
+  value = ((value >> 8) & 0x00ff00ff00ff00ffULL) | ((value & 0x00ff00ff00ff00ffULL) << 8);
+  value = ((value >> 16) & 0x0000ffff0000ffffULL) | ((value & 0x0000ffff0000ffffULL) << 16);
+  return (value >> 32) | (value << 32);
+}
+
+}
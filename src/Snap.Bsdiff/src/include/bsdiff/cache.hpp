@@ -0,0 +1,50 @@
+#pragma once
+
+#include "bsdiff/file.hpp"
+#include "bsdiff/lib.hpp"
+#include "bsdiff/sha256.hpp"
+
+#include <string>
+
+namespace snap::bsdiff {
+
+// Identifies a diff result: the digests of older and newer and every option that changes
+// the patch. thread_count and the index never do, so they are not part of it.
+struct diff_cache_key {
+  uint8_t digest[sha256_digest_size];
+};
+
+diff_cache_key make_diff_cache_key(const uint8_t older_sha256[sha256_digest_size], const uint8_t newer_sha256[sha256_digest_size],
+                                   const snap_bsdiff_packer_options &packer, snap_bsdiff_filter_type filter,
+                                   snap_bsdiff_engine_type engine, uint64_t max_memory_bytes);
+
+// Directory of patches named after their key, shared by any number of threads and
+// processes. An entry is written to a temporary file and renamed into place, so readers
+// only ever see complete entries, and concurrent inserts of the same key are harmless
+// since they write the same bytes. The modification time of an entry is its last use.
+//
+// The cache only ever speeds up a diff: find misses and insert gives up on any error.
+class diff_cache final {
+  std::string m_path;
+  uint64_t m_max_bytes;
+
+public:
+  // A path of nullptr disables the cache, max_bytes of 0 never evicts.
+  diff_cache(const char *path, uint64_t max_bytes);
+
+  bool enabled() const { return !m_path.empty(); }
+
+  // Maps the patch stored under key into file and marks it used. False on a miss or when
+  // the cache is disabled.
+  bool find(const diff_cache_key &key, mapped_file &file) const;
+
+  // Stores patch under key, then evicts the least recently used entries until the cache
+  // fits max_bytes again.
+  void insert(const diff_cache_key &key, const uint8_t *patch, size_t patch_size) const;
+
+private:
+  std::string entry_path(const diff_cache_key &key) const;
+  void evict() const;
+};
+
+}
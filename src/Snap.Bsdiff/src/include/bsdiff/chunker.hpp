@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace snap::bsdiff {
+
+// Chunk sizes used when the caller leaves them at zero. Large enough that the manifest of
+// a release stays small, small enough that an edit only invalidates a few chunks.
+constexpr uint32_t chunk_default_min_size = 16 * 1024;
+constexpr uint32_t chunk_default_avg_size = 64 * 1024;
+constexpr uint32_t chunk_default_max_size = 256 * 1024;
+
+struct chunk_params {
+  uint32_t min_size;
+  // Power of two.
+  uint32_t avg_size;
+  uint32_t max_size;
+};
+
+// Returns the size of the content defined chunk at the start of data, using FastCDC with
+// normalized chunking. Cut points only depend on the bytes just before them, so an insert
+// or delete moves the boundaries around it and leaves all others in place. The result is
+// stable across versions and platforms, chunks can be compared with those of any earlier
+// release.
+size_t next_chunk(const uint8_t *data, size_t size, const chunk_params &params);
+
+}
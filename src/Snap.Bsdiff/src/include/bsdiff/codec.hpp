@@ -0,0 +1,48 @@
+#pragma once
+
+#include "bsdiff/lib.hpp"
+
+#include <memory>
+#include <vector>
+
+namespace snap::bsdiff {
+
+// Compressed byte stream layered on top of a bsdiff_stream, used by the patch packers. A
+// codec is opened either for writing or for reading and only supports that direction.
+class patch_codec {
+public:
+  patch_codec() = default;
+  patch_codec(const patch_codec &) = delete;
+  patch_codec &operator=(const patch_codec &) = delete;
+  virtual ~patch_codec() = default;
+
+  virtual int write(const uint8_t *data, size_t size) = 0;
+  // Ends the compressed stream, nothing may be written after this.
+  virtual int finish() = 0;
+  // Fills data completely, or returns BSDIFF_END_OF_FILE with readed set to what was available.
+  virtual int read(uint8_t *data, size_t size, size_t *readed) = 0;
+};
+
+// One shot codec used for independent blocks. compress replaces frame with a complete
+// frame, decompress must produce exactly size bytes.
+struct block_format {
+  int (*compress)(int32_t level, uint32_t window_log, const uint8_t *data, size_t size, std::vector<uint8_t> &frame);
+  int (*decompress)(const uint8_t *frame, size_t frame_size, uint8_t *data, size_t size);
+};
+
+int open_stored_codec(int mode, struct bsdiff_stream *stream, std::unique_ptr<patch_codec> &codec);
+#ifdef SNAP_BSDIFF_ZSTD
+int open_zstd_codec(int mode, struct bsdiff_stream *stream, int32_t level, uint32_t window_log, std::unique_ptr<patch_codec> &codec);
+extern const block_format zstd_block_format;
+#endif
+#ifdef SNAP_BSDIFF_LZ4
+int open_lz4_codec(int mode, struct bsdiff_stream *stream, int32_t level, std::unique_ptr<patch_codec> &codec);
+extern const block_format lz4_block_format;
+#endif
+
+// Splits the stream into block_size blocks that are compressed, or decompressed, on up to
+// thread_count threads. See codec_block.cpp for the layout.
+int open_block_codec(int mode, struct bsdiff_stream *stream, const block_format *format, int32_t level, uint32_t window_log,
+                     uint32_t block_size, uint32_t thread_count, std::unique_ptr<patch_codec> &codec);
+
+}
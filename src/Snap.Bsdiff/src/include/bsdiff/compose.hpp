@@ -0,0 +1,54 @@
+#pragma once
+
+#include "bsdiff/lib.hpp"
+#include "bsdiff/packer.hpp"
+
+#include <vector>
+
+namespace snap::bsdiff {
+
+// Folds a chain of patches, each made against the output of the one before, into a single
+// patch from the older file of the first to the newer file of the last.
+//
+// Every byte a patch produces is an older byte plus a diff byte, or an extra byte. Mapping
+// the older bytes of each patch through the patches before it therefore leaves every byte
+// of the final file as a byte of the first older file plus the sum of the diff bytes along
+// the way, or a literal. No file of the chain is ever read, the work and memory are bound
+// by the size of the files the patches produce.
+class patch_chain final {
+public:
+  patch_chain();
+
+  // Appends the patch read from packer, digests are those of its header. Fails with
+  // bsdiff_status_type_digest_mismatch when the digests show that the patch was not made
+  // against the output of the chain so far.
+  int add(struct bsdiff_ctx *ctx, struct bsdiff_patch_packer *packer, const patch_digests &digests);
+
+  // Digests for the header of the composed patch, present when every patch had them.
+  const patch_digests &digests() const { return m_digests; }
+
+  // Writes the composed patch to packer.
+  int write(struct bsdiff_ctx *ctx, struct bsdiff_patch_packer *packer) const;
+
+private:
+  // A run of the output, either older[older_offset, older_offset + length) plus the delta
+  // bytes or the delta bytes alone.
+  struct segment {
+    int64_t newer_offset;
+    int64_t length;
+    int64_t older_offset;
+    bool literal;
+  };
+
+  int map(int64_t older_pos, int64_t length, int64_t newer_pos, std::vector<segment> &segments,
+          std::vector<uint8_t> &delta) const;
+  static void append(std::vector<segment> &segments, const segment &run);
+
+  std::vector<segment> m_segments;
+  std::vector<uint8_t> m_delta;
+  int64_t m_size;
+  size_t m_count;
+  patch_digests m_digests;
+};
+
+}
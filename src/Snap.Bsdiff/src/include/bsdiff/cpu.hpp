@@ -0,0 +1,26 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SNAP_BSDIFF_X86 1
+#endif
+
+// Compiles a single function for an instruction set the rest of the library does not
+// assume, callers must check cpu_features() first. MSVC accepts the intrinsics anywhere.
+#if defined(__GNUC__) || defined(__clang__)
+#define SNAP_BSDIFF_TARGET(features) __attribute__((target(features)))
+#else
+#define SNAP_BSDIFF_TARGET(features)
+#endif
+
+namespace snap::bsdiff {
+
+// Instruction sets available at runtime, detected once. Everything is false off x86.
+struct cpu_feature_set {
+  bool sse41;
+  bool avx2;
+  bool sha;
+};
+
+const cpu_feature_set &cpu_features();
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "bsdiff/lib.hpp"
+#include "bsdiff/stats.hpp"
+
+namespace snap::bsdiff {
+
+struct diff_options {
+  // Threads used to build the suffix array, 0 uses all hardware threads.
+  uint32_t thread_count;
+  // Prebuilt suffix array of older (older_size + 1 entries of index_width bytes), skips the
+  // sort when set.
+  const void *suffix_array;
+  // Width of the suffix array entries, 0 uses suffix_array_width(older_size). 8 is always
+  // accepted and gives the same patch as 4, which only fits older below 4 GiB.
+  size_t index_width;
+  // When diff_memory_estimate exceeds this budget older and newer are diffed in windows
+  // that fit it. 0 means unlimited. Ignored when suffix_array is set.
+  uint64_t max_memory_bytes;
+  // Receives progress over newer and may cancel the diff, nullptr runs without.
+  const snap_bsdiff_progress *progress;
+  // Receives the sort, scan and compress phases and the entries written, nullptr runs without.
+  stats_recorder *stats;
+  // suffix_array and max_memory_bytes don't apply to the rolling hash engine, prematch is
+  // ignored when the diff is windowed.
+  snap_bsdiff_engine_type engine;
+};
+
+// Approximate peak memory used by diff besides the caller's buffers and the patch.
+uint64_t diff_memory_estimate(uint64_t older_size, uint64_t newer_size,
+                              snap_bsdiff_engine_type engine = bsdiff_engine_type_prematch);
+
+// Computes a patch turning older into newer and writes it to packer.
+//
+// This is the bsdiff algorithm (suffix array search followed by the forward/backward
+// extension scan) operating directly on the caller's buffers, so the output is
+// interchangeable with bsdiff and is applied by bspatch or snap::bsdiff::patch. The prematch
+// engine follows runs found by block hashing instead of searching the suffix array there,
+// the rolling hash engine writes the same entries from block hash matches alone.
+int diff(struct bsdiff_ctx *ctx, const uint8_t *older, int64_t older_size, const uint8_t *newer, int64_t newer_size,
+         struct bsdiff_patch_packer *packer, const diff_options *options = nullptr);
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct bsdiff_stream;
+
+namespace snap::bsdiff {
+
+// Read-only memory mapping of a whole file.
+class mapped_file final {
+  const uint8_t *m_data;
+  size_t m_size;
+#if defined(SNAP_PLATFORM_WINDOWS)
+  void *m_file;
+  void *m_mapping;
+#elif defined(SNAP_PLATFORM_LINUX)
+  int m_fd;
+#endif
+
+public:
+  mapped_file();
+  mapped_file(const mapped_file &) = delete;
+  mapped_file &operator=(const mapped_file &) = delete;
+  ~mapped_file();
+
+  // Returns a BSDIFF_* status code.
+  int open(const char *path);
+  void close();
+
+  const uint8_t *data() const { return m_data; }
+  size_t size() const { return m_size; }
+};
+
+// Write only bsdiff_stream that creates or truncates path. Writes are collected in a large
+// buffer and handed to the file in big chunks, flush writes out whatever is buffered and
+// reports any error of the file.
+int open_file_sink(const char *path, struct bsdiff_stream *stream);
+
+// A sibling of path that is unique to the calling process and thread, for writing a file
+// that is then moved into place with replace_file.
+std::string temporary_path(const std::string &path);
+
+// Atomically moves source over destination, replacing destination if it exists.
+int replace_file(const std::string &source, const std::string &destination);
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace snap::bsdiff {
+
+// Instruction set whose relative branches the executable filter rewrites. The values are
+// stored in patch headers.
+enum class filter_arch : uint8_t {
+  none = 0,
+  x86 = 1,
+  arm64 = 2
+};
+
+// File offsets of a code section.
+struct filter_range {
+  int64_t offset;
+  int64_t size;
+};
+
+// Where the code of an ELF or PE image lives. arch is none for anything else, including
+// images of other architectures.
+struct executable_layout {
+  filter_arch arch;
+  // Sorted, disjoint and within the file.
+  std::vector<filter_range> ranges;
+};
+
+// Parses the headers of an ELF or PE image. Throws std::bad_alloc.
+executable_layout detect_executable(const uint8_t *data, size_t size);
+
+// Rewrites the relative targets of x86 call/jmp and arm64 bl instructions in the code of
+// layout into absolute ones. When code moves between two builds every call to the same
+// function then still encodes to the same bytes, which bsdiff turns into long matches.
+void filter_encode(const executable_layout &layout, uint8_t *data, size_t size);
+
+// Encodes data with its own layout when it is an image of arch, otherwise leaves it as is.
+// Applied to the old file on both sides of a patch. Throws std::bad_alloc.
+void filter_encode_as(filter_arch arch, uint8_t *data, size_t size);
+
+// Undoes filter_encode on a file that is produced front to back. Bytes are only held back
+// while an instruction straddles two writes.
+class filter_decoder final {
+public:
+  using emit_function = std::function<int(const uint8_t *data, size_t size)>;
+
+  explicit filter_decoder(const executable_layout &layout);
+
+  // Decodes data, which continues the file, and passes every byte that is final to emit.
+  int write(const uint8_t *data, size_t size, const emit_function &emit);
+  // Passes the bytes still held back to emit.
+  int finish(const emit_function &emit);
+
+private:
+  int drain(bool final, const emit_function &emit);
+
+  const executable_layout &m_layout;
+  size_t m_range;
+  std::vector<uint8_t> m_buffer;
+  int64_t m_base;
+  int64_t m_next;
+};
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "bsdiff/file.hpp"
+#include "bsdiff/lib.hpp"
+
+namespace snap::bsdiff {
+
+// Cheap 64-bit fingerprint that ties an index file to the contents it was built from.
+uint64_t content_fingerprint(const uint8_t *buffer, size_t size);
+
+// Builds the suffix array of older and writes it to path, with entries as wide as
+// suffix_array_width gives for older_size. The file is written next to
+// path and moved into place once complete, so readers never observe a partial index.
+int index_build(const char *path, const uint8_t *older, int64_t older_size, uint32_t thread_count);
+
+// Memory mapped suffix array index of an old file, as written by index_build.
+class suffix_array_index final {
+  mapped_file m_file;
+  const void *m_suffix_array;
+  int64_t m_older_size;
+
+public:
+  suffix_array_index();
+  suffix_array_index(const suffix_array_index &) = delete;
+  suffix_array_index &operator=(const suffix_array_index &) = delete;
+
+  // Fails with BSDIFF_CORRUPT_PATCH if the file is not an index of older, or if an entry of
+  // its suffix array points past the end of older.
+  int open(const char *path, const uint8_t *older, int64_t older_size);
+
+  // Entries are suffix_array_width(older_size) bytes wide.
+  const void *suffix_array() const { return m_suffix_array; }
+  int64_t older_size() const { return m_older_size; }
+};
+
+}
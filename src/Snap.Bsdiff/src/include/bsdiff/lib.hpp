@@ -27,18 +27,177 @@ typedef enum _snap_bsdiff_status_type {
   bsdiff_status_type_file_error = 4,
   bsdiff_status_type_end_of_file = 5,
   bsdiff_status_type_corrupt_patch = 6,
-  bsdiff_status_type_size_too_large = 7
+  bsdiff_status_type_size_too_large = 7,
+  bsdiff_status_type_unsupported = 8,
+  bsdiff_status_type_cancelled = 9,
+  bsdiff_status_type_digest_mismatch = 10
 } snap_bsdiff_status_type;
 
+// Compression of the patch body. bz2 writes the classic BSDIFF43 format that every version
+// can apply, the others write a header naming the packer so snap_bsdiff_patch picks the
+// right decoder by itself. That header also records the size and SHA-256 of older and
+// newer: applying such a patch verifies older before it starts and newer once it is
+// written, and fails with bsdiff_status_type_digest_mismatch otherwise. zstd and lz4 are
+// only available when the library was built with them, otherwise
+// bsdiff_status_type_unsupported is reported.
+typedef enum _snap_bsdiff_packer_type {
+  bsdiff_packer_type_bz2 = 0,
+  bsdiff_packer_type_stored = 1,
+  bsdiff_packer_type_zstd = 2,
+  bsdiff_packer_type_lz4 = 3
+} snap_bsdiff_packer_type;
+
+typedef struct _snap_bsdiff_packer_options {
+  snap_bsdiff_packer_type type;
+  // Codec compression level, 0 uses the codec default. Ignored by bz2 and stored.
+  int32_t level;
+  // zstd only: enables long distance matching with a window of 2^window_log bytes (10-31),
+  // 0 disables it. Applying such a patch needs a window sized buffer.
+  uint32_t window_log;
+  // zstd and lz4: compresses independent blocks of this many bytes on the diff threads, so
+  // they can also be decompressed in parallel. 0 writes a single frame. The output is still
+  // one valid stream for readers that do not know about blocks. bz2 and stored reject a
+  // non-zero block size with bsdiff_status_type_invalid_arg.
+  uint32_t block_size;
+} snap_bsdiff_packer_options;
+
+typedef void *(*snap_bsdiff_alloc_t)(void *opaque, size_t size);
+typedef void *(*snap_bsdiff_realloc_t)(void *opaque, void *ptr, size_t size);
+typedef void (*snap_bsdiff_free_t)(void *opaque, void *ptr);
+
+// Output buffers are allocated with these hooks and written in place, the caller owns
+// the result. Leave alloc unset to use malloc/realloc/free. realloc is optional, growth
+// falls back to alloc + copy + free without it.
+typedef struct _snap_bsdiff_allocator {
+  void *opaque;
+  snap_bsdiff_alloc_t alloc;
+  snap_bsdiff_realloc_t realloc;
+  snap_bsdiff_free_t free;
+} snap_bsdiff_allocator;
+
+// Called periodically while a diff or patch runs with the number of bytes of newer that
+// have been scanned or written so far, out of bytes_total. Returning non-zero stops the
+// operation, which then fails with bsdiff_status_type_cancelled. Batches invoke it from
+// their worker threads, one item at a time per ctx.
+typedef int32_t (*snap_bsdiff_progress_t)(void *opaque, uint64_t bytes_processed, uint64_t bytes_total);
+
+// Leave report unset to run without progress.
+typedef struct _snap_bsdiff_progress {
+  void *opaque;
+  snap_bsdiff_progress_t report;
+} snap_bsdiff_progress;
+
+// cpu_ns is the CPU time of the whole process, so it includes the threads compressing
+// blocks and may exceed wall_ns.
+typedef struct _snap_bsdiff_phase_stats {
+  uint64_t wall_ns;
+  uint64_t cpu_ns;
+} snap_bsdiff_phase_stats;
+
+// Filled by a diff or patch when the ctx points stats at it, previous contents are
+// discarded. Phases are timed at their boundaries only, collecting stats does not slow
+// down the engine measurably.
+//
+// prepare covers hashing, filtering and opening the patch, sort the suffix sort of older and
+// the block hashing of the prematch and rolling_hash engines.
+// scan is the search for matches of a diff and apply the reconstruction of newer of a
+// patch. compress is the time spent in the packer, compressing blocks for a diff and
+// decompressing them for a patch. total covers the whole call.
+//
+// peak_memory_bytes is the peak of the large buffers allocated by the engine: the suffix
+// array, diff blocks, filtered or expanded copies of the files and a new file held in
+// memory. Packer buffers, which are bounded by the block size, are not included.
+//
+// control_bytes, diff_bytes and extra_bytes are the uncompressed sizes of the three
+// streams of the patch, 24 bytes of control per entry. The streams are compressed
+// together, patch_bytes is the compressed size of the whole patch including its header.
+// matched_bytes counts the bytes of diff blocks identical in older and newer, the longer
+// the matches the better newer was predicted from older. longest_match_bytes is the
+// longest diff block.
+typedef struct _snap_bsdiff_stats {
+  snap_bsdiff_phase_stats prepare;
+  snap_bsdiff_phase_stats sort;
+  snap_bsdiff_phase_stats scan;
+  snap_bsdiff_phase_stats compress;
+  snap_bsdiff_phase_stats apply;
+  snap_bsdiff_phase_stats total;
+  uint64_t peak_memory_bytes;
+  uint64_t control_bytes;
+  uint64_t diff_bytes;
+  uint64_t extra_bytes;
+  uint64_t patch_bytes;
+  uint64_t entry_count;
+  uint64_t matched_bytes;
+  uint64_t longest_match_bytes;
+} snap_bsdiff_stats;
+
+// Preprocessing applied to both files before they are diffed. executable rewrites the
+// relative branch targets in the code of x86, x64 and arm64 ELF and PE images into absolute
+// ones, so a call whose target only moved diffs to nothing; other files are diffed as is.
+// archive diffs the uncompressed entries of zip based files such as nupkg, the entries of
+// the new file are compressed again while the patch is applied. Only entries zlib
+// reproduces bit for bit are expanded, and the filter needs a library built with zlib,
+// bsdiff_status_type_unsupported is reported otherwise.
+// Filtered patches need a packer other than bz2, bz2 fails with
+// bsdiff_status_type_unsupported. Applying a patch undoes the filter by itself, but has to
+// load older into memory to do so.
+typedef enum _snap_bsdiff_filter_type {
+  bsdiff_filter_type_none = 0,
+  bsdiff_filter_type_executable = 1,
+  bsdiff_filter_type_archive = 2
+} snap_bsdiff_filter_type;
+
+// Matching strategy of a diff. suffix_array is the plain bsdiff algorithm, it searches the
+// suffix array of older for every stretch of newer. prematch, the default, first finds the
+// runs of newer that are unchanged since older by hashing older in fixed blocks, when older
+// is at least 1 MiB and most of newer is found that way. The scan then follows those runs
+// instead of searching for them and only searches in between, against all of older, so it
+// writes the same entries as suffix_array in less time. Either way older is sorted as a
+// whole unless an index is given. rolling_hash keeps every run the block hashing finds and
+// sorts nothing: it runs in linear time with a hash table of a quarter of older at most,
+// but misses matches shorter than two blocks, so its patches are larger. All of them write
+// the same entries, a patch is applied the same way whichever engine made it.
+typedef enum _snap_bsdiff_engine_type {
+  bsdiff_engine_type_prematch = 0,
+  bsdiff_engine_type_suffix_array = 1,
+  bsdiff_engine_type_rolling_hash = 2
+} snap_bsdiff_engine_type;
+
+// On-disk cache of diff results, leave path unset to diff without it. Patches are stored in
+// the directory at path under a digest of older, newer and every option that changes the
+// patch, so diffing the same pair again returns the stored patch without running the
+// engine. The directory may be shared by concurrent threads and processes: entries appear
+// atomically and a failing cache never fails the diff. Once the entries exceed max_bytes,
+// the least recently used are removed, 0 means unlimited.
+typedef struct _snap_bsdiff_cache_options {
+  const char *path;
+  uint64_t max_bytes;
+} snap_bsdiff_cache_options;
+
+// Prebuilt suffix array index of an old file, see snap_bsdiff_index_open.
+typedef struct _snap_bsdiff_index snap_bsdiff_index;
+
 typedef struct _snap_bsdiff_patch_ctx {
   snap_bsdiff_error_logger_t error_logger;
   const void *older;
   size_t older_size;
-  uint8_t **newer;
+  uint8_t *newer;
   size_t newer_size;
   const void *patch;
   const size_t patch_size;
   snap_bsdiff_status_type status;
+  snap_bsdiff_allocator allocator;
+  // Threads decompressing a block compressed patch, 0 uses all hardware threads.
+  uint32_t thread_count;
+  snap_bsdiff_progress progress;
+  // Non-zero applies the patch without keeping the result, newer stays unset. Combined
+  // with the digests in the patch header, or newer_sha256, this validates a patch against
+  // older without allocating newer.
+  int32_t verify_only;
+  // Receives the SHA-256 of newer, which is computed while newer is written.
+  uint8_t newer_sha256[32];
+  // Receives timing, memory and stream statistics of the patch, nullptr collects none.
+  snap_bsdiff_stats *stats;
 } snap_bsdiff_patch_ctx;
 
 typedef struct _snap_bsdiff_diff_ctx {
@@ -47,15 +206,346 @@ typedef struct _snap_bsdiff_diff_ctx {
   size_t older_size;
   const void *newer;
   size_t newer_size;
-  uint8_t **patch;
+  uint8_t *patch;
   size_t patch_size;
   snap_bsdiff_status_type status;
+  snap_bsdiff_allocator allocator;
+  // Threads used to build the suffix array and to compress blocks, 0 uses all hardware
+  // threads. The patch is byte-identical for any value.
+  uint32_t thread_count;
+  // Optional index opened for older, the suffix sort is skipped when set.
+  const snap_bsdiff_index *index;
+  snap_bsdiff_packer_options packer;
+  // Caps the working memory of the diff, 0 means unlimited. Inputs that would need more are
+  // diffed in overlapping windows that fit the budget, the patch may get larger but applies
+  // like any other. Ignored when index is set.
+  uint64_t max_memory_bytes;
+  snap_bsdiff_progress progress;
+  // index is not used when the filter applies to newer, older is sorted again.
+  snap_bsdiff_filter_type filter;
+  // Receives timing, memory and stream statistics of the diff, nullptr collects none.
+  snap_bsdiff_stats *stats;
+  // The prematch engine runs like suffix_array when the diff is windowed. index and
+  // max_memory_bytes don't apply to the rolling_hash engine.
+  snap_bsdiff_engine_type engine;
+  snap_bsdiff_cache_options cache;
+  // Set to non-zero when the patch was taken from the cache.
+  int32_t cache_hit;
 } snap_bsdiff_diff_ctx;
 
+// snap_bsdiff_index_build sorts older once and writes the suffix array to index_path.
+// snap_bsdiff_index_open maps such a file into index for use by any number of diffs
+// against the same older, and snap_bsdiff_index_close releases it. Opening verifies that
+// the file was built from the same older contents and that every suffix array entry lies
+// within older.
+typedef struct _snap_bsdiff_index_ctx {
+  snap_bsdiff_error_logger_t error_logger;
+  const void *older;
+  size_t older_size;
+  const char *index_path;
+  uint32_t thread_count;
+  snap_bsdiff_index *index;
+  snap_bsdiff_status_type status;
+} snap_bsdiff_index_ctx;
+
+// Diffs every item independently. Each item is a regular diff ctx: its status and patch are
+// filled in as by snap_bsdiff_diff and the patch is released with snap_bsdiff_diff_free.
+// Nothing else of an item is modified. An item thread_count of 0 means 1 here, parallelism
+// comes from running items concurrently. Items that were not run because the batch itself
+// failed report bsdiff_status_type_cancelled.
+typedef struct _snap_bsdiff_diff_batch_ctx {
+  snap_bsdiff_diff_ctx *items;
+  size_t items_count;
+  // Items diffed concurrently, 0 uses all hardware threads.
+  uint32_t thread_count;
+  // Limits the summed estimated working memory of running items, 0 means unlimited. An item
+  // that alone exceeds the budget runs by itself.
+  uint64_t max_memory_bytes;
+  // Number of items that failed, see each item's status.
+  size_t failed_count;
+  // Failure of the batch itself, such as running out of memory for the thread pool.
+  snap_bsdiff_status_type status;
+} snap_bsdiff_diff_batch_ctx;
+
+// Applies every item independently. Each item is a regular patch ctx: its status and newer
+// are filled in as by snap_bsdiff_patch and newer is released with snap_bsdiff_patch_free.
+// Nothing else of an item is modified. An item thread_count of 0 means 1 here. Items that
+// were not run because the batch itself failed report bsdiff_status_type_cancelled.
+typedef struct _snap_bsdiff_patch_batch_ctx {
+  snap_bsdiff_patch_ctx *items;
+  size_t items_count;
+  // Items applied concurrently, 0 uses all hardware threads.
+  uint32_t thread_count;
+  // Limits the summed size of older and newer of running items, 0 means unlimited. The size
+  // of newer is taken from the patch header. An item that alone exceeds the budget runs by itself.
+  uint64_t max_memory_bytes;
+  // Number of items that failed, see each item's status.
+  size_t failed_count;
+  // Failure of the batch itself, such as running out of memory for the thread pool.
+  snap_bsdiff_status_type status;
+} snap_bsdiff_patch_batch_ctx;
+
+// Diffs older_path against newer_path and writes the patch to patch_path. Both inputs are
+// memory mapped, so neither needs to be loaded by the caller. The options match
+// snap_bsdiff_diff_ctx.
+//
+// Output files of this and snap_bsdiff_patch_files are written through a buffered temporary
+// file next to them that replaces the destination once complete, a failure never leaves a
+// partial file behind.
+typedef struct _snap_bsdiff_diff_files_ctx {
+  snap_bsdiff_error_logger_t error_logger;
+  const char *older_path;
+  const char *newer_path;
+  const char *patch_path;
+  snap_bsdiff_status_type status;
+  uint32_t thread_count;
+  const snap_bsdiff_index *index;
+  snap_bsdiff_packer_options packer;
+  uint64_t max_memory_bytes;
+  snap_bsdiff_progress progress;
+  snap_bsdiff_filter_type filter;
+  snap_bsdiff_stats *stats;
+  snap_bsdiff_engine_type engine;
+  snap_bsdiff_cache_options cache;
+  int32_t cache_hit;
+} snap_bsdiff_diff_files_ctx;
+
+// Applies patch_path to older_path and writes the result to newer_path. older and the patch
+// are memory mapped.
+typedef struct _snap_bsdiff_patch_files_ctx {
+  snap_bsdiff_error_logger_t error_logger;
+  const char *older_path;
+  const char *patch_path;
+  const char *newer_path;
+  snap_bsdiff_status_type status;
+  uint32_t thread_count;
+  snap_bsdiff_progress progress;
+  snap_bsdiff_stats *stats;
+} snap_bsdiff_patch_files_ctx;
+
+typedef enum _snap_bsdiff_seek_origin {
+  bsdiff_seek_origin_begin = 0,
+  bsdiff_seek_origin_current = 1,
+  bsdiff_seek_origin_end = 2
+} snap_bsdiff_seek_origin;
+
+// Stream callbacks return a snap_bsdiff_status_type, bsdiff_status_type_success (0) on success.
+// A read that returns fewer bytes than requested must report bsdiff_status_type_end_of_file.
+typedef int32_t (*snap_bsdiff_stream_read_t)(void *opaque, void *buffer, size_t size, size_t *bytes_read);
+typedef int32_t (*snap_bsdiff_stream_write_t)(void *opaque, const void *buffer, size_t size);
+typedef int32_t (*snap_bsdiff_stream_seek_t)(void *opaque, int64_t offset, snap_bsdiff_seek_origin origin);
+typedef int32_t (*snap_bsdiff_stream_tell_t)(void *opaque, int64_t *position);
+
+typedef struct _snap_bsdiff_stream {
+  void *opaque;
+  snap_bsdiff_stream_read_t read;
+  snap_bsdiff_stream_write_t write;
+  snap_bsdiff_stream_seek_t seek;
+  snap_bsdiff_stream_tell_t tell;
+} snap_bsdiff_stream;
+
+// older: read, seek, tell. patch: read. newer: write.
+typedef struct _snap_bsdiff_patch_stream_ctx {
+  snap_bsdiff_error_logger_t error_logger;
+  snap_bsdiff_stream older;
+  snap_bsdiff_stream patch;
+  snap_bsdiff_stream newer;
+  snap_bsdiff_status_type status;
+  uint32_t thread_count;
+  snap_bsdiff_progress progress;
+  snap_bsdiff_stats *stats;
+} snap_bsdiff_patch_stream_ctx;
+
+// older: read, seek, tell. newer: read, seek, tell. patch: write.
+typedef struct _snap_bsdiff_diff_stream_ctx {
+  snap_bsdiff_error_logger_t error_logger;
+  snap_bsdiff_stream older;
+  snap_bsdiff_stream newer;
+  snap_bsdiff_stream patch;
+  snap_bsdiff_status_type status;
+  uint32_t thread_count;
+  snap_bsdiff_packer_options packer;
+  // See snap_bsdiff_diff_ctx, the caller's streams are read into memory in addition.
+  uint64_t max_memory_bytes;
+  snap_bsdiff_progress progress;
+  snap_bsdiff_filter_type filter;
+  snap_bsdiff_stats *stats;
+  snap_bsdiff_engine_type engine;
+} snap_bsdiff_diff_stream_ctx;
+
+// Incremental SHA-256 state, see snap_bsdiff_sha256_init.
+typedef struct _snap_bsdiff_sha256 snap_bsdiff_sha256;
+
+// snap_bsdiff_sha256_init allocates hash, snap_bsdiff_sha256_update hashes data and may be
+// called any number of times, snap_bsdiff_sha256_final writes digest and releases hash.
+// Blocks are hashed with the SHA extensions when the CPU has them.
+typedef struct _snap_bsdiff_sha256_ctx {
+  snap_bsdiff_sha256 *hash;
+  const void *data;
+  size_t data_size;
+  uint8_t digest[32];
+  snap_bsdiff_status_type status;
+} snap_bsdiff_sha256_ctx;
+
+typedef struct _snap_bsdiff_sha256_item {
+  const void *data;
+  size_t data_size;
+  uint8_t digest[32];
+} snap_bsdiff_sha256_item;
+
+// Hashes every item. Items are spread over the threads largest first, and on CPUs with AVX2
+// but without the SHA extensions items of similar size are hashed eight at a time, which
+// keeps thousands of small files from being bound by the hash.
+typedef struct _snap_bsdiff_sha256_batch_ctx {
+  snap_bsdiff_sha256_item *items;
+  size_t items_count;
+  // 0 uses all hardware threads.
+  uint32_t thread_count;
+  snap_bsdiff_status_type status;
+} snap_bsdiff_sha256_batch_ctx;
+
+// One content defined chunk of a file.
+typedef struct _snap_bsdiff_chunk_entry {
+  uint64_t offset;
+  uint32_t size;
+  // Non-zero for the first occurrence of a chunk in the release that is not in known. Only
+  // these chunks have to be shipped, every other one is already on the client or comes
+  // earlier in the same release.
+  int32_t novel;
+  uint8_t sha256[32];
+} snap_bsdiff_chunk_entry;
+
+typedef struct _snap_bsdiff_chunk_file {
+  const void *data;
+  size_t data_size;
+  // The chunks covering data in order, allocated with the ctx allocator.
+  snap_bsdiff_chunk_entry *chunks;
+  size_t chunks_count;
+} snap_bsdiff_chunk_file;
+
+// Splits every file of a release into content defined chunks and dedupes them, across the
+// files of the release and against the chunks of the previous release in known. The chunk
+// lists form the manifest of the release, the novel chunks are all a delta has to carry.
+// Files are chunked and hashed on up to thread_count threads, the result does not depend
+// on it. snap_bsdiff_chunk_free releases the chunk lists.
+typedef struct _snap_bsdiff_chunk_ctx {
+  snap_bsdiff_error_logger_t error_logger;
+  snap_bsdiff_chunk_file *files;
+  size_t files_count;
+  // SHA-256 of the chunks of the previous release, 32 bytes each.
+  const uint8_t *known;
+  size_t known_count;
+  // 0 uses 16 KiB, 64 KiB and 256 KiB. avg_size must be a power of two between min_size
+  // and max_size. Only chunks made with the same sizes dedupe against each other.
+  uint32_t min_size;
+  uint32_t avg_size;
+  uint32_t max_size;
+  // 0 uses all hardware threads.
+  uint32_t thread_count;
+  snap_bsdiff_allocator allocator;
+  snap_bsdiff_status_type status;
+  // Number and total size of the novel chunks.
+  size_t novel_count;
+  uint64_t novel_size;
+} snap_bsdiff_chunk_ctx;
+
+typedef struct _snap_bsdiff_compose_item {
+  const void *patch;
+  size_t patch_size;
+} snap_bsdiff_compose_item;
+
+// Composes a chain of patches, each made against the output of the one before, into one
+// patch from the older file of the first to the newer file of the last. Applying it costs
+// a single patch, however long the chain, and no intermediate file is ever produced. The
+// composed patch is written with packer and carries digests when every patch in the chain
+// did. Patches made with a filter can't be composed and fail with
+// bsdiff_status_type_unsupported, a broken chain fails with
+// bsdiff_status_type_digest_mismatch.
+typedef struct _snap_bsdiff_compose_ctx {
+  snap_bsdiff_error_logger_t error_logger;
+  const snap_bsdiff_compose_item *items;
+  size_t items_count;
+  uint8_t *patch;
+  size_t patch_size;
+  snap_bsdiff_status_type status;
+  snap_bsdiff_allocator allocator;
+  // Threads decompressing and compressing blocks, 0 uses all hardware threads.
+  uint32_t thread_count;
+  snap_bsdiff_packer_options packer;
+} snap_bsdiff_compose_ctx;
+
+// Diff or patch running on the worker pool of the library, see snap_bsdiff_diff_async.
+typedef struct _snap_bsdiff_async snap_bsdiff_async;
+
+// Called on the worker once the work has completed, with what the synchronous call returned.
+typedef void (*snap_bsdiff_completion_t)(void *opaque, int32_t result);
+
+typedef struct _snap_bsdiff_completion {
+  snap_bsdiff_completion_t callback;
+  void *opaque;
+} snap_bsdiff_completion;
+
+// snap_bsdiff_diff_async queues snap_bsdiff_diff(diff) on a pool of native workers owned by
+// the library and returns at once, the calling thread is free while the diff runs. The pool
+// starts with one worker per hardware thread on first use, more work than that waits in its
+// queue. Completion is signaled through the optional callback and through handle, which
+// can be polled or waited on with snap_bsdiff_async_wait and must be released with
+// snap_bsdiff_async_close. diff and everything it points to must stay valid until then,
+// its status and patch are filled in as by the synchronous call. Progress callbacks run on
+// the worker and cancel the work as usual.
+typedef struct _snap_bsdiff_diff_async_ctx {
+  snap_bsdiff_diff_ctx *diff;
+  snap_bsdiff_completion completion;
+  snap_bsdiff_async *handle;
+  snap_bsdiff_status_type status;
+} snap_bsdiff_diff_async_ctx;
+
+// Queues snap_bsdiff_patch(patch), see snap_bsdiff_diff_async_ctx.
+typedef struct _snap_bsdiff_patch_async_ctx {
+  snap_bsdiff_patch_ctx *patch;
+  snap_bsdiff_completion completion;
+  snap_bsdiff_async *handle;
+  snap_bsdiff_status_type status;
+} snap_bsdiff_patch_async_ctx;
+
+#define SNAP_BSDIFF_WAIT_INFINITE UINT32_MAX
+
+// snap_bsdiff_async_wait waits up to timeout_ms for the work of handle, 0 only polls. It
+// returns 1 and sets result to what the synchronous call returned once the work has
+// completed, by then the completion callback has returned too. snap_bsdiff_async_close
+// releases handle, work still running completes and calls its callback regardless.
+typedef struct _snap_bsdiff_async_handle_ctx {
+  snap_bsdiff_async *handle;
+  uint32_t timeout_ms;
+  int32_t completed;
+  int32_t result;
+} snap_bsdiff_async_handle_ctx;
+
 SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_patch(snap_bsdiff_patch_ctx *p_ctx);
 SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_patch_free(snap_bsdiff_patch_ctx* p_ctx);
 SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_diff(snap_bsdiff_diff_ctx* p_ctx);
 SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_diff_free(snap_bsdiff_diff_ctx* p_ctx);
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_index_build(snap_bsdiff_index_ctx* p_ctx);
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_index_open(snap_bsdiff_index_ctx* p_ctx);
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_index_close(snap_bsdiff_index_ctx* p_ctx);
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_patch_stream(snap_bsdiff_patch_stream_ctx* p_ctx);
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_diff_stream(snap_bsdiff_diff_stream_ctx* p_ctx);
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_diff_batch(snap_bsdiff_diff_batch_ctx* p_ctx);
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_patch_batch(snap_bsdiff_patch_batch_ctx* p_ctx);
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_diff_files(snap_bsdiff_diff_files_ctx* p_ctx);
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_patch_files(snap_bsdiff_patch_files_ctx* p_ctx);
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_sha256_init(snap_bsdiff_sha256_ctx* p_ctx);
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_sha256_update(snap_bsdiff_sha256_ctx* p_ctx);
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_sha256_final(snap_bsdiff_sha256_ctx* p_ctx);
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_sha256_batch(snap_bsdiff_sha256_batch_ctx* p_ctx);
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_chunk(snap_bsdiff_chunk_ctx* p_ctx);
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_chunk_free(snap_bsdiff_chunk_ctx* p_ctx);
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_compose(snap_bsdiff_compose_ctx* p_ctx);
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_compose_free(snap_bsdiff_compose_ctx* p_ctx);
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_diff_async(snap_bsdiff_diff_async_ctx* p_ctx);
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_patch_async(snap_bsdiff_patch_async_ctx* p_ctx);
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_async_wait(snap_bsdiff_async_handle_ctx* p_ctx);
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_async_close(snap_bsdiff_async_handle_ctx* p_ctx);
 
 #ifdef __cplusplus
 }
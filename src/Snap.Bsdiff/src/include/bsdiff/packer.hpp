@@ -0,0 +1,39 @@
+#pragma once
+
+#include "bsdiff/archive.hpp"
+#include "bsdiff/filter.hpp"
+#include "bsdiff/lib.hpp"
+#include "bsdiff/sha256.hpp"
+
+namespace snap::bsdiff {
+
+// Size and SHA-256 of the files a patch was made from. Every patch but bz2 carries them in
+// its header, so a patch can check older before it is applied and newer while it is written.
+struct patch_digests {
+  bool present;
+  int64_t older_size;
+  uint8_t older_sha256[sha256_digest_size];
+  uint8_t newer_sha256[sha256_digest_size];
+};
+
+// Opens a packer writing a patch compressed as described by options, nullptr selects bz2.
+// Blocks are compressed on up to thread_count threads. digests, when present, are stored in
+// the header; bz2 has no room for them and ignores them. filter, when set and not none,
+// records that the files went through the executable filter and the code ranges of the new
+// file; bz2 can't carry it either, callers have to reject that combination. archive, when
+// set and expanded, records the zip entries the archive filter replaced, with the same
+// restriction.
+int open_patch_writer(const snap_bsdiff_packer_options *options, uint32_t thread_count, const patch_digests *digests,
+                      const executable_layout *filter, const archive_layout *archive, struct bsdiff_stream *stream,
+                      struct bsdiff_patch_packer *packer);
+
+// Opens a packer reading a patch written by any packer. The format is detected from the
+// header, so stream only has to support read. Blocks are decompressed on up to thread_count
+// threads. digests, when set, receives the digests from the header, if the patch has them.
+// filter, when set, receives the executable filter of the patch, arch none if it has none.
+// archive, when set, receives the archive entries of the patch, none if it has none.
+int open_patch_reader(struct bsdiff_stream *stream, uint32_t thread_count, struct bsdiff_patch_packer *packer,
+                      patch_digests *digests = nullptr, executable_layout *filter = nullptr,
+                      archive_layout *archive = nullptr);
+
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace snap::bsdiff {
+
+// 0 means one thread per hardware thread.
+inline uint32_t resolve_thread_count(const uint32_t thread_count) {
+  const auto resolved = thread_count == 0 ? std::thread::hardware_concurrency() : thread_count;
+  return resolved == 0 ? 1 : resolved;
+}
+
+// Calls fn(begin, end) for blocks of at most grain items covering [0, count). Blocks are
+// handed out dynamically to up to thread_count threads, the calling thread included.
+// Exceptions thrown by fn, or by starting a thread, are rethrown on the calling thread once
+// every thread has stopped.
+template<typename F>
+void parallel_for(const size_t count, const size_t grain, const uint32_t thread_count, F &&fn) {
+  if (count == 0) {
+    return;
+  }
+
+  const auto block_size = std::max<size_t>(grain, 1);
+  const auto blocks = (count + block_size - 1) / block_size;
+  const auto workers = std::min<size_t>(resolve_thread_count(thread_count), blocks);
+  if (workers <= 1) {
+    fn(size_t(0), count);
+    return;
+  }
+
+  std::atomic<size_t> next_block{0};
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  auto worker = [&]() {
+    try {
+      for (;;) {
+        const auto block = next_block.fetch_add(1, std::memory_order_relaxed);
+        if (block >= blocks) {
+          break;
+        }
+        const auto begin = block * block_size;
+        fn(begin, std::min(begin + block_size, count));
+      }
+    } catch (...) {
+      // Stops handing out blocks, the first error is rethrown on the calling thread.
+      next_block.store(blocks, std::memory_order_relaxed);
+      std::lock_guard<std::mutex> lock(error_mutex);
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  try {
+    threads.reserve(workers - 1);
+    for (size_t i = 0; i < workers - 1; i++) {
+      threads.emplace_back(worker);
+    }
+  } catch (...) {
+    // Out of threads or memory: the threads already started are drained before rethrowing.
+    next_block.store(blocks, std::memory_order_relaxed);
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    throw;
+  }
+
+  worker();
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "bsdiff/lib.hpp"
+#include "bsdiff/packer.hpp"
+#include "bsdiff/stats.hpp"
+
+namespace snap::bsdiff {
+
+struct patch_options {
+  // Invoked once with the size of the new file, before anything is written to newer. It is
+  // expected to allocate newer in memory, stats count it as such.
+  int (*reserve_newer)(struct bsdiff_stream *newer, int64_t newer_size);
+  // Receives progress over newer and may cancel the patch, nullptr runs without.
+  const snap_bsdiff_progress *progress;
+  // Digests read from the patch header. When present older is verified before anything is
+  // written and newer once it is complete, a mismatch fails with
+  // bsdiff_status_type_digest_mismatch.
+  const patch_digests *digests;
+  // Receives the SHA-256 of newer, computed while it is written.
+  uint8_t *newer_sha256;
+  // Executable filter read from the patch header, nullptr or arch none when it has none.
+  const executable_layout *filter;
+  // Archive entries read from the patch header, nullptr or none when it has none.
+  const archive_layout *archive;
+  // Receives the prepare, apply and compress phases and the entries read, nullptr runs without.
+  stats_recorder *stats;
+};
+
+// Applies a patch read from packer on top of older and writes the result to newer.
+//
+// Unlike bspatch this never loads older into memory: diff blocks are applied in fixed size
+// chunks and older is read through seek/read (or directly when it is backed by a buffer),
+// so peak memory does not depend on the size of the files involved. The exception are
+// patches made with the executable or the archive filter, older is then loaded and filtered
+// or expanded up front.
+int patch(struct bsdiff_ctx *ctx, struct bsdiff_stream *older, struct bsdiff_stream *newer, struct bsdiff_patch_packer *packer,
+          const patch_options *options = nullptr);
+
+}
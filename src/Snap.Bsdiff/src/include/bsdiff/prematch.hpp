@@ -0,0 +1,31 @@
+#pragma once
+
+#include "bsdiff/stats.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace snap::bsdiff {
+
+// Smallest older the block hash pass runs for, below it the scan is cheap anyway.
+constexpr int64_t prematch_min_older_size = 1024 * 1024;
+
+// A run of newer that lines up with a run of older, identical but for short gaps.
+struct block_match {
+  int64_t newer_pos;
+  int64_t older_pos;
+  int64_t length;
+};
+
+// Hashes older in aligned blocks and rolls a hash of the same width over newer, so blocks
+// are found at any offset of newer. Each hit is extended in both directions as long as the
+// bytes stay identical, and hits on the same diagonal with a short gap between them are
+// joined. matches are ordered and disjoint in newer. Unless keep_partial is set they are
+// only kept when they cover at least half of newer, otherwise matches is left empty and the
+// pass gives up as soon as that is out of reach, so unrelated inputs don't pay for it.
+//
+// Throws std::bad_alloc.
+void find_block_matches(const uint8_t *older, int64_t older_size, const uint8_t *newer, int64_t newer_size,
+                        bool keep_partial, std::vector<block_match> &matches, stats_recorder &stats);
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "bsdiff/lib.hpp"
+
+namespace snap::bsdiff {
+
+// Forwards progress of a diff or patch to the caller's snap_bsdiff_progress and turns a
+// request to stop into bsdiff_status_type_cancelled. Once cancelled every later call fails
+// as well, so the error propagates no matter which loop observes it first.
+class progress_reporter final {
+  snap_bsdiff_progress_t m_report;
+  void *m_opaque;
+  uint64_t m_total;
+  uint64_t m_processed;
+  uint64_t m_next;
+  bool m_cancelled;
+
+public:
+  // progress may be nullptr or have no callback, every call then succeeds.
+  progress_reporter(const snap_bsdiff_progress *progress, uint64_t total);
+
+  // Cheap enough for inner loops, the callback only runs when processed has advanced far
+  // enough since it last ran.
+  int update(const uint64_t processed) {
+    return processed < m_next ? BSDIFF_SUCCESS : report(processed);
+  }
+
+  // Runs the callback with the last processed value. Used by phases, such as the suffix
+  // sort, that take long without advancing processed.
+  int poll() { return report(m_processed); }
+
+  // Runs the callback unconditionally.
+  int report(uint64_t processed);
+};
+
+}
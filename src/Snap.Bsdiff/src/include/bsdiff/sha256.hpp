@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace snap::bsdiff {
+
+constexpr size_t sha256_digest_size = 32;
+
+// Incremental SHA-256 (FIPS 180-4), used to verify patch inputs and outputs while they
+// are streamed. Blocks are hashed with the SHA extensions when the CPU has them.
+class sha256 final {
+  uint32_t m_state[8];
+  uint8_t m_block[64];
+  size_t m_block_size;
+  uint64_t m_length;
+
+public:
+  sha256();
+
+  void update(const uint8_t *data, size_t size);
+  // Writes the digest, the object must not be updated afterwards.
+  void finish(uint8_t digest[sha256_digest_size]);
+};
+
+void sha256_digest(const uint8_t *data, size_t size, uint8_t digest[sha256_digest_size]);
+
+struct sha256_message {
+  const uint8_t *data;
+  size_t size;
+  uint8_t *digest;
+};
+
+// Hashes every message. Without SHA extensions but with AVX2, consecutive groups of eight
+// messages are hashed together in the lanes of one register, so pass them sorted by size
+// to keep the lanes busy.
+void sha256_digest_many(const sha256_message *messages, size_t count);
+
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "bsdiff/cpu.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace snap::bsdiff {
+
+extern const uint32_t sha256_round_constants[64];
+
+// Hashes count consecutive 64 byte blocks into state.
+void sha256_compress_portable(uint32_t state[8], const uint8_t *blocks, size_t count);
+
+#if defined(SNAP_BSDIFF_X86)
+// Requires cpu_features().sha.
+void sha256_compress_shani(uint32_t state[8], const uint8_t *blocks, size_t count);
+
+// Requires cpu_features().avx2. Hashes one block into each of eight independent states,
+// lane j of state[i] is word i of the j-th state.
+void sha256_compress_x8_avx2(uint32_t state[8][8], const uint8_t *const blocks[8]);
+#endif
+
+}
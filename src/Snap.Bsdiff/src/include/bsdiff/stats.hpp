@@ -0,0 +1,64 @@
+#pragma once
+
+#include "bsdiff/lib.hpp"
+
+namespace snap::bsdiff {
+
+// Fills the caller's snap_bsdiff_stats. Clocks are only read at phase boundaries and around
+// packer calls, and every method is a no-op when there are no stats to fill.
+class stats_recorder final {
+public:
+  using phase = snap_bsdiff_phase_stats snap_bsdiff_stats::*;
+
+private:
+  snap_bsdiff_stats *m_stats;
+  uint64_t m_total_wall_begin;
+  uint64_t m_total_cpu_begin;
+  uint64_t m_wall_begin;
+  uint64_t m_cpu_begin;
+  uint64_t m_thread_cpu_begin;
+  // Time spent in a packer opened by open_stats_packer since begin.
+  uint64_t m_packer_wall_ns;
+  uint64_t m_packer_thread_cpu_ns;
+  uint64_t m_allocated;
+
+public:
+  // stats may be nullptr. It is cleared here, so a reused struct only holds the last call,
+  // and the total phase starts.
+  explicit stats_recorder(snap_bsdiff_stats *stats);
+
+  bool enabled() const { return m_stats != nullptr; }
+  snap_bsdiff_stats *stats() const { return m_stats; }
+
+  // Ends the total phase.
+  void finish();
+
+  // Starts a phase, phases do not nest.
+  void begin();
+  // Adds the time since begin to phase.
+  void end(phase phase);
+  // Ends a phase that called into a stats packer. Time spent in the packer goes to compress,
+  // so does the CPU time of other threads, the rest of this thread goes to phase.
+  void end_interleaved(phase phase);
+
+  // Tracks the large buffers of the engine for peak_memory_bytes.
+  void allocated(uint64_t bytes);
+  void released(uint64_t bytes);
+
+  void add_packer_time(uint64_t wall_ns, uint64_t thread_cpu_ns);
+  void add_patch_bytes(const uint64_t bytes) { m_stats->patch_bytes += bytes; }
+};
+
+// Total CPU time of the process and of the calling thread.
+uint64_t process_cpu_ns();
+uint64_t thread_cpu_ns();
+
+// Opens a packer forwarding every call to inner that times the calls and counts the entries
+// going through it into stats. Closing it leaves inner open.
+int open_stats_packer(struct bsdiff_patch_packer *inner, stats_recorder *stats, struct bsdiff_patch_packer *packer);
+
+// Opens a stream forwarding every call to inner that counts the bytes read from or written
+// to it as patch_bytes. Closing it leaves inner open.
+int open_stats_stream(struct bsdiff_stream *inner, stats_recorder *stats, struct bsdiff_stream *stream);
+
+}
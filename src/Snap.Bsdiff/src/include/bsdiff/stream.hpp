@@ -0,0 +1,28 @@
+#pragma once
+
+#include "bsdiff/lib.hpp"
+
+#include <vector>
+
+namespace snap::bsdiff {
+
+// Wraps caller supplied callbacks as a bsdiff_stream. The callbacks are not owned,
+// closing the returned stream only releases the adapter state.
+int open_callback_stream(int mode, const snap_bsdiff_stream *callbacks, struct bsdiff_stream *stream);
+
+// Write only stream that grows a buffer obtained from allocator. The buffer is handed over
+// with allocator_stream_detach, otherwise it is released when the stream is closed.
+int open_allocator_stream(const snap_bsdiff_allocator *allocator, struct bsdiff_stream *stream);
+int allocator_stream_reserve(struct bsdiff_stream *stream, size_t capacity);
+int allocator_stream_detach(struct bsdiff_stream *stream, uint8_t **buffer, size_t *size);
+
+// Write only stream that discards everything written to it.
+int open_null_stream(struct bsdiff_stream *stream);
+
+// Reads the whole stream, from the beginning, into buffer.
+int read_stream(struct bsdiff_stream *stream, std::vector<uint8_t> &buffer);
+
+void *allocator_alloc(const snap_bsdiff_allocator *allocator, size_t size);
+void allocator_free(const snap_bsdiff_allocator *allocator, void *ptr);
+
+}
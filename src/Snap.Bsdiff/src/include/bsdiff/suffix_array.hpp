@@ -0,0 +1,40 @@
+#pragma once
+
+#include "bsdiff/lib.hpp"
+
+#include <cstddef>
+
+namespace snap::bsdiff {
+
+class progress_reporter;
+
+// Largest input whose suffix array holds 32-bit entries, every entry is at most size.
+constexpr int64_t suffix_array_max_size_32 = int64_t(UINT32_MAX) - 1;
+
+// Width of the entries of the suffix array of an input of size bytes. Inputs below 4 GiB
+// get uint32_t entries, which halves the suffix array and the ranks of the sort, larger
+// ones int64_t entries. Everything that stores or reads a suffix array of older, index
+// files included, uses the width for older_size.
+inline size_t suffix_array_width(const int64_t size) {
+  return size <= suffix_array_max_size_32 ? sizeof(uint32_t) : sizeof(int64_t);
+}
+
+// Builds the suffix array of buffer into sa, which must hold size + 1 entries. sa[0] is
+// always size (the empty suffix), matching the layout produced by qsufsort in bsdiff.
+// Index is uint32_t or int64_t, a size too large for Index fails with BSDIFF_SIZE_TOO_LARGE.
+//
+// Suffixes are bucketed on their first two bytes and then refined by prefix doubling.
+// Each doubling round only touches groups that are still unsorted and those groups are
+// independent, so they are sorted on up to thread_count threads. Low entropy input, long
+// runs of one byte or repeated tables, leaves a few huge groups that one thread would sort
+// round after round, so such input is sorted by SA-IS instead, single threaded but linear
+// in size. A suffix array is unique for its input, so the result depends neither on
+// thread_count nor on the algorithm picked.
+//
+// progress, when set, is polled between doubling rounds and SA-IS levels so a long sort
+// can be cancelled.
+template<typename Index>
+int suffix_array_build(const uint8_t *buffer, int64_t size, Index *sa, uint32_t thread_count,
+                       progress_reporter *progress = nullptr);
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace snap::bsdiff {
+
+// Fixed size pool where every worker owns a queue. Tasks are spread round-robin over the
+// queues, a worker drains its own queue from the front and steals from the back of the
+// other queues once it runs dry.
+class thread_pool final {
+  struct worker_queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+
+    worker_queue() :
+        mutex(),
+        tasks() {
+    }
+  };
+
+  std::vector<std::unique_ptr<worker_queue>> m_queues;
+  std::vector<std::thread> m_threads;
+  std::mutex m_mutex;
+  std::condition_variable m_work_available;
+  std::condition_variable m_work_done;
+  size_t m_queued;
+  size_t m_pending;
+  size_t m_next_queue;
+  bool m_stopping;
+
+  bool try_pop(size_t worker, std::function<void()> &task);
+  void run_worker(size_t worker);
+  void stop();
+
+public:
+  explicit thread_pool(uint32_t thread_count);
+  thread_pool(const thread_pool &) = delete;
+  thread_pool &operator=(const thread_pool &) = delete;
+  ~thread_pool();
+
+  size_t size() const;
+  void submit(std::function<void()> task);
+  // Blocks until every task submitted so far has completed.
+  void wait();
+};
+
+// Counts bytes handed out to running work. A request larger than the whole budget is
+// clamped to it, so it runs once everything else has finished instead of never.
+class memory_budget final {
+  std::mutex m_mutex;
+  std::condition_variable m_released;
+  uint64_t m_capacity;
+  uint64_t m_available;
+
+public:
+  // A capacity of 0 disables the budget.
+  explicit memory_budget(uint64_t capacity);
+
+  uint64_t acquire(uint64_t bytes);
+  void release(uint64_t bytes);
+};
+
+}
@@ -0,0 +1,173 @@
+#include "bsdiff/index.hpp"
+#include "bsdiff/suffix_array.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <vector>
+
+namespace {
+
+constexpr char index_magic[8] = {'S', 'N', 'A', 'P', 'S', 'A', 'I', 'X'};
+// Version 2 stores 32-bit entries for older files below 4 GiB, version 1 always stored 64-bit ones.
+constexpr uint32_t index_version = 2;
+constexpr uint32_t index_byte_order = 0x01020304;
+
+// Fixed 64 byte header so the suffix array that follows is naturally aligned when mapped.
+struct index_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t index_width;
+  uint32_t byte_order;
+  uint32_t reserved0;
+  uint64_t older_size;
+  uint64_t older_fingerprint;
+  uint8_t reserved1[24];
+};
+
+static_assert(sizeof(index_header) == 64, "index header must stay 64 bytes");
+
+}
+
+uint64_t snap::bsdiff::content_fingerprint(const uint8_t *buffer, const size_t size) {
+  constexpr uint64_t prime = 0x9E3779B97F4A7C15ull;
+  uint64_t hash = size * prime;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, buffer + i, sizeof(word));
+    hash = (hash ^ word) * prime;
+    hash ^= hash >> 29;
+  }
+  for (; i < size; i++) {
+    hash = (hash ^ buffer[i]) * prime;
+  }
+  return hash ^ (hash >> 32);
+}
+
+namespace {
+
+template<typename Index>
+int write_index(const char *path, const uint8_t *older, const int64_t older_size, const uint32_t thread_count) {
+  std::vector<Index> sa;
+  try {
+    sa.resize(static_cast<size_t>(older_size) + 1);
+  } catch (const std::bad_alloc &) {
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  int ret;
+  if ((ret = snap::bsdiff::suffix_array_build(older, older_size, sa.data(), thread_count)) != BSDIFF_SUCCESS) {
+    return ret;
+  }
+
+  index_header header = {};
+  std::memcpy(header.magic, index_magic, sizeof(index_magic));
+  header.version = index_version;
+  header.index_width = sizeof(Index);
+  header.byte_order = index_byte_order;
+  header.older_size = static_cast<uint64_t>(older_size);
+  header.older_fingerprint = snap::bsdiff::content_fingerprint(older, static_cast<size_t>(older_size));
+
+  const auto tmp_path = snap::bsdiff::temporary_path(path);
+  auto *file = std::fopen(tmp_path.c_str(), "wb");
+  if (file == nullptr) {
+    return BSDIFF_FILE_ERROR;
+  }
+
+  const auto written = std::fwrite(&header, sizeof(header), 1, file) == 1
+                       && std::fwrite(sa.data(), sizeof(Index), sa.size(), file) == sa.size();
+
+  if (std::fclose(file) != 0 || !written) {
+    std::remove(tmp_path.c_str());
+    return BSDIFF_FILE_ERROR;
+  }
+
+  if ((ret = snap::bsdiff::replace_file(tmp_path, path)) != BSDIFF_SUCCESS) {
+    std::remove(tmp_path.c_str());
+    return ret;
+  }
+
+  return BSDIFF_SUCCESS;
+}
+
+// Every entry of the suffix array is used as an offset into older, so an entry past its end
+// would make a diff read out of bounds. The fingerprint only covers older, not the entries.
+template<typename Index>
+bool entries_in_bounds(const void *suffix_array, const int64_t older_size) {
+  const auto *sa = static_cast<const Index *>(suffix_array);
+  const auto last = static_cast<Index>(older_size);
+  if (sa[0] != last) {
+    return false;
+  }
+  for (int64_t i = 1; i <= older_size; i++) {
+    // Unsigned for 32-bit entries, so the first test is always false there.
+    if (sa[i] < 0 || sa[i] >= last) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+
+int snap::bsdiff::index_build(const char *path, const uint8_t *older, const int64_t older_size, const uint32_t thread_count) {
+  if (path == nullptr || (older == nullptr && older_size > 0) || older_size < 0) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  return suffix_array_width(older_size) == sizeof(uint32_t)
+    ? write_index<uint32_t>(path, older, older_size, thread_count)
+    : write_index<int64_t>(path, older, older_size, thread_count);
+}
+
+snap::bsdiff::suffix_array_index::suffix_array_index() :
+    m_file(),
+    m_suffix_array(nullptr),
+    m_older_size(0) {
+}
+
+int snap::bsdiff::suffix_array_index::open(const char *path, const uint8_t *older, const int64_t older_size) {
+  if (path == nullptr || (older == nullptr && older_size > 0) || older_size < 0) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  int ret;
+  if ((ret = m_file.open(path)) != BSDIFF_SUCCESS) {
+    return ret;
+  }
+
+  index_header header = {};
+  const auto width = suffix_array_width(older_size);
+  const auto expected_size = sizeof(header) + (static_cast<uint64_t>(older_size) + 1) * width;
+  if (m_file.size() < sizeof(header)) {
+    m_file.close();
+    return BSDIFF_CORRUPT_PATCH;
+  }
+
+  std::memcpy(&header, m_file.data(), sizeof(header));
+
+  if (std::memcmp(header.magic, index_magic, sizeof(index_magic)) != 0
+      || header.version != index_version
+      || header.index_width != width
+      || header.byte_order != index_byte_order
+      || header.older_size != static_cast<uint64_t>(older_size)
+      || m_file.size() != expected_size
+      || header.older_fingerprint != content_fingerprint(older, static_cast<size_t>(older_size))) {
+    m_file.close();
+    return BSDIFF_CORRUPT_PATCH;
+  }
+
+  const auto *suffix_array = m_file.data() + sizeof(header);
+  if (!(width == sizeof(uint32_t)
+          ? entries_in_bounds<uint32_t>(suffix_array, older_size)
+          : entries_in_bounds<int64_t>(suffix_array, older_size))) {
+    m_file.close();
+    return BSDIFF_CORRUPT_PATCH;
+  }
+
+  m_suffix_array = suffix_array;
+  m_older_size = older_size;
+
+  return BSDIFF_SUCCESS;
+}
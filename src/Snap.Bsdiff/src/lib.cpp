@@ -1,5 +1,339 @@
 #include "bsdiff/lib.hpp"
+#include "bsdiff/archive.hpp"
+#include "bsdiff/async.hpp"
+#include "bsdiff/batch.hpp"
+#include "bsdiff/cache.hpp"
+#include "bsdiff/chunker.hpp"
+#include "bsdiff/compose.hpp"
+#include "bsdiff/diff.hpp"
+#include "bsdiff/file.hpp"
+#include "bsdiff/filter.hpp"
+#include "bsdiff/index.hpp"
+#include "bsdiff/packer.hpp"
+#include "bsdiff/patch.hpp"
+#include "bsdiff/sha256.hpp"
+#include "bsdiff/stats.hpp"
+#include "bsdiff/stream.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
 #include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <system_error>
+#include <unordered_set>
+#include <vector>
+
+struct _snap_bsdiff_index {
+  snap::bsdiff::suffix_array_index index;
+
+  _snap_bsdiff_index() :
+      index() {
+  }
+};
+
+struct _snap_bsdiff_sha256 {
+  snap::bsdiff::sha256 hash;
+
+  _snap_bsdiff_sha256() :
+      hash() {
+  }
+};
+
+struct _snap_bsdiff_async {
+  std::shared_ptr<snap::bsdiff::async_operation> operation;
+
+  _snap_bsdiff_async() :
+      operation() {
+  }
+};
+
+namespace {
+
+// Messages hashed per task by snap_bsdiff_sha256_batch. After sorting by size, messages of
+// similar size share a group and so the lanes of sha256_digest_many.
+constexpr size_t sha256_group_size = 8;
+
+void log_error(struct bsdiff_ctx *ctx, const char *errmsg) {
+  if (ctx->log_error != nullptr) {
+    ctx->log_error(ctx->opaque, errmsg);
+  }
+}
+
+// Queues work for snap_bsdiff_diff_async and snap_bsdiff_patch_async and opens the handle
+// that tracks it.
+int start_async(std::function<int32_t()> work, const snap_bsdiff_completion &completion, snap_bsdiff_async **handle) {
+  std::unique_ptr<snap_bsdiff_async> async(new (std::nothrow) snap_bsdiff_async());
+  if (async == nullptr) {
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  try {
+    async->operation = std::make_shared<snap::bsdiff::async_operation>();
+  } catch (const std::bad_alloc &) {
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  const auto ret = snap::bsdiff::run_async(async->operation, std::move(work), [completion](const int32_t result) {
+    if (completion.callback != nullptr) {
+      completion.callback(completion.opaque, result);
+    }
+  });
+  if (ret == BSDIFF_SUCCESS) {
+    *handle = async.release();
+  }
+
+  return ret;
+}
+
+// Digests stored in the header of the patch, bz2 has no room for them so they are only
+// computed for the other packers.
+snap::bsdiff::patch_digests input_digests(const snap_bsdiff_packer_options &packer, const void *older, const size_t older_size,
+                                          const void *newer, const size_t newer_size) {
+  snap::bsdiff::patch_digests digests = {};
+  if (packer.type == bsdiff_packer_type_bz2) {
+    return digests;
+  }
+
+  digests.present = true;
+  digests.older_size = static_cast<int64_t>(older_size);
+  snap::bsdiff::sha256_digest(static_cast<const uint8_t *>(older), older_size, digests.older_sha256);
+  snap::bsdiff::sha256_digest(static_cast<const uint8_t *>(newer), newer_size, digests.newer_sha256);
+
+  return digests;
+}
+
+// Cache key of a diff of older and newer with the options of p_ctx. The digests written to
+// the patch header are reused, the inputs are only hashed again for bz2. max_memory_bytes
+// is left out when it can't change the patch: rolling_hash ignores it, and so does a diff
+// with an index unless a filter may replace the index by a sort.
+template<typename Ctx>
+snap::bsdiff::diff_cache_key diff_cache_key(const Ctx &p_ctx, const snap::bsdiff::patch_digests &digests,
+                                            const void *older, const size_t older_size,
+                                            const void *newer, const size_t newer_size) {
+  const auto max_memory_bytes = p_ctx.engine == bsdiff_engine_type_rolling_hash
+    || (p_ctx.index != nullptr && p_ctx.filter == bsdiff_filter_type_none) ? 0 : p_ctx.max_memory_bytes;
+  if (digests.present) {
+    return snap::bsdiff::make_diff_cache_key(digests.older_sha256, digests.newer_sha256, p_ctx.packer, p_ctx.filter,
+                                             p_ctx.engine, max_memory_bytes);
+  }
+
+  uint8_t older_sha256[snap::bsdiff::sha256_digest_size];
+  uint8_t newer_sha256[snap::bsdiff::sha256_digest_size];
+  snap::bsdiff::sha256_digest(static_cast<const uint8_t *>(older), older_size, older_sha256);
+  snap::bsdiff::sha256_digest(static_cast<const uint8_t *>(newer), newer_size, newer_sha256);
+  return snap::bsdiff::make_diff_cache_key(older_sha256, newer_sha256, p_ctx.packer, p_ctx.filter, p_ctx.engine,
+                                           max_memory_bytes);
+}
+
+// Copies of older and newer run through the executable or the archive filter. They replace
+// the inputs of the diff when applied is set, the digests stay those of the originals.
+struct filtered_inputs {
+  bool applied;
+  snap::bsdiff::executable_layout layout;
+  snap::bsdiff::archive_layout archive;
+  std::vector<uint8_t> older;
+  std::vector<uint8_t> newer;
+};
+
+// Applies the filter requested by type when newer is an image or an archive it understands.
+// Inputs that already live in inputs are filtered in place instead of being copied, archives
+// always end up in new buffers since expanding them changes their size.
+int filter_inputs(const snap_bsdiff_filter_type type, const snap_bsdiff_packer_options &packer,
+                  const uint8_t *older, const size_t older_size, const uint8_t *newer, const size_t newer_size,
+                  filtered_inputs &inputs) {
+  if (type == bsdiff_filter_type_none) {
+    return BSDIFF_SUCCESS;
+  }
+  if (type != bsdiff_filter_type_executable && type != bsdiff_filter_type_archive) {
+    return BSDIFF_INVALID_ARG;
+  }
+  // The legacy format has no header to record the filter in.
+  if (packer.type == bsdiff_packer_type_bz2
+      || (type == bsdiff_filter_type_archive && !snap::bsdiff::archive_supported())) {
+    return bsdiff_status_type_unsupported;
+  }
+
+  try {
+    if (type == bsdiff_filter_type_archive) {
+      inputs.archive.older = snap::bsdiff::find_archive_entries(older, older_size, false);
+      inputs.archive.newer = snap::bsdiff::find_archive_entries(newer, newer_size, true);
+      inputs.archive.newer_size = static_cast<int64_t>(newer_size);
+      if (!snap::bsdiff::archive_expanded(inputs.archive)) {
+        return BSDIFF_SUCCESS;
+      }
+
+      int ret;
+      std::vector<uint8_t> expanded;
+      if ((ret = snap::bsdiff::archive_expand(older, older_size, inputs.archive.older, expanded)) != BSDIFF_SUCCESS) {
+        return ret;
+      }
+      inputs.older = std::move(expanded);
+      expanded = std::vector<uint8_t>();
+      if ((ret = snap::bsdiff::archive_expand(newer, newer_size, inputs.archive.newer, expanded)) != BSDIFF_SUCCESS) {
+        return ret;
+      }
+      inputs.newer = std::move(expanded);
+      inputs.applied = true;
+      return BSDIFF_SUCCESS;
+    }
+
+    inputs.layout = snap::bsdiff::detect_executable(newer, newer_size);
+    if (inputs.layout.arch == snap::bsdiff::filter_arch::none) {
+      return BSDIFF_SUCCESS;
+    }
+    if (older != inputs.older.data()) {
+      inputs.older.assign(older, older + older_size);
+    }
+    if (newer != inputs.newer.data()) {
+      inputs.newer.assign(newer, newer + newer_size);
+    }
+    snap::bsdiff::filter_encode(inputs.layout, inputs.newer.data(), inputs.newer.size());
+    snap::bsdiff::filter_encode_as(inputs.layout.arch, inputs.older.data(), inputs.older.size());
+    inputs.applied = true;
+  } catch (const std::bad_alloc &) {
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  return BSDIFF_SUCCESS;
+}
+
+using chunk_digest = std::array<uint8_t, snap::bsdiff::sha256_digest_size>;
+
+// The leading bytes of a SHA-256 are as good a hash as any.
+struct chunk_digest_hash {
+  size_t operator()(const chunk_digest &digest) const {
+    size_t value;
+    std::memcpy(&value, digest.data(), sizeof value);
+    return value;
+  }
+};
+
+// Splits file into chunks, stored in file.chunks, and hashes them. Chunks of one file have
+// about the same size, so they fill the lanes of sha256_digest_many well.
+int chunk_file(const snap::bsdiff::chunk_params &params, const snap_bsdiff_allocator &allocator, snap_bsdiff_chunk_file &file) {
+  const auto *data = static_cast<const uint8_t *>(file.data);
+
+  std::vector<snap_bsdiff_chunk_entry> chunks;
+  for (size_t offset = 0; offset < file.data_size;) {
+    const auto size = snap::bsdiff::next_chunk(data + offset, file.data_size - offset, params);
+    chunks.push_back({ offset, static_cast<uint32_t>(size), 0, { 0 } });
+    offset += size;
+  }
+
+  std::vector<snap::bsdiff::sha256_message> messages(chunks.size());
+  for (size_t i = 0; i < chunks.size(); i++) {
+    messages[i] = { data + chunks[i].offset, chunks[i].size, chunks[i].sha256 };
+  }
+  snap::bsdiff::sha256_digest_many(messages.data(), messages.size());
+
+  if (!chunks.empty()) {
+    file.chunks = static_cast<snap_bsdiff_chunk_entry *>(snap::bsdiff::allocator_alloc(&allocator, chunks.size() * sizeof(snap_bsdiff_chunk_entry)));
+    if (file.chunks == nullptr) {
+      return BSDIFF_OUT_OF_MEMORY;
+    }
+    std::memcpy(file.chunks, chunks.data(), chunks.size() * sizeof(snap_bsdiff_chunk_entry));
+  }
+  file.chunks_count = chunks.size();
+
+  return BSDIFF_SUCCESS;
+}
+
+void free_chunks(snap_bsdiff_chunk_ctx *p_ctx) {
+  for (size_t i = 0; i < p_ctx->files_count; i++) {
+    auto &file = p_ctx->files[i];
+    if (file.chunks != nullptr) {
+      snap::bsdiff::allocator_free(&p_ctx->allocator, file.chunks);
+      file.chunks = nullptr;
+    }
+    file.chunks_count = 0;
+  }
+}
+
+// Points patch at a stream counting the bytes of patchfile into stats, or at patchfile
+// itself when no stats are collected. counted has to be closed before patchfile.
+int count_patch_bytes(snap::bsdiff::stats_recorder &stats, struct bsdiff_stream *patchfile, struct bsdiff_stream *counted,
+                      struct bsdiff_stream **patch) {
+  *patch = patchfile;
+  if (!stats.enabled()) {
+    return BSDIFF_SUCCESS;
+  }
+
+  const auto ret = snap::bsdiff::open_stats_stream(patchfile, &stats, counted);
+  if (ret == BSDIFF_SUCCESS) {
+    *patch = counted;
+  }
+  return ret;
+}
+
+// Reads the patch of item and appends it to chain.
+int add_to_chain(snap::bsdiff::patch_chain &chain, struct bsdiff_ctx *ctx, const snap_bsdiff_compose_item &item,
+                 const uint32_t thread_count) {
+  int ret;
+  struct bsdiff_stream patchfile = { nullptr };
+  struct bsdiff_patch_packer packer = { nullptr };
+  snap::bsdiff::patch_digests digests = {};
+  snap::bsdiff::executable_layout filter = { snap::bsdiff::filter_arch::none, {} };
+  snap::bsdiff::archive_layout archive = { {}, {}, 0 };
+
+  if ((ret = bsdiff_open_memory_stream(BSDIFF_MODE_READ, item.patch, item.patch_size, &patchfile)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  if ((ret = snap::bsdiff::open_patch_reader(&patchfile, thread_count, &packer, &digests, &filter, &archive)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  // Filters are undone on the output of each patch, composing would have to undo them
+  // half way through the chain.
+  if (filter.arch != snap::bsdiff::filter_arch::none || snap::bsdiff::archive_expanded(archive)) {
+    ret = bsdiff_status_type_unsupported;
+    goto cleanup;
+  }
+
+  ret = chain.add(ctx, &packer, digests);
+
+cleanup:
+  bsdiff_close_patch_packer(&packer);
+  bsdiff_close_stream(&patchfile);
+
+  return ret;
+}
+
+// Reads the size of the new file from the patch header without applying it.
+int read_newer_size(const void *patch, const size_t patch_size, int64_t *newer_size) {
+  int ret;
+  struct bsdiff_stream patchfile = { nullptr };
+  struct bsdiff_patch_packer packer = { nullptr };
+  snap::bsdiff::archive_layout archive = { {}, {}, 0 };
+
+  if ((ret = bsdiff_open_memory_stream(BSDIFF_MODE_READ, patch, patch_size, &patchfile)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  if ((ret = snap::bsdiff::open_patch_reader(&patchfile, 1, &packer, nullptr, nullptr, &archive)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  // The header holds the size of the expanded new file.
+  if (snap::bsdiff::archive_expanded(archive)) {
+    *newer_size = archive.newer_size;
+  } else {
+    ret = packer.read_new_size(packer.state, newer_size);
+  }
+
+cleanup:
+  bsdiff_close_patch_packer(&packer);
+  bsdiff_close_stream(&patchfile);
+
+  return ret;
+}
+
+}
 
 SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_patch(snap_bsdiff_patch_ctx* p_ctx) {
   if(p_ctx == nullptr ||
@@ -13,15 +347,27 @@ SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_patch(snap_bsdiff_patch_ctx
   }
 
   int ret;
-  struct bsdiff_stream oldfile = { nullptr }, newfile = { nullptr }, patchfile = { nullptr };
+  struct bsdiff_stream oldfile = { nullptr }, newfile = { nullptr }, patchfile = { nullptr }, countedfile = { nullptr };
+  struct bsdiff_stream *patch_stream = nullptr;
   struct bsdiff_ctx ctx = { nullptr };
   struct bsdiff_patch_packer packer = { nullptr };
+  snap::bsdiff::stats_recorder stats(p_ctx->stats);
+  snap::bsdiff::patch_digests digests = {};
+  snap::bsdiff::executable_layout filter = { snap::bsdiff::filter_arch::none, {} };
+  snap::bsdiff::archive_layout archive = { {}, {}, 0 };
+  snap::bsdiff::patch_options options = { nullptr, &p_ctx->progress, &digests, p_ctx->newer_sha256, &filter, &archive, &stats };
+
+  stats.begin();
 
   if ((ret = bsdiff_open_memory_stream(BSDIFF_MODE_READ, p_ctx->older, p_ctx->older_size, &oldfile)) != BSDIFF_SUCCESS) {
     goto cleanup;
   }
 
-  if ((ret = bsdiff_open_memory_stream(BSDIFF_MODE_WRITE, nullptr, 0, &newfile)) != BSDIFF_SUCCESS) {
+  // The new file is written straight into memory obtained from the caller's allocator, sized
+  // exactly from the patch header, so no intermediate copy is made. Verifying discards it.
+  if ((ret = p_ctx->verify_only != 0
+      ? snap::bsdiff::open_null_stream(&newfile)
+      : snap::bsdiff::open_allocator_stream(&p_ctx->allocator, &newfile)) != BSDIFF_SUCCESS) {
     goto cleanup;
   }
 
@@ -29,30 +375,39 @@ SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_patch(snap_bsdiff_patch_ctx
     goto cleanup;
   }
 
-  if ((ret = bsdiff_open_bz2_patch_packer(BSDIFF_MODE_READ, &patchfile, &packer)) != BSDIFF_SUCCESS) {
+  if ((ret = count_patch_bytes(stats, &patchfile, &countedfile, &patch_stream)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  if ((ret = snap::bsdiff::open_patch_reader(patch_stream, p_ctx->thread_count, &packer, &digests, &filter, &archive)) != BSDIFF_SUCCESS) {
     goto cleanup;
   }
+  stats.end(&snap_bsdiff_stats::prepare);
 
   ctx.log_error = p_ctx->error_logger;
+  if (p_ctx->verify_only == 0) {
+    options.reserve_newer = [](struct bsdiff_stream *newer, const int64_t newer_size) {
+      if (static_cast<uint64_t>(newer_size) > SIZE_MAX) {
+        return BSDIFF_SIZE_TOO_LARGE;
+      }
+      return snap::bsdiff::allocator_stream_reserve(newer, static_cast<size_t>(newer_size));
+    };
+  }
 
-  if ((ret = bspatch(&ctx, &oldfile, &newfile, &packer)) != BSDIFF_SUCCESS) {
+  if ((ret = snap::bsdiff::patch(&ctx, &oldfile, &newfile, &packer, &options)) != BSDIFF_SUCCESS) {
     goto cleanup;
   }
 
+  if (p_ctx->verify_only == 0) {
+    ret = snap::bsdiff::allocator_stream_detach(&newfile, &p_ctx->newer, &p_ctx->newer_size);
+  }
+
 cleanup:
+  stats.finish();
   p_ctx->status = static_cast<snap_bsdiff_status_type>(ret);
 
-  if(p_ctx->status == bsdiff_status_type_success) {
-    const void* newer_buffer = nullptr;
-    size_t newer_buffer_len = 0;
-    newfile.get_buffer(newfile.state, &newer_buffer, &newer_buffer_len);
-
-    p_ctx->newer_size = static_cast<int64_t>(newer_buffer_len);
-    p_ctx->newer = new uint8_t*[newer_buffer_len];
-    std::memcpy(p_ctx->newer, newer_buffer, newer_buffer_len);
-  }
-
   bsdiff_close_patch_packer(&packer);
+  bsdiff_close_stream(&countedfile);
   bsdiff_close_stream(&patchfile);
   bsdiff_close_stream(&newfile);
   bsdiff_close_stream(&oldfile);
@@ -66,7 +421,7 @@ SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_patch_free(snap_bsdiff_patc
   }
 
   if(p_ctx->newer != nullptr) {
-    delete[] p_ctx->newer;
+    snap::bsdiff::allocator_free(&p_ctx->allocator, p_ctx->newer);
     p_ctx->newer = nullptr;
     p_ctx->newer_size = 0;
   }
@@ -84,49 +439,97 @@ SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_diff(snap_bsdiff_diff_ctx*
   }
 
   int ret;
-  struct bsdiff_stream oldfile = { nullptr }, newfile = { nullptr }, patchfile = { nullptr };
+  struct bsdiff_stream patchfile = { nullptr }, countedfile = { nullptr };
+  struct bsdiff_stream *patch_stream = nullptr;
   struct bsdiff_ctx ctx = { nullptr };
   struct bsdiff_patch_packer packer = { nullptr };
+  snap::bsdiff::stats_recorder stats(p_ctx->stats);
+  snap::bsdiff::diff_options options = { p_ctx->thread_count, nullptr, 0, p_ctx->max_memory_bytes, &p_ctx->progress,
+                                         &stats, p_ctx->engine };
+  snap::bsdiff::patch_digests digests = {};
+  filtered_inputs inputs = {};
+  const snap::bsdiff::diff_cache cache(p_ctx->cache.path, p_ctx->cache.max_bytes);
+  snap::bsdiff::diff_cache_key cache_key = {};
+  snap::bsdiff::mapped_file cached;
+  auto *older = static_cast<const uint8_t *>(p_ctx->older);
+  auto *newer = static_cast<const uint8_t *>(p_ctx->newer);
+  auto older_size = p_ctx->older_size;
+  auto newer_size = p_ctx->newer_size;
 
-  if ((ret = bsdiff_open_memory_stream(BSDIFF_MODE_READ, p_ctx->older, p_ctx->older_size, &oldfile)) != BSDIFF_SUCCESS) {
+  p_ctx->cache_hit = 0;
+  stats.begin();
+
+  if (p_ctx->index != nullptr) {
+    if (p_ctx->index->index.older_size() != static_cast<int64_t>(p_ctx->older_size)) {
+      ret = BSDIFF_INVALID_ARG;
+      goto cleanup;
+    }
+    options.suffix_array = p_ctx->index->index.suffix_array();
+  }
+
+  if ((ret = snap::bsdiff::open_allocator_stream(&p_ctx->allocator, &patchfile)) != BSDIFF_SUCCESS) {
     goto cleanup;
   }
 
-  if ((ret = bsdiff_open_memory_stream(BSDIFF_MODE_READ, p_ctx->newer, p_ctx->newer_size, &newfile)) != BSDIFF_SUCCESS) {
+  if ((ret = count_patch_bytes(stats, &patchfile, &countedfile, &patch_stream)) != BSDIFF_SUCCESS) {
     goto cleanup;
   }
 
-  if ((ret = bsdiff_open_memory_stream(BSDIFF_MODE_WRITE, nullptr, 0, &patchfile)) != BSDIFF_SUCCESS) {
+  digests = input_digests(p_ctx->packer, p_ctx->older, p_ctx->older_size, p_ctx->newer, p_ctx->newer_size);
+
+  // The patch is copied out of the cache, the caller releases it with its allocator.
+  if (cache.enabled()) {
+    cache_key = diff_cache_key(*p_ctx, digests, p_ctx->older, p_ctx->older_size, p_ctx->newer, p_ctx->newer_size);
+    if (cache.find(cache_key, cached)) {
+      stats.end(&snap_bsdiff_stats::prepare);
+      if ((ret = patch_stream->write(patch_stream->state, cached.data(), cached.size())) == BSDIFF_SUCCESS
+          && (ret = snap::bsdiff::allocator_stream_detach(&patchfile, &p_ctx->patch, &p_ctx->patch_size)) == BSDIFF_SUCCESS) {
+        p_ctx->cache_hit = 1;
+      }
+      goto cleanup;
+    }
+  }
+
+  if ((ret = filter_inputs(p_ctx->filter, p_ctx->packer, older, p_ctx->older_size, newer, p_ctx->newer_size, inputs)) != BSDIFF_SUCCESS) {
     goto cleanup;
   }
 
-  if ((ret = bsdiff_open_bz2_patch_packer(BSDIFF_MODE_WRITE, &patchfile, &packer)) != BSDIFF_SUCCESS) {
+  // The index was sorted from the unfiltered older.
+  if (inputs.applied) {
+    older = inputs.older.data();
+    newer = inputs.newer.data();
+    older_size = inputs.older.size();
+    newer_size = inputs.newer.size();
+    options.suffix_array = nullptr;
+    stats.allocated(older_size + newer_size);
+  }
+
+  if ((ret = snap::bsdiff::open_patch_writer(&p_ctx->packer, p_ctx->thread_count, &digests, &inputs.layout, &inputs.archive,
+                                             patch_stream, &packer)) != BSDIFF_SUCCESS) {
     goto cleanup;
   }
+  stats.end(&snap_bsdiff_stats::prepare);
 
   ctx.log_error = p_ctx->error_logger;
 
-  if ((ret = bsdiff(&ctx, &oldfile, &newfile, &packer)) != BSDIFF_SUCCESS) {
+  if ((ret = snap::bsdiff::diff(&ctx,
+      older, static_cast<int64_t>(older_size),
+      newer, static_cast<int64_t>(newer_size),
+      &packer, &options)) != BSDIFF_SUCCESS) {
     goto cleanup;
   }
 
+  if ((ret = snap::bsdiff::allocator_stream_detach(&patchfile, &p_ctx->patch, &p_ctx->patch_size)) == BSDIFF_SUCCESS) {
+    cache.insert(cache_key, p_ctx->patch, p_ctx->patch_size);
+  }
+
 cleanup:
+  stats.finish();
   p_ctx->status = static_cast<snap_bsdiff_status_type>(ret);
 
-  if(p_ctx->status == bsdiff_status_type_success) {
-    const void* patch_buffer = nullptr;
-    size_t patch_buffer_len = 0;
-    patchfile.get_buffer(patchfile.state, &patch_buffer, &patch_buffer_len);
-
-    p_ctx->patch_size = static_cast<int64_t>(patch_buffer_len);
-    p_ctx->patch = new uint8_t*[patch_buffer_len];
-    std::memcpy(p_ctx->patch, patch_buffer, patch_buffer_len);
-  }
-
   bsdiff_close_patch_packer(&packer);
+  bsdiff_close_stream(&countedfile);
   bsdiff_close_stream(&patchfile);
-  bsdiff_close_stream(&newfile);
-  bsdiff_close_stream(&oldfile);
 
   return p_ctx->status == bsdiff_status_type_success ? 1 : 0;
 }
@@ -137,10 +540,900 @@ SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_diff_free(snap_bsdiff_diff_
   }
 
   if(p_ctx->patch != nullptr) {
-    delete[] p_ctx->patch;
+    snap::bsdiff::allocator_free(&p_ctx->allocator, p_ctx->patch);
     p_ctx->patch = nullptr;
     p_ctx->patch_size = 0;
   }
 
   return 1;
 }
+
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_index_build(snap_bsdiff_index_ctx* p_ctx) {
+  if(p_ctx == nullptr ||
+      p_ctx->older == nullptr ||
+      p_ctx->older_size <= 0 ||
+      p_ctx->index_path == nullptr) {
+    return 0;
+  }
+
+  const auto ret = snap::bsdiff::index_build(p_ctx->index_path,
+    static_cast<const uint8_t *>(p_ctx->older), static_cast<int64_t>(p_ctx->older_size), p_ctx->thread_count);
+
+  if (ret != BSDIFF_SUCCESS && p_ctx->error_logger != nullptr) {
+    p_ctx->error_logger(nullptr, "Failed to build suffix array index.");
+  }
+
+  p_ctx->status = static_cast<snap_bsdiff_status_type>(ret);
+
+  return p_ctx->status == bsdiff_status_type_success ? 1 : 0;
+}
+
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_index_open(snap_bsdiff_index_ctx* p_ctx) {
+  if(p_ctx == nullptr ||
+      p_ctx->older == nullptr ||
+      p_ctx->older_size <= 0 ||
+      p_ctx->index_path == nullptr ||
+      p_ctx->index != nullptr) {
+    return 0;
+  }
+
+  auto *index = new (std::nothrow) snap_bsdiff_index();
+  if (index == nullptr) {
+    p_ctx->status = bsdiff_status_type_out_of_memory;
+    return 0;
+  }
+
+  const auto ret = index->index.open(p_ctx->index_path,
+    static_cast<const uint8_t *>(p_ctx->older), static_cast<int64_t>(p_ctx->older_size));
+
+  if (ret != BSDIFF_SUCCESS) {
+    if (p_ctx->error_logger != nullptr) {
+      p_ctx->error_logger(nullptr, "Failed to open suffix array index.");
+    }
+    delete index;
+  } else {
+    p_ctx->index = index;
+  }
+
+  p_ctx->status = static_cast<snap_bsdiff_status_type>(ret);
+
+  return p_ctx->status == bsdiff_status_type_success ? 1 : 0;
+}
+
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_index_close(snap_bsdiff_index_ctx* p_ctx) {
+  if(p_ctx == nullptr) {
+    return 0;
+  }
+
+  if(p_ctx->index != nullptr) {
+    delete p_ctx->index;
+    p_ctx->index = nullptr;
+  }
+
+  return 1;
+}
+
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_patch_stream(snap_bsdiff_patch_stream_ctx* p_ctx) {
+  if(p_ctx == nullptr ||
+      p_ctx->older.read == nullptr ||
+      p_ctx->older.seek == nullptr ||
+      p_ctx->older.tell == nullptr ||
+      p_ctx->patch.read == nullptr ||
+      p_ctx->newer.write == nullptr) {
+    return 0;
+  }
+
+  int ret;
+  struct bsdiff_stream oldfile = { nullptr }, newfile = { nullptr }, patchfile = { nullptr }, countedfile = { nullptr };
+  struct bsdiff_stream *patch_stream = nullptr;
+  struct bsdiff_ctx ctx = { nullptr };
+  struct bsdiff_patch_packer packer = { nullptr };
+  snap::bsdiff::stats_recorder stats(p_ctx->stats);
+  snap::bsdiff::patch_digests digests = {};
+  snap::bsdiff::executable_layout filter = { snap::bsdiff::filter_arch::none, {} };
+  snap::bsdiff::archive_layout archive = { {}, {}, 0 };
+  const snap::bsdiff::patch_options options = { nullptr, &p_ctx->progress, &digests, nullptr, &filter, &archive, &stats };
+
+  stats.begin();
+
+  if ((ret = snap::bsdiff::open_callback_stream(BSDIFF_MODE_READ, &p_ctx->older, &oldfile)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  if ((ret = snap::bsdiff::open_callback_stream(BSDIFF_MODE_WRITE, &p_ctx->newer, &newfile)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  if ((ret = snap::bsdiff::open_callback_stream(BSDIFF_MODE_READ, &p_ctx->patch, &patchfile)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  if ((ret = count_patch_bytes(stats, &patchfile, &countedfile, &patch_stream)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  if ((ret = snap::bsdiff::open_patch_reader(patch_stream, p_ctx->thread_count, &packer, &digests, &filter, &archive)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+  stats.end(&snap_bsdiff_stats::prepare);
+
+  ctx.log_error = p_ctx->error_logger;
+
+  if ((ret = snap::bsdiff::patch(&ctx, &oldfile, &newfile, &packer, &options)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+cleanup:
+  stats.finish();
+  p_ctx->status = static_cast<snap_bsdiff_status_type>(ret);
+
+  bsdiff_close_patch_packer(&packer);
+  bsdiff_close_stream(&countedfile);
+  bsdiff_close_stream(&patchfile);
+  bsdiff_close_stream(&newfile);
+  bsdiff_close_stream(&oldfile);
+
+  return p_ctx->status == bsdiff_status_type_success ? 1 : 0;
+}
+
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_diff_stream(snap_bsdiff_diff_stream_ctx* p_ctx) {
+  if(p_ctx == nullptr ||
+      p_ctx->older.read == nullptr ||
+      p_ctx->older.seek == nullptr ||
+      p_ctx->older.tell == nullptr ||
+      p_ctx->newer.read == nullptr ||
+      p_ctx->newer.seek == nullptr ||
+      p_ctx->newer.tell == nullptr ||
+      p_ctx->patch.write == nullptr) {
+    return 0;
+  }
+
+  int ret;
+  struct bsdiff_stream oldfile = { nullptr }, newfile = { nullptr }, patchfile = { nullptr }, countedfile = { nullptr };
+  struct bsdiff_stream *patch_stream = nullptr;
+  struct bsdiff_ctx ctx = { nullptr };
+  struct bsdiff_patch_packer packer = { nullptr };
+  snap::bsdiff::stats_recorder stats(p_ctx->stats);
+  snap::bsdiff::diff_options options = { p_ctx->thread_count, nullptr, 0, p_ctx->max_memory_bytes, &p_ctx->progress,
+                                         &stats, p_ctx->engine };
+  snap::bsdiff::patch_digests digests = {};
+  filtered_inputs inputs = {};
+  auto &older = inputs.older;
+  auto &newer = inputs.newer;
+
+  stats.begin();
+
+  if ((ret = snap::bsdiff::open_callback_stream(BSDIFF_MODE_READ, &p_ctx->older, &oldfile)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  if ((ret = snap::bsdiff::open_callback_stream(BSDIFF_MODE_READ, &p_ctx->newer, &newfile)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  if ((ret = snap::bsdiff::open_callback_stream(BSDIFF_MODE_WRITE, &p_ctx->patch, &patchfile)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  if ((ret = count_patch_bytes(stats, &patchfile, &countedfile, &patch_stream)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  // The suffix sort needs random access to both files, but the patch is compressed
+  // straight into the caller's sink.
+  if ((ret = snap::bsdiff::read_stream(&oldfile, older)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  if ((ret = snap::bsdiff::read_stream(&newfile, newer)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+  stats.allocated(older.size() + newer.size());
+
+  digests = input_digests(p_ctx->packer, older.data(), older.size(), newer.data(), newer.size());
+
+  // Both files are already in memory, they are filtered in place or replaced by their
+  // expanded form.
+  if ((ret = filter_inputs(p_ctx->filter, p_ctx->packer, older.data(), older.size(), newer.data(), newer.size(),
+                           inputs)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  if ((ret = snap::bsdiff::open_patch_writer(&p_ctx->packer, p_ctx->thread_count, &digests, &inputs.layout, &inputs.archive,
+                                             patch_stream, &packer)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+  stats.end(&snap_bsdiff_stats::prepare);
+
+  ctx.log_error = p_ctx->error_logger;
+
+  if ((ret = snap::bsdiff::diff(&ctx,
+      older.data(), static_cast<int64_t>(older.size()),
+      newer.data(), static_cast<int64_t>(newer.size()),
+      &packer, &options)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+cleanup:
+  stats.finish();
+  p_ctx->status = static_cast<snap_bsdiff_status_type>(ret);
+
+  bsdiff_close_patch_packer(&packer);
+  bsdiff_close_stream(&countedfile);
+  bsdiff_close_stream(&patchfile);
+  bsdiff_close_stream(&newfile);
+  bsdiff_close_stream(&oldfile);
+
+  return p_ctx->status == bsdiff_status_type_success ? 1 : 0;
+}
+
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_diff_batch(snap_bsdiff_diff_batch_ctx* p_ctx) {
+  if(p_ctx == nullptr) {
+    return 0;
+  }
+
+  if(p_ctx->items == nullptr && p_ctx->items_count > 0) {
+    p_ctx->status = bsdiff_status_type_invalid_arg;
+    return 0;
+  }
+
+  const snap::bsdiff::batch_options options = { p_ctx->thread_count, p_ctx->max_memory_bytes };
+  std::atomic<size_t> failed_count{0};
+
+  // Items the batch never gets to, because it fails itself, keep this status.
+  for (size_t i = 0; i < p_ctx->items_count; i++) {
+    p_ctx->items[i].status = bsdiff_status_type_cancelled;
+  }
+
+  try {
+    snap::bsdiff::run_batch(p_ctx->items_count, options,
+      [p_ctx](const size_t index) {
+        const auto &item = p_ctx->items[index];
+        const auto estimate = snap::bsdiff::diff_memory_estimate(item.older_size, item.newer_size, item.engine);
+        return item.max_memory_bytes > 0 && item.index == nullptr && item.engine != bsdiff_engine_type_rolling_hash
+          ? std::min(estimate, item.max_memory_bytes) : estimate;
+      },
+      [p_ctx, &failed_count](const size_t index) {
+        // The item is diffed as a copy so that the options of the caller stay as they were,
+        // only the results are written back.
+        auto item = p_ctx->items[index];
+        if (item.thread_count == 0) {
+          item.thread_count = 1;
+        }
+        // snap_bsdiff_diff leaves status untouched when it rejects its arguments.
+        item.status = bsdiff_status_type_invalid_arg;
+        if (snap_bsdiff_diff(&item) != 1) {
+          failed_count++;
+        }
+
+        auto &result = p_ctx->items[index];
+        result.patch = item.patch;
+        result.patch_size = item.patch_size;
+        result.status = item.status;
+        result.cache_hit = item.cache_hit;
+      });
+    p_ctx->status = bsdiff_status_type_success;
+  } catch (const std::bad_alloc &) {
+    p_ctx->status = bsdiff_status_type_out_of_memory;
+  } catch (const std::system_error &) {
+    p_ctx->status = bsdiff_status_type_error;
+  }
+
+  p_ctx->failed_count = failed_count;
+  if (p_ctx->status != bsdiff_status_type_success) {
+    p_ctx->failed_count = 0;
+    for (size_t i = 0; i < p_ctx->items_count; i++) {
+      if (p_ctx->items[i].status != bsdiff_status_type_success) {
+        p_ctx->failed_count++;
+      }
+    }
+  }
+
+  return p_ctx->status == bsdiff_status_type_success && p_ctx->failed_count == 0 ? 1 : 0;
+}
+
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_patch_batch(snap_bsdiff_patch_batch_ctx* p_ctx) {
+  if(p_ctx == nullptr) {
+    return 0;
+  }
+
+  if(p_ctx->items == nullptr && p_ctx->items_count > 0) {
+    p_ctx->status = bsdiff_status_type_invalid_arg;
+    return 0;
+  }
+
+  const snap::bsdiff::batch_options options = { p_ctx->thread_count, p_ctx->max_memory_bytes };
+  std::atomic<size_t> failed_count{0};
+
+  // Items the batch never gets to, because it fails itself, keep this status.
+  for (size_t i = 0; i < p_ctx->items_count; i++) {
+    p_ctx->items[i].status = bsdiff_status_type_cancelled;
+  }
+
+  try {
+    snap::bsdiff::run_batch(p_ctx->items_count, options,
+      [p_ctx](const size_t index) {
+        const auto &item = p_ctx->items[index];
+        int64_t newer_size = 0;
+        if (item.patch == nullptr
+            || read_newer_size(item.patch, item.patch_size, &newer_size) != BSDIFF_SUCCESS
+            || newer_size < 0) {
+          // The item fails fast once it runs, it does not need a share of the budget.
+          return static_cast<uint64_t>(0);
+        }
+        // Verifying only needs older, newer is never materialized.
+        return static_cast<uint64_t>(item.older_size) + (item.verify_only != 0 ? 0 : static_cast<uint64_t>(newer_size));
+      },
+      [p_ctx, &failed_count](const size_t index) {
+        // The item is applied as a copy so that the options of the caller stay as they were,
+        // only the results are written back.
+        auto item = p_ctx->items[index];
+        if (item.thread_count == 0) {
+          item.thread_count = 1;
+        }
+        // snap_bsdiff_patch leaves status untouched when it rejects its arguments.
+        item.status = bsdiff_status_type_invalid_arg;
+        if (snap_bsdiff_patch(&item) != 1) {
+          failed_count++;
+        }
+
+        auto &result = p_ctx->items[index];
+        result.newer = item.newer;
+        result.newer_size = item.newer_size;
+        std::memcpy(result.newer_sha256, item.newer_sha256, sizeof result.newer_sha256);
+        result.status = item.status;
+      });
+    p_ctx->status = bsdiff_status_type_success;
+  } catch (const std::bad_alloc &) {
+    p_ctx->status = bsdiff_status_type_out_of_memory;
+  } catch (const std::system_error &) {
+    p_ctx->status = bsdiff_status_type_error;
+  }
+
+  p_ctx->failed_count = failed_count;
+  if (p_ctx->status != bsdiff_status_type_success) {
+    p_ctx->failed_count = 0;
+    for (size_t i = 0; i < p_ctx->items_count; i++) {
+      if (p_ctx->items[i].status != bsdiff_status_type_success) {
+        p_ctx->failed_count++;
+      }
+    }
+  }
+
+  return p_ctx->status == bsdiff_status_type_success && p_ctx->failed_count == 0 ? 1 : 0;
+}
+
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_diff_files(snap_bsdiff_diff_files_ctx* p_ctx) {
+  if(p_ctx == nullptr ||
+      p_ctx->older_path == nullptr ||
+      p_ctx->newer_path == nullptr ||
+      p_ctx->patch_path == nullptr) {
+    return 0;
+  }
+
+  int ret;
+  snap::bsdiff::mapped_file older, newer;
+  const auto temp_path = snap::bsdiff::temporary_path(p_ctx->patch_path);
+  struct bsdiff_stream patchfile = { nullptr }, countedfile = { nullptr };
+  struct bsdiff_stream *patch_stream = nullptr;
+  struct bsdiff_ctx ctx = { nullptr };
+  struct bsdiff_patch_packer packer = { nullptr };
+  snap::bsdiff::stats_recorder stats(p_ctx->stats);
+  snap::bsdiff::diff_options options = { p_ctx->thread_count, nullptr, 0, p_ctx->max_memory_bytes, &p_ctx->progress,
+                                         &stats, p_ctx->engine };
+  snap::bsdiff::patch_digests digests = {};
+  filtered_inputs inputs = {};
+  const snap::bsdiff::diff_cache cache(p_ctx->cache.path, p_ctx->cache.max_bytes);
+  snap::bsdiff::diff_cache_key cache_key = {};
+  snap::bsdiff::mapped_file cached;
+  const uint8_t *older_data = nullptr;
+  const uint8_t *newer_data = nullptr;
+  size_t older_size = 0;
+  size_t newer_size = 0;
+  auto cache_hit = false;
+
+  ctx.log_error = p_ctx->error_logger;
+  p_ctx->cache_hit = 0;
+  stats.begin();
+
+  if ((ret = older.open(p_ctx->older_path)) != BSDIFF_SUCCESS
+      || (ret = newer.open(p_ctx->newer_path)) != BSDIFF_SUCCESS) {
+    log_error(&ctx, "Failed to map input file.");
+    goto cleanup;
+  }
+
+  older_data = older.data();
+  newer_data = newer.data();
+  older_size = older.size();
+  newer_size = newer.size();
+
+  if (older.size() == 0 || newer.size() == 0) {
+    ret = BSDIFF_INVALID_ARG;
+    goto cleanup;
+  }
+
+  if (p_ctx->index != nullptr) {
+    if (p_ctx->index->index.older_size() != static_cast<int64_t>(older.size())) {
+      ret = BSDIFF_INVALID_ARG;
+      goto cleanup;
+    }
+    options.suffix_array = p_ctx->index->index.suffix_array();
+  }
+
+  if ((ret = snap::bsdiff::open_file_sink(temp_path.c_str(), &patchfile)) != BSDIFF_SUCCESS) {
+    log_error(&ctx, "Failed to create patch file.");
+    goto cleanup;
+  }
+
+  if ((ret = count_patch_bytes(stats, &patchfile, &countedfile, &patch_stream)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  digests = input_digests(p_ctx->packer, older.data(), older.size(), newer.data(), newer.size());
+
+  if (cache.enabled()) {
+    cache_key = diff_cache_key(*p_ctx, digests, older.data(), older.size(), newer.data(), newer.size());
+    if (cache.find(cache_key, cached)) {
+      cache_hit = true;
+      stats.end(&snap_bsdiff_stats::prepare);
+      if ((ret = patch_stream->write(patch_stream->state, cached.data(), cached.size())) == BSDIFF_SUCCESS) {
+        ret = patchfile.flush(patchfile.state);
+      }
+      goto cleanup;
+    }
+  }
+
+  if ((ret = filter_inputs(p_ctx->filter, p_ctx->packer, older_data, older.size(), newer_data, newer.size(), inputs)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  // The filtered copies live in memory, only unfiltered inputs are diffed from the mapping.
+  if (inputs.applied) {
+    older_data = inputs.older.data();
+    newer_data = inputs.newer.data();
+    older_size = inputs.older.size();
+    newer_size = inputs.newer.size();
+    options.suffix_array = nullptr;
+    stats.allocated(older_size + newer_size);
+  }
+
+  if ((ret = snap::bsdiff::open_patch_writer(&p_ctx->packer, p_ctx->thread_count, &digests, &inputs.layout, &inputs.archive,
+                                             patch_stream, &packer)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+  stats.end(&snap_bsdiff_stats::prepare);
+
+  if ((ret = snap::bsdiff::diff(&ctx,
+      older_data, static_cast<int64_t>(older_size),
+      newer_data, static_cast<int64_t>(newer_size),
+      &packer, &options)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  ret = patchfile.flush(patchfile.state);
+
+cleanup:
+  bsdiff_close_patch_packer(&packer);
+  bsdiff_close_stream(&countedfile);
+  bsdiff_close_stream(&patchfile);
+
+  if (ret == BSDIFF_SUCCESS) {
+    ret = snap::bsdiff::replace_file(temp_path, p_ctx->patch_path);
+  }
+  if (ret != BSDIFF_SUCCESS) {
+    std::remove(temp_path.c_str());
+  }
+
+  // A cached patch only counts once it is in place. Otherwise the patch is read back from
+  // its destination, it was streamed to disk while diffing.
+  if (ret == BSDIFF_SUCCESS && cache_hit) {
+    p_ctx->cache_hit = 1;
+  } else if (ret == BSDIFF_SUCCESS && cache.enabled()) {
+    snap::bsdiff::mapped_file written;
+    if (written.open(p_ctx->patch_path) == BSDIFF_SUCCESS) {
+      cache.insert(cache_key, written.data(), written.size());
+    }
+  }
+
+  stats.finish();
+  p_ctx->status = static_cast<snap_bsdiff_status_type>(ret);
+
+  return p_ctx->status == bsdiff_status_type_success ? 1 : 0;
+}
+
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_patch_files(snap_bsdiff_patch_files_ctx* p_ctx) {
+  if(p_ctx == nullptr ||
+      p_ctx->older_path == nullptr ||
+      p_ctx->patch_path == nullptr ||
+      p_ctx->newer_path == nullptr) {
+    return 0;
+  }
+
+  int ret;
+  snap::bsdiff::mapped_file older, patch;
+  const auto temp_path = snap::bsdiff::temporary_path(p_ctx->newer_path);
+  struct bsdiff_stream oldfile = { nullptr }, newfile = { nullptr }, patchfile = { nullptr }, countedfile = { nullptr };
+  struct bsdiff_stream *patch_stream = nullptr;
+  struct bsdiff_ctx ctx = { nullptr };
+  struct bsdiff_patch_packer packer = { nullptr };
+  snap::bsdiff::stats_recorder stats(p_ctx->stats);
+  snap::bsdiff::patch_digests digests = {};
+  snap::bsdiff::executable_layout filter = { snap::bsdiff::filter_arch::none, {} };
+  snap::bsdiff::archive_layout archive = { {}, {}, 0 };
+  const snap::bsdiff::patch_options options = { nullptr, &p_ctx->progress, &digests, nullptr, &filter, &archive, &stats };
+
+  ctx.log_error = p_ctx->error_logger;
+  stats.begin();
+
+  if ((ret = older.open(p_ctx->older_path)) != BSDIFF_SUCCESS
+      || (ret = patch.open(p_ctx->patch_path)) != BSDIFF_SUCCESS) {
+    log_error(&ctx, "Failed to map input file.");
+    goto cleanup;
+  }
+
+  if (older.size() == 0 || patch.size() == 0) {
+    ret = BSDIFF_INVALID_ARG;
+    goto cleanup;
+  }
+
+  if ((ret = bsdiff_open_memory_stream(BSDIFF_MODE_READ, older.data(), older.size(), &oldfile)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  if ((ret = bsdiff_open_memory_stream(BSDIFF_MODE_READ, patch.data(), patch.size(), &patchfile)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  if ((ret = count_patch_bytes(stats, &patchfile, &countedfile, &patch_stream)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  if ((ret = snap::bsdiff::open_patch_reader(patch_stream, p_ctx->thread_count, &packer, &digests, &filter, &archive)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  if ((ret = snap::bsdiff::open_file_sink(temp_path.c_str(), &newfile)) != BSDIFF_SUCCESS) {
+    log_error(&ctx, "Failed to create new file.");
+    goto cleanup;
+  }
+  stats.end(&snap_bsdiff_stats::prepare);
+
+  // patch flushes newer once everything is written.
+  ret = snap::bsdiff::patch(&ctx, &oldfile, &newfile, &packer, &options);
+
+cleanup:
+  bsdiff_close_patch_packer(&packer);
+  bsdiff_close_stream(&countedfile);
+  bsdiff_close_stream(&patchfile);
+  bsdiff_close_stream(&newfile);
+  bsdiff_close_stream(&oldfile);
+
+  if (ret == BSDIFF_SUCCESS) {
+    ret = snap::bsdiff::replace_file(temp_path, p_ctx->newer_path);
+  }
+  if (ret != BSDIFF_SUCCESS) {
+    std::remove(temp_path.c_str());
+  }
+
+  stats.finish();
+  p_ctx->status = static_cast<snap_bsdiff_status_type>(ret);
+
+  return p_ctx->status == bsdiff_status_type_success ? 1 : 0;
+}
+
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_sha256_init(snap_bsdiff_sha256_ctx* p_ctx) {
+  if(p_ctx == nullptr ||
+      p_ctx->hash != nullptr) {
+    return 0;
+  }
+
+  p_ctx->hash = new (std::nothrow) snap_bsdiff_sha256();
+  p_ctx->status = p_ctx->hash == nullptr ? bsdiff_status_type_out_of_memory : bsdiff_status_type_success;
+
+  return p_ctx->status == bsdiff_status_type_success ? 1 : 0;
+}
+
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_sha256_update(snap_bsdiff_sha256_ctx* p_ctx) {
+  if(p_ctx == nullptr ||
+      p_ctx->hash == nullptr ||
+      (p_ctx->data == nullptr && p_ctx->data_size > 0)) {
+    return 0;
+  }
+
+  p_ctx->hash->hash.update(static_cast<const uint8_t *>(p_ctx->data), p_ctx->data_size);
+  p_ctx->status = bsdiff_status_type_success;
+
+  return 1;
+}
+
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_sha256_final(snap_bsdiff_sha256_ctx* p_ctx) {
+  if(p_ctx == nullptr ||
+      p_ctx->hash == nullptr) {
+    return 0;
+  }
+
+  p_ctx->hash->hash.finish(p_ctx->digest);
+  delete p_ctx->hash;
+  p_ctx->hash = nullptr;
+  p_ctx->status = bsdiff_status_type_success;
+
+  return 1;
+}
+
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_sha256_batch(snap_bsdiff_sha256_batch_ctx* p_ctx) {
+  if(p_ctx == nullptr ||
+      (p_ctx->items == nullptr && p_ctx->items_count > 0)) {
+    return 0;
+  }
+
+  for (size_t i = 0; i < p_ctx->items_count; i++) {
+    if (p_ctx->items[i].data == nullptr && p_ctx->items[i].data_size > 0) {
+      return 0;
+    }
+  }
+
+  try {
+    std::vector<snap::bsdiff::sha256_message> messages(p_ctx->items_count);
+    for (size_t i = 0; i < p_ctx->items_count; i++) {
+      auto &item = p_ctx->items[i];
+      messages[i] = { static_cast<const uint8_t *>(item.data), item.data_size, item.digest };
+    }
+    std::stable_sort(messages.begin(), messages.end(), [](const auto &lhs, const auto &rhs) {
+      return lhs.size > rhs.size;
+    });
+
+    const auto group_count = (messages.size() + sha256_group_size - 1) / sha256_group_size;
+    const auto group_length = [&messages](const size_t group) {
+      return std::min(sha256_group_size, messages.size() - group * sha256_group_size);
+    };
+
+    snap::bsdiff::run_batch(group_count, { p_ctx->thread_count, 0 },
+      [&messages, &group_length](const size_t group) {
+        uint64_t size = 0;
+        for (size_t i = 0; i < group_length(group); i++) {
+          size += messages[group * sha256_group_size + i].size;
+        }
+        return size;
+      },
+      [&messages, &group_length](const size_t group) {
+        snap::bsdiff::sha256_digest_many(messages.data() + group * sha256_group_size, group_length(group));
+      });
+
+    p_ctx->status = bsdiff_status_type_success;
+  } catch (const std::bad_alloc &) {
+    p_ctx->status = bsdiff_status_type_out_of_memory;
+  } catch (const std::system_error &) {
+    p_ctx->status = bsdiff_status_type_error;
+  }
+
+  return p_ctx->status == bsdiff_status_type_success ? 1 : 0;
+}
+
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_chunk(snap_bsdiff_chunk_ctx* p_ctx) {
+  if(p_ctx == nullptr) {
+    return 0;
+  }
+
+  if((p_ctx->files == nullptr && p_ctx->files_count > 0) ||
+      (p_ctx->known == nullptr && p_ctx->known_count > 0)) {
+    p_ctx->status = bsdiff_status_type_invalid_arg;
+    return 0;
+  }
+
+  for (size_t i = 0; i < p_ctx->files_count; i++) {
+    const auto &file = p_ctx->files[i];
+    if ((file.data == nullptr && file.data_size > 0) || file.chunks != nullptr) {
+      p_ctx->status = bsdiff_status_type_invalid_arg;
+      return 0;
+    }
+  }
+
+  snap::bsdiff::chunk_params params = { p_ctx->min_size, p_ctx->avg_size, p_ctx->max_size };
+  if (params.min_size == 0 && params.avg_size == 0 && params.max_size == 0) {
+    params = { snap::bsdiff::chunk_default_min_size, snap::bsdiff::chunk_default_avg_size, snap::bsdiff::chunk_default_max_size };
+  }
+  if (params.min_size == 0 || params.min_size >= params.avg_size || params.avg_size >= params.max_size
+      || (params.avg_size & (params.avg_size - 1)) != 0) {
+    p_ctx->status = bsdiff_status_type_invalid_arg;
+    return 0;
+  }
+
+  std::atomic<int> failure{BSDIFF_SUCCESS};
+
+  try {
+    snap::bsdiff::run_batch(p_ctx->files_count, { p_ctx->thread_count, 0 },
+      [p_ctx](const size_t index) {
+        return static_cast<uint64_t>(p_ctx->files[index].data_size);
+      },
+      [p_ctx, &params, &failure](const size_t index) {
+        int ret;
+        try {
+          ret = chunk_file(params, p_ctx->allocator, p_ctx->files[index]);
+        } catch (const std::bad_alloc &) {
+          ret = BSDIFF_OUT_OF_MEMORY;
+        }
+        if (ret != BSDIFF_SUCCESS) {
+          failure = ret;
+        }
+      });
+  } catch (const std::bad_alloc &) {
+    failure = BSDIFF_OUT_OF_MEMORY;
+  } catch (const std::system_error &) {
+    failure = BSDIFF_ERROR;
+  }
+
+  p_ctx->status = static_cast<snap_bsdiff_status_type>(failure.load());
+  p_ctx->novel_count = 0;
+  p_ctx->novel_size = 0;
+
+  // Novelty is decided in release order once every file is hashed, so the first
+  // occurrence of a chunk is the one that ships no matter how the threads ran.
+  if (p_ctx->status == bsdiff_status_type_success) {
+    try {
+      std::unordered_set<chunk_digest, chunk_digest_hash> seen;
+      seen.reserve(p_ctx->known_count);
+      for (size_t i = 0; i < p_ctx->known_count; i++) {
+        chunk_digest digest;
+        std::memcpy(digest.data(), p_ctx->known + i * digest.size(), digest.size());
+        seen.insert(digest);
+      }
+
+      for (size_t i = 0; i < p_ctx->files_count; i++) {
+        const auto &file = p_ctx->files[i];
+        for (size_t j = 0; j < file.chunks_count; j++) {
+          auto &chunk = file.chunks[j];
+          chunk_digest digest;
+          std::memcpy(digest.data(), chunk.sha256, digest.size());
+          chunk.novel = seen.insert(digest).second ? 1 : 0;
+          if (chunk.novel != 0) {
+            p_ctx->novel_count++;
+            p_ctx->novel_size += chunk.size;
+          }
+        }
+      }
+    } catch (const std::bad_alloc &) {
+      p_ctx->status = bsdiff_status_type_out_of_memory;
+    }
+  }
+
+  if (p_ctx->status != bsdiff_status_type_success) {
+    if (p_ctx->error_logger != nullptr) {
+      p_ctx->error_logger(nullptr, "Failed to chunk release.");
+    }
+    free_chunks(p_ctx);
+  }
+
+  return p_ctx->status == bsdiff_status_type_success ? 1 : 0;
+}
+
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_chunk_free(snap_bsdiff_chunk_ctx* p_ctx) {
+  if(p_ctx == nullptr ||
+      (p_ctx->files == nullptr && p_ctx->files_count > 0)) {
+    return 0;
+  }
+
+  free_chunks(p_ctx);
+
+  return 1;
+}
+
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_compose(snap_bsdiff_compose_ctx* p_ctx) {
+  if(p_ctx == nullptr ||
+      p_ctx->items == nullptr ||
+      p_ctx->items_count == 0 ||
+      p_ctx->patch != nullptr ||
+      p_ctx->patch_size != 0) {
+    return 0;
+  }
+
+  for (size_t i = 0; i < p_ctx->items_count; i++) {
+    if (p_ctx->items[i].patch == nullptr || p_ctx->items[i].patch_size == 0) {
+      return 0;
+    }
+  }
+
+  int ret = BSDIFF_SUCCESS;
+  struct bsdiff_stream patchfile = { nullptr };
+  struct bsdiff_ctx ctx = { nullptr };
+  struct bsdiff_patch_packer packer = { nullptr };
+  snap::bsdiff::patch_chain chain;
+
+  ctx.log_error = p_ctx->error_logger;
+
+  for (size_t i = 0; i < p_ctx->items_count; i++) {
+    if ((ret = add_to_chain(chain, &ctx, p_ctx->items[i], p_ctx->thread_count)) != BSDIFF_SUCCESS) {
+      goto cleanup;
+    }
+  }
+
+  if ((ret = snap::bsdiff::open_allocator_stream(&p_ctx->allocator, &patchfile)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  if ((ret = snap::bsdiff::open_patch_writer(&p_ctx->packer, p_ctx->thread_count, &chain.digests(), nullptr, nullptr,
+                                             &patchfile, &packer)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  if ((ret = chain.write(&ctx, &packer)) != BSDIFF_SUCCESS) {
+    goto cleanup;
+  }
+
+  ret = snap::bsdiff::allocator_stream_detach(&patchfile, &p_ctx->patch, &p_ctx->patch_size);
+
+cleanup:
+  p_ctx->status = static_cast<snap_bsdiff_status_type>(ret);
+
+  bsdiff_close_patch_packer(&packer);
+  bsdiff_close_stream(&patchfile);
+
+  return p_ctx->status == bsdiff_status_type_success ? 1 : 0;
+}
+
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_compose_free(snap_bsdiff_compose_ctx* p_ctx) {
+  if(p_ctx == nullptr) {
+    return 0;
+  }
+
+  if(p_ctx->patch != nullptr) {
+    snap::bsdiff::allocator_free(&p_ctx->allocator, p_ctx->patch);
+    p_ctx->patch = nullptr;
+    p_ctx->patch_size = 0;
+  }
+
+  return 1;
+}
+
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_diff_async(snap_bsdiff_diff_async_ctx* p_ctx) {
+  if(p_ctx == nullptr ||
+      p_ctx->diff == nullptr ||
+      p_ctx->handle != nullptr) {
+    return 0;
+  }
+
+  auto *diff = p_ctx->diff;
+  const auto ret = start_async([diff] { return snap_bsdiff_diff(diff); }, p_ctx->completion, &p_ctx->handle);
+
+  p_ctx->status = static_cast<snap_bsdiff_status_type>(ret);
+
+  return p_ctx->status == bsdiff_status_type_success ? 1 : 0;
+}
+
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_patch_async(snap_bsdiff_patch_async_ctx* p_ctx) {
+  if(p_ctx == nullptr ||
+      p_ctx->patch == nullptr ||
+      p_ctx->handle != nullptr) {
+    return 0;
+  }
+
+  auto *patch = p_ctx->patch;
+  const auto ret = start_async([patch] { return snap_bsdiff_patch(patch); }, p_ctx->completion, &p_ctx->handle);
+
+  p_ctx->status = static_cast<snap_bsdiff_status_type>(ret);
+
+  return p_ctx->status == bsdiff_status_type_success ? 1 : 0;
+}
+
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_async_wait(snap_bsdiff_async_handle_ctx* p_ctx) {
+  if(p_ctx == nullptr ||
+      p_ctx->handle == nullptr) {
+    return 0;
+  }
+
+  p_ctx->completed = p_ctx->handle->operation->wait(p_ctx->timeout_ms, &p_ctx->result) ? 1 : 0;
+
+  return p_ctx->completed;
+}
+
+SNAP_API int32_t SNAP_CALLING_CONVENTION snap_bsdiff_async_close(snap_bsdiff_async_handle_ctx* p_ctx) {
+  if(p_ctx == nullptr) {
+    return 0;
+  }
+
+  if(p_ctx->handle != nullptr) {
+    delete p_ctx->handle;
+    p_ctx->handle = nullptr;
+  }
+
+  return 1;
+}
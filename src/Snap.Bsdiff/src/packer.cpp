@@ -0,0 +1,753 @@
+#include "bsdiff/packer.hpp"
+#include "bsdiff/codec.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace {
+
+// Patches written by anything but bz2 start with this header, followed by the compressed
+// entries. Entries use the BSDIFF43 layout: three 8 byte sign-magnitude integers (diff,
+// extra, seek) followed by the diff and extra bytes.
+//
+//   0  magic "SNAPBSDF"
+//   8  format version
+//   9  snap_bsdiff_packer_type
+//  10  zstd window log, 0 when long distance matching is off
+//  11  flags, see packer_flag_blocks, packer_flag_digests, packer_flag_filter and
+//      packer_flag_archive
+//  12  filter_arch of the executable filter, zero without packer_flag_filter
+//  13  reserved, three zero bytes
+//  16  size of the new file
+//
+// With packer_flag_digests the header continues with
+//
+//  24  size of the old file
+//  32  SHA-256 of the old file
+//  64  SHA-256 of the new file
+//
+// With packer_flag_filter the header then continues with the number of code ranges in the
+// new file, followed by the offset and size of every range, all as 8 byte integers.
+//
+// With packer_flag_archive the header then continues with the size of the new file before
+// it was expanded, the number of expanded entries of the old file followed by the offset,
+// compressed and uncompressed size of every entry, and the number of expanded entries of
+// the new file followed by the same and the zlib level of every entry, all as 8 byte
+// integers. The size at 16 is the size of the expanded new file.
+constexpr char packer_magic[8] = { 'S', 'N', 'A', 'P', 'B', 'S', 'D', 'F' };
+constexpr uint8_t packer_version = 1;
+constexpr size_t packer_header_size = 24;
+constexpr size_t entry_header_size = 24;
+constexpr size_t packer_digests_size = 8 + 2 * snap::bsdiff::sha256_digest_size;
+// The body is split in independently compressed blocks, see codec_block.cpp.
+constexpr uint8_t packer_flag_blocks = 0x01;
+constexpr uint8_t packer_flag_digests = 0x02;
+// Old and new file went through the executable filter, see filter.hpp.
+constexpr uint8_t packer_flag_filter = 0x04;
+// Real images have a few dozen code sections at most.
+constexpr int64_t packer_max_filter_ranges = 65536;
+// Entries of zip archives were expanded, see archive.hpp.
+constexpr uint8_t packer_flag_archive = 0x08;
+// A zip without zip64 holds 65535 entries at most.
+constexpr int64_t packer_max_archive_entries = 65535;
+
+struct codec_params {
+  snap_bsdiff_packer_type type;
+  int32_t level;
+  uint32_t window_log;
+  // Writer block size, 0 for a single stream. Readers only test for non zero.
+  uint32_t block_size;
+  uint32_t thread_count;
+};
+
+void offtout(const int64_t value, uint8_t *buffer) {
+  // Negated as unsigned, -value overflows for INT64_MIN.
+  auto magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+  for (auto i = 0; i < 8; ++i) {
+    buffer[i] = static_cast<uint8_t>(magnitude & 0xff);
+    magnitude >>= 8;
+  }
+  if (value < 0) {
+    buffer[7] |= 0x80;
+  }
+}
+
+int64_t offtin(const uint8_t *buffer) {
+  uint64_t magnitude = buffer[7] & 0x7f;
+  for (auto i = 6; i >= 0; --i) {
+    magnitude = (magnitude << 8) | buffer[i];
+  }
+  const auto value = static_cast<int64_t>(magnitude);
+  return (buffer[7] & 0x80) != 0 ? -value : value;
+}
+
+int open_codec(const int mode, const codec_params &params, struct bsdiff_stream *stream,
+               std::unique_ptr<snap::bsdiff::patch_codec> &codec) {
+  const snap::bsdiff::block_format *format = nullptr;
+  switch (params.type) {
+    case bsdiff_packer_type_stored:
+      if (params.block_size > 0) {
+        return mode == BSDIFF_MODE_READ ? BSDIFF_CORRUPT_PATCH : BSDIFF_INVALID_ARG;
+      }
+      return snap::bsdiff::open_stored_codec(mode, stream, codec);
+    case bsdiff_packer_type_zstd:
+#ifdef SNAP_BSDIFF_ZSTD
+      if (params.block_size == 0) {
+        return snap::bsdiff::open_zstd_codec(mode, stream, params.level, params.window_log, codec);
+      }
+      format = &snap::bsdiff::zstd_block_format;
+      break;
+#else
+      return bsdiff_status_type_unsupported;
+#endif
+    case bsdiff_packer_type_lz4:
+#ifdef SNAP_BSDIFF_LZ4
+      if (params.block_size == 0) {
+        return snap::bsdiff::open_lz4_codec(mode, stream, params.level, codec);
+      }
+      format = &snap::bsdiff::lz4_block_format;
+      break;
+#else
+      return bsdiff_status_type_unsupported;
+#endif
+    default:
+      return mode == BSDIFF_MODE_READ ? BSDIFF_CORRUPT_PATCH : BSDIFF_INVALID_ARG;
+  }
+
+  return snap::bsdiff::open_block_codec(mode, stream, format, params.level, params.window_log, params.block_size,
+                                        params.thread_count, codec);
+}
+
+struct codec_packer_state {
+  int mode;
+  struct bsdiff_stream *stream;
+  codec_params params;
+  int64_t new_size;
+  snap::bsdiff::patch_digests digests;
+  snap::bsdiff::executable_layout filter;
+  snap::bsdiff::archive_layout archive;
+  bool expanded;
+  std::unique_ptr<snap::bsdiff::patch_codec> codec;
+  bool finished;
+};
+
+int codec_packer_get_mode(void *state) {
+  return static_cast<codec_packer_state *>(state)->mode;
+}
+
+int codec_packer_read_new_size(void *state, int64_t *size) {
+  const auto *p_state = static_cast<codec_packer_state *>(state);
+  if (p_state->mode != BSDIFF_MODE_READ) {
+    return BSDIFF_INVALID_ARG;
+  }
+  *size = p_state->new_size;
+  return BSDIFF_SUCCESS;
+}
+
+int codec_packer_read_entry_header(void *state, int64_t *diff, int64_t *extra, int64_t *seek) {
+  const auto *p_state = static_cast<codec_packer_state *>(state);
+  if (p_state->mode != BSDIFF_MODE_READ) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  uint8_t buffer[entry_header_size];
+  size_t readed = 0;
+  const auto ret = p_state->codec->read(buffer, sizeof buffer, &readed);
+  if (ret == BSDIFF_END_OF_FILE) {
+    return readed == 0 ? BSDIFF_END_OF_FILE : BSDIFF_CORRUPT_PATCH;
+  }
+  if (ret != BSDIFF_SUCCESS) {
+    return ret;
+  }
+
+  *diff = offtin(buffer);
+  *extra = offtin(buffer + 8);
+  *seek = offtin(buffer + 16);
+
+  return BSDIFF_SUCCESS;
+}
+
+int codec_packer_read_entry_data(void *state, void *buffer, const size_t size, size_t *readed) {
+  const auto *p_state = static_cast<codec_packer_state *>(state);
+  if (p_state->mode != BSDIFF_MODE_READ) {
+    return BSDIFF_INVALID_ARG;
+  }
+  return p_state->codec->read(static_cast<uint8_t *>(buffer), size, readed);
+}
+
+int codec_packer_write_new_size(void *state, const int64_t size) {
+  auto *p_state = static_cast<codec_packer_state *>(state);
+  if (p_state->mode != BSDIFF_MODE_WRITE || size < 0) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  // The header is stored uncompressed so the packer can be identified before decoding.
+  const auto &digests = p_state->digests;
+  const auto &filter = p_state->filter;
+  const auto filtered = filter.arch != snap::bsdiff::filter_arch::none;
+  uint8_t header[packer_header_size + packer_digests_size] = { 0 };
+  std::memcpy(header, packer_magic, sizeof packer_magic);
+  header[8] = packer_version;
+  header[9] = static_cast<uint8_t>(p_state->params.type);
+  header[10] = static_cast<uint8_t>(p_state->params.window_log);
+  header[11] = static_cast<uint8_t>((p_state->params.block_size > 0 ? packer_flag_blocks : 0)
+                                    | (digests.present ? packer_flag_digests : 0)
+                                    | (filtered ? packer_flag_filter : 0)
+                                    | (p_state->expanded ? packer_flag_archive : 0));
+  header[12] = static_cast<uint8_t>(filter.arch);
+  offtout(size, header + 16);
+
+  if (digests.present) {
+    offtout(digests.older_size, header + 24);
+    std::memcpy(header + 32, digests.older_sha256, sizeof digests.older_sha256);
+    std::memcpy(header + 64, digests.newer_sha256, sizeof digests.newer_sha256);
+  }
+
+  p_state->new_size = size;
+
+  int ret;
+  if ((ret = p_state->stream->write(p_state->stream->state, header,
+                                    packer_header_size + (digests.present ? packer_digests_size : 0))) != BSDIFF_SUCCESS) {
+    return ret;
+  }
+
+  uint8_t buffer[32];
+  if (filtered) {
+    offtout(static_cast<int64_t>(filter.ranges.size()), buffer);
+    if ((ret = p_state->stream->write(p_state->stream->state, buffer, 8)) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+    for (const auto &range : filter.ranges) {
+      offtout(range.offset, buffer);
+      offtout(range.size, buffer + 8);
+      if ((ret = p_state->stream->write(p_state->stream->state, buffer, 16)) != BSDIFF_SUCCESS) {
+        return ret;
+      }
+    }
+  }
+
+  if (!p_state->expanded) {
+    return BSDIFF_SUCCESS;
+  }
+
+  const auto &archive = p_state->archive;
+  offtout(archive.newer_size, buffer);
+  offtout(static_cast<int64_t>(archive.older.size()), buffer + 8);
+  if ((ret = p_state->stream->write(p_state->stream->state, buffer, 16)) != BSDIFF_SUCCESS) {
+    return ret;
+  }
+  for (const auto &entry : archive.older) {
+    offtout(entry.offset, buffer);
+    offtout(entry.compressed_size, buffer + 8);
+    offtout(entry.uncompressed_size, buffer + 16);
+    if ((ret = p_state->stream->write(p_state->stream->state, buffer, 24)) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+  }
+
+  offtout(static_cast<int64_t>(archive.newer.size()), buffer);
+  if ((ret = p_state->stream->write(p_state->stream->state, buffer, 8)) != BSDIFF_SUCCESS) {
+    return ret;
+  }
+  for (const auto &entry : archive.newer) {
+    offtout(entry.offset, buffer);
+    offtout(entry.compressed_size, buffer + 8);
+    offtout(entry.uncompressed_size, buffer + 16);
+    offtout(entry.level, buffer + 24);
+    if ((ret = p_state->stream->write(p_state->stream->state, buffer, 32)) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+  }
+
+  return BSDIFF_SUCCESS;
+}
+
+int codec_packer_write_entry_header(void *state, const int64_t diff, const int64_t extra, const int64_t seek) {
+  const auto *p_state = static_cast<codec_packer_state *>(state);
+  if (p_state->mode != BSDIFF_MODE_WRITE) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  uint8_t buffer[entry_header_size];
+  offtout(diff, buffer);
+  offtout(extra, buffer + 8);
+  offtout(seek, buffer + 16);
+
+  return p_state->codec->write(buffer, sizeof buffer);
+}
+
+int codec_packer_write_entry_data(void *state, const uint8_t *buffer, const size_t size) {
+  const auto *p_state = static_cast<codec_packer_state *>(state);
+  if (p_state->mode != BSDIFF_MODE_WRITE) {
+    return BSDIFF_INVALID_ARG;
+  }
+  return p_state->codec->write(buffer, size);
+}
+
+int codec_packer_flush(void *state) {
+  auto *p_state = static_cast<codec_packer_state *>(state);
+  if (p_state->mode != BSDIFF_MODE_WRITE || p_state->finished) {
+    return BSDIFF_SUCCESS;
+  }
+
+  int ret;
+  if ((ret = p_state->codec->finish()) != BSDIFF_SUCCESS) {
+    return ret;
+  }
+  p_state->finished = true;
+
+  return p_state->stream->flush != nullptr ? p_state->stream->flush(p_state->stream->state) : BSDIFF_SUCCESS;
+}
+
+void codec_packer_close(void *state) {
+  delete static_cast<codec_packer_state *>(state);
+}
+
+int open_codec_packer(const int mode, const codec_params &params, const int64_t new_size,
+                      const snap::bsdiff::patch_digests &digests, snap::bsdiff::executable_layout filter,
+                      snap::bsdiff::archive_layout archive, const bool expanded, struct bsdiff_stream *stream,
+                      struct bsdiff_patch_packer *packer) {
+  std::unique_ptr<codec_packer_state> state(new (std::nothrow) codec_packer_state{
+    mode, stream, params, new_size, digests, std::move(filter), std::move(archive), expanded, nullptr, false
+  });
+  if (state == nullptr) {
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  int ret;
+  if ((ret = open_codec(mode, params, stream, state->codec)) != BSDIFF_SUCCESS) {
+    return ret;
+  }
+
+  std::memset(packer, 0, sizeof(*packer));
+  packer->state = state.release();
+  packer->get_mode = codec_packer_get_mode;
+  packer->read_new_size = codec_packer_read_new_size;
+  packer->read_entry_header = codec_packer_read_entry_header;
+  packer->read_entry_diff = codec_packer_read_entry_data;
+  packer->read_entry_extra = codec_packer_read_entry_data;
+  packer->write_new_size = codec_packer_write_new_size;
+  packer->write_entry_header = codec_packer_write_entry_header;
+  packer->write_entry_diff = codec_packer_write_entry_data;
+  packer->write_entry_extra = codec_packer_write_entry_data;
+  packer->flush = codec_packer_flush;
+  packer->close = codec_packer_close;
+
+  return BSDIFF_SUCCESS;
+}
+
+// Read only stream that returns the bytes consumed while sniffing the header before
+// continuing with the underlying stream.
+struct replay_stream_state {
+  uint8_t prefix[sizeof packer_magic];
+  size_t prefix_size;
+  size_t prefix_pos;
+  struct bsdiff_stream *stream;
+};
+
+void replay_stream_close(void *state) {
+  delete static_cast<replay_stream_state *>(state);
+}
+
+int replay_stream_get_mode(void *) {
+  return BSDIFF_MODE_READ;
+}
+
+int replay_stream_seek(void *, int64_t, int) {
+  return BSDIFF_INVALID_ARG;
+}
+
+int replay_stream_tell(void *, int64_t *) {
+  return BSDIFF_INVALID_ARG;
+}
+
+int replay_stream_read(void *state, void *buffer, const size_t size, size_t *readed) {
+  auto *p_state = static_cast<replay_stream_state *>(state);
+  auto *p_buffer = static_cast<uint8_t *>(buffer);
+
+  size_t prefix_bytes = 0;
+  if (p_state->prefix_pos < p_state->prefix_size) {
+    prefix_bytes = std::min(size, p_state->prefix_size - p_state->prefix_pos);
+    std::memcpy(p_buffer, p_state->prefix + p_state->prefix_pos, prefix_bytes);
+    p_state->prefix_pos += prefix_bytes;
+  }
+
+  size_t stream_bytes = 0;
+  auto ret = BSDIFF_SUCCESS;
+  if (prefix_bytes < size) {
+    ret = p_state->stream->read(p_state->stream->state, p_buffer + prefix_bytes, size - prefix_bytes, &stream_bytes);
+  }
+
+  *readed = prefix_bytes + stream_bytes;
+  return ret;
+}
+
+int replay_stream_write(void *, const void *, size_t) {
+  return BSDIFF_INVALID_ARG;
+}
+
+int replay_stream_flush(void *) {
+  return BSDIFF_SUCCESS;
+}
+
+int replay_stream_get_buffer(void *, const void **, size_t *) {
+  return BSDIFF_INVALID_ARG;
+}
+
+// bz2 patches are read by the bsdiff packer, which parses the header itself. It is fed
+// through a replay stream and owns it together with the packer.
+struct legacy_packer_state {
+  struct bsdiff_stream replay;
+  struct bsdiff_patch_packer packer;
+};
+
+int legacy_packer_get_mode(void *) {
+  return BSDIFF_MODE_READ;
+}
+
+int legacy_packer_read_new_size(void *state, int64_t *size) {
+  auto &inner = static_cast<legacy_packer_state *>(state)->packer;
+  return inner.read_new_size(inner.state, size);
+}
+
+int legacy_packer_read_entry_header(void *state, int64_t *diff, int64_t *extra, int64_t *seek) {
+  auto &inner = static_cast<legacy_packer_state *>(state)->packer;
+  return inner.read_entry_header(inner.state, diff, extra, seek);
+}
+
+int legacy_packer_read_entry_diff(void *state, void *buffer, const size_t size, size_t *readed) {
+  auto &inner = static_cast<legacy_packer_state *>(state)->packer;
+  return inner.read_entry_diff(inner.state, buffer, size, readed);
+}
+
+int legacy_packer_read_entry_extra(void *state, void *buffer, const size_t size, size_t *readed) {
+  auto &inner = static_cast<legacy_packer_state *>(state)->packer;
+  return inner.read_entry_extra(inner.state, buffer, size, readed);
+}
+
+int legacy_packer_write_new_size(void *, int64_t) {
+  return BSDIFF_INVALID_ARG;
+}
+
+int legacy_packer_write_entry_header(void *, int64_t, int64_t, int64_t) {
+  return BSDIFF_INVALID_ARG;
+}
+
+int legacy_packer_write_entry_data(void *, const uint8_t *, size_t) {
+  return BSDIFF_INVALID_ARG;
+}
+
+int legacy_packer_flush(void *) {
+  return BSDIFF_SUCCESS;
+}
+
+void legacy_packer_close(void *state) {
+  auto *p_state = static_cast<legacy_packer_state *>(state);
+  bsdiff_close_patch_packer(&p_state->packer);
+  bsdiff_close_stream(&p_state->replay);
+  delete p_state;
+}
+
+// Reads the code ranges that follow the header of a filtered patch. Ranges have to be
+// sorted, disjoint and within the new file, the decoder relies on that.
+int read_filter(struct bsdiff_stream *stream, const uint8_t arch, const int64_t new_size,
+                snap::bsdiff::executable_layout &filter) {
+  if (arch != static_cast<uint8_t>(snap::bsdiff::filter_arch::x86)
+      && arch != static_cast<uint8_t>(snap::bsdiff::filter_arch::arm64)) {
+    return BSDIFF_CORRUPT_PATCH;
+  }
+
+  uint8_t buffer[16];
+  size_t readed = 0;
+  int ret;
+  if ((ret = stream->read(stream->state, buffer, 8, &readed)) != BSDIFF_SUCCESS || readed != 8) {
+    return BSDIFF_CORRUPT_PATCH;
+  }
+
+  const auto count = offtin(buffer);
+  if (count <= 0 || count > packer_max_filter_ranges) {
+    return BSDIFF_CORRUPT_PATCH;
+  }
+
+  try {
+    filter.arch = static_cast<snap::bsdiff::filter_arch>(arch);
+    filter.ranges.reserve(static_cast<size_t>(count));
+    int64_t end = 0;
+    for (int64_t i = 0; i < count; i++) {
+      if ((ret = stream->read(stream->state, buffer, sizeof buffer, &readed)) != BSDIFF_SUCCESS || readed != sizeof buffer) {
+        return BSDIFF_CORRUPT_PATCH;
+      }
+      const snap::bsdiff::filter_range range = { offtin(buffer), offtin(buffer + 8) };
+      if (range.offset < end || range.size <= 0 || range.size > new_size - range.offset) {
+        return BSDIFF_CORRUPT_PATCH;
+      }
+      filter.ranges.push_back(range);
+      end = range.offset + range.size;
+    }
+  } catch (const std::bad_alloc &) {
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  return BSDIFF_SUCCESS;
+}
+
+// Reads the archive entries that follow the header of an expanded patch. Entries of either
+// file have to be sorted and disjoint, entries of the new file have to lie within it and
+// account for the difference between its size and new_size.
+int read_archive(struct bsdiff_stream *stream, const int64_t new_size, snap::bsdiff::archive_layout &archive) {
+  uint8_t buffer[32];
+  size_t readed = 0;
+  int ret;
+  if ((ret = stream->read(stream->state, buffer, 16, &readed)) != BSDIFF_SUCCESS || readed != 16) {
+    return BSDIFF_CORRUPT_PATCH;
+  }
+
+  archive.newer_size = offtin(buffer);
+  auto count = offtin(buffer + 8);
+  if (archive.newer_size < 0 || count < 0 || count > packer_max_archive_entries) {
+    return BSDIFF_CORRUPT_PATCH;
+  }
+
+  try {
+    int64_t end = 0;
+    archive.older.reserve(static_cast<size_t>(count));
+    for (int64_t i = 0; i < count; i++) {
+      if ((ret = stream->read(stream->state, buffer, 24, &readed)) != BSDIFF_SUCCESS || readed != 24) {
+        return BSDIFF_CORRUPT_PATCH;
+      }
+      const snap::bsdiff::archive_entry entry = { offtin(buffer), offtin(buffer + 8), offtin(buffer + 16), 0 };
+      if (entry.offset < end || entry.compressed_size < 0 || entry.uncompressed_size < 0
+          || entry.compressed_size > INT64_MAX - entry.offset) {
+        return BSDIFF_CORRUPT_PATCH;
+      }
+      archive.older.push_back(entry);
+      end = entry.offset + entry.compressed_size;
+    }
+
+    if ((ret = stream->read(stream->state, buffer, 8, &readed)) != BSDIFF_SUCCESS || readed != 8) {
+      return BSDIFF_CORRUPT_PATCH;
+    }
+    count = offtin(buffer);
+    if (count < 0 || count > packer_max_archive_entries) {
+      return BSDIFF_CORRUPT_PATCH;
+    }
+
+    // The expanded file holds every uncompressed entry, which bounds their sum.
+    end = 0;
+    int64_t compressed_size = 0, uncompressed_size = 0;
+    archive.newer.reserve(static_cast<size_t>(count));
+    for (int64_t i = 0; i < count; i++) {
+      if ((ret = stream->read(stream->state, buffer, 32, &readed)) != BSDIFF_SUCCESS || readed != 32) {
+        return BSDIFF_CORRUPT_PATCH;
+      }
+      const snap::bsdiff::archive_entry entry = {
+        offtin(buffer), offtin(buffer + 8), offtin(buffer + 16), static_cast<int32_t>(offtin(buffer + 24))
+      };
+      if (entry.offset < end || entry.compressed_size < 0 || entry.compressed_size > archive.newer_size - entry.offset
+          || entry.uncompressed_size < 0 || entry.uncompressed_size > new_size - uncompressed_size
+          || entry.level < 0 || entry.level > 9) {
+        return BSDIFF_CORRUPT_PATCH;
+      }
+      archive.newer.push_back(entry);
+      end = entry.offset + entry.compressed_size;
+      compressed_size += entry.compressed_size;
+      uncompressed_size += entry.uncompressed_size;
+    }
+
+    if (archive.newer_size - compressed_size + uncompressed_size != new_size) {
+      return BSDIFF_CORRUPT_PATCH;
+    }
+  } catch (const std::bad_alloc &) {
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  return BSDIFF_SUCCESS;
+}
+
+int open_legacy_reader(const uint8_t *prefix, const size_t prefix_size, struct bsdiff_stream *stream,
+                       struct bsdiff_patch_packer *packer) {
+  auto *p_replay = new (std::nothrow) replay_stream_state{ { 0 }, prefix_size, 0, stream };
+  if (p_replay == nullptr) {
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+  std::memcpy(p_replay->prefix, prefix, prefix_size);
+
+  auto *p_state = new (std::nothrow) legacy_packer_state();
+  if (p_state == nullptr) {
+    delete p_replay;
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  p_state->replay.state = p_replay;
+  p_state->replay.close = replay_stream_close;
+  p_state->replay.get_mode = replay_stream_get_mode;
+  p_state->replay.seek = replay_stream_seek;
+  p_state->replay.tell = replay_stream_tell;
+  p_state->replay.read = replay_stream_read;
+  p_state->replay.write = replay_stream_write;
+  p_state->replay.flush = replay_stream_flush;
+  p_state->replay.get_buffer = replay_stream_get_buffer;
+
+  int ret;
+  if ((ret = bsdiff_open_bz2_patch_packer(BSDIFF_MODE_READ, &p_state->replay, &p_state->packer)) != BSDIFF_SUCCESS) {
+    legacy_packer_close(p_state);
+    return ret;
+  }
+
+  std::memset(packer, 0, sizeof(*packer));
+  packer->state = p_state;
+  packer->get_mode = legacy_packer_get_mode;
+  packer->read_new_size = legacy_packer_read_new_size;
+  packer->read_entry_header = legacy_packer_read_entry_header;
+  packer->read_entry_diff = legacy_packer_read_entry_diff;
+  packer->read_entry_extra = legacy_packer_read_entry_extra;
+  packer->write_new_size = legacy_packer_write_new_size;
+  packer->write_entry_header = legacy_packer_write_entry_header;
+  packer->write_entry_diff = legacy_packer_write_entry_data;
+  packer->write_entry_extra = legacy_packer_write_entry_data;
+  packer->flush = legacy_packer_flush;
+  packer->close = legacy_packer_close;
+
+  return BSDIFF_SUCCESS;
+}
+
+}
+
+int snap::bsdiff::open_patch_writer(const snap_bsdiff_packer_options *options, const uint32_t thread_count,
+                                    const patch_digests *digests, const executable_layout *filter,
+                                    const archive_layout *archive, struct bsdiff_stream *stream,
+                                    struct bsdiff_patch_packer *packer) {
+  if (stream == nullptr || packer == nullptr) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  if (options == nullptr) {
+    return bsdiff_open_bz2_patch_packer(BSDIFF_MODE_WRITE, stream, packer);
+  }
+
+  if (options->type == bsdiff_packer_type_bz2) {
+    // The BSDIFF43 stream has no header to flag blocks in.
+    if (options->block_size > 0) {
+      return BSDIFF_INVALID_ARG;
+    }
+    return bsdiff_open_bz2_patch_packer(BSDIFF_MODE_WRITE, stream, packer);
+  }
+
+  if (options->window_log != 0 && options->type != bsdiff_packer_type_zstd) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  if (digests != nullptr && digests->present && digests->older_size < 0) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  executable_layout layout = { filter_arch::none, {} };
+  archive_layout entries = { {}, {}, 0 };
+  try {
+    if (filter != nullptr && filter->arch != filter_arch::none) {
+      layout = *filter;
+    }
+    if (archive != nullptr) {
+      entries = *archive;
+    }
+  } catch (const std::bad_alloc &) {
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  const codec_params params = { options->type, options->level, options->window_log, options->block_size, thread_count };
+  return open_codec_packer(BSDIFF_MODE_WRITE, params, 0, digests != nullptr ? *digests : patch_digests{},
+                           std::move(layout), std::move(entries), archive_expanded(entries), stream, packer);
+}
+
+int snap::bsdiff::open_patch_reader(struct bsdiff_stream *stream, const uint32_t thread_count, struct bsdiff_patch_packer *packer,
+                                    patch_digests *digests, executable_layout *filter, archive_layout *archive) {
+  if (stream == nullptr || packer == nullptr) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  patch_digests header_digests = {};
+  executable_layout header_filter = { filter_arch::none, {} };
+  archive_layout header_archive = { {}, {}, 0 };
+
+  uint8_t header[packer_header_size];
+  size_t readed = 0;
+  auto ret = stream->read(stream->state, header, sizeof packer_magic, &readed);
+  if (ret != BSDIFF_SUCCESS && ret != BSDIFF_END_OF_FILE) {
+    return ret;
+  }
+
+  if (readed < sizeof packer_magic || std::memcmp(header, packer_magic, sizeof packer_magic) != 0) {
+    return open_legacy_reader(header, readed, stream, packer);
+  }
+
+  const auto remaining = packer_header_size - sizeof packer_magic;
+  if ((ret = stream->read(stream->state, header + sizeof packer_magic, remaining, &readed)) != BSDIFF_SUCCESS
+      || readed != remaining) {
+    return BSDIFF_CORRUPT_PATCH;
+  }
+
+  const auto new_size = offtin(header + 16);
+  if (header[8] != packer_version || new_size < 0) {
+    return BSDIFF_CORRUPT_PATCH;
+  }
+
+  // Writers zero what they don't use, anything else was not written by this version.
+  if ((header[11] & ~(packer_flag_blocks | packer_flag_digests | packer_flag_filter | packer_flag_archive)) != 0
+      || ((header[11] & packer_flag_filter) == 0 && header[12] != 0)) {
+    return BSDIFF_CORRUPT_PATCH;
+  }
+  for (size_t i = 13; i < 16; i++) {
+    if (header[i] != 0) {
+      return BSDIFF_CORRUPT_PATCH;
+    }
+  }
+
+  if ((header[11] & packer_flag_digests) != 0) {
+    uint8_t buffer[packer_digests_size];
+    if ((ret = stream->read(stream->state, buffer, sizeof buffer, &readed)) != BSDIFF_SUCCESS || readed != sizeof buffer) {
+      return BSDIFF_CORRUPT_PATCH;
+    }
+
+    header_digests.present = true;
+    header_digests.older_size = offtin(buffer);
+    std::memcpy(header_digests.older_sha256, buffer + 8, sizeof header_digests.older_sha256);
+    std::memcpy(header_digests.newer_sha256, buffer + 40, sizeof header_digests.newer_sha256);
+    if (header_digests.older_size < 0) {
+      return BSDIFF_CORRUPT_PATCH;
+    }
+  }
+
+  if ((header[11] & packer_flag_filter) != 0) {
+    if ((ret = read_filter(stream, header[12], new_size, header_filter)) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+  }
+
+  if ((header[11] & packer_flag_archive) != 0 && (ret = read_archive(stream, new_size, header_archive)) != BSDIFF_SUCCESS) {
+    return ret;
+  }
+
+  const codec_params params = {
+    static_cast<snap_bsdiff_packer_type>(header[9]), 0, header[10],
+    (header[11] & packer_flag_blocks) != 0 ? 1u : 0u, thread_count
+  };
+  if ((ret = open_codec_packer(BSDIFF_MODE_READ, params, new_size, header_digests, executable_layout{ filter_arch::none, {} },
+                               archive_layout{ {}, {}, 0 }, false, stream, packer)) != BSDIFF_SUCCESS) {
+    return ret;
+  }
+
+  if (digests != nullptr) {
+    *digests = header_digests;
+  }
+  if (filter != nullptr) {
+    *filter = std::move(header_filter);
+  }
+  if (archive != nullptr) {
+    *archive = std::move(header_archive);
+  }
+
+  return BSDIFF_SUCCESS;
+}
@@ -0,0 +1,451 @@
+#include "bsdiff/patch.hpp"
+#include "bsdiff/archive.hpp"
+#include "bsdiff/bytes.hpp"
+#include "bsdiff/filter.hpp"
+#include "bsdiff/progress.hpp"
+#include "bsdiff/sha256.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <vector>
+
+namespace {
+
+using snap::bsdiff::archive_encoder;
+using snap::bsdiff::archive_entry;
+using snap::bsdiff::byte_kernels;
+using snap::bsdiff::executable_layout;
+using snap::bsdiff::filter_arch;
+using snap::bsdiff::filter_decoder;
+using snap::bsdiff::sha256;
+using snap::bsdiff::sha256_digest_size;
+using snap::bsdiff::stats_recorder;
+
+constexpr size_t patch_chunk_size = 64 * 1024;
+
+void log_error(struct bsdiff_ctx *ctx, const char *errmsg) {
+  if (ctx != nullptr && ctx->log_error != nullptr) {
+    ctx->log_error(ctx->opaque, errmsg);
+  }
+}
+
+class older_reader final {
+  struct bsdiff_stream *m_stream;
+  stats_recorder &m_stats;
+  const uint8_t *m_buffer;
+  int64_t m_size;
+  int64_t m_position;
+  std::vector<uint8_t> m_chunk;
+  std::vector<uint8_t> m_loaded;
+  std::vector<uint8_t> m_expanded;
+
+  // Copies all of older to m_loaded.
+  int load() {
+    try {
+      m_loaded.resize(static_cast<size_t>(m_size));
+    } catch (const std::bad_alloc &) {
+      return BSDIFF_OUT_OF_MEMORY;
+    }
+    m_stats.allocated(m_loaded.size());
+
+    int ret;
+    if (m_buffer != nullptr) {
+      std::memcpy(m_loaded.data(), m_buffer, m_loaded.size());
+    } else {
+      size_t readed = 0;
+      if ((ret = m_stream->seek(m_stream->state, 0, bsdiff_seek_origin_begin)) != BSDIFF_SUCCESS
+          || (ret = m_stream->read(m_stream->state, m_loaded.data(), m_loaded.size(), &readed)) != BSDIFF_SUCCESS) {
+        return ret;
+      }
+      if (readed != m_loaded.size()) {
+        return BSDIFF_FILE_ERROR;
+      }
+    }
+
+    return BSDIFF_SUCCESS;
+  }
+
+public:
+  older_reader(struct bsdiff_stream *stream, stats_recorder &stats) :
+      m_stream(stream),
+      m_stats(stats),
+      m_buffer(nullptr),
+      m_size(-1),
+      m_position(-1),
+      m_chunk(),
+      m_loaded(),
+      m_expanded() {
+  }
+
+  older_reader(const older_reader &) = delete;
+  older_reader &operator=(const older_reader &) = delete;
+
+  ~older_reader() {
+    m_stats.released(m_chunk.size() + m_loaded.size() + m_expanded.size());
+  }
+
+  int open() {
+    const void *buffer = nullptr;
+    size_t buffer_len = 0;
+    if (m_stream->get_buffer != nullptr
+        && m_stream->get_buffer(m_stream->state, &buffer, &buffer_len) == BSDIFF_SUCCESS) {
+      m_buffer = static_cast<const uint8_t *>(buffer);
+      m_size = static_cast<int64_t>(buffer_len);
+      return BSDIFF_SUCCESS;
+    }
+
+    int ret;
+    if ((ret = m_stream->seek(m_stream->state, 0, SEEK_END)) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+
+    if ((ret = m_stream->tell(m_stream->state, &m_size)) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+
+    m_position = m_size;
+    m_chunk.resize(patch_chunk_size);
+    m_stats.allocated(m_chunk.size());
+
+    return m_size < 0 ? BSDIFF_FILE_ERROR : BSDIFF_SUCCESS;
+  }
+
+  int64_t size() const { return m_size; }
+
+  // Hashes all of older, reading it from the start when it is not backed by a buffer.
+  int hash(uint8_t digest[snap::bsdiff::sha256_digest_size]) {
+    snap::bsdiff::sha256 hash;
+    if (m_buffer != nullptr) {
+      hash.update(m_buffer, static_cast<size_t>(m_size));
+      hash.finish(digest);
+      return BSDIFF_SUCCESS;
+    }
+
+    int ret;
+    if ((ret = m_stream->seek(m_stream->state, 0, bsdiff_seek_origin_begin)) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+    m_position = 0;
+
+    while (m_position < m_size) {
+      const auto len = static_cast<size_t>(std::min<int64_t>(m_size - m_position, static_cast<int64_t>(m_chunk.size())));
+      size_t readed = 0;
+      if ((ret = m_stream->read(m_stream->state, m_chunk.data(), len, &readed)) != BSDIFF_SUCCESS) {
+        return ret;
+      }
+      hash.update(m_chunk.data(), len);
+      m_position += static_cast<int64_t>(len);
+    }
+
+    hash.finish(digest);
+    return BSDIFF_SUCCESS;
+  }
+
+  // Loads all of older and runs it through the executable filter, the patch was made from
+  // the filtered bytes. Reads continue from memory.
+  int filter(const snap::bsdiff::filter_arch arch) {
+    int ret;
+    if ((ret = load()) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+
+    try {
+      snap::bsdiff::filter_encode_as(arch, m_loaded.data(), m_loaded.size());
+    } catch (const std::bad_alloc &) {
+      return BSDIFF_OUT_OF_MEMORY;
+    }
+
+    m_buffer = m_loaded.data();
+    return BSDIFF_SUCCESS;
+  }
+
+  // Replaces the archive entries of older by their uncompressed bytes, the patch was made
+  // from the expanded file. Reads continue from memory.
+  int expand(const std::vector<snap::bsdiff::archive_entry> &entries) {
+    int ret;
+    if (m_buffer == nullptr) {
+      if ((ret = load()) != BSDIFF_SUCCESS) {
+        return ret;
+      }
+      m_buffer = m_loaded.data();
+    }
+
+    try {
+      if ((ret = snap::bsdiff::archive_expand(m_buffer, static_cast<size_t>(m_size), entries, m_expanded)) != BSDIFF_SUCCESS) {
+        return ret;
+      }
+    } catch (const std::bad_alloc &) {
+      return BSDIFF_OUT_OF_MEMORY;
+    }
+    m_stats.allocated(m_expanded.size());
+
+    m_stats.released(m_loaded.size());
+    m_loaded = std::vector<uint8_t>();
+    m_buffer = m_expanded.data();
+    m_size = static_cast<int64_t>(m_expanded.size());
+    return BSDIFF_SUCCESS;
+  }
+
+  // Adds older[offset, offset + size) to buffer. Bytes outside of older are treated as zero.
+  int add_to(const int64_t offset, uint8_t *buffer, const size_t size) {
+    const auto begin = std::max<int64_t>(offset, 0);
+    const auto end = std::min<int64_t>(offset + static_cast<int64_t>(size), m_size);
+    if (begin >= end) {
+      return BSDIFF_SUCCESS;
+    }
+
+    auto *dst = buffer + (begin - offset);
+    const auto len = static_cast<size_t>(end - begin);
+
+    if (m_buffer != nullptr) {
+      byte_kernels().add(dst, m_buffer + begin, len);
+      return BSDIFF_SUCCESS;
+    }
+
+    int ret;
+    if (m_position != begin) {
+      if ((ret = m_stream->seek(m_stream->state, begin, SEEK_SET)) != BSDIFF_SUCCESS) {
+        return ret;
+      }
+      m_position = begin;
+    }
+
+    size_t readed = 0;
+    if ((ret = m_stream->read(m_stream->state, m_chunk.data(), len, &readed)) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+
+    m_position += static_cast<int64_t>(readed);
+
+    byte_kernels().add(dst, m_chunk.data(), len);
+
+    return BSDIFF_SUCCESS;
+  }
+};
+
+}
+
+namespace {
+
+int patch_entries(struct bsdiff_ctx *ctx, struct bsdiff_stream *older, struct bsdiff_stream *newer,
+                  struct bsdiff_patch_packer *packer, const snap::bsdiff::patch_options *options, stats_recorder &stats) {
+  int ret;
+  stats.begin();
+  older_reader reader(older, stats);
+  if ((ret = reader.open()) != BSDIFF_SUCCESS) {
+    log_error(ctx, "Failed to determine size of old file.");
+    return ret;
+  }
+
+  int64_t newer_size = 0;
+  if ((ret = packer->read_new_size(packer->state, &newer_size)) != BSDIFF_SUCCESS) {
+    log_error(ctx, "Failed to read new file size from patch.");
+    return ret;
+  }
+
+  if (newer_size < 0) {
+    log_error(ctx, "Corrupt patch: negative new file size.");
+    return BSDIFF_CORRUPT_PATCH;
+  }
+
+  // Checking older first fails a patch made from another file before any work is done.
+  const auto *digests = options != nullptr && options->digests != nullptr && options->digests->present
+    ? options->digests : nullptr;
+  if (digests != nullptr) {
+    uint8_t older_sha256[sha256_digest_size];
+    if (reader.size() != digests->older_size) {
+      log_error(ctx, "Old file size does not match the patch.");
+      return bsdiff_status_type_digest_mismatch;
+    }
+    if ((ret = reader.hash(older_sha256)) != BSDIFF_SUCCESS) {
+      log_error(ctx, "Failed to read old file.");
+      return ret;
+    }
+    if (std::memcmp(older_sha256, digests->older_sha256, sizeof older_sha256) != 0) {
+      log_error(ctx, "Old file does not match the patch.");
+      return bsdiff_status_type_digest_mismatch;
+    }
+  }
+
+  const auto *filter = options != nullptr && options->filter != nullptr && options->filter->arch != filter_arch::none
+    ? options->filter : nullptr;
+  if (filter != nullptr && (ret = reader.filter(filter->arch)) != BSDIFF_SUCCESS) {
+    log_error(ctx, "Failed to read old file.");
+    return ret;
+  }
+
+  const auto *archive = options != nullptr && options->archive != nullptr && snap::bsdiff::archive_expanded(*options->archive)
+    ? options->archive : nullptr;
+  if (archive != nullptr && (ret = reader.expand(archive->older)) != BSDIFF_SUCCESS) {
+    log_error(ctx, ret == BSDIFF_CORRUPT_PATCH ? "Old file does not match the archive entries of the patch."
+                                               : "Failed to read old file.");
+    return ret;
+  }
+
+  if (options != nullptr && options->reserve_newer != nullptr
+      && (ret = options->reserve_newer(newer, archive != nullptr ? archive->newer_size : newer_size)) != BSDIFF_SUCCESS) {
+    log_error(ctx, "Failed to allocate new file.");
+    return ret;
+  }
+  if (options != nullptr && options->reserve_newer != nullptr) {
+    stats.allocated(static_cast<uint64_t>(archive != nullptr ? archive->newer_size : newer_size));
+  }
+  stats.end(&snap_bsdiff_stats::prepare);
+  stats.begin();
+
+  snap::bsdiff::progress_reporter progress(options != nullptr ? options->progress : nullptr, static_cast<uint64_t>(newer_size));
+  // newer is hashed chunk by chunk while the chunk is still in cache.
+  auto *newer_sha256 = options != nullptr ? options->newer_sha256 : nullptr;
+  const auto hash_newer = digests != nullptr || newer_sha256 != nullptr;
+  sha256 newer_hash;
+  const filter_decoder::emit_function emit = [&](const uint8_t *data, const size_t size) {
+    if (hash_newer) {
+      newer_hash.update(data, size);
+    }
+    return newer->write(newer->state, data, size);
+  };
+  // Bytes of newer as they come out of the patch, still filtered or expanded when the patch is.
+  const executable_layout no_filter = { filter_arch::none, {} };
+  const std::vector<archive_entry> no_entries;
+  filter_decoder decoder(filter != nullptr ? *filter : no_filter);
+  archive_encoder encoder(archive != nullptr ? archive->newer : no_entries);
+  const auto output = [&](const uint8_t *data, const size_t size) {
+    try {
+      if (filter != nullptr) {
+        return decoder.write(data, size, emit);
+      }
+      return archive != nullptr ? encoder.write(data, size, emit) : emit(data, size);
+    } catch (const std::bad_alloc &) {
+      return BSDIFF_OUT_OF_MEMORY;
+    }
+  };
+  std::vector<uint8_t> chunk(patch_chunk_size);
+  stats.allocated(chunk.size());
+  int64_t older_pos = 0;
+  int64_t newer_pos = 0;
+  uint64_t written = 0;
+
+  while (newer_pos < newer_size) {
+    int64_t diff_len = 0, extra_len = 0, seek_len = 0;
+    if ((ret = packer->read_entry_header(packer->state, &diff_len, &extra_len, &seek_len)) != BSDIFF_SUCCESS) {
+      log_error(ctx, "Failed to read patch entry header.");
+      return ret;
+    }
+
+    if (diff_len < 0 || extra_len < 0 || diff_len > newer_size - newer_pos
+        || extra_len > newer_size - newer_pos - diff_len) {
+      log_error(ctx, "Corrupt patch: entry exceeds new file size.");
+      return BSDIFF_CORRUPT_PATCH;
+    }
+
+    for (auto remaining = diff_len; remaining > 0;) {
+      const auto len = static_cast<size_t>(std::min<int64_t>(remaining, static_cast<int64_t>(chunk.size())));
+      size_t readed = 0;
+      if ((ret = packer->read_entry_diff(packer->state, chunk.data(), len, &readed)) != BSDIFF_SUCCESS || readed != len) {
+        log_error(ctx, "Corrupt patch: truncated diff block.");
+        return ret != BSDIFF_SUCCESS ? ret : BSDIFF_CORRUPT_PATCH;
+      }
+
+      if ((ret = reader.add_to(older_pos, chunk.data(), len)) != BSDIFF_SUCCESS) {
+        log_error(ctx, "Failed to read old file.");
+        return ret;
+      }
+
+      if ((ret = output(chunk.data(), len)) != BSDIFF_SUCCESS) {
+        log_error(ctx, "Failed to write new file.");
+        return ret;
+      }
+
+      if ((ret = progress.update(written += len)) != BSDIFF_SUCCESS) {
+        return ret;
+      }
+
+      older_pos += static_cast<int64_t>(len);
+      remaining -= static_cast<int64_t>(len);
+    }
+
+    for (auto remaining = extra_len; remaining > 0;) {
+      const auto len = static_cast<size_t>(std::min<int64_t>(remaining, static_cast<int64_t>(chunk.size())));
+      size_t readed = 0;
+      if ((ret = packer->read_entry_extra(packer->state, chunk.data(), len, &readed)) != BSDIFF_SUCCESS || readed != len) {
+        log_error(ctx, "Corrupt patch: truncated extra block.");
+        return ret != BSDIFF_SUCCESS ? ret : BSDIFF_CORRUPT_PATCH;
+      }
+
+      if ((ret = output(chunk.data(), len)) != BSDIFF_SUCCESS) {
+        log_error(ctx, "Failed to write new file.");
+        return ret;
+      }
+
+      if ((ret = progress.update(written += len)) != BSDIFF_SUCCESS) {
+        return ret;
+      }
+
+      remaining -= static_cast<int64_t>(len);
+    }
+
+    newer_pos += diff_len + extra_len;
+    older_pos += seek_len;
+  }
+
+  if (filter != nullptr && (ret = decoder.finish(emit)) != BSDIFF_SUCCESS) {
+    log_error(ctx, "Failed to write new file.");
+    return ret;
+  }
+
+  if (archive != nullptr && (ret = encoder.finish(emit)) != BSDIFF_SUCCESS) {
+    log_error(ctx, "Failed to write new file.");
+    return ret;
+  }
+
+  if ((ret = progress.report(written)) != BSDIFF_SUCCESS) {
+    return ret;
+  }
+
+  if (hash_newer) {
+    uint8_t digest[sha256_digest_size];
+    newer_hash.finish(digest);
+    if (digests != nullptr && std::memcmp(digest, digests->newer_sha256, sizeof digest) != 0) {
+      log_error(ctx, "New file does not match the patch.");
+      return bsdiff_status_type_digest_mismatch;
+    }
+    if (newer_sha256 != nullptr) {
+      std::memcpy(newer_sha256, digest, sizeof digest);
+    }
+  }
+
+  if (newer->flush != nullptr && (ret = newer->flush(newer->state)) != BSDIFF_SUCCESS) {
+    return ret;
+  }
+  stats.end_interleaved(&snap_bsdiff_stats::apply);
+  stats.released(chunk.size());
+
+  return BSDIFF_SUCCESS;
+}
+
+}
+
+int snap::bsdiff::patch(struct bsdiff_ctx *ctx, struct bsdiff_stream *older, struct bsdiff_stream *newer, struct bsdiff_patch_packer *packer,
+                       const patch_options *options) {
+  if (older == nullptr || newer == nullptr || packer == nullptr) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  stats_recorder no_stats(nullptr);
+  auto &stats = options != nullptr && options->stats != nullptr ? *options->stats : no_stats;
+  if (!stats.enabled()) {
+    return patch_entries(ctx, older, newer, packer, options, stats);
+  }
+
+  // Entries are counted and packer calls timed on their way from the caller's packer.
+  struct bsdiff_patch_packer counted = { nullptr };
+  auto ret = open_stats_packer(packer, &stats, &counted);
+  if (ret == BSDIFF_SUCCESS) {
+    ret = patch_entries(ctx, older, newer, &counted, options, stats);
+  }
+  bsdiff_close_patch_packer(&counted);
+
+  return ret;
+}
@@ -0,0 +1,157 @@
+#include "bsdiff/prematch.hpp"
+#include "bsdiff/bytes.hpp"
+
+#include <algorithm>
+
+namespace {
+
+using snap::bsdiff::block_match;
+
+// Width of the hashed blocks. Older is hashed at multiples of it, so a run of newer has to
+// be at least twice as long to be sure to contain a whole block.
+constexpr int64_t block_size = 64;
+// Shorter runs are left to the suffix array, which finds them anyway and also covers the
+// changed bytes around them.
+constexpr int64_t min_match_length = 2 * block_size;
+// Matches on the same diagonal at most this far apart in newer are joined, the changed
+// bytes between them then go to the diff block like they do in a suffix array match.
+constexpr int64_t max_join_gap = min_match_length;
+
+// Substituted bytes after which a run is looked for on the same diagonal before hashing.
+constexpr int64_t max_resume_gap = 8;
+
+constexpr uint64_t hash_multiplier = 0x100000001b3ULL;
+
+// The polynomial the rolling hash updates, evaluated by Horner's rule over four interleaved
+// lanes so that the multiplications of one lane don't wait on the others.
+uint64_t block_hash(const uint8_t *block) {
+  constexpr auto lane_multiplier = hash_multiplier * hash_multiplier * hash_multiplier * hash_multiplier;
+  uint64_t lane0 = 0, lane1 = 0, lane2 = 0, lane3 = 0;
+  for (int64_t i = 0; i < block_size; i += 4) {
+    lane0 = lane0 * lane_multiplier + block[i];
+    lane1 = lane1 * lane_multiplier + block[i + 1];
+    lane2 = lane2 * lane_multiplier + block[i + 2];
+    lane3 = lane3 * lane_multiplier + block[i + 3];
+  }
+  return ((lane0 * hash_multiplier + lane1) * hash_multiplier + lane2) * hash_multiplier + lane3;
+}
+
+// Maps a hash onto a table of 2^bits slots.
+size_t slot(const uint64_t hash, const int bits) {
+  return static_cast<size_t>((hash * 0x9e3779b97f4a7c15ULL) >> (64 - bits));
+}
+
+}
+
+void snap::bsdiff::find_block_matches(const uint8_t *older, const int64_t older_size, const uint8_t *newer,
+                                      const int64_t newer_size, const bool keep_partial, std::vector<block_match> &matches,
+                                      stats_recorder &stats) {
+  matches.clear();
+  const auto block_count = older_size / block_size;
+  if (block_count == 0 || newer_size < block_size) {
+    return;
+  }
+
+  // Direct mapped, a slot keeps the first block that hashed to it. Blocks lost to collisions
+  // are mostly recovered by extending the hits of their neighbours.
+  int bits = 1;
+  while ((int64_t(1) << bits) < 2 * block_count) {
+    bits++;
+  }
+  std::vector<uint32_t> table(size_t(1) << bits, 0);
+  const auto table_bytes = static_cast<uint64_t>(table.size()) * sizeof(uint32_t);
+  stats.allocated(table_bytes);
+  for (int64_t block = 0; block < block_count; block++) {
+    auto &entry = table[slot(block_hash(older + block * block_size), bits)];
+    if (entry == 0) {
+      entry = static_cast<uint32_t>(block + 1);
+    }
+  }
+
+  uint64_t top_power = 1;
+  for (int64_t i = 1; i < block_size; i++) {
+    top_power *= hash_multiplier;
+  }
+
+  const auto &kernels = byte_kernels();
+  const auto unmatched_limit = keep_partial ? newer_size : newer_size - newer_size / 2;
+  int64_t unmatched = 0;
+  int64_t matched_end = 0;
+  int64_t pos = 0;
+  auto hash = block_hash(newer);
+
+  while (pos + block_size <= newer_size) {
+    const auto entry = table[slot(hash, bits)];
+    if (entry != 0) {
+      const auto older_pos = static_cast<int64_t>(entry - 1) * block_size;
+      const auto forward = static_cast<int64_t>(kernels.common_prefix(
+        newer + pos, older + older_pos, static_cast<size_t>(std::min(newer_size - pos, older_size - older_pos))));
+      if (forward >= block_size) {
+        int64_t backward = 0;
+        while (pos - backward > matched_end && older_pos - backward > 0
+               && newer[pos - backward - 1] == older[older_pos - backward - 1]) {
+          backward++;
+        }
+
+        if (backward + forward >= min_match_length) {
+          const block_match match{ pos - backward, older_pos - backward, backward + forward };
+          auto *last = matches.empty() ? nullptr : &matches.back();
+          if (last != nullptr && last->older_pos - last->newer_pos == match.older_pos - match.newer_pos
+              && match.newer_pos - (last->newer_pos + last->length) <= max_join_gap) {
+            last->length = match.newer_pos + match.length - last->newer_pos;
+          } else {
+            matches.push_back(match);
+          }
+          // The bytes skipped back over were counted as unmatched when the hash passed them.
+          unmatched -= std::min(backward, unmatched);
+          pos += forward;
+          matched_end = pos;
+
+          // A few substituted bytes leave the rest of a run on the same diagonal, so the run
+          // is resumed there rather than found again by the hash a block later.
+          const auto offset = older_pos - (pos - forward);
+          for (;;) {
+            const auto limit = std::min({ pos + max_resume_gap, newer_size, older_size - offset });
+            auto resume = pos;
+            while (resume < limit && newer[resume] != older[resume + offset]) {
+              resume++;
+            }
+            if (resume == limit) {
+              break;
+            }
+            const auto resumed = static_cast<int64_t>(kernels.common_prefix(
+              newer + resume, older + resume + offset,
+              static_cast<size_t>(std::min(newer_size - resume, older_size - resume - offset))));
+            if (resumed < block_size) {
+              break;
+            }
+            matches.back().length = resume + resumed - matches.back().newer_pos;
+            unmatched += resume - pos;
+            pos = resume + resumed;
+            matched_end = pos;
+          }
+          if (pos + block_size <= newer_size) {
+            hash = block_hash(newer + pos);
+          }
+          continue;
+        }
+      }
+    }
+
+    if (++unmatched > unmatched_limit) {
+      matches.clear();
+      break;
+    }
+
+    if (pos + block_size < newer_size) {
+      hash = (hash - newer[pos] * top_power) * hash_multiplier + newer[pos + block_size];
+    }
+    pos++;
+  }
+
+  if (newer_size - pos + unmatched > unmatched_limit) {
+    matches.clear();
+  }
+
+  stats.released(table_bytes);
+}
@@ -0,0 +1,40 @@
+#include "bsdiff/progress.hpp"
+
+#include <cstdint>
+
+namespace {
+
+// Bytes processed between two callbacks, small enough for a responsive cancel and large
+// enough that the callback never shows up in a profile.
+constexpr uint64_t progress_interval = 1024 * 1024;
+
+}
+
+snap::bsdiff::progress_reporter::progress_reporter(const snap_bsdiff_progress *progress, const uint64_t total) :
+    m_report(progress != nullptr ? progress->report : nullptr),
+    m_opaque(progress != nullptr ? progress->opaque : nullptr),
+    m_total(total),
+    m_processed(0),
+    m_next(m_report != nullptr ? 0 : UINT64_MAX),
+    m_cancelled(false) {
+}
+
+int snap::bsdiff::progress_reporter::report(const uint64_t processed) {
+  if (m_cancelled) {
+    return bsdiff_status_type_cancelled;
+  }
+
+  if (m_report == nullptr) {
+    return BSDIFF_SUCCESS;
+  }
+
+  m_processed = processed;
+  m_next = processed + progress_interval;
+
+  if (m_report(m_opaque, processed, m_total) != 0) {
+    m_cancelled = true;
+    return bsdiff_status_type_cancelled;
+  }
+
+  return BSDIFF_SUCCESS;
+}
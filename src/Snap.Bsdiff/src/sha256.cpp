@@ -0,0 +1,261 @@
+#include "bsdiff/sha256.hpp"
+#include "bsdiff/sha256_kernels.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+const uint32_t snap::bsdiff::sha256_round_constants[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+namespace {
+
+constexpr uint32_t initial_state[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+inline uint32_t rotr(const uint32_t value, const int count) {
+  return (value >> count) | (value << (32 - count));
+}
+
+inline uint32_t load_be32(const uint8_t *buffer) {
+  return (static_cast<uint32_t>(buffer[0]) << 24) | (static_cast<uint32_t>(buffer[1]) << 16)
+         | (static_cast<uint32_t>(buffer[2]) << 8) | static_cast<uint32_t>(buffer[3]);
+}
+
+using compress_function = void (*)(uint32_t state[8], const uint8_t *blocks, size_t count);
+
+compress_function select_compress() {
+#if defined(SNAP_BSDIFF_X86)
+  if (snap::bsdiff::cpu_features().sha) {
+    return snap::bsdiff::sha256_compress_shani;
+  }
+#endif
+  return snap::bsdiff::sha256_compress_portable;
+}
+
+void compress(uint32_t state[8], const uint8_t *blocks, const size_t count) {
+  static const auto function = select_compress();
+  if (count > 0) {
+    function(state, blocks, count);
+  }
+}
+
+// Writes the last partial block of a message, padded and followed by the bit length, to
+// tail and returns the number of blocks that takes, one or two.
+size_t pad(const uint8_t *data, const size_t size, const uint64_t length, uint8_t tail[128]) {
+  const size_t blocks = size < 56 ? 1 : 2;
+  std::memset(tail, 0, blocks * 64);
+  if (size > 0) {
+    std::memcpy(tail, data, size);
+  }
+  tail[size] = 0x80;
+
+  const auto bit_length = length * 8;
+  for (size_t i = 0; i < 8; i++) {
+    tail[blocks * 64 - 8 + i] = static_cast<uint8_t>(bit_length >> (56 - i * 8));
+  }
+
+  return blocks;
+}
+
+void store_digest(const uint32_t state[8], uint8_t digest[snap::bsdiff::sha256_digest_size]) {
+  for (int i = 0; i < 8; i++) {
+    digest[i * 4] = static_cast<uint8_t>(state[i] >> 24);
+    digest[i * 4 + 1] = static_cast<uint8_t>(state[i] >> 16);
+    digest[i * 4 + 2] = static_cast<uint8_t>(state[i] >> 8);
+    digest[i * 4 + 3] = static_cast<uint8_t>(state[i]);
+  }
+}
+
+#if defined(SNAP_BSDIFF_X86)
+
+// One message in a lane of the eight way kernel.
+struct lane_message {
+  const uint8_t *data;
+  size_t full_blocks;
+  size_t blocks;
+  uint8_t tail[128];
+};
+
+const uint8_t *lane_block(const lane_message &lane, const size_t block) {
+  return block < lane.full_blocks ? lane.data + block * 64 : lane.tail + (block - lane.full_blocks) * 64;
+}
+
+// Hashes up to eight messages side by side. Idle lanes hash a zero block whose result is
+// never read. Once a single message is left it is finished on its own, so one large
+// message in the group costs no more than hashing it alone.
+void digest_lanes(const snap::bsdiff::sha256_message *messages, const size_t count) {
+  static const uint8_t idle_block[64] = {};
+
+  lane_message lanes[8];
+  uint32_t state[8][8];
+  for (size_t j = 0; j < 8; j++) {
+    lanes[j].blocks = 0;
+    if (j < count) {
+      const auto &message = messages[j];
+      lanes[j].data = message.data;
+      lanes[j].full_blocks = message.size / 64;
+      lanes[j].blocks = lanes[j].full_blocks + pad(message.data + lanes[j].full_blocks * 64, message.size % 64,
+                                                   message.size, lanes[j].tail);
+    }
+    for (int i = 0; i < 8; i++) {
+      state[i][j] = initial_state[i];
+    }
+  }
+
+  for (size_t block = 0;; block++) {
+    size_t active = 0, last = 0;
+    for (size_t j = 0; j < count; j++) {
+      if (lanes[j].blocks > block) {
+        active++;
+        last = j;
+      }
+    }
+
+    if (active <= 1) {
+      if (active == 1) {
+        uint32_t single[8];
+        for (int i = 0; i < 8; i++) {
+          single[i] = state[i][last];
+        }
+        const auto &lane = lanes[last];
+        if (block < lane.full_blocks) {
+          compress(single, lane_block(lane, block), lane.full_blocks - block);
+        }
+        const auto tail_block = std::max(block, lane.full_blocks);
+        compress(single, lane_block(lane, tail_block), lane.blocks - tail_block);
+        store_digest(single, messages[last].digest);
+      }
+      return;
+    }
+
+    const uint8_t *blocks[8];
+    for (size_t j = 0; j < 8; j++) {
+      blocks[j] = lanes[j].blocks > block ? lane_block(lanes[j], block) : idle_block;
+    }
+    snap::bsdiff::sha256_compress_x8_avx2(state, blocks);
+
+    for (size_t j = 0; j < count; j++) {
+      if (lanes[j].blocks == block + 1) {
+        uint32_t finished[8];
+        for (int i = 0; i < 8; i++) {
+          finished[i] = state[i][j];
+        }
+        store_digest(finished, messages[j].digest);
+      }
+    }
+  }
+}
+
+#endif
+
+}
+
+void snap::bsdiff::sha256_compress_portable(uint32_t state[8], const uint8_t *blocks, size_t count) {
+  uint32_t w[64];
+  for (; count > 0; --count, blocks += 64) {
+    for (int i = 0; i < 16; i++) {
+      w[i] = load_be32(blocks + i * 4);
+    }
+    for (int i = 16; i < 64; i++) {
+      const auto s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      const auto s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    auto a = state[0], b = state[1], c = state[2], d = state[3];
+    auto e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+      const auto t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + sha256_round_constants[i] + w[i];
+      const auto t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+}
+
+snap::bsdiff::sha256::sha256() :
+    m_state(),
+    m_block(),
+    m_block_size(0),
+    m_length(0) {
+  std::memcpy(m_state, initial_state, sizeof m_state);
+}
+
+void snap::bsdiff::sha256::update(const uint8_t *data, size_t size) {
+  m_length += size;
+
+  if (m_block_size > 0) {
+    const auto count = std::min(size, sizeof m_block - m_block_size);
+    std::memcpy(m_block + m_block_size, data, count);
+    m_block_size += count;
+    data += count;
+    size -= count;
+    if (m_block_size < sizeof m_block) {
+      return;
+    }
+    compress(m_state, m_block, 1);
+    m_block_size = 0;
+  }
+
+  // Whole blocks are hashed straight from the caller's buffer.
+  const auto blocks = size / sizeof m_block;
+  compress(m_state, data, blocks);
+  data += blocks * sizeof m_block;
+  size -= blocks * sizeof m_block;
+
+  std::memcpy(m_block, data, size);
+  m_block_size = size;
+}
+
+void snap::bsdiff::sha256::finish(uint8_t digest[sha256_digest_size]) {
+  uint8_t tail[sizeof m_block * 2];
+  compress(m_state, tail, pad(m_block, m_block_size, m_length, tail));
+  store_digest(m_state, digest);
+}
+
+void snap::bsdiff::sha256_digest(const uint8_t *data, const size_t size, uint8_t digest[sha256_digest_size]) {
+  sha256 hash;
+  hash.update(data, size);
+  hash.finish(digest);
+}
+
+void snap::bsdiff::sha256_digest_many(const sha256_message *messages, const size_t count) {
+#if defined(SNAP_BSDIFF_X86)
+  // The SHA extensions beat eight AVX2 lanes, and need no lane bookkeeping.
+  const auto &features = cpu_features();
+  if (!features.sha && features.avx2) {
+    for (size_t i = 0; i < count; i += 8) {
+      digest_lanes(messages + i, std::min<size_t>(count - i, 8));
+    }
+    return;
+  }
+#endif
+
+  for (size_t i = 0; i < count; i++) {
+    sha256_digest(messages[i].data, messages[i].size, messages[i].digest);
+  }
+}
@@ -0,0 +1,95 @@
+#include "bsdiff/sha256_kernels.hpp"
+
+#if defined(SNAP_BSDIFF_X86)
+
+#include <immintrin.h>
+
+namespace {
+
+SNAP_BSDIFF_TARGET("avx2")
+inline __m256i rotr(const __m256i value, const int count) {
+  return _mm256_or_si256(_mm256_srli_epi32(value, count), _mm256_slli_epi32(value, 32 - count));
+}
+
+// Loads eight words from each block and transposes them, so lane j of words[i] is word
+// offset + i of block j.
+SNAP_BSDIFF_TARGET("avx2")
+inline void load_words(const uint8_t *const blocks[8], const int offset, __m256i words[8]) {
+  const auto byte_swap = _mm256_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL,
+                                           0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+  __m256i rows[8];
+  for (int j = 0; j < 8; j++) {
+    rows[j] = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(blocks[j] + offset * 4)), byte_swap);
+  }
+
+  __m256i pairs[8];
+  for (int j = 0; j < 8; j += 2) {
+    pairs[j] = _mm256_unpacklo_epi32(rows[j], rows[j + 1]);
+    pairs[j + 1] = _mm256_unpackhi_epi32(rows[j], rows[j + 1]);
+  }
+
+  __m256i quads[8];
+  for (int j = 0; j < 8; j += 4) {
+    quads[j] = _mm256_unpacklo_epi64(pairs[j], pairs[j + 2]);
+    quads[j + 1] = _mm256_unpackhi_epi64(pairs[j], pairs[j + 2]);
+    quads[j + 2] = _mm256_unpacklo_epi64(pairs[j + 1], pairs[j + 3]);
+    quads[j + 3] = _mm256_unpackhi_epi64(pairs[j + 1], pairs[j + 3]);
+  }
+
+  for (int i = 0; i < 4; i++) {
+    words[i] = _mm256_permute2x128_si256(quads[i], quads[i + 4], 0x20);
+    words[i + 4] = _mm256_permute2x128_si256(quads[i], quads[i + 4], 0x31);
+  }
+}
+
+}
+
+// The scalar rounds with every operation widened to eight lanes. Lanes never interact, so
+// this is exactly eight single block compressions.
+SNAP_BSDIFF_TARGET("avx2")
+void snap::bsdiff::sha256_compress_x8_avx2(uint32_t state[8][8], const uint8_t *const blocks[8]) {
+  __m256i w[16];
+  load_words(blocks, 0, w);
+  load_words(blocks, 8, w + 8);
+
+  __m256i v[8];
+  for (int i = 0; i < 8; i++) {
+    v[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(state[i]));
+  }
+  auto a = v[0], b = v[1], c = v[2], d = v[3], e = v[4], f = v[5], g = v[6], h = v[7];
+
+  for (int i = 0; i < 64; i++) {
+    auto &word = w[i & 15];
+    if (i >= 16) {
+      const auto w15 = w[(i - 15) & 15];
+      const auto w2 = w[(i - 2) & 15];
+      const auto s0 = _mm256_xor_si256(_mm256_xor_si256(rotr(w15, 7), rotr(w15, 18)), _mm256_srli_epi32(w15, 3));
+      const auto s1 = _mm256_xor_si256(_mm256_xor_si256(rotr(w2, 17), rotr(w2, 19)), _mm256_srli_epi32(w2, 10));
+      word = _mm256_add_epi32(_mm256_add_epi32(word, s0), _mm256_add_epi32(w[(i - 7) & 15], s1));
+    }
+
+    const auto sigma1 = _mm256_xor_si256(_mm256_xor_si256(rotr(e, 6), rotr(e, 11)), rotr(e, 25));
+    const auto choice = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+    const auto constant = _mm256_set1_epi32(static_cast<int>(sha256_round_constants[i]));
+    const auto t1 = _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(h, sigma1), _mm256_add_epi32(choice, constant)), word);
+    const auto sigma0 = _mm256_xor_si256(_mm256_xor_si256(rotr(a, 2), rotr(a, 13)), rotr(a, 22));
+    const auto majority = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+    const auto t2 = _mm256_add_epi32(sigma0, majority);
+
+    h = g;
+    g = f;
+    f = e;
+    e = _mm256_add_epi32(d, t1);
+    d = c;
+    c = b;
+    b = a;
+    a = _mm256_add_epi32(t1, t2);
+  }
+
+  const __m256i rounds[8] = { a, b, c, d, e, f, g, h };
+  for (int i = 0; i < 8; i++) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(state[i]), _mm256_add_epi32(v[i], rounds[i]));
+  }
+}
+
+#endif
@@ -0,0 +1,53 @@
+#include "bsdiff/sha256_kernels.hpp"
+
+#if defined(SNAP_BSDIFF_X86)
+
+#include <immintrin.h>
+
+// Four rounds per step, the message schedule for the next four words is derived from the
+// previous sixteen with sha256msg1/sha256msg2. The state is kept as ABEF/CDGH pairs, the
+// layout sha256rnds2 works on.
+SNAP_BSDIFF_TARGET("sha,sse4.1")
+void snap::bsdiff::sha256_compress_shani(uint32_t state[8], const uint8_t *blocks, size_t count) {
+  const auto byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+  auto cdab = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state)), 0xb1);
+  auto efgh = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state + 4)), 0x1b);
+  auto abef = _mm_alignr_epi8(cdab, efgh, 8);
+  auto cdgh = _mm_blend_epi16(efgh, cdab, 0xf0);
+
+  for (; count > 0; --count, blocks += 64) {
+    const auto abef_saved = abef;
+    const auto cdgh_saved = cdgh;
+
+    // w0 holds the oldest four schedule words, w3 the newest.
+    __m128i w0 = _mm_setzero_si128(), w1 = w0, w2 = w0, w3 = w0;
+    for (int step = 0; step < 16; step++) {
+      __m128i words;
+      if (step < 4) {
+        words = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(blocks + step * 16)), byte_swap);
+      } else {
+        words = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(w0, w1), _mm_alignr_epi8(w3, w2, 4)), w3);
+      }
+      w0 = w1;
+      w1 = w2;
+      w2 = w3;
+      w3 = words;
+
+      auto message = _mm_add_epi32(words, _mm_loadu_si128(reinterpret_cast<const __m128i *>(sha256_round_constants + step * 4)));
+      cdgh = _mm_sha256rnds2_epu32(cdgh, abef, message);
+      message = _mm_shuffle_epi32(message, 0x0e);
+      abef = _mm_sha256rnds2_epu32(abef, cdgh, message);
+    }
+
+    abef = _mm_add_epi32(abef, abef_saved);
+    cdgh = _mm_add_epi32(cdgh, cdgh_saved);
+  }
+
+  const auto feba = _mm_shuffle_epi32(abef, 0x1b);
+  const auto dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(state), _mm_blend_epi16(feba, dchg, 0xf0));
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(state + 4), _mm_alignr_epi8(dchg, feba, 8));
+}
+
+#endif
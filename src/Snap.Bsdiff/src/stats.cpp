@@ -0,0 +1,387 @@
+#include "bsdiff/stats.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <new>
+
+#if defined(SNAP_PLATFORM_WINDOWS)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(SNAP_PLATFORM_LINUX)
+#include <time.h>
+#endif
+
+namespace {
+
+using snap::bsdiff::stats_recorder;
+
+// Size of a control entry in the patch, three 8 byte integers.
+constexpr uint64_t control_entry_size = 24;
+
+uint64_t wall_ns() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+#if defined(SNAP_PLATFORM_WINDOWS)
+// Kernel and user time in 100 ns units.
+uint64_t filetime_ns(const FILETIME &kernel, const FILETIME &user) {
+  const auto ticks = (static_cast<uint64_t>(kernel.dwHighDateTime) << 32 | kernel.dwLowDateTime)
+                     + (static_cast<uint64_t>(user.dwHighDateTime) << 32 | user.dwLowDateTime);
+  return ticks * 100;
+}
+#elif defined(SNAP_PLATFORM_LINUX)
+uint64_t clock_ns(const clockid_t clock) {
+  struct timespec ts = {};
+  if (clock_gettime(clock, &ts) != 0) {
+    return 0;
+  }
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000u + static_cast<uint64_t>(ts.tv_nsec);
+}
+#endif
+
+uint64_t count_zeros(const void *buffer, const size_t size) {
+  const auto *p = static_cast<const uint8_t *>(buffer);
+  uint64_t count = 0;
+  for (size_t i = 0; i < size; i++) {
+    count += p[i] == 0;
+  }
+  return count;
+}
+
+struct stats_stream_state {
+  struct bsdiff_stream *inner;
+  stats_recorder *stats;
+};
+
+void stats_stream_close(void *state) {
+  delete static_cast<stats_stream_state *>(state);
+}
+
+int stats_stream_get_mode(void *state) {
+  auto *p_state = static_cast<stats_stream_state *>(state);
+  return p_state->inner->get_mode(p_state->inner->state);
+}
+
+int stats_stream_seek(void *state, const int64_t offset, const int origin) {
+  auto *p_state = static_cast<stats_stream_state *>(state);
+  return p_state->inner->seek(p_state->inner->state, offset, origin);
+}
+
+int stats_stream_tell(void *state, int64_t *position) {
+  auto *p_state = static_cast<stats_stream_state *>(state);
+  return p_state->inner->tell(p_state->inner->state, position);
+}
+
+int stats_stream_read(void *state, void *buffer, const size_t size, size_t *readed) {
+  auto *p_state = static_cast<stats_stream_state *>(state);
+  const auto ret = p_state->inner->read(p_state->inner->state, buffer, size, readed);
+  // A short read at the end of the patch still returns data.
+  if (ret == BSDIFF_SUCCESS || ret == BSDIFF_END_OF_FILE) {
+    p_state->stats->add_patch_bytes(*readed);
+  }
+  return ret;
+}
+
+int stats_stream_write(void *state, const void *buffer, const size_t size) {
+  auto *p_state = static_cast<stats_stream_state *>(state);
+  const auto ret = p_state->inner->write(p_state->inner->state, buffer, size);
+  if (ret == BSDIFF_SUCCESS) {
+    p_state->stats->add_patch_bytes(size);
+  }
+  return ret;
+}
+
+int stats_stream_flush(void *state) {
+  auto *p_state = static_cast<stats_stream_state *>(state);
+  return p_state->inner->flush != nullptr ? p_state->inner->flush(p_state->inner->state) : BSDIFF_SUCCESS;
+}
+
+// Reads have to go through read to be counted.
+int stats_stream_get_buffer(void *, const void **, size_t *) {
+  return BSDIFF_INVALID_ARG;
+}
+
+struct stats_packer_state {
+  struct bsdiff_patch_packer *inner;
+  stats_recorder *stats;
+};
+
+// Times a call into the inner packer.
+class packer_call final {
+  stats_recorder *m_stats;
+  uint64_t m_wall;
+  uint64_t m_cpu;
+
+public:
+  explicit packer_call(stats_recorder *stats) :
+      m_stats(stats),
+      m_wall(wall_ns()),
+      m_cpu(snap::bsdiff::thread_cpu_ns()) {
+  }
+
+  packer_call(const packer_call &) = delete;
+  packer_call &operator=(const packer_call &) = delete;
+
+  ~packer_call() {
+    m_stats->add_packer_time(wall_ns() - m_wall, snap::bsdiff::thread_cpu_ns() - m_cpu);
+  }
+};
+
+void count_entry(snap_bsdiff_stats *stats, const int64_t diff, const int64_t extra) {
+  stats->control_bytes += control_entry_size;
+  stats->diff_bytes += static_cast<uint64_t>(diff);
+  stats->extra_bytes += static_cast<uint64_t>(extra);
+  stats->entry_count++;
+  stats->longest_match_bytes = std::max(stats->longest_match_bytes, static_cast<uint64_t>(diff));
+}
+
+int stats_packer_get_mode(void *state) {
+  auto *p_state = static_cast<stats_packer_state *>(state);
+  return p_state->inner->get_mode(p_state->inner->state);
+}
+
+int stats_packer_read_new_size(void *state, int64_t *size) {
+  auto *p_state = static_cast<stats_packer_state *>(state);
+  packer_call call(p_state->stats);
+  return p_state->inner->read_new_size(p_state->inner->state, size);
+}
+
+int stats_packer_read_entry_header(void *state, int64_t *diff, int64_t *extra, int64_t *seek) {
+  auto *p_state = static_cast<stats_packer_state *>(state);
+  int ret;
+  {
+    packer_call call(p_state->stats);
+    ret = p_state->inner->read_entry_header(p_state->inner->state, diff, extra, seek);
+  }
+  if (ret == BSDIFF_SUCCESS && *diff >= 0 && *extra >= 0) {
+    count_entry(p_state->stats->stats(), *diff, *extra);
+  }
+  return ret;
+}
+
+int stats_packer_read_entry_diff(void *state, void *buffer, const size_t size, size_t *readed) {
+  auto *p_state = static_cast<stats_packer_state *>(state);
+  int ret;
+  {
+    packer_call call(p_state->stats);
+    ret = p_state->inner->read_entry_diff(p_state->inner->state, buffer, size, readed);
+  }
+  if (ret == BSDIFF_SUCCESS) {
+    p_state->stats->stats()->matched_bytes += count_zeros(buffer, *readed);
+  }
+  return ret;
+}
+
+int stats_packer_read_entry_extra(void *state, void *buffer, const size_t size, size_t *readed) {
+  auto *p_state = static_cast<stats_packer_state *>(state);
+  packer_call call(p_state->stats);
+  return p_state->inner->read_entry_extra(p_state->inner->state, buffer, size, readed);
+}
+
+int stats_packer_write_new_size(void *state, const int64_t size) {
+  auto *p_state = static_cast<stats_packer_state *>(state);
+  packer_call call(p_state->stats);
+  return p_state->inner->write_new_size(p_state->inner->state, size);
+}
+
+int stats_packer_write_entry_header(void *state, const int64_t diff, const int64_t extra, const int64_t seek) {
+  auto *p_state = static_cast<stats_packer_state *>(state);
+  count_entry(p_state->stats->stats(), diff, extra);
+  packer_call call(p_state->stats);
+  return p_state->inner->write_entry_header(p_state->inner->state, diff, extra, seek);
+}
+
+int stats_packer_write_entry_diff(void *state, const uint8_t *buffer, const size_t size) {
+  auto *p_state = static_cast<stats_packer_state *>(state);
+  p_state->stats->stats()->matched_bytes += count_zeros(buffer, size);
+  packer_call call(p_state->stats);
+  return p_state->inner->write_entry_diff(p_state->inner->state, buffer, size);
+}
+
+int stats_packer_write_entry_extra(void *state, const uint8_t *buffer, const size_t size) {
+  auto *p_state = static_cast<stats_packer_state *>(state);
+  packer_call call(p_state->stats);
+  return p_state->inner->write_entry_extra(p_state->inner->state, buffer, size);
+}
+
+int stats_packer_flush(void *state) {
+  auto *p_state = static_cast<stats_packer_state *>(state);
+  packer_call call(p_state->stats);
+  return p_state->inner->flush(p_state->inner->state);
+}
+
+void stats_packer_close(void *state) {
+  delete static_cast<stats_packer_state *>(state);
+}
+
+}
+
+uint64_t snap::bsdiff::process_cpu_ns() {
+#if defined(SNAP_PLATFORM_WINDOWS)
+  FILETIME creation, exit, kernel, user;
+  if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+    return 0;
+  }
+  return filetime_ns(kernel, user);
+#elif defined(SNAP_PLATFORM_LINUX)
+  return clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+#endif
+}
+
+uint64_t snap::bsdiff::thread_cpu_ns() {
+#if defined(SNAP_PLATFORM_WINDOWS)
+  FILETIME creation, exit, kernel, user;
+  if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+    return 0;
+  }
+  return filetime_ns(kernel, user);
+#elif defined(SNAP_PLATFORM_LINUX)
+  return clock_ns(CLOCK_THREAD_CPUTIME_ID);
+#endif
+}
+
+snap::bsdiff::stats_recorder::stats_recorder(snap_bsdiff_stats *stats) :
+    m_stats(stats),
+    m_total_wall_begin(0),
+    m_total_cpu_begin(0),
+    m_wall_begin(0),
+    m_cpu_begin(0),
+    m_thread_cpu_begin(0),
+    m_packer_wall_ns(0),
+    m_packer_thread_cpu_ns(0),
+    m_allocated(0) {
+  if (m_stats != nullptr) {
+    std::memset(m_stats, 0, sizeof(*m_stats));
+    m_total_wall_begin = wall_ns();
+    m_total_cpu_begin = process_cpu_ns();
+  }
+}
+
+void snap::bsdiff::stats_recorder::finish() {
+  if (m_stats == nullptr) {
+    return;
+  }
+
+  m_stats->total.wall_ns = wall_ns() - m_total_wall_begin;
+  m_stats->total.cpu_ns = process_cpu_ns() - m_total_cpu_begin;
+}
+
+void snap::bsdiff::stats_recorder::begin() {
+  if (m_stats == nullptr) {
+    return;
+  }
+
+  m_packer_wall_ns = 0;
+  m_packer_thread_cpu_ns = 0;
+  m_wall_begin = wall_ns();
+  m_cpu_begin = process_cpu_ns();
+  m_thread_cpu_begin = thread_cpu_ns();
+}
+
+void snap::bsdiff::stats_recorder::end(const phase phase) {
+  if (m_stats == nullptr) {
+    return;
+  }
+
+  (m_stats->*phase).wall_ns += wall_ns() - m_wall_begin;
+  (m_stats->*phase).cpu_ns += process_cpu_ns() - m_cpu_begin;
+}
+
+void snap::bsdiff::stats_recorder::end_interleaved(const phase phase) {
+  if (m_stats == nullptr) {
+    return;
+  }
+
+  const auto wall = wall_ns() - m_wall_begin;
+  const auto cpu = process_cpu_ns() - m_cpu_begin;
+  const auto thread_cpu = thread_cpu_ns() - m_thread_cpu_begin;
+
+  // The clocks are read at different instants, keep the split within the measured totals.
+  const auto packer_wall = std::min(m_packer_wall_ns, wall);
+  const auto own_cpu = std::min(thread_cpu - std::min(m_packer_thread_cpu_ns, thread_cpu), cpu);
+
+  (m_stats->*phase).wall_ns += wall - packer_wall;
+  (m_stats->*phase).cpu_ns += own_cpu;
+  m_stats->compress.wall_ns += packer_wall;
+  m_stats->compress.cpu_ns += cpu - own_cpu;
+}
+
+void snap::bsdiff::stats_recorder::allocated(const uint64_t bytes) {
+  if (m_stats == nullptr) {
+    return;
+  }
+
+  m_allocated += bytes;
+  m_stats->peak_memory_bytes = std::max(m_stats->peak_memory_bytes, m_allocated);
+}
+
+void snap::bsdiff::stats_recorder::released(const uint64_t bytes) {
+  if (m_stats == nullptr) {
+    return;
+  }
+
+  m_allocated -= std::min(bytes, m_allocated);
+}
+
+void snap::bsdiff::stats_recorder::add_packer_time(const uint64_t wall_ns, const uint64_t thread_cpu_ns) {
+  m_packer_wall_ns += wall_ns;
+  m_packer_thread_cpu_ns += thread_cpu_ns;
+}
+
+int snap::bsdiff::open_stats_packer(struct bsdiff_patch_packer *inner, stats_recorder *stats, struct bsdiff_patch_packer *packer) {
+  if (inner == nullptr || stats == nullptr || !stats->enabled() || packer == nullptr) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  auto *state = new (std::nothrow) stats_packer_state{ inner, stats };
+  if (state == nullptr) {
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  std::memset(packer, 0, sizeof(*packer));
+  packer->state = state;
+  packer->get_mode = stats_packer_get_mode;
+  packer->read_new_size = stats_packer_read_new_size;
+  packer->read_entry_header = stats_packer_read_entry_header;
+  packer->read_entry_diff = stats_packer_read_entry_diff;
+  packer->read_entry_extra = stats_packer_read_entry_extra;
+  packer->write_new_size = stats_packer_write_new_size;
+  packer->write_entry_header = stats_packer_write_entry_header;
+  packer->write_entry_diff = stats_packer_write_entry_diff;
+  packer->write_entry_extra = stats_packer_write_entry_extra;
+  packer->flush = stats_packer_flush;
+  packer->close = stats_packer_close;
+
+  return BSDIFF_SUCCESS;
+}
+
+int snap::bsdiff::open_stats_stream(struct bsdiff_stream *inner, stats_recorder *stats, struct bsdiff_stream *stream) {
+  if (inner == nullptr || stats == nullptr || !stats->enabled() || stream == nullptr) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  auto *state = new (std::nothrow) stats_stream_state{ inner, stats };
+  if (state == nullptr) {
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  std::memset(stream, 0, sizeof(*stream));
+  stream->state = state;
+  stream->close = stats_stream_close;
+  stream->get_mode = stats_stream_get_mode;
+  stream->seek = stats_stream_seek;
+  stream->tell = stats_stream_tell;
+  stream->read = stats_stream_read;
+  stream->write = stats_stream_write;
+  stream->flush = stats_stream_flush;
+  stream->get_buffer = stats_stream_get_buffer;
+
+  return BSDIFF_SUCCESS;
+}
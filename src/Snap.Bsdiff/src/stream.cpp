@@ -0,0 +1,408 @@
+#include "bsdiff/stream.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace {
+
+struct callback_stream_state {
+  int mode;
+  snap_bsdiff_stream callbacks;
+};
+
+void callback_stream_close(void *state) {
+  delete static_cast<callback_stream_state *>(state);
+}
+
+int callback_stream_get_mode(void *state) {
+  return static_cast<callback_stream_state *>(state)->mode;
+}
+
+int callback_stream_seek(void *state, const int64_t offset, const int origin) {
+  const auto *p_state = static_cast<callback_stream_state *>(state);
+  if (p_state->callbacks.seek == nullptr) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  // bsdiff streams take the stdio origins, callers get their own enum.
+  snap_bsdiff_seek_origin seek_origin;
+  switch (origin) {
+  case SEEK_SET:
+    seek_origin = bsdiff_seek_origin_begin;
+    break;
+  case SEEK_CUR:
+    seek_origin = bsdiff_seek_origin_current;
+    break;
+  case SEEK_END:
+    seek_origin = bsdiff_seek_origin_end;
+    break;
+  default:
+    return BSDIFF_INVALID_ARG;
+  }
+
+  return p_state->callbacks.seek(p_state->callbacks.opaque, offset, seek_origin);
+}
+
+int callback_stream_tell(void *state, int64_t *position) {
+  const auto *p_state = static_cast<callback_stream_state *>(state);
+  if (p_state->callbacks.tell == nullptr) {
+    return BSDIFF_INVALID_ARG;
+  }
+  return p_state->callbacks.tell(p_state->callbacks.opaque, position);
+}
+
+int callback_stream_read(void *state, void *buffer, const size_t size, size_t *readed) {
+  const auto *p_state = static_cast<callback_stream_state *>(state);
+  if (p_state->mode != BSDIFF_MODE_READ || p_state->callbacks.read == nullptr) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  // Callers may hand out partial reads, keep asking until the request is satisfied or the source is drained.
+  auto *p_buffer = static_cast<uint8_t *>(buffer);
+  size_t total = 0;
+  int ret = BSDIFF_SUCCESS;
+  while (total < size) {
+    size_t bytes_read = 0;
+    ret = p_state->callbacks.read(p_state->callbacks.opaque, p_buffer + total, size - total, &bytes_read);
+    total += bytes_read;
+    if (ret != BSDIFF_SUCCESS || bytes_read == 0) {
+      break;
+    }
+  }
+
+  *readed = total;
+
+  if (total == size) {
+    return BSDIFF_SUCCESS;
+  }
+
+  return ret == BSDIFF_SUCCESS ? BSDIFF_END_OF_FILE : ret;
+}
+
+int callback_stream_write(void *state, const void *buffer, const size_t size) {
+  const auto *p_state = static_cast<callback_stream_state *>(state);
+  if (p_state->mode != BSDIFF_MODE_WRITE || p_state->callbacks.write == nullptr) {
+    return BSDIFF_INVALID_ARG;
+  }
+  return p_state->callbacks.write(p_state->callbacks.opaque, buffer, size);
+}
+
+int callback_stream_flush(void *) {
+  return BSDIFF_SUCCESS;
+}
+
+int callback_stream_get_buffer(void *, const void **, size_t *) {
+  // Callback streams are never backed by a contiguous buffer.
+  return BSDIFF_INVALID_ARG;
+}
+
+struct allocator_stream_state {
+  snap_bsdiff_allocator allocator;
+  uint8_t *buffer;
+  size_t size;
+  size_t capacity;
+  size_t position;
+};
+
+void null_stream_close(void *) {
+}
+
+int null_stream_get_mode(void *) {
+  return BSDIFF_MODE_WRITE;
+}
+
+int null_stream_seek(void *, int64_t, int) {
+  return BSDIFF_INVALID_ARG;
+}
+
+int null_stream_tell(void *, int64_t *) {
+  return BSDIFF_INVALID_ARG;
+}
+
+int null_stream_read(void *, void *, size_t, size_t *readed) {
+  *readed = 0;
+  return BSDIFF_INVALID_ARG;
+}
+
+int null_stream_write(void *, const void *, size_t) {
+  return BSDIFF_SUCCESS;
+}
+
+int null_stream_flush(void *) {
+  return BSDIFF_SUCCESS;
+}
+
+int null_stream_get_buffer(void *, const void **, size_t *) {
+  return BSDIFF_INVALID_ARG;
+}
+
+int allocator_stream_grow(allocator_stream_state *p_state, const size_t capacity) {
+  if (capacity <= p_state->capacity) {
+    return BSDIFF_SUCCESS;
+  }
+
+  void *buffer;
+  if (p_state->allocator.alloc == nullptr) {
+    buffer = std::realloc(p_state->buffer, capacity);
+  } else if (p_state->allocator.realloc != nullptr) {
+    buffer = p_state->allocator.realloc(p_state->allocator.opaque, p_state->buffer, capacity);
+  } else {
+    buffer = p_state->allocator.alloc(p_state->allocator.opaque, capacity);
+    if (buffer != nullptr && p_state->buffer != nullptr) {
+      std::memcpy(buffer, p_state->buffer, p_state->size);
+      snap::bsdiff::allocator_free(&p_state->allocator, p_state->buffer);
+    }
+  }
+
+  if (buffer == nullptr) {
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  p_state->buffer = static_cast<uint8_t *>(buffer);
+  p_state->capacity = capacity;
+
+  return BSDIFF_SUCCESS;
+}
+
+void allocator_stream_close(void *state) {
+  auto *p_state = static_cast<allocator_stream_state *>(state);
+  snap::bsdiff::allocator_free(&p_state->allocator, p_state->buffer);
+  delete p_state;
+}
+
+int allocator_stream_get_mode(void *) {
+  return BSDIFF_MODE_WRITE;
+}
+
+int allocator_stream_seek(void *state, const int64_t offset, const int origin) {
+  auto *p_state = static_cast<allocator_stream_state *>(state);
+  int64_t base;
+  switch (origin) {
+  case SEEK_SET:
+    base = 0;
+    break;
+  case SEEK_CUR:
+    base = static_cast<int64_t>(p_state->position);
+    break;
+  case SEEK_END:
+    base = static_cast<int64_t>(p_state->size);
+    break;
+  default:
+    return BSDIFF_INVALID_ARG;
+  }
+
+  const auto position = base + offset;
+  if (position < 0 || position > static_cast<int64_t>(p_state->size)) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  p_state->position = static_cast<size_t>(position);
+
+  return BSDIFF_SUCCESS;
+}
+
+int allocator_stream_tell(void *state, int64_t *position) {
+  *position = static_cast<int64_t>(static_cast<allocator_stream_state *>(state)->position);
+  return BSDIFF_SUCCESS;
+}
+
+int allocator_stream_read(void *, void *, size_t, size_t *readed) {
+  *readed = 0;
+  return BSDIFF_INVALID_ARG;
+}
+
+int allocator_stream_write(void *state, const void *buffer, const size_t size) {
+  auto *p_state = static_cast<allocator_stream_state *>(state);
+  const auto end = p_state->position + size;
+  if (end < p_state->position) {
+    return BSDIFF_SIZE_TOO_LARGE;
+  }
+
+  if (end > p_state->capacity) {
+    // Grow geometrically, callers that know the final size reserve it up front instead.
+    auto capacity = p_state->capacity < 4096 ? 4096 : p_state->capacity;
+    while (capacity < end) {
+      capacity = capacity * 2 < capacity ? end : capacity * 2;
+    }
+
+    int ret;
+    if ((ret = allocator_stream_grow(p_state, capacity)) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+  }
+
+  std::memcpy(p_state->buffer + p_state->position, buffer, size);
+  p_state->position = end;
+  if (end > p_state->size) {
+    p_state->size = end;
+  }
+
+  return BSDIFF_SUCCESS;
+}
+
+int allocator_stream_flush(void *) {
+  return BSDIFF_SUCCESS;
+}
+
+int allocator_stream_get_buffer(void *state, const void **ppbuffer, size_t *psize) {
+  const auto *p_state = static_cast<allocator_stream_state *>(state);
+  *ppbuffer = p_state->buffer;
+  *psize = p_state->size;
+  return BSDIFF_SUCCESS;
+}
+
+}
+
+void *snap::bsdiff::allocator_alloc(const snap_bsdiff_allocator *allocator, const size_t size) {
+  if (allocator == nullptr || allocator->alloc == nullptr) {
+    return std::malloc(size);
+  }
+  return allocator->alloc(allocator->opaque, size);
+}
+
+void snap::bsdiff::allocator_free(const snap_bsdiff_allocator *allocator, void *ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+
+  if (allocator == nullptr || allocator->alloc == nullptr) {
+    std::free(ptr);
+    return;
+  }
+
+  if (allocator->free != nullptr) {
+    allocator->free(allocator->opaque, ptr);
+  }
+}
+
+int snap::bsdiff::open_allocator_stream(const snap_bsdiff_allocator *allocator, struct bsdiff_stream *stream) {
+  if (stream == nullptr) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  auto *p_state = new (std::nothrow) allocator_stream_state{};
+  if (p_state == nullptr) {
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  if (allocator != nullptr) {
+    p_state->allocator = *allocator;
+  }
+
+  stream->state = p_state;
+  stream->close = allocator_stream_close;
+  stream->get_mode = allocator_stream_get_mode;
+  stream->seek = allocator_stream_seek;
+  stream->tell = allocator_stream_tell;
+  stream->read = allocator_stream_read;
+  stream->write = allocator_stream_write;
+  stream->flush = allocator_stream_flush;
+  stream->get_buffer = allocator_stream_get_buffer;
+
+  return BSDIFF_SUCCESS;
+}
+
+int snap::bsdiff::open_null_stream(struct bsdiff_stream *stream) {
+  if (stream == nullptr) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  stream->state = nullptr;
+  stream->close = null_stream_close;
+  stream->get_mode = null_stream_get_mode;
+  stream->seek = null_stream_seek;
+  stream->tell = null_stream_tell;
+  stream->read = null_stream_read;
+  stream->write = null_stream_write;
+  stream->flush = null_stream_flush;
+  stream->get_buffer = null_stream_get_buffer;
+
+  return BSDIFF_SUCCESS;
+}
+
+int snap::bsdiff::allocator_stream_reserve(struct bsdiff_stream *stream, const size_t capacity) {
+  if (stream == nullptr || stream->close != allocator_stream_close) {
+    return BSDIFF_INVALID_ARG;
+  }
+  return allocator_stream_grow(static_cast<allocator_stream_state *>(stream->state), capacity);
+}
+
+int snap::bsdiff::allocator_stream_detach(struct bsdiff_stream *stream, uint8_t **buffer, size_t *size) {
+  if (stream == nullptr || stream->close != allocator_stream_close || buffer == nullptr || size == nullptr) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  auto *p_state = static_cast<allocator_stream_state *>(stream->state);
+  *buffer = p_state->buffer;
+  *size = p_state->size;
+  p_state->buffer = nullptr;
+  p_state->size = p_state->capacity = p_state->position = 0;
+
+  return BSDIFF_SUCCESS;
+}
+
+int snap::bsdiff::read_stream(struct bsdiff_stream *stream, std::vector<uint8_t> &buffer) {
+  if (stream == nullptr) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  int ret;
+  int64_t size = 0;
+  if ((ret = stream->seek(stream->state, 0, SEEK_END)) != BSDIFF_SUCCESS
+      || (ret = stream->tell(stream->state, &size)) != BSDIFF_SUCCESS
+      || (ret = stream->seek(stream->state, 0, SEEK_SET)) != BSDIFF_SUCCESS) {
+    return ret;
+  }
+
+  if (size < 0) {
+    return BSDIFF_FILE_ERROR;
+  }
+
+  if (static_cast<uint64_t>(size) > SIZE_MAX) {
+    return BSDIFF_SIZE_TOO_LARGE;
+  }
+
+  try {
+    buffer.resize(static_cast<size_t>(size));
+  } catch (const std::bad_alloc &) {
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  size_t readed = 0;
+  if (size > 0 && (ret = stream->read(stream->state, buffer.data(), buffer.size(), &readed)) != BSDIFF_SUCCESS) {
+    return ret;
+  }
+
+  return BSDIFF_SUCCESS;
+}
+
+int snap::bsdiff::open_callback_stream(const int mode, const snap_bsdiff_stream *callbacks, struct bsdiff_stream *stream) {
+  if (callbacks == nullptr || stream == nullptr) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  if ((mode == BSDIFF_MODE_READ && callbacks->read == nullptr)
+      || (mode == BSDIFF_MODE_WRITE && callbacks->write == nullptr)) {
+    return BSDIFF_INVALID_ARG;
+  }
+
+  auto *p_state = new (std::nothrow) callback_stream_state{mode, *callbacks};
+  if (p_state == nullptr) {
+    return BSDIFF_OUT_OF_MEMORY;
+  }
+
+  stream->state = p_state;
+  stream->close = callback_stream_close;
+  stream->get_mode = callback_stream_get_mode;
+  stream->seek = callback_stream_seek;
+  stream->tell = callback_stream_tell;
+  stream->read = callback_stream_read;
+  stream->write = callback_stream_write;
+  stream->flush = callback_stream_flush;
+  stream->get_buffer = callback_stream_get_buffer;
+
+  return BSDIFF_SUCCESS;
+}
@@ -0,0 +1,396 @@
+#include "bsdiff/suffix_array.hpp"
+#include "bsdiff/parallel.hpp"
+#include "bsdiff/progress.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Groups are inclusive ranges [first, last] of sa whose suffixes share a common prefix.
+using group = std::pair<int64_t, int64_t>;
+
+constexpr size_t bucket_count = 257 * 257;
+
+// Groups are small on average, hand them out in batches to keep scheduling overhead low.
+constexpr size_t group_grain = 256;
+
+// Prefix doubling hands over to induced sorting once a single group holds more than this
+// share of the suffixes, a group is sorted by one thread. Runs of zeros and padding end up
+// in such a group.
+constexpr int64_t max_group_share = 16;
+// Or once more than this share of the suffixes is still unsorted after a round, every
+// further round would sort most of the input again. Long repeats, such as tables, do that.
+constexpr int64_t max_unsorted_share = 4;
+
+size_t initial_key(const uint8_t *buffer, const int64_t size, const int64_t i) {
+  if (i >= size) {
+    return 0;
+  }
+  const size_t first = buffer[i] + 1u;
+  const size_t second = i + 1 < size ? buffer[i + 1] + 1u : 0u;
+  return first * 257 + second;
+}
+
+// Sorts on the first two bytes. The rank of a suffix is the index of the last entry of its group.
+template<typename Index>
+void bucket_sort(const uint8_t *buffer, const int64_t size, Index *sa, Index *rank, std::vector<group> &unsorted) {
+  std::vector<int64_t> bucket_first(bucket_count + 1, 0);
+  for (int64_t i = 0; i <= size; i++) {
+    bucket_first[initial_key(buffer, size, i) + 1]++;
+  }
+
+  for (size_t i = 1; i <= bucket_count; i++) {
+    bucket_first[i] += bucket_first[i - 1];
+  }
+
+  for (size_t key = 0; key < bucket_count; key++) {
+    const auto first = bucket_first[key];
+    const auto last = bucket_first[key + 1] - 1;
+    if (last > first) {
+      unsorted.emplace_back(first, last);
+    }
+  }
+
+  auto bucket_next = bucket_first;
+  for (int64_t i = 0; i <= size; i++) {
+    const auto key = initial_key(buffer, size, i);
+    sa[bucket_next[key]++] = static_cast<Index>(i);
+    rank[i] = static_cast<Index>(bucket_first[key + 1] - 1);
+  }
+}
+
+// Whether the groups left to sort are still spread well enough over the threads.
+bool doubling_converges(const std::vector<group> &unsorted, const int64_t size, const bool first_round) {
+  int64_t total = 0, largest = 0;
+  for (const auto &[first, last] : unsorted) {
+    total += last - first + 1;
+    largest = std::max(largest, last - first + 1);
+  }
+  return largest <= size / max_group_share && (first_round || total <= size / max_unsorted_share);
+}
+
+// Sorts sa by prefix doubling on up to thread_count threads. Leaves sorted unset, and sa
+// unspecified, when the input is better served by induced_sort.
+template<typename Index>
+int prefix_doubling(const uint8_t *buffer, const int64_t size, Index *sa, const uint32_t thread_count,
+                    snap::bsdiff::progress_reporter *progress, bool &sorted) {
+  std::vector<Index> rank(static_cast<size_t>(size) + 1);
+  std::vector<group> unsorted;
+
+  bucket_sort(buffer, size, sa, rank.data(), unsorted);
+
+  // Marks the first entry of every subgroup produced by the current round. Bytes rather than
+  // bits so that threads working on adjacent groups never touch the same word.
+  std::vector<uint8_t> heads(static_cast<size_t>(size) + 1, 0);
+  std::vector<group> next_unsorted;
+  std::mutex next_unsorted_mutex;
+
+  for (int64_t h = 2; !unsorted.empty(); h *= 2) {
+    int ret;
+    if (progress != nullptr && (ret = progress->poll()) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+
+    if (!doubling_converges(unsorted, size, h == 2)) {
+      return BSDIFF_SUCCESS;
+    }
+
+    // Suffixes in an unsorted group share their first h bytes, so none of them can end
+    // within h bytes and rank[sa[i] + h] is always in range.
+    auto key = [&](const Index suffix) { return rank[static_cast<size_t>(static_cast<int64_t>(suffix) + h)]; };
+
+    // Pass 1: order each group by the rank of the suffix h bytes further along. rank is
+    // only read here, so groups can be processed concurrently.
+    snap::bsdiff::parallel_for(unsorted.size(), group_grain, thread_count, [&](const size_t begin, const size_t end) {
+      for (auto g = begin; g < end; g++) {
+        const auto [first, last] = unsorted[g];
+        std::sort(sa + first, sa + last + 1, [&](const Index lhs, const Index rhs) {
+          return key(lhs) < key(rhs);
+        });
+        heads[static_cast<size_t>(first)] = 1;
+        for (auto i = first + 1; i <= last; i++) {
+          heads[static_cast<size_t>(i)] = key(sa[i - 1]) != key(sa[i]) ? 1 : 0;
+        }
+      }
+    });
+
+    // Pass 2: every suffix takes the index of the last entry of its new subgroup as rank.
+    // Groups are disjoint, so each position is written by exactly one thread.
+    snap::bsdiff::parallel_for(unsorted.size(), group_grain, thread_count, [&](const size_t begin, const size_t end) {
+      std::vector<group> local_unsorted;
+      for (auto g = begin; g < end; g++) {
+        const auto [first, last] = unsorted[g];
+        for (auto subgroup_last = last; subgroup_last >= first;) {
+          auto subgroup_first = subgroup_last;
+          while (heads[static_cast<size_t>(subgroup_first)] == 0) {
+            subgroup_first--;
+          }
+          for (auto i = subgroup_first; i <= subgroup_last; i++) {
+            rank[static_cast<size_t>(sa[i])] = static_cast<Index>(subgroup_last);
+          }
+          if (subgroup_last > subgroup_first) {
+            local_unsorted.emplace_back(subgroup_first, subgroup_last);
+          }
+          subgroup_last = subgroup_first - 1;
+        }
+      }
+
+      if (!local_unsorted.empty()) {
+        std::lock_guard<std::mutex> lock(next_unsorted_mutex);
+        next_unsorted.insert(next_unsorted.end(), local_unsorted.begin(), local_unsorted.end());
+      }
+    });
+
+    unsorted.swap(next_unsorted);
+    next_unsorted.clear();
+  }
+
+  sorted = true;
+  return BSDIFF_SUCCESS;
+}
+
+// S and L types of the suffixes of a text, one bit each. A suffix is S-type when it is
+// smaller than the one following it.
+class suffix_types final {
+  std::vector<uint8_t> m_bits;
+
+public:
+  explicit suffix_types(const size_t size) :
+      m_bits(size / 8 + 1, 0) {
+  }
+
+  bool is_s(const size_t i) const {
+    return ((m_bits[i >> 3] >> (i & 7)) & 1) != 0;
+  }
+
+  void set_s(const size_t i) {
+    m_bits[i >> 3] = static_cast<uint8_t>(m_bits[i >> 3] | (1u << (i & 7)));
+  }
+
+  // Leftmost S-type suffix. The virtual sentinel at size, smaller than every character,
+  // counts as one.
+  bool is_lms(const size_t i, const size_t size) const {
+    return i == size || (i > 0 && is_s(i) && !is_s(i - 1));
+  }
+};
+
+template<typename Index>
+constexpr Index empty_entry = std::numeric_limits<Index>::max();
+
+template<typename Char>
+size_t bucket_of(const Char c) {
+  return static_cast<size_t>(c);
+}
+
+template<typename Index>
+void bucket_starts(const std::vector<Index> &counts, std::vector<Index> &bounds) {
+  Index sum = 0;
+  for (size_t c = 0; c < counts.size(); c++) {
+    bounds[c] = sum;
+    sum = static_cast<Index>(sum + counts[c]);
+  }
+}
+
+template<typename Index>
+void bucket_ends(const std::vector<Index> &counts, std::vector<Index> &bounds) {
+  Index sum = 0;
+  for (size_t c = 0; c < counts.size(); c++) {
+    sum = static_cast<Index>(sum + counts[c]);
+    bounds[c] = sum;
+  }
+}
+
+// Induces the order of the L-type suffixes from the LMS suffixes at the ends of their
+// buckets, then that of the S-type suffixes from the L-type ones. The suffix before an
+// L-type or LMS suffix j is L-type exactly when text[j - 1] >= text[j], only equal
+// characters before an S-type suffix need the type bits.
+template<typename Char, typename Index>
+void induce(const Char *text, Index *sa, const size_t size, const suffix_types &types,
+            const std::vector<Index> &counts, std::vector<Index> &bounds) {
+  bucket_starts(counts, bounds);
+  // The suffix before the sentinel sorts first in its bucket.
+  sa[bounds[bucket_of(text[size - 1])]++] = static_cast<Index>(size - 1);
+  for (size_t i = 0; i < size; i++) {
+    const auto j = sa[i];
+    if (j != empty_entry<Index> && j > 0 && text[j - 1] >= text[j]) {
+      sa[bounds[bucket_of(text[j - 1])]++] = j - 1;
+    }
+  }
+
+  bucket_ends(counts, bounds);
+  for (size_t i = size; i-- > 0;) {
+    const auto j = sa[i];
+    if (j != empty_entry<Index> && j > 0
+        && (text[j - 1] < text[j] || (text[j - 1] == text[j] && types.is_s(static_cast<size_t>(j))))) {
+      sa[--bounds[bucket_of(text[j - 1])]] = j - 1;
+    }
+  }
+}
+
+// Whether the LMS substrings at lhs and rhs, which run up to and including the next LMS
+// position, have the same characters and types.
+template<typename Char>
+bool lms_substrings_equal(const Char *text, const size_t size, const suffix_types &types, const size_t lhs, const size_t rhs) {
+  for (size_t d = 0;; d++) {
+    // The sentinel is unique, no other substring equals one reaching it.
+    if (lhs + d == size || rhs + d == size
+        || text[lhs + d] != text[rhs + d] || types.is_s(lhs + d) != types.is_s(rhs + d)) {
+      return false;
+    }
+    if (d > 0 && (types.is_lms(lhs + d, size) || types.is_lms(rhs + d, size))) {
+      return types.is_lms(lhs + d, size) && types.is_lms(rhs + d, size);
+    }
+  }
+}
+
+// SA-IS (Nong, Zhang and Chan): sorts the suffixes of text over an alphabet of
+// alphabet_size characters into sa, which holds size entries, in time linear in size
+// whatever the contents. The empty suffix is not included.
+//
+// The LMS substrings are sorted by induction and named by rank, which reduces the text to
+// one at most half as long. Its suffix array, built recursively while names repeat, orders
+// the LMS suffixes, and a final induction orders everything else. The reduced text and its
+// suffix array both live in sa.
+template<typename Char, typename Index>
+int induced_sort(const Char *text, Index *sa, const size_t size, const size_t alphabet_size,
+                 snap::bsdiff::progress_reporter *progress) {
+  if (size == 0) {
+    return BSDIFF_SUCCESS;
+  }
+
+  int ret;
+  if (progress != nullptr && (ret = progress->poll()) != BSDIFF_SUCCESS) {
+    return ret;
+  }
+
+  // The last character is L-type, it is followed by the sentinel.
+  suffix_types types(size);
+  for (size_t i = size - 1; i-- > 0;) {
+    if (text[i] < text[i + 1] || (text[i] == text[i + 1] && types.is_s(i + 1))) {
+      types.set_s(i);
+    }
+  }
+
+  std::vector<Index> counts(alphabet_size, 0);
+  std::vector<Index> bounds(alphabet_size);
+  for (size_t i = 0; i < size; i++) {
+    counts[bucket_of(text[i])]++;
+  }
+
+  // Stage 1: sort the LMS substrings.
+  std::fill(sa, sa + size, empty_entry<Index>);
+  bucket_ends(counts, bounds);
+  size_t lms_count = 0;
+  for (size_t i = 1; i < size; i++) {
+    if (types.is_lms(i, size)) {
+      sa[--bounds[bucket_of(text[i])]] = static_cast<Index>(i);
+      lms_count++;
+    }
+  }
+  induce(text, sa, size, types, counts, bounds);
+
+  // Gather them in sorted order at the front of sa and name them. LMS positions are at
+  // least two apart, so halving them gives every one its own slot for its name.
+  size_t sorted = 0;
+  for (size_t i = 0; i < size; i++) {
+    if (types.is_lms(static_cast<size_t>(sa[i]), size)) {
+      sa[sorted++] = sa[i];
+    }
+  }
+  std::fill(sa + lms_count, sa + size, empty_entry<Index>);
+  size_t names = 0;
+  size_t previous = size;
+  for (size_t i = 0; i < lms_count; i++) {
+    const auto position = static_cast<size_t>(sa[i]);
+    if (previous == size || !lms_substrings_equal(text, size, types, previous, position)) {
+      names++;
+    }
+    previous = position;
+    sa[lms_count + position / 2] = static_cast<Index>(names - 1);
+  }
+  auto *reduced = sa + size - lms_count;
+  for (size_t i = size, j = size; i-- > lms_count;) {
+    if (sa[i] != empty_entry<Index>) {
+      sa[--j] = sa[i];
+    }
+  }
+
+  // Stage 2: sort the LMS suffixes. Unique names already give their order, repeated ones
+  // need the suffix array of the reduced text. The buckets are released meanwhile, the
+  // alphabet of the reduced text can be as large as the text.
+  if (names < lms_count) {
+    std::vector<Index>().swap(counts);
+    std::vector<Index>().swap(bounds);
+    if ((ret = induced_sort(reduced, sa, lms_count, names, progress)) != BSDIFF_SUCCESS) {
+      return ret;
+    }
+    counts.assign(alphabet_size, 0);
+    bounds.resize(alphabet_size);
+    for (size_t i = 0; i < size; i++) {
+      counts[bucket_of(text[i])]++;
+    }
+  } else {
+    for (size_t i = 0; i < lms_count; i++) {
+      sa[static_cast<size_t>(reduced[i])] = static_cast<Index>(i);
+    }
+  }
+
+  for (size_t i = 1, j = 0; i < size; i++) {
+    if (types.is_lms(i, size)) {
+      reduced[j++] = static_cast<Index>(i);
+    }
+  }
+  for (size_t i = 0; i < lms_count; i++) {
+    sa[i] = reduced[static_cast<size_t>(sa[i])];
+  }
+
+  // Stage 3: put the sorted LMS suffixes at the ends of their buckets, last first, and
+  // induce the order of all the others from them.
+  std::fill(sa + lms_count, sa + size, empty_entry<Index>);
+  bucket_ends(counts, bounds);
+  for (size_t i = lms_count; i-- > 0;) {
+    const auto j = sa[i];
+    sa[i] = empty_entry<Index>;
+    sa[--bounds[bucket_of(text[j])]] = j;
+  }
+  induce(text, sa, size, types, counts, bounds);
+
+  return BSDIFF_SUCCESS;
+}
+
+}
+
+template<typename Index>
+int snap::bsdiff::suffix_array_build(const uint8_t *buffer, const int64_t size, Index *sa, const uint32_t thread_count,
+                                     progress_reporter *progress) {
+  if (size < 0 || (size > 0 && buffer == nullptr) || sa == nullptr) {
+    return BSDIFF_INVALID_ARG;
+  }
+  if (sizeof(Index) < sizeof(int64_t) && size > suffix_array_max_size_32) {
+    return BSDIFF_SIZE_TOO_LARGE;
+  }
+
+  try {
+    int ret;
+    auto sorted = false;
+    if ((ret = prefix_doubling(buffer, size, sa, thread_count, progress, sorted)) != BSDIFF_SUCCESS || sorted) {
+      return ret;
+    }
+
+    sa[0] = static_cast<Index>(size);
+    return induced_sort(buffer, sa + 1, static_cast<size_t>(size), 256, progress);
+  } catch (const std::bad_alloc &) {
+    return BSDIFF_OUT_OF_MEMORY;
+  } catch (const std::system_error &) {
+    return BSDIFF_ERROR;
+  }
+}
+
+template int snap::bsdiff::suffix_array_build<uint32_t>(const uint8_t *, int64_t, uint32_t *, uint32_t, progress_reporter *);
+template int snap::bsdiff::suffix_array_build<int64_t>(const uint8_t *, int64_t, int64_t *, uint32_t, progress_reporter *);
@@ -0,0 +1,157 @@
+#include "bsdiff/thread_pool.hpp"
+#include "bsdiff/parallel.hpp"
+
+#include <algorithm>
+
+snap::bsdiff::thread_pool::thread_pool(const uint32_t thread_count) :
+    m_queues(),
+    m_threads(),
+    m_mutex(),
+    m_work_available(),
+    m_work_done(),
+    m_queued(0),
+    m_pending(0),
+    m_next_queue(0),
+    m_stopping(false) {
+  const auto workers = resolve_thread_count(thread_count);
+  for (uint32_t i = 0; i < workers; i++) {
+    m_queues.emplace_back(std::make_unique<worker_queue>());
+  }
+
+  m_threads.reserve(workers);
+  try {
+    for (size_t i = 0; i < workers; i++) {
+      m_threads.emplace_back(&thread_pool::run_worker, this, i);
+    }
+  } catch (...) {
+    // The destructor does not run for a pool that failed to construct, and destroying a
+    // thread that was never joined terminates the process.
+    stop();
+    throw;
+  }
+}
+
+snap::bsdiff::thread_pool::~thread_pool() {
+  wait();
+  stop();
+}
+
+void snap::bsdiff::thread_pool::stop() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+
+  m_work_available.notify_all();
+
+  for (auto &thread : m_threads) {
+    thread.join();
+  }
+}
+
+size_t snap::bsdiff::thread_pool::size() const {
+  return m_threads.size();
+}
+
+void snap::bsdiff::thread_pool::submit(std::function<void()> task) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  auto &queue = *m_queues[m_next_queue++ % m_queues.size()];
+  {
+    std::lock_guard<std::mutex> queue_lock(queue.mutex);
+    queue.tasks.emplace_back(std::move(task));
+  }
+
+  m_queued++;
+  m_pending++;
+  m_work_available.notify_one();
+}
+
+void snap::bsdiff::thread_pool::wait() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_work_done.wait(lock, [this] { return m_pending == 0; });
+}
+
+bool snap::bsdiff::thread_pool::try_pop(const size_t worker, std::function<void()> &task) {
+  {
+    auto &own = *m_queues[worker];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.front());
+      own.tasks.pop_front();
+      return true;
+    }
+  }
+
+  for (size_t i = 1; i < m_queues.size(); i++) {
+    auto &victim = *m_queues[(worker + i) % m_queues.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.back());
+      victim.tasks.pop_back();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void snap::bsdiff::thread_pool::run_worker(const size_t worker) {
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_work_available.wait(lock, [this] { return m_stopping || m_queued > 0; });
+      if (m_queued == 0) {
+        return;
+      }
+      m_queued--;
+    }
+
+    // m_queued was reserved above, so a task is guaranteed to be in one of the queues.
+    std::function<void()> task;
+    while (!try_pop(worker, task)) {
+      std::this_thread::yield();
+    }
+
+    task();
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (--m_pending == 0) {
+        m_work_done.notify_all();
+      }
+    }
+  }
+}
+
+snap::bsdiff::memory_budget::memory_budget(const uint64_t capacity) :
+    m_mutex(),
+    m_released(),
+    m_capacity(capacity),
+    m_available(capacity) {
+}
+
+uint64_t snap::bsdiff::memory_budget::acquire(const uint64_t bytes) {
+  if (m_capacity == 0) {
+    return 0;
+  }
+
+  const auto granted = std::min(bytes, m_capacity);
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_released.wait(lock, [&] { return m_available >= granted; });
+  m_available -= granted;
+  return granted;
+}
+
+void snap::bsdiff::memory_budget::release(const uint64_t bytes) {
+  if (m_capacity == 0 || bytes == 0) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_available += bytes;
+  }
+
+  m_released.notify_all();
+}
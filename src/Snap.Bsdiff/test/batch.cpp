@@ -0,0 +1,132 @@
+#include "gtest/gtest.h"
+#include "bsdiff/batch.hpp"
+#include "bsdiff/lib.hpp"
+#include "tests/support/patch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace snap::bsdiff;
+
+namespace {
+
+// Allocator that stays inside alloc for a while and records how many calls overlapped. The
+// patch of an item allocates newer once before it is applied, so overlapping calls mean
+// items ran at the same time.
+struct overlap_allocator {
+  std::atomic<int> inside{0};
+  std::atomic<int> peak{0};
+
+  static void *alloc(void *opaque, const size_t size) {
+    auto *self = static_cast<overlap_allocator *>(opaque);
+    const auto now = ++self->inside;
+    auto previous = self->peak.load();
+    while (now > previous && !self->peak.compare_exchange_weak(previous, now)) {
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    self->inside--;
+    return std::malloc(size);
+  }
+
+  static void free(void *, void *ptr) {
+    std::free(ptr);
+  }
+};
+
+}
+
+TEST(batch, RunsLargestEstimateFirst) {
+  const std::vector<uint64_t> estimates = {3, 9, 1, 9, 5};
+  std::vector<size_t> order;
+  std::mutex order_mutex;
+
+  const batch_options options = { 1, 0 };
+  run_batch(estimates.size(), options,
+    [&](const size_t index) { return estimates[index]; },
+    [&](const size_t index) {
+      std::lock_guard<std::mutex> lock(order_mutex);
+      order.push_back(index);
+    });
+
+  EXPECT_EQ((std::vector<size_t>{1, 3, 4, 0, 2}), order);
+}
+
+TEST(batch, StaysWithinMemoryBudget) {
+  // 250 exceeds the budget on its own, it is granted all of it and so runs alone.
+  const std::vector<uint64_t> estimates = {40, 40, 250, 40, 40, 40, 40, 40, 40, 40};
+  std::atomic<uint64_t> running{0};
+  std::atomic<uint64_t> peak{0};
+  std::atomic<int> running_count{0};
+  std::atomic<bool> large_shared{false};
+
+  const batch_options options = { 4, 100 };
+  run_batch(estimates.size(), options,
+    [&](const size_t index) { return estimates[index]; },
+    [&](const size_t index) {
+      const auto charged = std::min<uint64_t>(estimates[index], 100);
+      const auto now = running += charged;
+      auto previous = peak.load();
+      while (now > previous && !peak.compare_exchange_weak(previous, now)) {
+      }
+      running_count++;
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      if (index == 2 && running_count != 1) {
+        large_shared = true;
+      }
+      running_count--;
+      running -= charged;
+    });
+
+  EXPECT_LE(peak.load(), 100u);
+  EXPECT_FALSE(large_shared);
+}
+
+TEST(batch, PatchBatchStaysWithinMemoryBudget) {
+  std::vector<std::vector<uint8_t>> olders, newers;
+  std::vector<snap_bsdiff_diff_ctx> diffs;
+  for (uint32_t i = 0; i < 4; i++) {
+    olders.push_back(tests::random_bytes(64 * 1024, i));
+    newers.push_back(tests::edit(olders.back(), i + 100));
+  }
+  for (size_t i = 0; i < olders.size(); i++) {
+    snap_bsdiff_diff_ctx diff = {};
+    diff.older = olders[i].data();
+    diff.older_size = olders[i].size();
+    diff.newer = newers[i].data();
+    diff.newer_size = newers[i].size();
+    diff.thread_count = 1;
+    ASSERT_EQ(1, snap_bsdiff_diff(&diff));
+    diffs.push_back(diff);
+  }
+
+  // Every item is charged older plus newer, so a budget of one item runs them one at a time.
+  overlap_allocator allocator;
+  const snap_bsdiff_allocator hooks = { &allocator, overlap_allocator::alloc, nullptr, overlap_allocator::free };
+  std::vector<snap_bsdiff_patch_ctx> items;
+  for (size_t i = 0; i < diffs.size(); i++) {
+    items.push_back({ nullptr, olders[i].data(), olders[i].size(), nullptr, 0,
+                      diffs[i].patch, diffs[i].patch_size, bsdiff_status_type_success, hooks, 0, {}, 0, {}, nullptr });
+  }
+
+  snap_bsdiff_patch_batch_ctx batch = {};
+  batch.items = items.data();
+  batch.items_count = items.size();
+  batch.thread_count = 4;
+  batch.max_memory_bytes = olders[0].size() + newers[0].size();
+  EXPECT_EQ(1, snap_bsdiff_patch_batch(&batch));
+  EXPECT_EQ(bsdiff_status_type_success, batch.status);
+  EXPECT_EQ(0u, batch.failed_count);
+  EXPECT_EQ(1, allocator.peak.load());
+
+  for (size_t i = 0; i < items.size(); i++) {
+    EXPECT_EQ(bsdiff_status_type_success, items[i].status);
+    EXPECT_EQ(newers[i], std::vector<uint8_t>(items[i].newer, items[i].newer + items[i].newer_size));
+    snap_bsdiff_patch_free(&items[i]);
+    snap_bsdiff_diff_free(&diffs[i]);
+  }
+}
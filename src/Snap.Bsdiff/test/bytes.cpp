@@ -0,0 +1,109 @@
+#include "gtest/gtest.h"
+#include "bsdiff/bytes.hpp"
+#include "tests/support/patch.hpp"
+
+#include <utility>
+#include <vector>
+
+using namespace snap::bsdiff;
+
+namespace {
+
+// Every set the CPU can run besides the portable one, which the others are checked against.
+std::vector<std::pair<const char *, const byte_kernel_set *>> vector_kernels() {
+  std::vector<std::pair<const char *, const byte_kernel_set *>> kernels;
+#if defined(SNAP_BSDIFF_X86)
+  if (cpu_features().sse41) {
+    kernels.emplace_back("sse41", &byte_kernels_sse41);
+  }
+  if (cpu_features().avx2) {
+    kernels.emplace_back("avx2", &byte_kernels_avx2);
+  }
+#endif
+  return kernels;
+}
+
+// Sizes around the 16, 32 and 64 byte strides of the vector loops, so every tail length is
+// taken.
+std::vector<size_t> sizes() {
+  std::vector<size_t> result;
+  for (size_t size = 0; size <= 200; size++) {
+    result.push_back(size);
+  }
+  for (const size_t size : {255u, 256u, 257u, 1023u, 1024u, 1025u}) {
+    result.push_back(size);
+  }
+  return result;
+}
+
+// b equals a in about half of the bytes, in runs, so both the matching and the mismatching
+// paths of the loops are taken.
+std::pair<std::vector<uint8_t>, std::vector<uint8_t>> similar_bytes(const size_t size, const uint32_t seed) {
+  auto a = tests::random_bytes(size, seed);
+  auto b = a;
+  const auto noise = tests::random_bytes(size, seed + 1);
+  for (size_t i = 0; i < size; i++) {
+    if ((i / 37) % 2 == 1 && noise[i] % 3 != 0) {
+      b[i] = static_cast<uint8_t>(b[i] ^ (noise[i] | 1));
+    }
+  }
+  return { a, b };
+}
+
+}
+
+TEST(bytes, KernelsMatchPortableAtUnalignedOffsets) {
+  const auto kernels = vector_kernels();
+  if (kernels.empty()) {
+    GTEST_SKIP() << "No vector kernels on this CPU.";
+  }
+
+  // 64 bytes of slack, so every size starts at each offset within a cache line.
+  const auto [a, b] = similar_bytes(1025 + 64, 11);
+  for (const auto &[name, set] : kernels) {
+    SCOPED_TRACE(name);
+    for (size_t offset = 0; offset < 64; offset++) {
+      SCOPED_TRACE(offset);
+      for (const auto size : sizes()) {
+        SCOPED_TRACE(size);
+        const auto *x = a.data() + offset;
+        const auto *y = b.data() + offset;
+        EXPECT_EQ(byte_kernels_portable.common_prefix(x, x, size), set->common_prefix(x, x, size));
+        EXPECT_EQ(byte_kernels_portable.common_prefix(x, y, size), set->common_prefix(x, y, size));
+        EXPECT_EQ(byte_kernels_portable.count_equal(x, y, size), set->count_equal(x, y, size));
+
+        std::vector<uint8_t> expected(x, x + size);
+        std::vector<uint8_t> actual(expected);
+        byte_kernels_portable.add(expected.data(), y, size);
+        set->add(actual.data(), y, size);
+        EXPECT_EQ(expected, actual);
+
+        byte_kernels_portable.subtract(expected.data(), x, y, size);
+        set->subtract(actual.data(), x, y, size);
+        EXPECT_EQ(expected, actual);
+      }
+      EXPECT_EQ(byte_kernels_portable.equal_mask(a.data() + offset, b.data() + offset),
+                set->equal_mask(a.data() + offset, b.data() + offset));
+    }
+  }
+}
+
+TEST(bytes, CommonPrefixStopsAtEveryMismatch) {
+  const auto kernels = vector_kernels();
+  if (kernels.empty()) {
+    GTEST_SKIP() << "No vector kernels on this CPU.";
+  }
+
+  const auto a = tests::random_bytes(256 + 64, 13);
+  for (const auto &[name, set] : kernels) {
+    SCOPED_TRACE(name);
+    for (size_t offset = 0; offset < 64; offset += 7) {
+      for (size_t mismatch = 0; mismatch < 256; mismatch++) {
+        auto b = a;
+        b[offset + mismatch] = static_cast<uint8_t>(~b[offset + mismatch]);
+        EXPECT_EQ(mismatch, set->common_prefix(a.data() + offset, b.data() + offset, 256));
+        EXPECT_EQ(255u, set->count_equal(a.data() + offset, b.data() + offset, 256));
+      }
+    }
+  }
+}
@@ -0,0 +1,58 @@
+#include "gtest/gtest.h"
+#include "bsdiff/index.hpp"
+#include "bsdiff/suffix_array.hpp"
+#include "tests/support/patch.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace snap::bsdiff;
+
+namespace {
+
+std::string index_path(const char *name) {
+  return ::testing::TempDir() + name;
+}
+
+}
+
+TEST(index, OpenMapsTheBuiltSuffixArray) {
+  const auto older = tests::random_bytes(64 * 1024, 1);
+  const auto older_size = static_cast<int64_t>(older.size());
+  const auto path = index_path("snap_bsdiff_index_open.idx");
+  ASSERT_EQ(BSDIFF_SUCCESS, index_build(path.c_str(), older.data(), older_size, 2));
+
+  // Below 4 GiB the entries are 32-bit.
+  ASSERT_EQ(sizeof(uint32_t), suffix_array_width(older_size));
+  std::vector<uint32_t> expected(older.size() + 1);
+  ASSERT_EQ(BSDIFF_SUCCESS, suffix_array_build(older.data(), older_size, expected.data(), 1));
+
+  suffix_array_index index;
+  ASSERT_EQ(BSDIFF_SUCCESS, index.open(path.c_str(), older.data(), older_size));
+  EXPECT_EQ(older_size, index.older_size());
+  const auto *entries = static_cast<const uint32_t *>(index.suffix_array());
+  EXPECT_EQ(expected, std::vector<uint32_t>(entries, entries + expected.size()));
+
+  std::remove(path.c_str());
+}
+
+TEST(index, RejectsEntryPastEndOfOlder) {
+  const auto older = tests::random_bytes(4096, 2);
+  const auto older_size = static_cast<int64_t>(older.size());
+  const auto path = index_path("snap_bsdiff_index_tampered.idx");
+  ASSERT_EQ(BSDIFF_SUCCESS, index_build(path.c_str(), older.data(), older_size, 1));
+
+  // The second entry follows the 64 byte header and the empty suffix.
+  auto *file = std::fopen(path.c_str(), "r+b");
+  ASSERT_NE(nullptr, file);
+  const auto entry = static_cast<uint32_t>(older_size + 16);
+  ASSERT_EQ(0, std::fseek(file, 64 + static_cast<long>(sizeof(uint32_t)), SEEK_SET));
+  ASSERT_EQ(1u, std::fwrite(&entry, sizeof(entry), 1, file));
+  ASSERT_EQ(0, std::fclose(file));
+
+  suffix_array_index index;
+  EXPECT_EQ(BSDIFF_CORRUPT_PATCH, index.open(path.c_str(), older.data(), older_size));
+
+  std::remove(path.c_str());
+}
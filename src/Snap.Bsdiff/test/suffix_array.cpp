@@ -0,0 +1,154 @@
+#include "gtest/gtest.h"
+#include "bsdiff/diff.hpp"
+#include "bsdiff/parallel.hpp"
+#include "bsdiff/suffix_array.hpp"
+#include "tests/support/patch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <numeric>
+#include <vector>
+
+using namespace snap::bsdiff;
+
+namespace {
+
+// Reference suffix array, with the empty suffix first as suffix_array_build lays it out.
+std::vector<int64_t> sorted_suffixes(const std::vector<uint8_t> &buffer) {
+  const auto size = static_cast<int64_t>(buffer.size());
+  std::vector<int64_t> sa(buffer.size() + 1);
+  std::iota(sa.begin(), sa.end(), int64_t(0));
+  std::sort(sa.begin(), sa.end(), [&](const int64_t lhs, const int64_t rhs) {
+    const auto len = static_cast<size_t>(std::min(size - lhs, size - rhs));
+    const auto cmp = std::memcmp(buffer.data() + lhs, buffer.data() + rhs, len);
+    return cmp != 0 ? cmp < 0 : lhs > rhs;
+  });
+  return sa;
+}
+
+// Suffix array with Index entries, widened for comparison.
+template<typename Index = int64_t>
+std::vector<int64_t> build(const std::vector<uint8_t> &buffer, const uint32_t thread_count) {
+  std::vector<Index> sa(buffer.size() + 1);
+  EXPECT_EQ(BSDIFF_SUCCESS, suffix_array_build(buffer.data(), static_cast<int64_t>(buffer.size()), sa.data(), thread_count));
+  return std::vector<int64_t>(sa.begin(), sa.end());
+}
+
+std::vector<uint8_t> diff_patch(const std::vector<uint8_t> &older, const std::vector<uint8_t> &newer,
+                                const diff_options &options) {
+  tests::recording_packer packer;
+  EXPECT_EQ(BSDIFF_SUCCESS, diff(nullptr, older.data(), static_cast<int64_t>(older.size()),
+                                 newer.data(), static_cast<int64_t>(newer.size()), packer.get(), &options));
+  return packer.bytes;
+}
+
+std::vector<uint8_t> diff_patch(const std::vector<uint8_t> &older, const std::vector<uint8_t> &newer, const uint32_t thread_count) {
+  diff_options options = {};
+  options.thread_count = thread_count;
+  return diff_patch(older, newer, options);
+}
+
+// Random bytes, a run of zeros and a repeated table. The latter two are sorted by SA-IS.
+std::vector<std::vector<uint8_t>> corpora(const size_t size) {
+  auto table = tests::random_bytes(251, 3);
+  std::vector<uint8_t> tables;
+  while (tables.size() < size) {
+    tables.insert(tables.end(), table.begin(), table.end());
+  }
+  tables.resize(size);
+  return { tests::random_bytes(size, 1), std::vector<uint8_t>(size, 0), tables };
+}
+
+}
+
+TEST(suffix_array, MatchesReferenceSort) {
+  for (const auto size : {0, 1, 2, 3, 17, 1000, 20000}) {
+    for (const auto &buffer : corpora(static_cast<size_t>(size))) {
+      EXPECT_EQ(sorted_suffixes(buffer), build(buffer, 1)) << "size " << size;
+    }
+  }
+}
+
+TEST(suffix_array, IndependentOfIndexWidth) {
+  for (const auto &buffer : corpora(100000)) {
+    EXPECT_EQ(build<int64_t>(buffer, 2), build<uint32_t>(buffer, 2));
+  }
+}
+
+TEST(suffix_array, RejectsSizeTooLargeForIndex) {
+  uint32_t sa = 0;
+  const uint8_t byte = 0;
+  EXPECT_EQ(BSDIFF_SIZE_TOO_LARGE, suffix_array_build(&byte, suffix_array_max_size_32 + 1, &sa, 1));
+}
+
+TEST(suffix_array, IndependentOfThreadCount) {
+  for (const auto &buffer : corpora(1 << 20)) {
+    const auto expected = build(buffer, 1);
+    EXPECT_EQ(expected, build(buffer, 4));
+    EXPECT_EQ(expected, build(buffer, 0));
+  }
+}
+
+TEST(suffix_array, PatchIndependentOfThreadCount) {
+  const auto older = tests::random_bytes(1 << 20, 7);
+  const auto newer = tests::edit(older, 8);
+  const auto expected = diff_patch(older, newer, 1);
+  EXPECT_EQ(expected, diff_patch(older, newer, 4));
+  EXPECT_EQ(expected, diff_patch(older, newer, 0));
+}
+
+// The width only changes how the suffix array is stored, so 64-bit entries on input that
+// would get 32-bit ones give the same patch, whether diff sorts or is handed the array.
+TEST(suffix_array, PatchIndependentOfIndexWidth) {
+  // Above prematch_min_older_size, so the prematch engine hashes blocks before it scans.
+  const auto older = tests::random_bytes(3 << 19, 9);
+  const auto newer = tests::edit(older, 8);
+  const auto sa32 = build<uint32_t>(older, 0);
+  const std::vector<uint32_t> prebuilt32(sa32.begin(), sa32.end());
+  const auto prebuilt64 = build<int64_t>(older, 0);
+
+  for (const auto engine : {bsdiff_engine_type_prematch, bsdiff_engine_type_suffix_array}) {
+    SCOPED_TRACE(engine);
+    diff_options options = {};
+    options.engine = engine;
+    options.index_width = sizeof(uint32_t);
+    const auto expected = diff_patch(older, newer, options);
+    options.suffix_array = prebuilt32.data();
+    EXPECT_EQ(expected, diff_patch(older, newer, options));
+
+    options.index_width = sizeof(int64_t);
+    options.suffix_array = nullptr;
+    EXPECT_EQ(expected, diff_patch(older, newer, options));
+    options.suffix_array = prebuilt64.data();
+    EXPECT_EQ(expected, diff_patch(older, newer, options));
+  }
+}
+
+TEST(suffix_array, RejectsNarrowIndexWidth) {
+  const auto older = tests::random_bytes(1024, 10);
+  tests::recording_packer packer;
+  diff_options options = {};
+  options.index_width = 2;
+  EXPECT_EQ(BSDIFF_INVALID_ARG, diff(nullptr, older.data(), static_cast<int64_t>(older.size()),
+                                     older.data(), static_cast<int64_t>(older.size()), packer.get(), &options));
+}
+
+TEST(parallel_for, CoversEveryItemOnce) {
+  std::vector<std::atomic<int>> visits(10000);
+  parallel_for(visits.size(), 7, 4, [&](const size_t begin, const size_t end) {
+    for (auto i = begin; i < end; i++) {
+      visits[i]++;
+    }
+  });
+  EXPECT_TRUE(std::all_of(visits.begin(), visits.end(), [](const std::atomic<int> &visit) { return visit == 1; }));
+}
+
+TEST(parallel_for, RethrowsOnCallingThread) {
+  EXPECT_THROW(parallel_for(10000, 7, 4, [&](const size_t begin, const size_t) {
+    if (begin == 700) {
+      throw std::bad_alloc();
+    }
+  }), std::bad_alloc);
+}
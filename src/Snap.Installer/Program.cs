@@ -191,7 +191,7 @@ internal static partial class Program
                 workingDirectory
             )
         );
-        container.Register<ISnapCryptoProvider>(_ => new SnapCryptoProvider());
+        container.Register<ISnapCryptoProvider>(c => new SnapCryptoProvider(c.GetInstance<IBsdiffLib>()));
         container.Register<ISnapAppReader>(_ => new SnapAppReader());
         container.Register<ISnapAppWriter>(_ => new SnapAppWriter());
         container.Register<ISnapBinaryPatcher>(c => new SnapBinaryPatcher(c.GetInstance<IBsdiffLib>()));
@@ -1,5 +1,6 @@
 using System;
 using System.IO;
+using System.Threading;
 using System.Threading.Tasks;
 using Snap.Core;
 using Xunit;
@@ -10,6 +11,7 @@ public class SnapBinaryPatcherTests
 {
     static readonly Random Random = new();
     readonly ISnapBinaryPatcher _snapBinaryPatcher = new SnapBinaryPatcher(new LibBsDiff());
+    readonly ISnapCryptoProvider _snapCryptoProvider = new SnapCryptoProvider();
 
     [Fact]
     public async Task TestBsDiff()
@@ -77,4 +79,137 @@ public class SnapBinaryPatcherTests
 
         Assert.Equal(newFileData, patchedStream.ToArray());
     }
-}
\ No newline at end of file
+
+    [Fact]
+    public void TestBsDiffFiles()
+    {
+        var baseFileData = new byte[1024 * 1024];
+        Random.NextBytes(baseFileData);
+        var newFileData = new byte[baseFileData.Length + 4096];
+        baseFileData.CopyTo(newFileData, 4096);
+
+        var workingDirectory = Path.Combine(Path.GetTempPath(), Guid.NewGuid().ToString("N"));
+        Directory.CreateDirectory(workingDirectory);
+
+        try
+        {
+            var baseFilename = Path.Combine(workingDirectory, "base.bin");
+            var newFilename = Path.Combine(workingDirectory, "new.bin");
+            var patchFilename = Path.Combine(workingDirectory, "patch.bin");
+            var patchedFilename = Path.Combine(workingDirectory, "patched.bin");
+
+            File.WriteAllBytes(baseFilename, baseFileData);
+            File.WriteAllBytes(newFilename, newFileData);
+
+            _snapBinaryPatcher.DiffFiles(baseFilename, newFilename, patchFilename);
+            _snapBinaryPatcher.PatchFiles(baseFilename, patchFilename, patchedFilename);
+
+            Assert.Equal(newFileData, File.ReadAllBytes(patchedFilename));
+        }
+        finally
+        {
+            Directory.Delete(workingDirectory, true);
+        }
+    }
+
+    [Fact]
+    public void TestBsPatch_Cancelled()
+    {
+        var baseFileData = new byte[4 * 1024 * 1024];
+        Random.NextBytes(baseFileData);
+        var newFileData = new byte[baseFileData.Length];
+        baseFileData.CopyTo(newFileData, 0);
+        newFileData[0]++;
+
+        using var baseFileStream = new MemoryStream(baseFileData, 0, baseFileData.Length, true, true);
+        using var newFileStream = new MemoryStream(newFileData, 0, newFileData.Length, true, true);
+        using var patchStream = new MemoryStream();
+        _snapBinaryPatcher.Diff(baseFileStream, newFileStream, patchStream);
+
+        using var cts = new CancellationTokenSource();
+        cts.Cancel();
+
+        using var toPatchStream = new MemoryStream(baseFileData, 0, baseFileData.Length, true, true);
+        using var patchedStream = new MemoryStream();
+        Assert.Throws<OperationCanceledException>(() =>
+            _snapBinaryPatcher.Patch(toPatchStream, patchStream, patchedStream, cts.Token));
+        Assert.Equal(0, patchedStream.Length);
+    }
+
+    [Fact]
+    public void TestBsPatch_Verify()
+    {
+        var baseFileData = new byte[1024 * 1024];
+        Random.NextBytes(baseFileData);
+        var newFileData = new byte[baseFileData.Length];
+        baseFileData.CopyTo(newFileData, 0);
+        newFileData[1024]++;
+
+        using var baseFileStream = new MemoryStream(baseFileData, 0, baseFileData.Length, true, true);
+        using var newFileStream = new MemoryStream(newFileData, 0, newFileData.Length, true, true);
+        using var patchStream = new MemoryStream();
+        _snapBinaryPatcher.Diff(baseFileStream, newFileStream, patchStream);
+
+        var expectedSha256 = _snapCryptoProvider.Sha256(newFileData);
+
+        using var toPatchStream = new MemoryStream(baseFileData, 0, baseFileData.Length, true, true);
+        using var patchedStream = new MemoryStream();
+        Assert.Equal(expectedSha256, _snapBinaryPatcher.Patch(toPatchStream, patchStream, patchedStream, default));
+        Assert.Equal(expectedSha256, _snapBinaryPatcher.Verify(toPatchStream, patchStream));
+        Assert.Equal(newFileData, patchedStream.ToArray());
+    }
+
+    [Fact]
+    public async Task TestBsDiffAsync_Concurrent()
+    {
+        var baseFileData = new byte[1024 * 1024];
+        Random.NextBytes(baseFileData);
+        var newFileData = new byte[baseFileData.Length];
+        baseFileData.CopyTo(newFileData, 0);
+        newFileData[1024]++;
+        newFileData[4096] = 0;
+
+        using var baseFileStream = new MemoryStream(baseFileData, 0, baseFileData.Length, true, true);
+        using var newFileStream = new MemoryStream(newFileData, 0, newFileData.Length, true, true);
+        await using var expectedPatchStream = new MemoryStream();
+        _snapBinaryPatcher.Diff(baseFileStream, newFileStream, expectedPatchStream);
+
+        var expectedSha256 = _snapCryptoProvider.Sha256(newFileData);
+
+        var tasks = new Task[8];
+        for (var i = 0; i < tasks.Length; i++)
+        {
+            tasks[i] = Task.Run(async () =>
+            {
+                using var olderStream = new MemoryStream(baseFileData, 0, baseFileData.Length, true, true);
+                using var newerStream = new MemoryStream(newFileData, 0, newFileData.Length, true, true);
+                await using var patchStream = new MemoryStream();
+                var stats = await _snapBinaryPatcher.DiffAsync(olderStream, newerStream, patchStream);
+                Assert.Equal(expectedPatchStream.ToArray(), patchStream.ToArray());
+                Assert.Equal((ulong)patchStream.Length, stats.patch_bytes);
+
+                await using var patchedStream = new MemoryStream();
+                Assert.Equal(expectedSha256, await _snapBinaryPatcher.PatchAsync(olderStream, patchStream, patchedStream, default));
+                Assert.Equal(newFileData, patchedStream.ToArray());
+            });
+        }
+
+        await Task.WhenAll(tasks);
+    }
+
+    [Fact]
+    public async Task TestBsDiffAsync_Cancelled()
+    {
+        var baseFileData = new byte[1024 * 1024];
+        Random.NextBytes(baseFileData);
+
+        using var baseFileStream = new MemoryStream(baseFileData, 0, baseFileData.Length, true, true);
+        using var newFileStream = new MemoryStream(baseFileData, 0, baseFileData.Length, true, true);
+        await using var patchStream = new MemoryStream();
+        using var cts = new CancellationTokenSource();
+        cts.Cancel();
+
+        await Assert.ThrowsAsync<OperationCanceledException>(() =>
+            _snapBinaryPatcher.DiffAsync(baseFileStream, newFileStream, patchStream, cts.Token));
+    }
+}
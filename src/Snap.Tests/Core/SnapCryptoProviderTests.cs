@@ -1,4 +1,5 @@
 using System;
+using System.Collections.Generic;
 using System.IO;
 using System.Text;
 using System.Threading.Tasks;
@@ -24,7 +25,7 @@ public class SnapCryptoProviderTests : IClassFixture<BaseFixturePackaging>
         var libPal = new LibPal();
         var bsdiffLib = new LibBsDiff();
         _baseFixture = baseFixture;
-        _snapCryptoProvider = new SnapCryptoProvider();
+        _snapCryptoProvider = new SnapCryptoProvider(bsdiffLib);
         var snapAppReader = new SnapAppReader();
         var snapAppWriter = new SnapAppWriter();
         _snapFilesystem = new SnapFilesystem();
@@ -52,6 +53,48 @@ public class SnapCryptoProviderTests : IClassFixture<BaseFixturePackaging>
         Assert.Equal(SnapConstants.Sha256EmptyFileChecksum, _snapCryptoProvider.Sha256(new MemoryStream()));
     }
 
+    [Theory]
+    [InlineData(0)]
+    [InlineData(55)]
+    [InlineData(64)]
+    [InlineData(1024 * 1024 + 7)]
+    public void TestSha256_Native_Equals_Managed(int length)
+    {
+        var content = new byte[length];
+        new Random(length).NextBytes(content);
+
+        var managedSnapCryptoProvider = new SnapCryptoProvider();
+        var expectedSha256 = managedSnapCryptoProvider.Sha256(content);
+
+        Assert.Equal(expectedSha256, _snapCryptoProvider.Sha256(content));
+        Assert.Equal(expectedSha256, _snapCryptoProvider.Sha256(new MemoryStream(content)));
+        Assert.Equal(expectedSha256, _snapCryptoProvider.Sha256(new BufferedStream(new MemoryStream(content))));
+    }
+
+    [Fact]
+    public void TestSha256_Native_Batch()
+    {
+        using var bsdiffLib = new LibBsDiff();
+        var managedSnapCryptoProvider = new SnapCryptoProvider();
+
+        var random = new Random(1);
+        var streams = new List<MemoryStream>();
+        for (var i = 0; i < 100; i++)
+        {
+            var content = new byte[random.Next(0, 16 * 1024)];
+            random.NextBytes(content);
+            streams.Add(new MemoryStream(content, 0, content.Length, false, true));
+        }
+
+        var checksums = bsdiffLib.Sha256(streams);
+
+        Assert.Equal(streams.Count, checksums.Length);
+        for (var i = 0; i < streams.Count; i++)
+        {
+            Assert.Equal(managedSnapCryptoProvider.Sha256(streams[i]), checksums[i]);
+        }
+    }
+
     [Fact]
     public async Task TestSha256_PackageArchiveReader_Central_Directory_Corrupt()
     {
@@ -0,0 +1,723 @@
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.IO.Compression;
+using System.Linq;
+using System.Security.Cryptography;
+using System.Text;
+using System.Threading;
+using System.Threading.Tasks;
+using Xunit;
+
+namespace Snap.Tests;
+
+public class LibBsDiffTests : IDisposable
+{
+    static readonly Random Random = new();
+    readonly LibBsDiff _libBsDiff = new();
+
+    [Theory]
+    [InlineData(1)]
+    [InlineData(7)]
+    [InlineData(64 * 1024)]
+    public void TestDiffStream_PatchStream(int maxReadSize)
+    {
+        var olderData = RandomBytes(256 * 1024);
+        var newerData = Edit(olderData);
+
+        using var olderStream = new ChunkedStream(olderData, maxReadSize);
+        using var newerStream = new ChunkedStream(newerData, maxReadSize);
+        using var patchStream = new MemoryStream();
+        _libBsDiff.DiffStream(olderStream, newerStream, patchStream);
+
+        var patchData = patchStream.ToArray();
+        using var patchReadStream = new ChunkedStream(patchData, maxReadSize);
+        using var outputStream = new MemoryStream();
+        olderStream.Position = 0;
+        _libBsDiff.PatchStream(olderStream, patchReadStream, outputStream);
+
+        Assert.Equal(newerData, outputStream.ToArray());
+        Assert.True(olderStream.Seeks > 0);
+    }
+
+    [Fact]
+    public void TestPatchStream_Truncated()
+    {
+        var olderData = RandomBytes(64 * 1024);
+        var newerData = Edit(olderData);
+
+        using var patchStream = new MemoryStream();
+        _libBsDiff.DiffStream(new ChunkedStream(olderData, 4096), new ChunkedStream(newerData, 4096), patchStream);
+
+        var patchData = patchStream.ToArray().AsSpan(0, (int)patchStream.Length / 2).ToArray();
+        using var outputStream = new MemoryStream();
+        Assert.Throws<Exception>(() => _libBsDiff.PatchStream(new ChunkedStream(olderData, 4096), new ChunkedStream(patchData, 4096), outputStream));
+    }
+
+    [Fact]
+    public void TestDiffBatch()
+    {
+        var olderData = new[] { RandomBytes(256 * 1024), RandomBytes(64 * 1024), RandomBytes(1024 * 1024) };
+        var newerData = olderData.Select(Edit).ToArray();
+        // The second item has nothing to diff against, which fails only that item.
+        olderData[1] = Array.Empty<byte>();
+
+        var items = olderData.Select((older, i) => new BsDiffBatchItem(
+            new MemoryStream(older, 0, older.Length, true, true),
+            new MemoryStream(newerData[i], 0, newerData[i].Length, true, true),
+            new MemoryStream())).ToList();
+
+        var statuses = _libBsDiff.DiffBatch(items, 2);
+
+        Assert.Equal(new[] { BsDiffStatusType.Success, BsDiffStatusType.InvalidArg, BsDiffStatusType.Success }, statuses);
+        Assert.Equal(0, items[1].PatchStream.Length);
+        foreach (var i in new[] { 0, 2 })
+        {
+            Assert.Equal(newerData[i], Patch(olderData[i], ((MemoryStream)items[i].PatchStream).ToArray()));
+            Assert.Equal((ulong)items[i].PatchStream.Length, items[i].Stats.patch_bytes);
+        }
+    }
+
+    [Fact]
+    public void TestDiffBatch_Cancelled()
+    {
+        var olderData = new[] { RandomBytes(256 * 1024), RandomBytes(64 * 1024) };
+        var newerData = olderData.Select(Edit).ToArray();
+        var items = olderData.Select((older, i) => new BsDiffBatchItem(
+            new MemoryStream(older, 0, older.Length, true, true),
+            new MemoryStream(newerData[i], 0, newerData[i].Length, true, true),
+            new MemoryStream())).ToList();
+
+        using var cts = new CancellationTokenSource();
+        cts.Cancel();
+
+        Assert.Throws<OperationCanceledException>(() => _libBsDiff.DiffBatch(items, 2, cancellationToken: cts.Token));
+        Assert.All(items, item => Assert.Equal(0, item.PatchStream.Length));
+    }
+
+    [Fact]
+    public void TestPatchBatch()
+    {
+        var olderData = new[] { RandomBytes(256 * 1024), RandomBytes(64 * 1024), RandomBytes(1024 * 1024) };
+        var newerData = olderData.Select(Edit).ToArray();
+        var patchData = olderData.Select((older, i) => Diff(older, newerData[i])).ToArray();
+        // The second patch is cut short, which fails only that item.
+        patchData[1] = patchData[1].AsSpan(0, patchData[1].Length / 2).ToArray();
+
+        var items = olderData.Select((older, i) => new BsPatchBatchItem(
+            new MemoryStream(older, 0, older.Length, true, true),
+            new MemoryStream(patchData[i], 0, patchData[i].Length, true, true),
+            new MemoryStream())).ToList();
+
+        // A budget of a single item makes the items run one at a time.
+        var statuses = _libBsDiff.PatchBatch(items, 2, (ulong)(olderData[2].Length + newerData[2].Length));
+
+        Assert.Equal(BsDiffStatusType.Success, statuses[0]);
+        Assert.NotEqual(BsDiffStatusType.Success, statuses[1]);
+        Assert.Equal(BsDiffStatusType.Success, statuses[2]);
+        Assert.Equal(0, items[1].OutputStream.Length);
+        Assert.Null(items[1].Sha256Checksum);
+        foreach (var i in new[] { 0, 2 })
+        {
+            Assert.Equal(newerData[i], ((MemoryStream)items[i].OutputStream).ToArray());
+            Assert.Equal(Convert.ToHexString(SHA256.HashData(newerData[i])).ToLowerInvariant(), items[i].Sha256Checksum);
+        }
+    }
+
+    [Fact]
+    public void TestIndex_DiffMatchesDiffWithoutIndex()
+    {
+        var olderData = RandomBytes(256 * 1024);
+        var newerData = Edit(olderData);
+        var indexPath = Path.Combine(Path.GetTempPath(), $"{Guid.NewGuid():N}.idx");
+
+        try
+        {
+            using var olderStream = new MemoryStream(olderData, 0, olderData.Length, true, true);
+            _libBsDiff.BuildIndex(olderStream, indexPath);
+
+            // A separate copy of older, the index only has to match its contents.
+            var olderCopy = olderData.ToArray();
+            using var olderCopyStream = new MemoryStream(olderCopy, 0, olderCopy.Length, true, true);
+            using var index = _libBsDiff.OpenIndex(olderCopyStream, indexPath);
+
+            Assert.Equal(Diff(olderData, newerData), Diff(olderCopy, newerData, new BsDiffOptions { Index = index }));
+        }
+        finally
+        {
+            File.Delete(indexPath);
+        }
+    }
+
+    [Fact]
+    public void TestIndex_RejectsStaleOlder()
+    {
+        var olderData = RandomBytes(64 * 1024);
+        var indexPath = Path.Combine(Path.GetTempPath(), $"{Guid.NewGuid():N}.idx");
+
+        try
+        {
+            using (var olderStream = new MemoryStream(olderData, 0, olderData.Length, true, true))
+            {
+                _libBsDiff.BuildIndex(olderStream, indexPath);
+            }
+
+            var resized = olderData.AsSpan(0, olderData.Length - 1).ToArray();
+            var edited = olderData.ToArray();
+            edited[edited.Length / 2] ^= 0xFF;
+
+            foreach (var stale in new[] { resized, edited })
+            {
+                using var staleStream = new MemoryStream(stale, 0, stale.Length, true, true);
+                var ex = Assert.Throws<Exception>(() => _libBsDiff.OpenIndex(staleStream, indexPath));
+                Assert.Contains(nameof(BsDiffStatusType.CorruptPatch), ex.Message);
+            }
+        }
+        finally
+        {
+            File.Delete(indexPath);
+        }
+    }
+
+    // BsDiffPackerType is internal, so the cases are passed as its values.
+    [Theory]
+    [InlineData((int)BsDiffPackerType.Bz2)]
+    [InlineData((int)BsDiffPackerType.Stored)]
+    [InlineData((int)BsDiffPackerType.Zstd)]
+    [InlineData((int)BsDiffPackerType.Lz4)]
+    public void TestDiff_PackerType(int packerType)
+    {
+        var olderData = RandomBytes(1024 * 1024);
+        var newerData = Edit(olderData);
+        var packer = new BsDiffPackerOptions { type = (BsDiffPackerType)packerType };
+
+        if (!TryDiff(olderData, newerData, new BsDiffOptions { Packer = packer }, out var patchData))
+        {
+            return;
+        }
+
+        if (packer.type != BsDiffPackerType.Bz2)
+        {
+            Assert.Equal("SNAPBSDF", Encoding.ASCII.GetString(patchData, 0, 8));
+            Assert.Equal((byte)packer.type, patchData[9]);
+        }
+
+        Assert.Equal(newerData, Patch(olderData, patchData));
+    }
+
+    [Theory]
+    [InlineData((int)BsDiffPackerType.Zstd, 64 * 1024)]
+    [InlineData((int)BsDiffPackerType.Zstd, 1024 * 1024)]
+    [InlineData((int)BsDiffPackerType.Lz4, 64 * 1024)]
+    [InlineData((int)BsDiffPackerType.Lz4, 1024 * 1024)]
+    public void TestDiff_BlockSize(int packerType, int blockSize)
+    {
+        var olderData = RandomBytes(4 * 1024 * 1024);
+        var newerData = Edit(olderData);
+        var packer = new BsDiffPackerOptions { type = (BsDiffPackerType)packerType, block_size = (uint)blockSize };
+
+        if (!TryDiff(olderData, newerData, new BsDiffOptions { Packer = packer }, out var patchData))
+        {
+            return;
+        }
+
+        Assert.Equal(0x01, patchData[11] & 0x01);
+        Assert.Equal(newerData, Patch(olderData, patchData));
+    }
+
+    // Only zstd and lz4 know blocks, the others must refuse a block size instead of ignoring it.
+    [Theory]
+    [InlineData((int)BsDiffPackerType.Bz2)]
+    [InlineData((int)BsDiffPackerType.Stored)]
+    public void TestDiff_BlockSize_Unsupported(int packerType)
+    {
+        var olderData = RandomBytes(64 * 1024);
+        var newerData = Edit(olderData);
+        var packer = new BsDiffPackerOptions { type = (BsDiffPackerType)packerType, block_size = 64 * 1024 };
+
+        var e = Assert.Throws<Exception>(() => Diff(olderData, newerData, new BsDiffOptions { Packer = packer }));
+        Assert.EndsWith($"Error code: {BsDiffStatusType.InvalidArg}", e.Message);
+    }
+
+    // Both budgets are far below the suffix array of older, so it is diffed in several windows.
+    [Theory]
+    [InlineData(2 * 1024 * 1024)]
+    [InlineData(8 * 1024 * 1024)]
+    public void TestDiff_MaxMemoryBytes(int maxMemoryBytes)
+    {
+        var olderData = RandomBytes(4 * 1024 * 1024);
+        var newerData = Edit(olderData);
+
+        var patchData = Diff(olderData, newerData, new BsDiffOptions { MaxMemoryBytes = (ulong)maxMemoryBytes }, out var stats);
+
+        Assert.InRange(stats.peak_memory_bytes, 1ul, (ulong)maxMemoryBytes);
+        Assert.Equal(newerData, Patch(olderData, patchData));
+    }
+
+    [Theory]
+    [InlineData((int)BsDiffPackerType.Bz2)]
+    [InlineData((int)BsDiffPackerType.Stored)]
+    public void TestDiff_Stats(int packerType)
+    {
+        var olderData = RandomBytes(1024 * 1024);
+        var newerData = Edit(olderData);
+
+        var patchData = Diff(olderData, newerData, new BsDiffOptions { Packer = new BsDiffPackerOptions { type = (BsDiffPackerType)packerType } }, out var stats);
+
+        // The streams are compressed together, so only their uncompressed sizes add up.
+        Assert.Equal((ulong)patchData.Length, stats.patch_bytes);
+        Assert.Equal((ulong)newerData.Length, stats.diff_bytes + stats.extra_bytes);
+        Assert.Equal(24 * stats.entry_count, stats.control_bytes);
+        Assert.InRange(stats.matched_bytes, 1ul, stats.diff_bytes);
+        Assert.InRange(stats.longest_match_bytes, 1ul, stats.diff_bytes);
+        Assert.InRange(stats.peak_memory_bytes, (ulong)olderData.Length, ulong.MaxValue);
+    }
+
+    [Fact]
+    public void TestDiff_ExecutableFilter()
+    {
+        var olderData = ElfBytes(1024 * 1024, 0);
+        var newerData = ElfBytes(1024 * 1024, 4096);
+        var packer = new BsDiffPackerOptions { type = BsDiffPackerType.Stored };
+
+        Diff(olderData, newerData, new BsDiffOptions { Packer = packer }, out var unfilteredStats);
+        var patchData = Diff(olderData, newerData, new BsDiffOptions { Packer = packer, Filter = BsDiffFilterType.Executable }, out var filteredStats);
+
+        Assert.Equal(0x04, patchData[11] & 0x04);
+        // Calls whose target only moved diff to zero bytes once the filter made them absolute.
+        Assert.True(filteredStats.matched_bytes > unfilteredStats.matched_bytes,
+            $"{filteredStats.matched_bytes} matched bytes with the filter, {unfilteredStats.matched_bytes} without.");
+        Assert.Equal(newerData, Patch(olderData, patchData));
+    }
+
+    [Fact]
+    public void TestChunk_BoundariesResyncAfterInsert()
+    {
+        var olderData = RandomBytes(1024 * 1024);
+        var newerData = Insert(olderData, olderData.Length / 2, RandomBytes(1000));
+
+        var older = Chunk(olderData);
+        var newer = Chunk(newerData);
+
+        AssertCovers(older.Files[0], olderData.Length);
+        AssertCovers(newer.Files[0], newerData.Length);
+        // Boundaries only depend on the bytes before them, so only the few chunks around the
+        // insert differ.
+        var olderChecksums = older.Files[0].Select(x => x.Sha256Checksum).ToHashSet();
+        var changed = newer.Files[0].Count(x => !olderChecksums.Contains(x.Sha256Checksum));
+        Assert.InRange(changed, 1, 8);
+        Assert.Equal(older.Files[0], Chunk(olderData).Files[0]);
+    }
+
+    [Fact]
+    public void TestChunk_DedupesWithinRelease()
+    {
+        var data = RandomBytes(256 * 1024);
+
+        var result = Chunk(data, RandomBytes(128 * 1024), data);
+
+        Assert.All(result.Files[0], x => Assert.True(x.Novel));
+        Assert.All(result.Files[1], x => Assert.True(x.Novel));
+        Assert.All(result.Files[2], x => Assert.False(x.Novel));
+        Assert.Equal(result.Files[0].Select(x => x.Sha256Checksum), result.Files[2].Select(x => x.Sha256Checksum));
+    }
+
+    [Fact]
+    public void TestChunk_DedupesAgainstKnown()
+    {
+        var olderData = RandomBytes(1024 * 1024);
+        var newerData = Insert(olderData, olderData.Length / 2, RandomBytes(1000));
+        var known = Chunk(olderData).Files[0].Select(x => x.Sha256Checksum).ToList();
+
+        var result = _libBsDiff.Chunk(new[] { Stream(olderData), Stream(newerData) }, known, ChunkMinSize, ChunkAvgSize, ChunkMaxSize);
+
+        Assert.All(result.Files[0], x => Assert.False(x.Novel));
+        Assert.InRange(result.Files[1].Count(x => x.Novel), 1, 8);
+    }
+
+    [Fact]
+    public void TestChunk_NovelCountAndSize()
+    {
+        var olderData = RandomBytes(512 * 1024);
+        var newerData = Insert(olderData, 1000, RandomBytes(5000));
+        var known = Chunk(olderData).Files[0].Take(10).Select(x => x.Sha256Checksum).ToList();
+
+        var result = _libBsDiff.Chunk(new[] { Stream(newerData), Stream(olderData) }, known, ChunkMinSize, ChunkAvgSize, ChunkMaxSize);
+        var novel = result.Files.SelectMany(x => x).Where(x => x.Novel).ToList();
+
+        Assert.NotEmpty(novel);
+        Assert.Equal((ulong)novel.Count, result.NovelCount);
+        Assert.Equal((ulong)novel.Sum(x => (long)x.Size), result.NovelSize);
+        Assert.Equal(novel.Count, novel.Select(x => x.Sha256Checksum).Distinct().Count());
+    }
+
+    [Fact]
+    public void TestChunk_InvalidSizes()
+    {
+        var e = Assert.Throws<Exception>(() => _libBsDiff.Chunk(new[] { Stream(RandomBytes(1024)) }, null, 4096, 3000, 16384));
+
+        Assert.EndsWith($"Error code: {BsDiffStatusType.InvalidArg}", e.Message);
+    }
+
+    [Fact]
+    public void TestDiff_ArchiveFilter()
+    {
+        // Compressible, so deflate scatters an edit over the rest of the entry.
+        var assembly = Encoding.ASCII.GetBytes(string.Concat(Enumerable.Range(0, 64 * 1024).Select(_ => Random.Next(1000) + " ")));
+        var olderData = NupkgBytes(assembly);
+        var newerData = NupkgBytes(Edit(assembly));
+        var packer = new BsDiffPackerOptions { type = BsDiffPackerType.Stored };
+
+        byte[] patchData;
+        BsDiffStats filteredStats;
+        try
+        {
+            patchData = Diff(olderData, newerData, new BsDiffOptions { Packer = packer, Filter = BsDiffFilterType.Archive }, out filteredStats);
+        }
+        catch (Exception e) when (e.Message.EndsWith($"Error code: {BsDiffStatusType.Unsupported}"))
+        {
+            // The native library was built without zlib.
+            return;
+        }
+
+        Diff(olderData, newerData, new BsDiffOptions { Packer = packer }, out var unfilteredStats);
+
+        Assert.Equal(0x08, patchData[11] & 0x08);
+        // Entries are only expanded when zlib reproduces the deflate output of ZipArchive, which
+        // depends on the zlib the runtime ships. Expanded entries make newer grow.
+        if (filteredStats.diff_bytes + filteredStats.extra_bytes > (ulong)newerData.Length)
+        {
+            Assert.True(filteredStats.matched_bytes > unfilteredStats.matched_bytes,
+                $"{filteredStats.matched_bytes} matched bytes with the filter, {unfilteredStats.matched_bytes} without.");
+        }
+        Assert.Equal(newerData, Patch(olderData, patchData));
+    }
+
+    [Fact]
+    public void TestDiff_RollingHash()
+    {
+        var olderData = RandomBytes(4 * 1024 * 1024);
+        var newerData = Edit(olderData);
+
+        var patchData = Diff(olderData, newerData, new BsDiffOptions { Engine = BsDiffEngineType.RollingHash }, out var stats);
+
+        Assert.True(stats.matched_bytes > 0);
+        Assert.Equal(newerData, Patch(olderData, patchData));
+    }
+
+    // Prematching only skips the search where newer is unchanged, older is still sorted as a
+    // whole, so its patches stay as small as those of the suffix array engine.
+    [Fact]
+    public void TestDiff_Prematch()
+    {
+        var olderData = RandomBytes(4 * 1024 * 1024);
+        var newerData = Edit(olderData);
+        var packer = new BsDiffPackerOptions { type = BsDiffPackerType.Stored };
+
+        var patchData = Diff(olderData, newerData, new BsDiffOptions { Packer = packer, Engine = BsDiffEngineType.SuffixArray }, out var stats);
+        var prematchedPatchData = Diff(olderData, newerData, new BsDiffOptions { Packer = packer }, out var prematchedStats);
+
+        Assert.True(prematchedPatchData.Length <= patchData.Length,
+            $"{prematchedPatchData.Length} bytes with prematching, {patchData.Length} without.");
+        Assert.True(prematchedStats.matched_bytes >= stats.matched_bytes,
+            $"{prematchedStats.matched_bytes} matched bytes with prematching, {stats.matched_bytes} without.");
+        Assert.Equal(newerData, Patch(olderData, patchData));
+        Assert.Equal(newerData, Patch(olderData, prematchedPatchData));
+    }
+
+    [Fact]
+    public async Task TestDiff_Cache()
+    {
+        var olderData = RandomBytes(1024 * 1024);
+        var newerData = Edit(olderData);
+        var cacheDirectory = Path.Combine(Path.GetTempPath(), Guid.NewGuid().ToString("N"));
+        var options = new BsDiffOptions { Packer = new BsDiffPackerOptions { type = BsDiffPackerType.Stored }, CacheDirectory = cacheDirectory };
+
+        try
+        {
+            var (patchData, cacheHit) = DiffCached(olderData, newerData, options);
+            var (cachedPatchData, cachedCacheHit) = DiffCached(olderData, newerData, options);
+
+            using var olderStream = new MemoryStream(olderData, 0, olderData.Length, true, true);
+            using var newerStream = new MemoryStream(newerData, 0, newerData.Length, true, true);
+            using var patchStream = new MemoryStream();
+            var (_, asyncCacheHit) = await _libBsDiff.DiffAsync(olderStream, newerStream, patchStream, options);
+
+            using var batchPatchStream = new MemoryStream();
+            var batchItem = new BsDiffBatchItem(olderStream, newerStream, batchPatchStream, options);
+            var statuses = _libBsDiff.DiffBatch(new[] { batchItem });
+
+            Assert.False(cacheHit);
+            Assert.True(cachedCacheHit);
+            Assert.True(asyncCacheHit);
+            Assert.Equal(BsDiffStatusType.Success, statuses[0]);
+            Assert.True(batchItem.CacheHit);
+            Assert.Equal(patchData, cachedPatchData);
+            Assert.Equal(patchData, patchStream.ToArray());
+            Assert.Equal(patchData, batchPatchStream.ToArray());
+        }
+        finally
+        {
+            Directory.Delete(cacheDirectory, true);
+        }
+    }
+
+    // The rolling hash engine ignores the memory budget, so it is not part of the cache key.
+    [Fact]
+    public void TestDiff_Cache_RollingHash()
+    {
+        var olderData = RandomBytes(1024 * 1024);
+        var newerData = Edit(olderData);
+        var cacheDirectory = Path.Combine(Path.GetTempPath(), Guid.NewGuid().ToString("N"));
+
+        try
+        {
+            var (patchData, _) = DiffCached(olderData, newerData, new BsDiffOptions { Engine = BsDiffEngineType.RollingHash, CacheDirectory = cacheDirectory });
+            var (cachedPatchData, cacheHit) = DiffCached(olderData, newerData,
+                new BsDiffOptions { Engine = BsDiffEngineType.RollingHash, MaxMemoryBytes = 1024 * 1024, CacheDirectory = cacheDirectory });
+
+            Assert.True(cacheHit);
+            Assert.Equal(patchData, cachedPatchData);
+        }
+        finally
+        {
+            Directory.Delete(cacheDirectory, true);
+        }
+    }
+
+    [Fact]
+    public void TestCompose()
+    {
+        var versions = new List<byte[]> { RandomBytes(1024 * 1024) };
+        for (var i = 0; i < 3; i++)
+        {
+            versions.Add(Edit(versions[^1]));
+        }
+
+        var patches = new List<byte[]>();
+        for (var i = 0; i < 3; i++)
+        {
+            patches.Add(Diff(versions[i], versions[i + 1], new BsDiffOptions { Packer = new BsDiffPackerOptions { type = BsDiffPackerType.Stored } }));
+        }
+
+        var sequential = versions[0];
+        foreach (var patchData in patches)
+        {
+            sequential = Patch(sequential, patchData);
+        }
+
+        var patchStreams = patches.Select(x => new MemoryStream(x, 0, x.Length, false, true)).ToList();
+        using var composedStream = new MemoryStream();
+        _libBsDiff.Compose(patchStreams, composedStream, new BsDiffPackerOptions { type = BsDiffPackerType.Stored });
+
+        Assert.Equal(versions[^1], sequential);
+        Assert.Equal(sequential, Patch(versions[0], composedStream.ToArray()));
+    }
+
+    // Diffs newer against older. Returns false when the native library was built without the
+    // packer, zstd and lz4 are optional.
+    bool TryDiff(byte[] olderData, byte[] newerData, BsDiffOptions options, out byte[] patchData)
+    {
+        try
+        {
+            patchData = Diff(olderData, newerData, options);
+            return true;
+        }
+        catch (Exception e) when (options.Packer.type is BsDiffPackerType.Zstd or BsDiffPackerType.Lz4
+                                  && e.Message.EndsWith($"Error code: {BsDiffStatusType.Unsupported}"))
+        {
+            patchData = null;
+            return false;
+        }
+    }
+
+    byte[] Diff(byte[] olderData, byte[] newerData, BsDiffOptions options = null) => Diff(olderData, newerData, options, out _);
+
+    byte[] Diff(byte[] olderData, byte[] newerData, BsDiffOptions options, out BsDiffStats stats)
+    {
+        using var olderStream = new MemoryStream(olderData, 0, olderData.Length, true, true);
+        using var newerStream = new MemoryStream(newerData, 0, newerData.Length, true, true);
+        using var patchStream = new MemoryStream();
+        (stats, _) = _libBsDiff.Diff(olderStream, newerStream, patchStream, options);
+        return patchStream.ToArray();
+    }
+
+    (byte[] patchData, bool cacheHit) DiffCached(byte[] olderData, byte[] newerData, BsDiffOptions options)
+    {
+        using var olderStream = new MemoryStream(olderData, 0, olderData.Length, true, true);
+        using var newerStream = new MemoryStream(newerData, 0, newerData.Length, true, true);
+        using var patchStream = new MemoryStream();
+        var (_, cacheHit) = _libBsDiff.Diff(olderStream, newerStream, patchStream, options);
+        return (patchStream.ToArray(), cacheHit);
+    }
+
+    byte[] Patch(byte[] olderData, byte[] patchData)
+    {
+        using var olderStream = new MemoryStream(olderData, 0, olderData.Length, true, true);
+        using var patchStream = new MemoryStream(patchData, 0, patchData.Length, true, true);
+        using var newerStream = new MemoryStream();
+        _libBsDiff.Patch(olderStream, patchStream, newerStream, default);
+        return newerStream.ToArray();
+    }
+
+    const uint ChunkMinSize = 2 * 1024;
+    const uint ChunkAvgSize = 8 * 1024;
+    const uint ChunkMaxSize = 32 * 1024;
+
+    BsDiffChunkResult Chunk(params byte[][] data) =>
+        _libBsDiff.Chunk(data.Select(Stream).ToList(), null, ChunkMinSize, ChunkAvgSize, ChunkMaxSize);
+
+    static MemoryStream Stream(byte[] data) => new(data, 0, data.Length, false, true);
+
+    static void AssertCovers(BsDiffChunk[] chunks, int length)
+    {
+        ulong offset = 0;
+        foreach (var chunk in chunks)
+        {
+            Assert.Equal(offset, chunk.Offset);
+            Assert.InRange(chunk.Size, 1u, ChunkMaxSize);
+            offset += chunk.Size;
+        }
+        Assert.Equal((ulong)length, offset);
+    }
+
+    static byte[] Insert(byte[] data, int offset, byte[] block)
+    {
+        var result = new byte[data.Length + block.Length];
+        data.AsSpan(0, offset).CopyTo(result);
+        block.CopyTo(result, offset);
+        data.AsSpan(offset).CopyTo(result.AsSpan(offset + block.Length));
+        return result;
+    }
+
+    static byte[] RandomBytes(int length)
+    {
+        var data = new byte[length];
+        Random.NextBytes(data);
+        return data;
+    }
+
+    // Overwrites a byte in every thousand and inserts a block in the middle, roughly what a
+    // rebuilt file looks like.
+    static byte[] Edit(byte[] olderData)
+    {
+        var block = RandomBytes(4096);
+        var newerData = new byte[olderData.Length + block.Length];
+        var middle = olderData.Length / 2;
+        olderData.AsSpan(0, middle).CopyTo(newerData);
+        block.CopyTo(newerData, middle);
+        olderData.AsSpan(middle).CopyTo(newerData.AsSpan(middle + block.Length));
+
+        for (var i = 0; i < newerData.Length / 1000; i++)
+        {
+            newerData[Random.Next(newerData.Length)] = (byte)Random.Next();
+        }
+
+        return newerData;
+    }
+
+    // A nupkg holding a manifest and an assembly, both deflated.
+    static byte[] NupkgBytes(byte[] assembly)
+    {
+        using var stream = new MemoryStream();
+        using (var archive = new ZipArchive(stream, ZipArchiveMode.Create, true))
+        {
+            using (var writer = new StreamWriter(archive.CreateEntry("demoapp.nuspec").Open()))
+            {
+                writer.Write("<?xml version=\"1.0\" encoding=\"utf-8\"?><package><metadata><id>demoapp</id></metadata></package>");
+            }
+
+            using var entryStream = archive.CreateEntry("lib/any/demoapp.dll").Open();
+            entryStream.Write(assembly);
+        }
+
+        return stream.ToArray();
+    }
+
+    // x64 code calling into a table of functions, described by an ELF header as a single
+    // executable section. shift random bytes inserted in the middle move every call target
+    // after them, which is what a rebuilt executable looks like to bsdiff.
+    static byte[] ElfBytes(int length, int shift)
+    {
+        const int text = 0x100;
+        const int sectionHeaders = 128;
+
+        var random = new Random(7);
+        var paddingRandom = new Random(11);
+        var data = new List<byte>(new byte[text]);
+        var shifted = false;
+        while (data.Count < length - sectionHeaders)
+        {
+            if (!shifted && data.Count >= text + (length - text - sectionHeaders) / 2)
+            {
+                var padding = new byte[shift];
+                paddingRandom.NextBytes(padding);
+                data.AddRange(padding);
+                shifted = true;
+            }
+
+            if (random.Next(4) == 0)
+            {
+                var target = text + random.Next(1024) * 32;
+                data.Add(0xe8);
+                data.AddRange(BitConverter.GetBytes(target - (data.Count + 4)));
+                continue;
+            }
+
+            byte c;
+            do
+            {
+                c = (byte)random.Next(256);
+            } while (c is 0xe8 or 0xe9);
+            data.Add(c);
+        }
+
+        var sh = data.Count;
+        data.AddRange(new byte[sectionHeaders]);
+        var bytes = data.ToArray();
+
+        void Put(int offset, long value, int size) => BitConverter.GetBytes(value).AsSpan(0, size).CopyTo(bytes.AsSpan(offset));
+
+        // ELF64 header with two section headers, the second one SHF_ALLOC | SHF_EXECINSTR.
+        bytes[0] = 0x7f;
+        bytes[1] = (byte)'E';
+        bytes[2] = (byte)'L';
+        bytes[3] = (byte)'F';
+        bytes[4] = 2;
+        bytes[5] = 1;
+        Put(18, 62, 2);
+        Put(40, sh, 8);
+        Put(58, 64, 2);
+        Put(60, 2, 2);
+        Put(sh + 64 + 4, 1, 4);
+        Put(sh + 64 + 8, 6, 8);
+        Put(sh + 64 + 24, text, 8);
+        Put(sh + 64 + 32, sh - text, 8);
+        return bytes;
+    }
+
+    public void Dispose() => _libBsDiff.Dispose();
+
+    // Hands out at most maxReadSize bytes per read and counts seeks, like a network or
+    // decompressing stream would.
+    sealed class ChunkedStream : MemoryStream
+    {
+        readonly int _maxReadSize;
+
+        public int Seeks { get; private set; }
+
+        public ChunkedStream(byte[] buffer, int maxReadSize) : base(buffer, false) => _maxReadSize = maxReadSize;
+
+        public override int Read(byte[] buffer, int offset, int count) =>
+            base.Read(buffer, offset, Math.Min(count, _maxReadSize));
+
+        public override int Read(Span<byte> buffer) =>
+            base.Read(buffer[..Math.Min(buffer.Length, _maxReadSize)]);
+
+        public override long Seek(long offset, SeekOrigin loc)
+        {
+            Seeks++;
+            return base.Seek(offset, loc);
+        }
+    }
+}
@@ -1,14 +1,23 @@
 using System;
+using System.Collections.Generic;
 using System.Diagnostics.CodeAnalysis;
 using System.IO;
 using System.Threading;
+using System.Threading.Tasks;
 
 namespace Snap.Core;
 
 internal interface ISnapBinaryPatcher
 {
-    void Diff([NotNull] MemoryStream olderStream, [NotNull] MemoryStream newerStream, [NotNull] Stream outputStream);
-    void Patch([NotNull] MemoryStream olderStream, [NotNull] MemoryStream patchStream, [NotNull] Stream outputStream, CancellationToken cancellationToken);
+    BsDiffStats Diff([NotNull] MemoryStream olderStream, [NotNull] MemoryStream newerStream, [NotNull] Stream outputStream, CancellationToken cancellationToken = default);
+    string Patch([NotNull] MemoryStream olderStream, [NotNull] MemoryStream patchStream, [NotNull] Stream outputStream, CancellationToken cancellationToken);
+    Task<BsDiffStats> DiffAsync([NotNull] MemoryStream olderStream, [NotNull] MemoryStream newerStream, [NotNull] Stream outputStream, CancellationToken cancellationToken = default);
+    Task<string> PatchAsync([NotNull] MemoryStream olderStream, [NotNull] MemoryStream patchStream, [NotNull] Stream outputStream, CancellationToken cancellationToken);
+    string Verify([NotNull] MemoryStream olderStream, [NotNull] MemoryStream patchStream, CancellationToken cancellationToken = default);
+    BsDiffStatusType[] DiffBatch([NotNull] IReadOnlyList<BsDiffBatchItem> items, CancellationToken cancellationToken = default);
+    BsDiffStatusType[] PatchBatch([NotNull] IReadOnlyList<BsPatchBatchItem> items, CancellationToken cancellationToken = default);
+    void DiffFiles([NotNull] string olderFilename, [NotNull] string newerFilename, [NotNull] string patchFilename, CancellationToken cancellationToken = default);
+    void PatchFiles([NotNull] string olderFilename, [NotNull] string patchFilename, [NotNull] string newerFilename, CancellationToken cancellationToken = default);
 }
 
 internal sealed class SnapBinaryPatcher : ISnapBinaryPatcher
@@ -21,9 +30,30 @@ internal sealed class SnapBinaryPatcher : ISnapBinaryPatcher
         _bsdiffLib = bsdiffLib;
     }
     
-    public void Diff(MemoryStream olderStream, MemoryStream newerStream, Stream outputStream) => 
-        _bsdiffLib.Diff(olderStream, newerStream, outputStream);
+    public BsDiffStats Diff(MemoryStream olderStream, MemoryStream newerStream, Stream outputStream, CancellationToken cancellationToken = default) => 
+        _bsdiffLib.Diff(olderStream, newerStream, outputStream, cancellationToken);
 
-    public void Patch(MemoryStream olderStream, MemoryStream patchStream, Stream outputStream, CancellationToken cancellationToken) => 
+    public string Patch(MemoryStream olderStream, MemoryStream patchStream, Stream outputStream, CancellationToken cancellationToken) => 
         _bsdiffLib.Patch(olderStream, patchStream, outputStream, cancellationToken);
+
+    public Task<BsDiffStats> DiffAsync(MemoryStream olderStream, MemoryStream newerStream, Stream outputStream, CancellationToken cancellationToken = default) =>
+        _bsdiffLib.DiffAsync(olderStream, newerStream, outputStream, cancellationToken);
+
+    public Task<string> PatchAsync(MemoryStream olderStream, MemoryStream patchStream, Stream outputStream, CancellationToken cancellationToken) =>
+        _bsdiffLib.PatchAsync(olderStream, patchStream, outputStream, cancellationToken);
+
+    public string Verify(MemoryStream olderStream, MemoryStream patchStream, CancellationToken cancellationToken = default) =>
+        _bsdiffLib.Verify(olderStream, patchStream, cancellationToken);
+
+    public BsDiffStatusType[] DiffBatch(IReadOnlyList<BsDiffBatchItem> items, CancellationToken cancellationToken = default) =>
+        _bsdiffLib.DiffBatch(items, cancellationToken: cancellationToken);
+
+    public BsDiffStatusType[] PatchBatch(IReadOnlyList<BsPatchBatchItem> items, CancellationToken cancellationToken = default) =>
+        _bsdiffLib.PatchBatch(items, cancellationToken: cancellationToken);
+
+    public void DiffFiles(string olderFilename, string newerFilename, string patchFilename, CancellationToken cancellationToken = default) =>
+        _bsdiffLib.DiffFiles(olderFilename, newerFilename, patchFilename, cancellationToken);
+
+    public void PatchFiles(string olderFilename, string patchFilename, string newerFilename, CancellationToken cancellationToken = default) =>
+        _bsdiffLib.PatchFiles(olderFilename, patchFilename, newerFilename, cancellationToken);
 }
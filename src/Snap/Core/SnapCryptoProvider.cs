@@ -26,10 +26,30 @@ internal interface ISnapCryptoProvider
 
 internal sealed class SnapCryptoProvider : ISnapCryptoProvider
 {
+    // Files of a release that are already in memory are hashed natively in batches of up to
+    // this many bytes.
+    const long NativeBatchSize = 64 * 1024 * 1024;
+    // Larger files gain nothing from sharing a batch and are hashed on their own.
+    const long NativeBatchMaxFileSize = 4 * 1024 * 1024;
+
+    readonly IBsdiffLib _bsdiffLib;
+
+    // Hashes with the native library when given one, which uses the SHA extensions or AVX2
+    // and hashes the files of a release side by side.
+    public SnapCryptoProvider([CanBeNull] IBsdiffLib bsdiffLib = null)
+    {
+        _bsdiffLib = bsdiffLib;
+    }
+
     public string Sha256(byte[] content)
     {
         if (content == null) throw new ArgumentNullException(nameof(content));
 
+        if (_bsdiffLib != null)
+        {
+            return _bsdiffLib.Sha256(new MemoryStream(content, 0, content.Length, false, true));
+        }
+
         using var sha256 = SHA256.Create();
         var hash = sha256.ComputeHash(content);
 
@@ -47,6 +67,13 @@ internal sealed class SnapCryptoProvider : ISnapCryptoProvider
 
         content.Seek(0, SeekOrigin.Begin);
 
+        if (_bsdiffLib != null)
+        {
+            var checksum = _bsdiffLib.Sha256(content);
+            content.Seek(0, SeekOrigin.Begin);
+            return checksum;
+        }
+
         using var sha256 = SHA256.Create();
         var hash = sha256.ComputeHash(content);
 
@@ -121,6 +148,13 @@ internal sealed class SnapCryptoProvider : ISnapCryptoProvider
     string Sha256(IEnumerable<(SnapReleaseChecksum targetPath, Stream srcStream)> inputStreams)
     {
         var sb = new StringBuilder();
+
+        if (_bsdiffLib != null)
+        {
+            Sha256Batched(inputStreams.Select(x => x.srcStream), sb);
+            return Sha256(sb, Encoding.UTF8);
+        }
+
         foreach (var (_, srcStream) in inputStreams)
         {
             if (srcStream.CanSeek)
@@ -143,6 +177,64 @@ internal sealed class SnapCryptoProvider : ISnapCryptoProvider
         return Sha256(sb, Encoding.UTF8);
     }
 
+    // Streams are hashed in order. Small streams that expose their buffer are hashed in
+    // batches, every other stream incrementally as it is read, so nothing is copied.
+    void Sha256Batched(IEnumerable<Stream> srcStreams, StringBuilder sb)
+    {
+        var batch = new List<MemoryStream>();
+        long batchSize = 0;
+
+        void Flush()
+        {
+            if (batch.Count == 0)
+            {
+                return;
+            }
+
+            foreach (var sha256 in _bsdiffLib.Sha256(batch))
+            {
+                sb.Append(sha256);
+            }
+
+            batch.Clear();
+            batchSize = 0;
+        }
+
+        foreach (var srcStream in srcStreams)
+        {
+            if (srcStream is MemoryStream memoryStream
+                && memoryStream.TryGetBuffer(out _)
+                && memoryStream.Length <= NativeBatchMaxFileSize)
+            {
+                batch.Add(memoryStream);
+                batchSize += memoryStream.Length;
+
+                if (batchSize >= NativeBatchSize)
+                {
+                    Flush();
+                }
+
+                continue;
+            }
+
+            Flush();
+
+            if (srcStream.CanSeek)
+            {
+                srcStream.Seek(0, SeekOrigin.Begin);
+            }
+
+            sb.Append(_bsdiffLib.Sha256(srcStream));
+
+            if (srcStream.CanSeek)
+            {
+                srcStream.Seek(0, SeekOrigin.Begin);
+            }
+        }
+
+        Flush();
+    }
+
     static string HashToString([NotNull] byte[] hash)
     {
         if (hash == null) throw new ArgumentNullException(nameof(hash));
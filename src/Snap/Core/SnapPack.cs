@@ -18,6 +18,7 @@ using SharpCompress.Common;
 using SharpCompress.Writers;
 using Snap.Core.Models;
 using Snap.Extensions;
+using Snap.Logging;
 using Snap.NuGet;
 using Snap.Reflection;
 
@@ -61,6 +62,8 @@ internal interface ISnapPackageDetails : ISnapNuspecDetails
     SnapAppsReleases SnapAppsReleases { get; }
     SnapApp SnapApp { get; }
     string PackagesDirectory { get; }
+    // Patches of unchanged file pairs are reused from here across packs, null disables it.
+    string BsDiffCacheDirectory { get; }
 }
 
 internal sealed class SnapPackageDetails : ISnapPackageDetails
@@ -70,6 +73,7 @@ internal sealed class SnapPackageDetails : ISnapPackageDetails
     public string NuspecBaseDirectory { get; init; }
     public IReadOnlyDictionary<string, string> NuspecProperties { get; [UsedImplicitly] set; } = new Dictionary<string, string>();
     public string PackagesDirectory { get; init; }
+    public string BsDiffCacheDirectory { get; init; }
 }
 
 internal interface IRebuildPackageProgressSource
@@ -107,6 +111,10 @@ internal interface ISnapPack
 
 internal sealed class SnapPack : ISnapPack
 {
+    static readonly ILog Logger = LogProvider.For<SnapPack>();
+    // Enough for the patches of several releases of a large app.
+    const ulong BsDiffCacheMaxBytes = 1024UL * 1024 * 1024;
+
     readonly ISnapFilesystem _snapFilesystem;
     readonly ISnapAppReader _snapAppReader;
     readonly ISnapAppWriter _snapAppWriter;
@@ -466,6 +474,15 @@ internal sealed class SnapPack : ISnapPack
         deltaNupkgPackageBuilder.Files.Clear(); // NB! We are _NOT_ loading files twice into memory.
 
         var deletedChecksums = previousFullSnapRelease.Files.ToList();
+        // Modified files are diffed together once every pair is known, see DiffBatch.
+        var diffItems = new List<BsDiffBatchItem>();
+        var diffChecksums = new List<SnapReleaseChecksum>();
+
+        var bsDiffOptions = snapPackageDetails.BsDiffCacheDirectory == null ? null : new BsDiffOptions
+        {
+            CacheDirectory = snapPackageDetails.BsDiffCacheDirectory,
+            CacheMaxBytes = BsDiffCacheMaxBytes
+        };
             
         foreach (var currentChecksum in currentFullSnapRelease.Files)
         {
@@ -500,19 +517,56 @@ internal sealed class SnapPack : ISnapPack
 
             var previousPackageFile = previousFullNupkgPackageBuilder.GetPackageFile(currentChecksum.NuspecTargetPath, StringComparison.OrdinalIgnoreCase);
 
-            await using var oldDataStream = await previousPackageFile.GetStream().ReadToEndAsync(cancellationToken: cancellationToken);
-            await using var newDataStream = await currentPackageFile.GetStream().ReadToEndAsync(cancellationToken: cancellationToken);
+            var oldDataStream = await previousPackageFile.GetStream().ReadToEndAsync(cancellationToken: cancellationToken);
+            var newDataStream = await currentPackageFile.GetStream().ReadToEndAsync(cancellationToken: cancellationToken);
             var patchStream = new MemoryStream();
 
             if (newDataStream.Length > 0
                 && oldDataStream.Length > 0)
             {
-                _snapBinaryPatcher.Diff(oldDataStream, newDataStream, patchStream);
-            } else if (newDataStream.Length > 0)
+                diffItems.Add(new BsDiffBatchItem(oldDataStream, newDataStream, patchStream, bsDiffOptions));
+                diffChecksums.Add(currentChecksum);
+                continue;
+            }
+
+            if (newDataStream.Length > 0)
             {
                 await newDataStream.CopyToAsync(patchStream, cancellationToken);
             }
-            
+
+            await oldDataStream.DisposeAsync();
+            await newDataStream.DisposeAsync();
+
+            AddDeltaPackageFile(currentChecksum, patchStream);
+        }
+
+        try
+        {
+            var statuses = _snapBinaryPatcher.DiffBatch(diffItems, cancellationToken);
+
+            for (var i = 0; i < diffItems.Count; i++)
+            {
+                if (statuses[i] != BsDiffStatusType.Success)
+                {
+                    throw new Exception($"Failed to execute bsdiff. Error code: {statuses[i]}. Target path: {diffChecksums[i].NuspecTargetPath}.");
+                }
+
+                LogDiffStats(diffChecksums[i].NuspecTargetPath, diffItems[i].OlderStream.Length, diffItems[i].NewerStream.Length, diffItems[i].Stats,
+                    diffItems[i].CacheHit);
+                AddDeltaPackageFile(diffChecksums[i], (MemoryStream)diffItems[i].PatchStream);
+            }
+        }
+        finally
+        {
+            foreach (var diffItem in diffItems)
+            {
+                await diffItem.OlderStream.DisposeAsync();
+                await diffItem.NewerStream.DisposeAsync();
+            }
+        }
+
+        void AddDeltaPackageFile(SnapReleaseChecksum currentChecksum, MemoryStream patchStream)
+        {
             currentChecksum.DeltaSha256Checksum = _snapCryptoProvider.Sha256(patchStream);
             currentChecksum.DeltaFilesize = patchStream.Length;
 
@@ -725,87 +779,124 @@ internal sealed class SnapPack : ISnapPack
                 UpdateRebuildProgress();
             }
 
-            foreach (var deltaChecksum in deltaRelease.Modified)
+            // Patched files are applied together once every delta of the release is read, see PatchBatch.
+            var patchItems = new List<BsPatchBatchItem>();
+            var patchChecksums = new List<SnapReleaseChecksum>();
+
+            try
             {
-                var existingChecksum = reassembledFullSnapRelease.Files.SingleOrDefault(x => string.Equals(x.NuspecTargetPath, deltaChecksum.NuspecTargetPath, StringComparison.OrdinalIgnoreCase));
-                if (existingChecksum == null)
+                foreach (var deltaChecksum in deltaRelease.Modified)
                 {
-                    throw new Exception(
-                        $"Unable to modify file in full release: {reassembledFullSnapRelease.Filename} because it does not exists. " +
-                        $"Filename: {deltaChecksum.NuspecTargetPath}. " +
-                        $"Nupkg: {deltaChecksum.Filename}.");
-                }
+                    var existingChecksum = reassembledFullSnapRelease.Files.SingleOrDefault(x => string.Equals(x.NuspecTargetPath, deltaChecksum.NuspecTargetPath, StringComparison.OrdinalIgnoreCase));
+                    if (existingChecksum == null)
+                    {
+                        throw new Exception(
+                            $"Unable to modify file in full release: {reassembledFullSnapRelease.Filename} because it does not exists. " +
+                            $"Filename: {deltaChecksum.NuspecTargetPath}. " +
+                            $"Nupkg: {deltaChecksum.Filename}.");
+                    }
 
-                var packageFile = packageBuilder.GetPackageFile(deltaChecksum.NuspecTargetPath, StringComparison.OrdinalIgnoreCase);
-                var packageFileStream = packageFile.GetStream();
-                packageFileStream.Seek(0, SeekOrigin.Begin);
+                    var packageFile = packageBuilder.GetPackageFile(deltaChecksum.NuspecTargetPath, StringComparison.OrdinalIgnoreCase);
+                    var packageFileStream = packageFile.GetStream();
+                    packageFileStream.Seek(0, SeekOrigin.Begin);
 
-                var neverGenerateBsDiffThisAssembly =
-                    NeverGenerateBsDiffsTheseAssemblies.SingleOrDefault(x =>
-                        string.Equals(x, deltaChecksum.NuspecTargetPath, StringComparison.OrdinalIgnoreCase));
+                    var neverGenerateBsDiffThisAssembly =
+                        NeverGenerateBsDiffsTheseAssemblies.SingleOrDefault(x =>
+                            string.Equals(x, deltaChecksum.NuspecTargetPath, StringComparison.OrdinalIgnoreCase));
 
-                var outputStream = new MemoryStream((int) deltaChecksum.FullFilesize);
-                await using (var patchStream = await packageArchiveReader.GetStream(deltaChecksum.NuspecTargetPath).ReadToEndAsync(cancellationToken: cancellationToken))
-                {
+                    var outputStream = new MemoryStream((int) deltaChecksum.FullFilesize);
+                    var patchStream = await packageArchiveReader.GetStream(deltaChecksum.NuspecTargetPath).ReadToEndAsync(cancellationToken: cancellationToken);
                     string sha256Checksum;
                     if (neverGenerateBsDiffThisAssembly != null)
                     {
-                        await patchStream.CopyToAsync(outputStream, cancellationToken);
-
-                        if (!skipChecksum)
+                        await using (patchStream)
                         {
-                            sha256Checksum = _snapCryptoProvider.Sha256(outputStream);
-                            if (deltaChecksum.FullSha256Checksum != sha256Checksum)
+                            await patchStream.CopyToAsync(outputStream, cancellationToken);
+
+                            if (!skipChecksum)
                             {
-                                throw new SnapReleaseFileChecksumDeltaMismatchException(deltaChecksum, snapRelease, patchStream.Length);
+                                sha256Checksum = _snapCryptoProvider.Sha256(outputStream);
+                                if (deltaChecksum.FullSha256Checksum != sha256Checksum)
+                                {
+                                    throw new SnapReleaseFileChecksumDeltaMismatchException(deltaChecksum, snapRelease, patchStream.Length);
+                                }
                             }
                         }
 
-                        goto done;
+                        AddPackageFile(packageBuilder, outputStream, deltaChecksum.NuspecTargetPath, string.Empty, reassembledFullSnapRelease, true);
+                        UpdateRebuildProgress();
+                        continue;
                     }
 
                     if (patchStream.Length == 0)
                     {
-                        if (deltaChecksum.DeltaFilesize != 0)
+                        await using (patchStream)
                         {
-                            throw new Exception($"Expected delta file size to equal 0 (zero) when {nameof(patchStream)} " +
-                                                $"length is 0 (zero). Target path: {existingChecksum.NuspecTargetPath}.");
-                        }
+                            if (deltaChecksum.DeltaFilesize != 0)
+                            {
+                                throw new Exception($"Expected delta file size to equal 0 (zero) when {nameof(patchStream)} " +
+                                                    $"length is 0 (zero). Target path: {existingChecksum.NuspecTargetPath}.");
+                            }
 
-                        if (deltaChecksum.DeltaSha256Checksum != SnapConstants.Sha256EmptyFileChecksum)
-                        {
-                            throw new Exception($"Expected delta file checksum to equal {SnapConstants.Sha256EmptyFileChecksum} when " +
-                                                $"{nameof(patchStream)} length is 0 (zero). Target path: {existingChecksum.NuspecTargetPath}.");
+                            if (deltaChecksum.DeltaSha256Checksum != SnapConstants.Sha256EmptyFileChecksum)
+                            {
+                                throw new Exception($"Expected delta file checksum to equal {SnapConstants.Sha256EmptyFileChecksum} when " +
+                                                    $"{nameof(patchStream)} length is 0 (zero). Target path: {existingChecksum.NuspecTargetPath}.");
+                            }
                         }
 
-                        goto done;
+                        AddPackageFile(packageBuilder, outputStream, deltaChecksum.NuspecTargetPath, string.Empty, reassembledFullSnapRelease, true);
+                        UpdateRebuildProgress();
+                        continue;
                     }
 
-                    if (!skipChecksum)
+                    patchItems.Add(new BsPatchBatchItem((MemoryStream)packageFileStream, patchStream, outputStream));
+                    patchChecksums.Add(deltaChecksum);
+                }
+
+                cancellationToken.ThrowIfCancellationRequested();
+
+                var statuses = _snapBinaryPatcher.PatchBatch(patchItems, cancellationToken);
+                for (var i = 0; i < patchItems.Count; i++)
+                {
+                    var deltaChecksum = patchChecksums[i];
+                    var patchItem = patchItems[i];
+
+                    // The patcher hashes the output while writing it, so the delta is only hashed
+                    // when something went wrong to tell a damaged delta from a wrong result.
+                    if (statuses[i] != BsDiffStatusType.Success
+                        || !skipChecksum && deltaChecksum.FullSha256Checksum != patchItem.Sha256Checksum)
                     {
-                        sha256Checksum = _snapCryptoProvider.Sha256(patchStream);
-                        if (deltaChecksum.DeltaSha256Checksum != sha256Checksum)
+                        if (!skipChecksum && deltaChecksum.DeltaSha256Checksum != _snapCryptoProvider.Sha256(patchItem.PatchStream))
                         {
-                            throw new SnapReleaseFileChecksumDeltaMismatchException(deltaChecksum, snapRelease, patchStream.Length);
+                            throw new SnapReleaseFileChecksumDeltaMismatchException(deltaChecksum, snapRelease, patchItem.PatchStream.Length);
                         }
-                    }
-                        
-                    _snapBinaryPatcher.Patch((MemoryStream)packageFileStream, patchStream, outputStream, cancellationToken);
 
-                    if (!skipChecksum)
-                    {
-                        sha256Checksum = _snapCryptoProvider.Sha256(outputStream);
-                        if (deltaChecksum.FullSha256Checksum != sha256Checksum)
+                        if (statuses[i] != BsDiffStatusType.Success)
                         {
-                            throw new SnapReleaseFileChecksumMismatchException(deltaChecksum, snapRelease);
+                            throw new Exception($"Failed to execute bspatch. Error code: {statuses[i]}. Target path: {deltaChecksum.NuspecTargetPath}.");
                         }
+
+                        throw new SnapReleaseFileChecksumMismatchException(deltaChecksum, snapRelease);
                     }
 
-                    done:
+                    var outputStream = patchItem.OutputStream;
+                    outputStream.Seek(0, SeekOrigin.Begin);
+
                     AddPackageFile(packageBuilder, outputStream, deltaChecksum.NuspecTargetPath, string.Empty, reassembledFullSnapRelease, true);
                     UpdateRebuildProgress();
                 }
+            }
+            finally
+            {
+                foreach (var patchItem in patchItems)
+                {
+                    await patchItem.PatchStream.DisposeAsync();
+                }
+            }
 
+            if (deltaRelease.Modified.Count > 0)
+            {
                 packageBuilder.Populate(await packageArchiveReader.GetManifestMetadataAsync(cancellationToken));
             }
                     
@@ -1167,6 +1258,24 @@ internal sealed class SnapPack : ISnapPack
         return await asyncPackageCoreReader.GetStreamAsync(targetPath, cancellationToken).ReadToEndAsync(cancellationToken: cancellationToken);
     }
 
+    static void LogDiffStats(string nuspecTargetPath, long olderSize, long newerSize, BsDiffStats stats, bool cacheHit)
+    {
+        static string Milliseconds(BsDiffPhaseStats phase) => $"{phase.wall_ns / 1_000_000.0:F1} ms";
+
+        if (cacheHit)
+        {
+            Logger.Debug($"Delta {nuspecTargetPath}: {olderSize} -> {newerSize} bytes, patch {stats.patch_bytes} bytes from the diff cache.");
+            return;
+        }
+
+        Logger.Debug($"Delta {nuspecTargetPath}: {olderSize} -> {newerSize} bytes, patch {stats.patch_bytes} bytes. " +
+                     $"Total {Milliseconds(stats.total)} (prepare {Milliseconds(stats.prepare)}, sort {Milliseconds(stats.sort)}, " +
+                     $"scan {Milliseconds(stats.scan)}, compress {Milliseconds(stats.compress)}), " +
+                     $"cpu {stats.total.cpu_ns / 1_000_000.0:F1} ms, peak memory {stats.peak_memory_bytes} bytes. " +
+                     $"Entries: {stats.entry_count}, control {stats.control_bytes} bytes, diff {stats.diff_bytes} bytes " +
+                     $"({stats.matched_bytes} matched, longest {stats.longest_match_bytes}), extra {stats.extra_bytes} bytes.");
+    }
+
     void AddPackageFile([NotNull] PackageBuilder packageBuilder, [NotNull] Stream srcStream,
         [NotNull] string nuspecTargetPath, [NotNull] string filename, SnapRelease snapRelease = null, bool replace = false)
     {
@@ -145,10 +145,11 @@ public sealed class SnapUpdateManager : ISnapUpdateManager
         _snapApp = snapApp ?? throw new ArgumentNullException(nameof(snapApp));
         
         _nugetService = nugetService ?? new NugetService(_snapOs.Filesystem, new NugetLogger(_logger));
-        _snapCryptoProvider = snapCryptoProvider ?? new SnapCryptoProvider();
+        IBsdiffLib bsdiffLib = null;
+        _snapCryptoProvider = snapCryptoProvider ?? new SnapCryptoProvider(bsdiffLib ??= new LibBsDiff());
         _snapAppReader = snapAppReader ?? new SnapAppReader();
         _snapAppWriter = snapAppWriter ?? new SnapAppWriter();
-        _snapBinaryPatcher = snapBinaryPatcher ?? new SnapBinaryPatcher(new LibBsDiff());
+        _snapBinaryPatcher = snapBinaryPatcher ?? new SnapBinaryPatcher(bsdiffLib ?? new LibBsDiff());
         _snapPack = snapPack ?? new SnapPack(_snapOs.Filesystem, _snapAppReader, _snapAppWriter,
             _snapCryptoProvider, _snapBinaryPatcher);
         _snapExtractor = snapExtractor ?? new SnapExtractor(_snapOs.Filesystem, _snapPack);
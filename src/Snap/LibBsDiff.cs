@@ -1,8 +1,13 @@
 using System;
+using System.Buffers;
+using System.Collections.Generic;
 using System.Diagnostics.CodeAnalysis;
 using System.IO;
 using System.Runtime.InteropServices;
+using System.Security.Cryptography;
+using System.Text;
 using System.Threading;
+using System.Threading.Tasks;
 using Snap.Extensions;
 
 namespace Snap;
@@ -17,11 +22,97 @@ internal enum BsDiffStatusType
     FileError = 4,
     EndOfFile = 5,
     CorruptPatch = 6,
-    SizeTooLarge = 7
+    SizeTooLarge = 7,
+    Unsupported = 8,
+    Cancelled = 9,
+    DigestMismatch = 10
+}
+
+[SuppressMessage("ReSharper", "UnusedMember.Global")]
+internal enum BsDiffPackerType
+{
+    Bz2 = 0,
+    Stored = 1,
+    Zstd = 2,
+    Lz4 = 3
+}
+
+[SuppressMessage("ReSharper", "UnusedMember.Global")]
+internal enum BsDiffFilterType
+{
+    None = 0,
+    Executable = 1,
+    Archive = 2
+}
+
+[SuppressMessage("ReSharper", "UnusedMember.Global")]
+internal enum BsDiffEngineType
+{
+    Prematch = 0,
+    SuffixArray = 1,
+    RollingHash = 2
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal struct BsDiffPackerOptions
+{
+    public BsDiffPackerType type;
+    public int level;
+    public uint window_log;
+    public uint block_size;
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal struct BsDiffAllocator
+{
+    public nint opaque;
+    public nint alloc;
+    public nint realloc;
+    public nint free;
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal struct BsDiffProgress
+{
+    public nint opaque;
+    public nint report;
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal struct BsDiffCacheOptions
+{
+    public nint path;
+    public ulong max_bytes;
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal struct BsDiffPhaseStats
+{
+    public ulong wall_ns;
+    public ulong cpu_ns;
 }
 
 [StructLayout(LayoutKind.Sequential)]
-internal struct BsDiffPatchCtx
+internal struct BsDiffStats
+{
+    public BsDiffPhaseStats prepare;
+    public BsDiffPhaseStats sort;
+    public BsDiffPhaseStats scan;
+    public BsDiffPhaseStats compress;
+    public BsDiffPhaseStats apply;
+    public BsDiffPhaseStats total;
+    public ulong peak_memory_bytes;
+    public ulong control_bytes;
+    public ulong diff_bytes;
+    public ulong extra_bytes;
+    public ulong patch_bytes;
+    public ulong entry_count;
+    public ulong matched_bytes;
+    public ulong longest_match_bytes;
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal unsafe struct BsDiffPatchCtx
 {
     public nint log_error;
     public nint older;
@@ -31,6 +122,12 @@ internal struct BsDiffPatchCtx
     public nint patch;
     public nuint patch_size;
     public readonly BsDiffStatusType status;
+    public BsDiffAllocator allocator;
+    public uint thread_count;
+    public BsDiffProgress progress;
+    public int verify_only;
+    public fixed byte newer_sha256[32];
+    public nint stats;
 }
 
 [StructLayout(LayoutKind.Sequential)]
@@ -44,12 +141,340 @@ internal struct BsDiffCtx
     public readonly nint patch;
     public readonly nuint patch_size;
     public readonly BsDiffStatusType status;
+    public BsDiffAllocator allocator;
+    public uint thread_count;
+    public nint index;
+    public BsDiffPackerOptions packer;
+    public ulong max_memory_bytes;
+    public BsDiffProgress progress;
+    public BsDiffFilterType filter;
+    public nint stats;
+    public BsDiffEngineType engine;
+    public BsDiffCacheOptions cache;
+    public readonly int cache_hit;
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal struct BsDiffIndexCtx
+{
+    public nint log_error;
+    public nint older;
+    public nuint older_size;
+    public nint index_path;
+    public uint thread_count;
+    public nint index;
+    public readonly BsDiffStatusType status;
+}
+
+// Suffix array index of an old file opened with IBsdiffLib.OpenIndex. Diffs against the same
+// old file skip the suffix sort while it is open.
+internal sealed class BsDiffIndex : IDisposable
+{
+    readonly Action<nint> _close;
+
+    public nint Handle { get; private set; }
+
+    public BsDiffIndex(nint handle, [NotNull] Action<nint> close)
+    {
+        Handle = handle;
+        _close = close ?? throw new ArgumentNullException(nameof(close));
+    }
+
+    public void Dispose()
+    {
+        if (Handle == 0)
+        {
+            return;
+        }
+
+        _close(Handle);
+        Handle = 0;
+    }
+}
+
+internal enum BsDiffSeekOrigin
+{
+    Begin = 0,
+    Current = 1,
+    End = 2
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal struct BsDiffStream
+{
+    public nint opaque;
+    public nint read;
+    public nint write;
+    public nint seek;
+    public nint tell;
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal struct BsPatchStreamCtx
+{
+    public nint log_error;
+    public BsDiffStream older;
+    public BsDiffStream patch;
+    public BsDiffStream newer;
+    public readonly BsDiffStatusType status;
+    public uint thread_count;
+    public BsDiffProgress progress;
+    public nint stats;
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal struct BsDiffStreamCtx
+{
+    public nint log_error;
+    public BsDiffStream older;
+    public BsDiffStream newer;
+    public BsDiffStream patch;
+    public readonly BsDiffStatusType status;
+    public uint thread_count;
+    public BsDiffPackerOptions packer;
+    public ulong max_memory_bytes;
+    public BsDiffProgress progress;
+    public BsDiffFilterType filter;
+    public nint stats;
+    public BsDiffEngineType engine;
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal struct BsDiffBatchCtx
+{
+    public nint items;
+    public nuint items_count;
+    public uint thread_count;
+    public ulong max_memory_bytes;
+    public readonly nuint failed_count;
+    public readonly BsDiffStatusType status;
+}
+
+internal sealed record BsDiffBatchItem(MemoryStream OlderStream, MemoryStream NewerStream, Stream PatchStream, BsDiffOptions Options = null)
+{
+    // Statistics the native code collected while diffing. Set once the item succeeded.
+    public BsDiffStats Stats { get; set; }
+    // Whether the patch came from the cache of Options. Set once the item succeeded.
+    public bool CacheHit { get; set; }
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal struct BsPatchBatchCtx
+{
+    public nint items;
+    public nuint items_count;
+    public uint thread_count;
+    public ulong max_memory_bytes;
+    public readonly nuint failed_count;
+    public readonly BsDiffStatusType status;
+}
+
+internal sealed record BsPatchBatchItem(MemoryStream OlderStream, MemoryStream PatchStream, Stream OutputStream)
+{
+    // SHA-256 of the output, computed by the native code while it was written. Set once the
+    // item succeeded.
+    public string Sha256Checksum { get; set; }
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal struct BsDiffFilesCtx
+{
+    public nint log_error;
+    public nint older_path;
+    public nint newer_path;
+    public nint patch_path;
+    public readonly BsDiffStatusType status;
+    public uint thread_count;
+    public nint index;
+    public BsDiffPackerOptions packer;
+    public ulong max_memory_bytes;
+    public BsDiffProgress progress;
+    public BsDiffFilterType filter;
+    public nint stats;
+    public BsDiffEngineType engine;
+    public BsDiffCacheOptions cache;
+    public readonly int cache_hit;
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal struct BsPatchFilesCtx
+{
+    public nint log_error;
+    public nint older_path;
+    public nint patch_path;
+    public nint newer_path;
+    public readonly BsDiffStatusType status;
+    public uint thread_count;
+    public BsDiffProgress progress;
+    public nint stats;
+}
+
+// Options of a diff, the defaults match Diff without options: a bz2 patch, no memory cap
+// and no index.
+internal sealed class BsDiffOptions
+{
+    public BsDiffPackerOptions Packer { get; init; }
+    // 0 means unlimited, otherwise larger inputs are diffed in windows that fit.
+    public ulong MaxMemoryBytes { get; init; }
+    // Skips the suffix sort, it has to be opened for the same older.
+    public BsDiffIndex Index { get; init; }
+    // Executable turns relative branch targets absolute, the index is not used then.
+    public BsDiffFilterType Filter { get; init; }
+    // Prematch finds unchanged runs by hashing before it searches, SuffixArray searches
+    // for all of newer, their patches are the same size. RollingHash sorts nothing and
+    // ignores the index and the memory cap, its patches are larger.
+    public BsDiffEngineType Engine { get; init; }
+    // Directory of the native diff cache, null diffs without it. Once the cache exceeds
+    // CacheMaxBytes the least recently used patches are removed, 0 means unlimited.
+    public string CacheDirectory { get; init; }
+    public ulong CacheMaxBytes { get; init; }
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal struct BsDiffCompletion
+{
+    public nint callback;
+    public nint opaque;
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal struct BsDiffAsyncCtx
+{
+    public nint diff;
+    public BsDiffCompletion completion;
+    public nint handle;
+    public readonly BsDiffStatusType status;
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal struct BsPatchAsyncCtx
+{
+    public nint patch;
+    public BsDiffCompletion completion;
+    public nint handle;
+    public readonly BsDiffStatusType status;
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal struct BsDiffAsyncHandleCtx
+{
+    public nint handle;
+    public uint timeout_ms;
+    public readonly int completed;
+    public readonly int result;
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal unsafe struct BsDiffSha256Ctx
+{
+    public nint hash;
+    public nint data;
+    public nuint data_size;
+    public fixed byte digest[32];
+    public readonly BsDiffStatusType status;
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal unsafe struct BsDiffSha256Item
+{
+    public nint data;
+    public nuint data_size;
+    public fixed byte digest[32];
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal struct BsDiffSha256BatchCtx
+{
+    public nint items;
+    public nuint items_count;
+    public uint thread_count;
+    public readonly BsDiffStatusType status;
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal unsafe struct BsDiffChunkEntry
+{
+    public readonly ulong offset;
+    public readonly uint size;
+    public readonly int novel;
+    public fixed byte sha256[32];
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal struct BsDiffChunkFile
+{
+    public nint data;
+    public nuint data_size;
+    public readonly nint chunks;
+    public readonly nuint chunks_count;
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal struct BsDiffChunkCtx
+{
+    public nint log_error;
+    public nint files;
+    public nuint files_count;
+    public nint known;
+    public nuint known_count;
+    public uint min_size;
+    public uint avg_size;
+    public uint max_size;
+    public uint thread_count;
+    public BsDiffAllocator allocator;
+    public readonly BsDiffStatusType status;
+    public readonly nuint novel_count;
+    public readonly ulong novel_size;
+}
+
+// Novel is set for the first occurrence of a chunk in the release that is not known, only
+// those have to be shipped.
+internal sealed record BsDiffChunk(ulong Offset, uint Size, bool Novel, string Sha256Checksum);
+
+internal sealed record BsDiffChunkResult(IReadOnlyList<BsDiffChunk[]> Files, ulong NovelCount, ulong NovelSize);
+
+[StructLayout(LayoutKind.Sequential)]
+internal struct BsDiffComposeItem
+{
+    public nint patch;
+    public nuint patch_size;
+}
+
+[StructLayout(LayoutKind.Sequential)]
+internal struct BsDiffComposeCtx
+{
+    public nint log_error;
+    public nint items;
+    public nuint items_count;
+    public readonly nint patch;
+    public readonly nuint patch_size;
+    public readonly BsDiffStatusType status;
+    public BsDiffAllocator allocator;
+    public uint thread_count;
+    public BsDiffPackerOptions packer;
 }
 
 internal interface IBsdiffLib : IDisposable
 {
-    void Diff([NotNull] MemoryStream olderStream, [NotNull] MemoryStream newerStream, [NotNull] Stream patchStream);
-    void Patch([NotNull] MemoryStream olderStream, [NotNull] MemoryStream patchStream, [NotNull] Stream outputStream, CancellationToken cancellationToken);
+    BsDiffStats Diff([NotNull] MemoryStream olderStream, [NotNull] MemoryStream newerStream, [NotNull] Stream patchStream, CancellationToken cancellationToken = default);
+    (BsDiffStats stats, bool cacheHit) Diff([NotNull] MemoryStream olderStream, [NotNull] MemoryStream newerStream, [NotNull] Stream patchStream, BsDiffOptions options, CancellationToken cancellationToken = default);
+    string Patch([NotNull] MemoryStream olderStream, [NotNull] MemoryStream patchStream, [NotNull] Stream outputStream, CancellationToken cancellationToken);
+    Task<BsDiffStats> DiffAsync([NotNull] MemoryStream olderStream, [NotNull] MemoryStream newerStream, [NotNull] Stream patchStream, CancellationToken cancellationToken = default);
+    Task<(BsDiffStats stats, bool cacheHit)> DiffAsync([NotNull] MemoryStream olderStream, [NotNull] MemoryStream newerStream, [NotNull] Stream patchStream, BsDiffOptions options, CancellationToken cancellationToken = default);
+    Task<string> PatchAsync([NotNull] MemoryStream olderStream, [NotNull] MemoryStream patchStream, [NotNull] Stream outputStream, CancellationToken cancellationToken);
+    string Verify([NotNull] MemoryStream olderStream, [NotNull] MemoryStream patchStream, CancellationToken cancellationToken = default);
+    void DiffStream([NotNull] Stream olderStream, [NotNull] Stream newerStream, [NotNull] Stream patchStream, CancellationToken cancellationToken = default);
+    void PatchStream([NotNull] Stream olderStream, [NotNull] Stream patchStream, [NotNull] Stream outputStream, CancellationToken cancellationToken = default);
+    BsDiffStatusType[] DiffBatch([NotNull] IReadOnlyList<BsDiffBatchItem> items, uint threadCount = 0, ulong maxMemoryBytes = 0, CancellationToken cancellationToken = default);
+    BsDiffStatusType[] PatchBatch([NotNull] IReadOnlyList<BsPatchBatchItem> items, uint threadCount = 0, ulong maxMemoryBytes = 0, CancellationToken cancellationToken = default);
+    void BuildIndex([NotNull] MemoryStream olderStream, [NotNull] string indexPath, uint threadCount = 0);
+    BsDiffIndex OpenIndex([NotNull] MemoryStream olderStream, [NotNull] string indexPath);
+    void DiffFiles([NotNull] string olderFilename, [NotNull] string newerFilename, [NotNull] string patchFilename, CancellationToken cancellationToken = default);
+    void PatchFiles([NotNull] string olderFilename, [NotNull] string patchFilename, [NotNull] string newerFilename, CancellationToken cancellationToken = default);
+    void Compose([NotNull] IReadOnlyList<MemoryStream> patchStreams, [NotNull] Stream outputStream, BsDiffPackerOptions packer = default);
+    string Sha256([NotNull] Stream stream);
+    string[] Sha256([NotNull] IReadOnlyList<MemoryStream> streams);
+    BsDiffChunkResult Chunk([NotNull] IReadOnlyList<MemoryStream> streams, IReadOnlyCollection<string> known = null, uint minSize = 0, uint avgSize = 0, uint maxSize = 0, uint threadCount = 0);
 }
 
 [SuppressMessage("ReSharper", "InconsistentNaming")]
@@ -74,6 +499,108 @@ internal sealed class LibBsDiff : IBsdiffLib
     delegate int snap_bsdiff_patch_free_delegate(ref BsDiffPatchCtx ctx);
     readonly Delegate<snap_bsdiff_patch_free_delegate> snap_bsdiff_patch_free;
 
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl, SetLastError = true, CharSet = CharSet.Unicode)]
+    delegate int snap_bsdiff_diff_stream_delegate(ref BsDiffStreamCtx ctx);
+    readonly Delegate<snap_bsdiff_diff_stream_delegate> snap_bsdiff_diff_stream;
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl, SetLastError = true, CharSet = CharSet.Unicode)]
+    delegate int snap_bsdiff_patch_stream_delegate(ref BsPatchStreamCtx ctx);
+    readonly Delegate<snap_bsdiff_patch_stream_delegate> snap_bsdiff_patch_stream;
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl, SetLastError = true, CharSet = CharSet.Unicode)]
+    delegate int snap_bsdiff_diff_batch_delegate(ref BsDiffBatchCtx ctx);
+    readonly Delegate<snap_bsdiff_diff_batch_delegate> snap_bsdiff_diff_batch;
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl, SetLastError = true, CharSet = CharSet.Unicode)]
+    delegate int snap_bsdiff_patch_batch_delegate(ref BsPatchBatchCtx ctx);
+    readonly Delegate<snap_bsdiff_patch_batch_delegate> snap_bsdiff_patch_batch;
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl, SetLastError = true, CharSet = CharSet.Unicode)]
+    delegate int snap_bsdiff_index_build_delegate(ref BsDiffIndexCtx ctx);
+    readonly Delegate<snap_bsdiff_index_build_delegate> snap_bsdiff_index_build;
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl, SetLastError = true, CharSet = CharSet.Unicode)]
+    delegate int snap_bsdiff_index_open_delegate(ref BsDiffIndexCtx ctx);
+    readonly Delegate<snap_bsdiff_index_open_delegate> snap_bsdiff_index_open;
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl, SetLastError = true, CharSet = CharSet.Unicode)]
+    delegate int snap_bsdiff_index_close_delegate(ref BsDiffIndexCtx ctx);
+    readonly Delegate<snap_bsdiff_index_close_delegate> snap_bsdiff_index_close;
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl, SetLastError = true, CharSet = CharSet.Unicode)]
+    delegate int snap_bsdiff_diff_files_delegate(ref BsDiffFilesCtx ctx);
+    readonly Delegate<snap_bsdiff_diff_files_delegate> snap_bsdiff_diff_files;
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl, SetLastError = true, CharSet = CharSet.Unicode)]
+    delegate int snap_bsdiff_patch_files_delegate(ref BsPatchFilesCtx ctx);
+    readonly Delegate<snap_bsdiff_patch_files_delegate> snap_bsdiff_patch_files;
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl, SetLastError = true, CharSet = CharSet.Unicode)]
+    delegate int snap_bsdiff_compose_delegate(ref BsDiffComposeCtx ctx);
+    readonly Delegate<snap_bsdiff_compose_delegate> snap_bsdiff_compose;
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl, SetLastError = true, CharSet = CharSet.Unicode)]
+    delegate int snap_bsdiff_compose_free_delegate(ref BsDiffComposeCtx ctx);
+    readonly Delegate<snap_bsdiff_compose_free_delegate> snap_bsdiff_compose_free;
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl, SetLastError = true, CharSet = CharSet.Unicode)]
+    delegate int snap_bsdiff_sha256_init_delegate(ref BsDiffSha256Ctx ctx);
+    readonly Delegate<snap_bsdiff_sha256_init_delegate> snap_bsdiff_sha256_init;
+    
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl, SetLastError = true, CharSet = CharSet.Unicode)]
+    delegate int snap_bsdiff_sha256_update_delegate(ref BsDiffSha256Ctx ctx);
+    readonly Delegate<snap_bsdiff_sha256_update_delegate> snap_bsdiff_sha256_update;
+    
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl, SetLastError = true, CharSet = CharSet.Unicode)]
+    delegate int snap_bsdiff_sha256_final_delegate(ref BsDiffSha256Ctx ctx);
+    readonly Delegate<snap_bsdiff_sha256_final_delegate> snap_bsdiff_sha256_final;
+    
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl, SetLastError = true, CharSet = CharSet.Unicode)]
+    delegate int snap_bsdiff_sha256_batch_delegate(ref BsDiffSha256BatchCtx ctx);
+    readonly Delegate<snap_bsdiff_sha256_batch_delegate> snap_bsdiff_sha256_batch;
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl, SetLastError = true, CharSet = CharSet.Unicode)]
+    delegate int snap_bsdiff_chunk_delegate(ref BsDiffChunkCtx ctx);
+    readonly Delegate<snap_bsdiff_chunk_delegate> snap_bsdiff_chunk;
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl, SetLastError = true, CharSet = CharSet.Unicode)]
+    delegate int snap_bsdiff_chunk_free_delegate(ref BsDiffChunkCtx ctx);
+    readonly Delegate<snap_bsdiff_chunk_free_delegate> snap_bsdiff_chunk_free;
+
+[UnmanagedFunctionPointer(CallingConvention.Cdecl, SetLastError = true, CharSet = CharSet.Unicode)]
+    delegate int snap_bsdiff_diff_async_delegate(ref BsDiffAsyncCtx ctx);
+    readonly Delegate<snap_bsdiff_diff_async_delegate> snap_bsdiff_diff_async;
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl, SetLastError = true, CharSet = CharSet.Unicode)]
+    delegate int snap_bsdiff_patch_async_delegate(ref BsPatchAsyncCtx ctx);
+    readonly Delegate<snap_bsdiff_patch_async_delegate> snap_bsdiff_patch_async;
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl, SetLastError = true, CharSet = CharSet.Unicode)]
+    delegate int snap_bsdiff_async_close_delegate(ref BsDiffAsyncHandleCtx ctx);
+    readonly Delegate<snap_bsdiff_async_close_delegate> snap_bsdiff_async_close;
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    delegate int snap_bsdiff_stream_read_delegate(nint opaque, nint buffer, nuint size, out nuint bytesRead);
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    delegate int snap_bsdiff_stream_write_delegate(nint opaque, nint buffer, nuint size);
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    delegate int snap_bsdiff_stream_seek_delegate(nint opaque, long offset, BsDiffSeekOrigin origin);
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    delegate int snap_bsdiff_stream_tell_delegate(nint opaque, out long position);
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    delegate int snap_bsdiff_progress_delegate(nint opaque, ulong bytesProcessed, ulong bytesTotal);
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    delegate void snap_bsdiff_completion_delegate(nint opaque, int result);
+
+    // Called on native worker threads, long after the call that started the work returned,
+    // so it is kept alive here rather than by the caller.
+    static readonly snap_bsdiff_completion_delegate CompletionDelegate = AsyncCall.Complete;
+
     public LibBsDiff() 
     {
         OSPlatform osPlatform = default;
@@ -122,38 +649,35 @@ internal sealed class LibBsDiff : IBsdiffLib
         snap_bsdiff_diff_free = new Delegate<snap_bsdiff_diff_free_delegate>(_libPtr, osPlatform, filename);
         snap_bsdiff_patch = new Delegate<snap_bsdiff_patch_delegate>(_libPtr, osPlatform, filename);
         snap_bsdiff_patch_free = new Delegate<snap_bsdiff_patch_free_delegate>(_libPtr, osPlatform, filename);
+        snap_bsdiff_diff_stream = new Delegate<snap_bsdiff_diff_stream_delegate>(_libPtr, osPlatform, filename);
+        snap_bsdiff_patch_stream = new Delegate<snap_bsdiff_patch_stream_delegate>(_libPtr, osPlatform, filename);
+        snap_bsdiff_diff_batch = new Delegate<snap_bsdiff_diff_batch_delegate>(_libPtr, osPlatform, filename);
+        snap_bsdiff_patch_batch = new Delegate<snap_bsdiff_patch_batch_delegate>(_libPtr, osPlatform, filename);
+        snap_bsdiff_index_build = new Delegate<snap_bsdiff_index_build_delegate>(_libPtr, osPlatform, filename);
+        snap_bsdiff_index_open = new Delegate<snap_bsdiff_index_open_delegate>(_libPtr, osPlatform, filename);
+        snap_bsdiff_index_close = new Delegate<snap_bsdiff_index_close_delegate>(_libPtr, osPlatform, filename);
+        snap_bsdiff_diff_files = new Delegate<snap_bsdiff_diff_files_delegate>(_libPtr, osPlatform, filename);
+        snap_bsdiff_patch_files = new Delegate<snap_bsdiff_patch_files_delegate>(_libPtr, osPlatform, filename);
+        snap_bsdiff_compose = new Delegate<snap_bsdiff_compose_delegate>(_libPtr, osPlatform, filename);
+        snap_bsdiff_compose_free = new Delegate<snap_bsdiff_compose_free_delegate>(_libPtr, osPlatform, filename);
+        snap_bsdiff_sha256_init = new Delegate<snap_bsdiff_sha256_init_delegate>(_libPtr, osPlatform, filename);
+        snap_bsdiff_sha256_update = new Delegate<snap_bsdiff_sha256_update_delegate>(_libPtr, osPlatform, filename);
+        snap_bsdiff_sha256_final = new Delegate<snap_bsdiff_sha256_final_delegate>(_libPtr, osPlatform, filename);
+        snap_bsdiff_sha256_batch = new Delegate<snap_bsdiff_sha256_batch_delegate>(_libPtr, osPlatform, filename);
+        snap_bsdiff_chunk = new Delegate<snap_bsdiff_chunk_delegate>(_libPtr, osPlatform, filename);
+        snap_bsdiff_chunk_free = new Delegate<snap_bsdiff_chunk_free_delegate>(_libPtr, osPlatform, filename);
+        snap_bsdiff_diff_async = new Delegate<snap_bsdiff_diff_async_delegate>(_libPtr, osPlatform, filename);
+        snap_bsdiff_patch_async = new Delegate<snap_bsdiff_patch_async_delegate>(_libPtr, osPlatform, filename);
+        snap_bsdiff_async_close = new Delegate<snap_bsdiff_async_close_delegate>(_libPtr, osPlatform, filename);
     }
 
-    public void Diff(MemoryStream olderStream, MemoryStream newerStream, Stream patchStream)
-    {
-        ArgumentNullException.ThrowIfNull(olderStream);
-        ArgumentNullException.ThrowIfNull(newerStream);
-        ArgumentNullException.ThrowIfNull(patchStream);
-
-        if (!olderStream.CanRead)
-        {
-            throw new Exception($"{nameof(olderStream)} must be readable.");
-        }
-
-        if (!olderStream.CanSeek)
-        {
-            throw new Exception($"{nameof(olderStream)} must be seekable.");
-        }
-        
-        if (!newerStream.CanRead)
-        {
-            throw new Exception($"{nameof(newerStream)} must be readable.");
-        }
+    public BsDiffStats Diff(MemoryStream olderStream, MemoryStream newerStream, Stream patchStream, CancellationToken cancellationToken = default) =>
+        Diff(olderStream, newerStream, patchStream, null, cancellationToken).stats;
 
-        if (!newerStream.CanSeek)
-        {
-            throw new Exception($"{nameof(newerStream)} must be seekable.");
-        }
-        
-        if (!patchStream.CanWrite)
-        {
-            throw new Exception($"{nameof(patchStream)} must be writable.");
-        }
+    // Returns the timing, memory and stream statistics the native code collected while diffing.
+    public (BsDiffStats stats, bool cacheHit) Diff(MemoryStream olderStream, MemoryStream newerStream, Stream patchStream, BsDiffOptions options, CancellationToken cancellationToken = default)
+    {
+        ThrowIfInvalidDiffStreams(olderStream, newerStream, patchStream);
 
         unsafe
         {
@@ -169,13 +693,29 @@ internal sealed class LibBsDiff : IBsdiffLib
                 
                 var logErrorDelegate = Marshal.GetFunctionPointerForDelegate(LogError);
                 
+                var progressDelegate = CreateProgressDelegate(cancellationToken);
+
+                BsDiffStats stats = default;
+
                 var ctx = new BsDiffCtx
                 {
                     log_error = logErrorDelegate,
                     older = (nint)olderStreamPtr,
                     older_size = (nuint)olderStream.Length,
                     newer = (nint)newerStreamPtr,
-                    newer_size = (nuint)newerStream.Length
+                    newer_size = (nuint)newerStream.Length,
+                    index = options?.Index?.Handle ?? 0,
+                    packer = options?.Packer ?? default,
+                    max_memory_bytes = options?.MaxMemoryBytes ?? 0,
+                    filter = options?.Filter ?? BsDiffFilterType.None,
+                    engine = options?.Engine ?? BsDiffEngineType.Prematch,
+                    progress = CreateProgress(progressDelegate),
+                    stats = (nint)(&stats),
+                    cache = new BsDiffCacheOptions
+                    {
+                        path = Marshal.StringToCoTaskMemUTF8(options?.CacheDirectory),
+                        max_bytes = options?.CacheMaxBytes ?? 0
+                    }
                 };
 
                 bool success = default;
@@ -183,9 +723,11 @@ internal sealed class LibBsDiff : IBsdiffLib
                 {
                     snap_bsdiff_diff.ThrowIfDangling(); 
                     success = snap_bsdiff_diff.Invoke(ref ctx) == 1;
+                    GC.KeepAlive(progressDelegate);
 
                     if (!success)
                     {
+                        ThrowIfCancelled(ctx.status, cancellationToken);
                         throw new Exception($"Failed to execute bsdiff. Error code: {ctx.status}");
                     }
                 
@@ -203,21 +745,765 @@ internal sealed class LibBsDiff : IBsdiffLib
                 }
                 finally
                 {
+                    Marshal.FreeCoTaskMem(ctx.cache.path);
+
                     if (success)
                     {
                         snap_bsdiff_diff_free.ThrowIfDangling();
                         snap_bsdiff_diff_free.Invoke(ref ctx);
                     }
                 }
+
+                return (stats, ctx.cache_hit != 0);
             }
         }
     }
 
-    public void Patch(MemoryStream olderStream, MemoryStream patchStream, Stream outputStream, CancellationToken cancellationToken)
+    // Returns the SHA-256 of the result, computed by the native code while it was written.
+    public string Patch(MemoryStream olderStream, MemoryStream patchStream, Stream outputStream, CancellationToken cancellationToken)
     {
-        ArgumentNullException.ThrowIfNull(olderStream);
-        ArgumentNullException.ThrowIfNull(patchStream);
         ArgumentNullException.ThrowIfNull(outputStream);
+        return Patch(olderStream, patchStream, outputStream, false, cancellationToken);
+    }
+
+    // Applies the patch without keeping the result and returns its SHA-256. Patches that carry
+    // digests are also checked against olderStream and their own output.
+    public string Verify(MemoryStream olderStream, MemoryStream patchStream, CancellationToken cancellationToken = default) =>
+        Patch(olderStream, patchStream, null, true, cancellationToken);
+
+    string Patch(MemoryStream olderStream, MemoryStream patchStream, Stream outputStream, bool verifyOnly, CancellationToken cancellationToken)
+    {
+        ThrowIfInvalidPatchStreams(olderStream, patchStream);
+        
+        unsafe
+        {
+            fixed (byte* olderStreamPtr = olderStream.GetBuffer())
+            fixed (byte* patchStreamPtr = patchStream.GetBuffer())
+            {
+                void LogError(void* opaque, char* message)
+                {
+                    var messageStr = message == null ? null : Marshal.PtrToStringUTF8((nint)message);
+                    if (messageStr == null) return;
+                    Console.WriteLine(messageStr);
+                }
+                
+                var logErrorDelegate = Marshal.GetFunctionPointerForDelegate(LogError);
+
+                var progressDelegate = CreateProgressDelegate(cancellationToken);
+
+                var ctx = new BsDiffPatchCtx
+                {
+                    log_error = logErrorDelegate,
+                    older = (nint)olderStreamPtr,
+                    older_size = (nuint)olderStream.Length,
+                    patch = (nint)patchStreamPtr,
+                    patch_size = (nuint)patchStream.Length,
+                    progress = CreateProgress(progressDelegate),
+                    verify_only = verifyOnly ? 1 : 0
+                };
+
+                bool success = default;
+                try
+                {
+                    snap_bsdiff_patch.ThrowIfDangling(); 
+                    success = snap_bsdiff_patch.Invoke(ref ctx) == 1;
+                    GC.KeepAlive(progressDelegate);
+                    
+                    if (!success)
+                    {
+                        ThrowIfCancelled(ctx.status, cancellationToken);
+                        throw new Exception($"Failed to execute bspatch. Error code: {ctx.status}");
+                    }
+                
+                    var offset = 0;
+                    var bytesRemaining = ctx.newer_size;
+
+                    while (bytesRemaining > 0)
+                    {
+                        var sliceSize = bytesRemaining <= int.MaxValue ? (int) bytesRemaining : int.MaxValue;
+                        outputStream.Write(new ReadOnlySpan<byte>((void*)(ctx.newer + offset), sliceSize));
+                        offset += sliceSize;
+                        bytesRemaining -= (nuint)sliceSize;
+                    }
+
+                    return ToHexString(ctx.newer_sha256);
+                }
+                finally
+                {
+                    if (success)
+                    {
+                        snap_bsdiff_patch_free.ThrowIfDangling();
+                        snap_bsdiff_patch_free.Invoke(ref ctx);
+                    }
+                }
+            }
+        }
+    }
+
+    public void DiffStream(Stream olderStream, Stream newerStream, Stream patchStream, CancellationToken cancellationToken = default)
+    {
+        ArgumentNullException.ThrowIfNull(olderStream);
+        ArgumentNullException.ThrowIfNull(newerStream);
+        ArgumentNullException.ThrowIfNull(patchStream);
+
+        if (!olderStream.CanRead || !olderStream.CanSeek)
+        {
+            throw new Exception($"{nameof(olderStream)} must be readable and seekable.");
+        }
+
+        if (!newerStream.CanRead || !newerStream.CanSeek)
+        {
+            throw new Exception($"{nameof(newerStream)} must be readable and seekable.");
+        }
+
+        if (!patchStream.CanWrite)
+        {
+            throw new Exception($"{nameof(patchStream)} must be writable.");
+        }
+
+        var older = new StreamCallbacks(olderStream);
+        var newer = new StreamCallbacks(newerStream);
+        var patch = new StreamCallbacks(patchStream);
+        var progressDelegate = CreateProgressDelegate(cancellationToken);
+
+        var ctx = new BsDiffStreamCtx
+        {
+            log_error = Marshal.GetFunctionPointerForDelegate(StreamLogErrorDelegate),
+            older = older.Stream,
+            newer = newer.Stream,
+            patch = patch.Stream,
+            progress = CreateProgress(progressDelegate)
+        };
+
+        snap_bsdiff_diff_stream.ThrowIfDangling();
+        var success = snap_bsdiff_diff_stream.Invoke(ref ctx) == 1;
+        GC.KeepAlive(progressDelegate);
+
+        GC.KeepAlive(older);
+        GC.KeepAlive(newer);
+        GC.KeepAlive(patch);
+
+        if (!success)
+        {
+            ThrowIfCancelled(ctx.status, cancellationToken);
+            throw new Exception($"Failed to execute bsdiff. Error code: {ctx.status}", older.Exception ?? newer.Exception ?? patch.Exception);
+        }
+    }
+
+    public void PatchStream(Stream olderStream, Stream patchStream, Stream outputStream, CancellationToken cancellationToken = default)
+    {
+        ArgumentNullException.ThrowIfNull(olderStream);
+        ArgumentNullException.ThrowIfNull(patchStream);
+        ArgumentNullException.ThrowIfNull(outputStream);
+
+        if (!olderStream.CanRead || !olderStream.CanSeek)
+        {
+            throw new Exception($"{nameof(olderStream)} must be readable and seekable.");
+        }
+
+        if (!patchStream.CanRead)
+        {
+            throw new Exception($"{nameof(patchStream)} must be readable.");
+        }
+
+        if (!outputStream.CanWrite)
+        {
+            throw new Exception($"{nameof(outputStream)} must be writable.");
+        }
+
+        var older = new StreamCallbacks(olderStream);
+        var patch = new StreamCallbacks(patchStream);
+        var newer = new StreamCallbacks(outputStream);
+        var progressDelegate = CreateProgressDelegate(cancellationToken);
+
+        var ctx = new BsPatchStreamCtx
+        {
+            log_error = Marshal.GetFunctionPointerForDelegate(StreamLogErrorDelegate),
+            older = older.Stream,
+            patch = patch.Stream,
+            newer = newer.Stream,
+            progress = CreateProgress(progressDelegate)
+        };
+
+        snap_bsdiff_patch_stream.ThrowIfDangling();
+        var success = snap_bsdiff_patch_stream.Invoke(ref ctx) == 1;
+        GC.KeepAlive(progressDelegate);
+
+        GC.KeepAlive(older);
+        GC.KeepAlive(patch);
+        GC.KeepAlive(newer);
+
+        if (!success)
+        {
+            ThrowIfCancelled(ctx.status, cancellationToken);
+            throw new Exception($"Failed to execute bspatch. Error code: {ctx.status}", older.Exception ?? patch.Exception ?? newer.Exception);
+        }
+    }
+
+    // Same as Diff, except that the diff runs on the worker pool of the native library and
+    // no managed thread is blocked while it does.
+    public async Task<BsDiffStats> DiffAsync(MemoryStream olderStream, MemoryStream newerStream, Stream patchStream, CancellationToken cancellationToken = default) =>
+        (await DiffAsync(olderStream, newerStream, patchStream, null, cancellationToken).ConfigureAwait(false)).stats;
+
+    public async Task<(BsDiffStats stats, bool cacheHit)> DiffAsync(MemoryStream olderStream, MemoryStream newerStream, Stream patchStream, BsDiffOptions options, CancellationToken cancellationToken = default)
+    {
+        ThrowIfInvalidDiffStreams(olderStream, newerStream, patchStream);
+
+        using var call = new AsyncCall(snap_bsdiff_async_close, CreateProgressDelegate(cancellationToken));
+        StartDiff(call, olderStream, newerStream, options);
+        var result = await call.Completion.ConfigureAwait(false);
+        return EndDiff(call, result, patchStream, cancellationToken);
+    }
+
+    // Same as Patch, except that the patch is applied on the worker pool of the native library.
+    public async Task<string> PatchAsync(MemoryStream olderStream, MemoryStream patchStream, Stream outputStream, CancellationToken cancellationToken)
+    {
+        ThrowIfInvalidPatchStreams(olderStream, patchStream);
+        ArgumentNullException.ThrowIfNull(outputStream);
+
+        using var call = new AsyncCall(snap_bsdiff_async_close, CreateProgressDelegate(cancellationToken));
+        StartPatch(call, olderStream, patchStream);
+        var result = await call.Completion.ConfigureAwait(false);
+        return EndPatch(call, result, outputStream, cancellationToken);
+    }
+
+    unsafe void StartDiff(AsyncCall call, MemoryStream olderStream, MemoryStream newerStream, BsDiffOptions options)
+    {
+        var ctx = call.Allocate<BsDiffCtx>();
+        var stats = call.Allocate<BsDiffStats>();
+        ctx->log_error = Marshal.GetFunctionPointerForDelegate(StreamLogErrorDelegate);
+        ctx->older = call.Pin(olderStream.GetBuffer());
+        ctx->older_size = (nuint)olderStream.Length;
+        ctx->newer = call.Pin(newerStream.GetBuffer());
+        ctx->newer_size = (nuint)newerStream.Length;
+        ctx->progress = call.Progress;
+        ctx->stats = (nint)stats;
+        ctx->index = options?.Index?.Handle ?? 0;
+        ctx->packer = options?.Packer ?? default;
+        ctx->max_memory_bytes = options?.MaxMemoryBytes ?? 0;
+        ctx->filter = options?.Filter ?? BsDiffFilterType.None;
+        ctx->engine = options?.Engine ?? BsDiffEngineType.Prematch;
+        ctx->cache.path = call.AllocateUtf8(options?.CacheDirectory);
+        ctx->cache.max_bytes = options?.CacheMaxBytes ?? 0;
+
+        var asyncCtx = new BsDiffAsyncCtx
+        {
+            diff = (nint)ctx,
+            completion = call.Callback
+        };
+
+        snap_bsdiff_diff_async.ThrowIfDangling();
+        if (snap_bsdiff_diff_async.Invoke(ref asyncCtx) != 1)
+        {
+            throw new Exception($"Failed to queue bsdiff. Error code: {asyncCtx.status}");
+        }
+
+        call.Handle = asyncCtx.handle;
+    }
+
+    unsafe (BsDiffStats stats, bool cacheHit) EndDiff(AsyncCall call, int result, Stream patchStream, CancellationToken cancellationToken)
+    {
+        var ctx = (BsDiffCtx*)call.Allocations[0];
+        if (result != 1)
+        {
+            ThrowIfCancelled(ctx->status, cancellationToken);
+            throw new Exception($"Failed to execute bsdiff. Error code: {ctx->status}");
+        }
+
+        try
+        {
+            WriteNative(ctx->patch, ctx->patch_size, patchStream);
+        }
+        finally
+        {
+            snap_bsdiff_diff_free.ThrowIfDangling();
+            snap_bsdiff_diff_free.Invoke(ref *ctx);
+        }
+
+        return (*(BsDiffStats*)call.Allocations[1], ctx->cache_hit != 0);
+    }
+
+    unsafe void StartPatch(AsyncCall call, MemoryStream olderStream, MemoryStream patchStream)
+    {
+        var ctx = call.Allocate<BsDiffPatchCtx>();
+        ctx->log_error = Marshal.GetFunctionPointerForDelegate(StreamLogErrorDelegate);
+        ctx->older = call.Pin(olderStream.GetBuffer());
+        ctx->older_size = (nuint)olderStream.Length;
+        ctx->patch = call.Pin(patchStream.GetBuffer());
+        ctx->patch_size = (nuint)patchStream.Length;
+        ctx->progress = call.Progress;
+
+        var asyncCtx = new BsPatchAsyncCtx
+        {
+            patch = (nint)ctx,
+            completion = call.Callback
+        };
+
+        snap_bsdiff_patch_async.ThrowIfDangling();
+        if (snap_bsdiff_patch_async.Invoke(ref asyncCtx) != 1)
+        {
+            throw new Exception($"Failed to queue bspatch. Error code: {asyncCtx.status}");
+        }
+
+        call.Handle = asyncCtx.handle;
+    }
+
+    unsafe string EndPatch(AsyncCall call, int result, Stream outputStream, CancellationToken cancellationToken)
+    {
+        var ctx = (BsDiffPatchCtx*)call.Allocations[0];
+        if (result != 1)
+        {
+            ThrowIfCancelled(ctx->status, cancellationToken);
+            throw new Exception($"Failed to execute bspatch. Error code: {ctx->status}");
+        }
+
+        try
+        {
+            WriteNative(ctx->newer, ctx->newer_size, outputStream);
+            return ToHexString(ctx->newer_sha256);
+        }
+        finally
+        {
+            snap_bsdiff_patch_free.ThrowIfDangling();
+            snap_bsdiff_patch_free.Invoke(ref *ctx);
+        }
+    }
+
+    public void DiffFiles(string olderFilename, string newerFilename, string patchFilename, CancellationToken cancellationToken = default)
+    {
+        ArgumentNullException.ThrowIfNull(olderFilename);
+        ArgumentNullException.ThrowIfNull(newerFilename);
+        ArgumentNullException.ThrowIfNull(patchFilename);
+
+        unsafe
+        {
+            void LogError(void* opaque, char* message)
+            {
+                var messageStr = message == null ? null : Marshal.PtrToStringUTF8((nint)message);
+                if (messageStr == null) return;
+                Console.WriteLine(messageStr);
+            }
+
+            var logErrorDelegate = Marshal.GetFunctionPointerForDelegate(LogError);
+
+            var progressDelegate = CreateProgressDelegate(cancellationToken);
+
+            var ctx = new BsDiffFilesCtx
+            {
+                log_error = logErrorDelegate,
+                progress = CreateProgress(progressDelegate)
+            };
+
+            try
+            {
+                ctx.older_path = Marshal.StringToCoTaskMemUTF8(olderFilename);
+                ctx.newer_path = Marshal.StringToCoTaskMemUTF8(newerFilename);
+                ctx.patch_path = Marshal.StringToCoTaskMemUTF8(patchFilename);
+
+                snap_bsdiff_diff_files.ThrowIfDangling();
+                var success = snap_bsdiff_diff_files.Invoke(ref ctx) == 1;
+                GC.KeepAlive(progressDelegate);
+
+                if (!success)
+                {
+                    ThrowIfCancelled(ctx.status, cancellationToken);
+                    throw new Exception($"Failed to execute bsdiff. Error code: {ctx.status}");
+                }
+            }
+            finally
+            {
+                Marshal.FreeCoTaskMem(ctx.older_path);
+                Marshal.FreeCoTaskMem(ctx.newer_path);
+                Marshal.FreeCoTaskMem(ctx.patch_path);
+            }
+        }
+    }
+
+    public void PatchFiles(string olderFilename, string patchFilename, string newerFilename, CancellationToken cancellationToken = default)
+    {
+        ArgumentNullException.ThrowIfNull(olderFilename);
+        ArgumentNullException.ThrowIfNull(patchFilename);
+        ArgumentNullException.ThrowIfNull(newerFilename);
+
+        unsafe
+        {
+            void LogError(void* opaque, char* message)
+            {
+                var messageStr = message == null ? null : Marshal.PtrToStringUTF8((nint)message);
+                if (messageStr == null) return;
+                Console.WriteLine(messageStr);
+            }
+
+            var logErrorDelegate = Marshal.GetFunctionPointerForDelegate(LogError);
+
+            var progressDelegate = CreateProgressDelegate(cancellationToken);
+
+            var ctx = new BsPatchFilesCtx
+            {
+                log_error = logErrorDelegate,
+                progress = CreateProgress(progressDelegate)
+            };
+
+            try
+            {
+                ctx.older_path = Marshal.StringToCoTaskMemUTF8(olderFilename);
+                ctx.patch_path = Marshal.StringToCoTaskMemUTF8(patchFilename);
+                ctx.newer_path = Marshal.StringToCoTaskMemUTF8(newerFilename);
+
+                snap_bsdiff_patch_files.ThrowIfDangling();
+                var success = snap_bsdiff_patch_files.Invoke(ref ctx) == 1;
+                GC.KeepAlive(progressDelegate);
+
+                if (!success)
+                {
+                    ThrowIfCancelled(ctx.status, cancellationToken);
+                    throw new Exception($"Failed to execute bspatch. Error code: {ctx.status}");
+                }
+            }
+            finally
+            {
+                Marshal.FreeCoTaskMem(ctx.older_path);
+                Marshal.FreeCoTaskMem(ctx.patch_path);
+                Marshal.FreeCoTaskMem(ctx.newer_path);
+            }
+        }
+    }
+
+    // Composes a chain of patches, each made against the output of the one before, into a
+    // single patch from the older file of the first to the newer file of the last. The
+    // streams must expose their buffers.
+    public void Compose(IReadOnlyList<MemoryStream> patchStreams, Stream outputStream, BsDiffPackerOptions packer = default)
+    {
+        ArgumentNullException.ThrowIfNull(patchStreams);
+        ArgumentNullException.ThrowIfNull(outputStream);
+
+        var items = new BsDiffComposeItem[patchStreams.Count];
+        var handles = new GCHandle[patchStreams.Count];
+
+        try
+        {
+            for (var i = 0; i < patchStreams.Count; i++)
+            {
+                if (!patchStreams[i].TryGetBuffer(out var segment))
+                {
+                    throw new Exception($"{nameof(patchStreams)} must expose their buffers.");
+                }
+
+                handles[i] = GCHandle.Alloc(segment.Array, GCHandleType.Pinned);
+                items[i].patch = handles[i].AddrOfPinnedObject() + segment.Offset;
+                items[i].patch_size = (nuint)segment.Count;
+            }
+
+            unsafe
+            {
+                fixed (BsDiffComposeItem* itemsPtr = items)
+                {
+                    var ctx = new BsDiffComposeCtx
+                    {
+                        log_error = Marshal.GetFunctionPointerForDelegate(StreamLogErrorDelegate),
+                        items = (nint)itemsPtr,
+                        items_count = (nuint)items.Length,
+                        packer = packer
+                    };
+
+                    snap_bsdiff_compose.ThrowIfDangling();
+                    if (snap_bsdiff_compose.Invoke(ref ctx) != 1)
+                    {
+                        throw new Exception($"Failed to compose patches. Error code: {ctx.status}");
+                    }
+
+                    try
+                    {
+                        WriteNative(ctx.patch, ctx.patch_size, outputStream);
+                    }
+                    finally
+                    {
+                        snap_bsdiff_compose_free.ThrowIfDangling();
+                        snap_bsdiff_compose_free.Invoke(ref ctx);
+                    }
+                }
+            }
+        }
+        finally
+        {
+            foreach (var handle in handles)
+            {
+                if (handle.IsAllocated)
+                {
+                    handle.Free();
+                }
+            }
+        }
+    }
+
+    // Hashes the stream from its current position to the end.
+    public string Sha256(Stream stream)
+    {
+        ArgumentNullException.ThrowIfNull(stream);
+
+#if SNAP_BOOTSTRAP
+            return ManagedSha256(stream);
+#endif
+
+        unsafe
+        {
+            var ctx = new BsDiffSha256Ctx();
+
+            snap_bsdiff_sha256_init.ThrowIfDangling();
+            if (snap_bsdiff_sha256_init.Invoke(ref ctx) != 1)
+            {
+                throw new Exception($"Failed to initialize sha256. Error code: {ctx.status}");
+            }
+
+            try
+            {
+                if (stream is MemoryStream memoryStream && memoryStream.TryGetBuffer(out var segment))
+                {
+                    Sha256Update(ref ctx, segment.AsSpan((int)memoryStream.Position));
+                    memoryStream.Position = memoryStream.Length;
+                }
+                else
+                {
+                    var buffer = ArrayPool<byte>.Shared.Rent(1024 * 1024);
+                    try
+                    {
+                        int bytesRead;
+                        while ((bytesRead = stream.Read(buffer, 0, buffer.Length)) > 0)
+                        {
+                            Sha256Update(ref ctx, buffer.AsSpan(0, bytesRead));
+                        }
+                    }
+                    finally
+                    {
+                        ArrayPool<byte>.Shared.Return(buffer);
+                    }
+                }
+            }
+            finally
+            {
+                snap_bsdiff_sha256_final.ThrowIfDangling();
+                snap_bsdiff_sha256_final.Invoke(ref ctx);
+            }
+
+            return ToHexString(ctx.digest);
+        }
+    }
+
+    // Hashes the whole contents of every stream, side by side on all hardware threads. The
+    // streams must expose their buffers.
+    public string[] Sha256(IReadOnlyList<MemoryStream> streams)
+    {
+        ArgumentNullException.ThrowIfNull(streams);
+
+#if SNAP_BOOTSTRAP
+            var checksums = new string[streams.Count];
+            for (var i = 0; i < streams.Count; i++)
+            {
+                streams[i].Seek(0, SeekOrigin.Begin);
+                checksums[i] = ManagedSha256(streams[i]);
+            }
+            return checksums;
+#endif
+
+        var items = new BsDiffSha256Item[streams.Count];
+        var handles = new GCHandle[streams.Count];
+
+        try
+        {
+            for (var i = 0; i < streams.Count; i++)
+            {
+                if (!streams[i].TryGetBuffer(out var segment))
+                {
+                    throw new Exception($"{nameof(streams)} must expose their buffers.");
+                }
+
+                handles[i] = GCHandle.Alloc(segment.Array, GCHandleType.Pinned);
+                items[i].data = handles[i].AddrOfPinnedObject() + segment.Offset;
+                items[i].data_size = (nuint)segment.Count;
+            }
+
+            unsafe
+            {
+                fixed (BsDiffSha256Item* itemsPtr = items)
+                {
+                    var ctx = new BsDiffSha256BatchCtx
+                    {
+                        items = (nint)itemsPtr,
+                        items_count = (nuint)items.Length
+                    };
+
+                    snap_bsdiff_sha256_batch.ThrowIfDangling();
+                    if (snap_bsdiff_sha256_batch.Invoke(ref ctx) != 1)
+                    {
+                        throw new Exception($"Failed to execute sha256 batch. Error code: {ctx.status}");
+                    }
+
+                    var checksums = new string[items.Length];
+                    for (var i = 0; i < items.Length; i++)
+                    {
+                        checksums[i] = ToHexString(itemsPtr[i].digest);
+                    }
+
+                    return checksums;
+                }
+            }
+        }
+        finally
+        {
+            foreach (var handle in handles)
+            {
+                if (handle.IsAllocated)
+                {
+                    handle.Free();
+                }
+            }
+        }
+    }
+
+    // Splits every stream into content defined chunks and dedupes them across the streams and
+    // against the SHA-256 checksums of the chunks in known. The streams must expose their
+    // buffers, chunks only dedupe against chunks made with the same sizes.
+    public BsDiffChunkResult Chunk(IReadOnlyList<MemoryStream> streams, IReadOnlyCollection<string> known = null, uint minSize = 0, uint avgSize = 0, uint maxSize = 0, uint threadCount = 0)
+    {
+        ArgumentNullException.ThrowIfNull(streams);
+
+        var files = new BsDiffChunkFile[streams.Count];
+        var handles = new GCHandle[streams.Count];
+        var knownDigests = new byte[(known?.Count ?? 0) * 32];
+
+        if (known != null)
+        {
+            var offset = 0;
+            foreach (var checksum in known)
+            {
+                Convert.FromHexString(checksum).CopyTo(knownDigests, offset);
+                offset += 32;
+            }
+        }
+
+        try
+        {
+            for (var i = 0; i < streams.Count; i++)
+            {
+                if (!streams[i].TryGetBuffer(out var segment))
+                {
+                    throw new Exception($"{nameof(streams)} must expose their buffers.");
+                }
+
+                handles[i] = GCHandle.Alloc(segment.Array, GCHandleType.Pinned);
+                files[i].data = handles[i].AddrOfPinnedObject() + segment.Offset;
+                files[i].data_size = (nuint)segment.Count;
+            }
+
+            unsafe
+            {
+                fixed (BsDiffChunkFile* filesPtr = files)
+                fixed (byte* knownPtr = knownDigests)
+                {
+                    var ctx = new BsDiffChunkCtx
+                    {
+                        log_error = Marshal.GetFunctionPointerForDelegate(StreamLogErrorDelegate),
+                        files = (nint)filesPtr,
+                        files_count = (nuint)files.Length,
+                        known = (nint)knownPtr,
+                        known_count = (nuint)(knownDigests.Length / 32),
+                        min_size = minSize,
+                        avg_size = avgSize,
+                        max_size = maxSize,
+                        thread_count = threadCount
+                    };
+
+                    snap_bsdiff_chunk.ThrowIfDangling();
+                    if (snap_bsdiff_chunk.Invoke(ref ctx) != 1)
+                    {
+                        throw new Exception($"Failed to execute chunk. Error code: {ctx.status}");
+                    }
+
+                    try
+                    {
+                        var chunks = new BsDiffChunk[files.Length][];
+                        for (var i = 0; i < files.Length; i++)
+                        {
+                            var entries = (BsDiffChunkEntry*)filesPtr[i].chunks;
+                            chunks[i] = new BsDiffChunk[(int)filesPtr[i].chunks_count];
+                            for (var j = 0; j < chunks[i].Length; j++)
+                            {
+                                chunks[i][j] = new BsDiffChunk(entries[j].offset, entries[j].size, entries[j].novel != 0, ToHexString(entries[j].sha256));
+                            }
+                        }
+
+                        return new BsDiffChunkResult(chunks, ctx.novel_count, ctx.novel_size);
+                    }
+                    finally
+                    {
+                        snap_bsdiff_chunk_free.ThrowIfDangling();
+                        snap_bsdiff_chunk_free.Invoke(ref ctx);
+                    }
+                }
+            }
+        }
+        finally
+        {
+            foreach (var handle in handles)
+            {
+                if (handle.IsAllocated)
+                {
+                    handle.Free();
+                }
+            }
+        }
+    }
+
+    unsafe void Sha256Update(ref BsDiffSha256Ctx ctx, ReadOnlySpan<byte> data)
+    {
+        fixed (byte* dataPtr = data)
+        {
+            ctx.data = (nint)dataPtr;
+            ctx.data_size = (nuint)data.Length;
+            snap_bsdiff_sha256_update.ThrowIfDangling();
+            if (snap_bsdiff_sha256_update.Invoke(ref ctx) != 1)
+            {
+                throw new Exception($"Failed to execute sha256. Error code: {ctx.status}");
+            }
+        }
+    }
+
+    static void ThrowIfInvalidDiffStreams(MemoryStream olderStream, MemoryStream newerStream, Stream patchStream)
+    {
+        ArgumentNullException.ThrowIfNull(olderStream);
+        ArgumentNullException.ThrowIfNull(newerStream);
+        ArgumentNullException.ThrowIfNull(patchStream);
+
+        if (!olderStream.CanRead)
+        {
+            throw new Exception($"{nameof(olderStream)} must be readable.");
+        }
+
+        if (!olderStream.CanSeek)
+        {
+            throw new Exception($"{nameof(olderStream)} must be seekable.");
+        }
+        
+        if (!newerStream.CanRead)
+        {
+            throw new Exception($"{nameof(newerStream)} must be readable.");
+        }
+
+        if (!newerStream.CanSeek)
+        {
+            throw new Exception($"{nameof(newerStream)} must be seekable.");
+        }
+        
+        if (!patchStream.CanWrite)
+        {
+            throw new Exception($"{nameof(patchStream)} must be writable.");
+        }
+    }
+
+    static void ThrowIfInvalidPatchStreams(MemoryStream olderStream, MemoryStream patchStream)
+    {
+        ArgumentNullException.ThrowIfNull(olderStream);
+        ArgumentNullException.ThrowIfNull(patchStream);
 
         if (!olderStream.CanRead)
         {
@@ -243,60 +1529,452 @@ internal sealed class LibBsDiff : IBsdiffLib
         {
             throw new Exception($"{nameof(patchStream)} must be writable.");
         }
-        
-        unsafe
+    }
+
+    static unsafe string ToHexString(byte* digest) => 
+        Convert.ToHexString(new ReadOnlySpan<byte>(digest, 32)).ToLowerInvariant();
+
+    static unsafe string NewerSha256(BsDiffPatchCtx ctx) => ToHexString(ctx.newer_sha256);
+
+    // The native library is not loaded when bootstrapping, hashing is the one operation with a
+    // managed equivalent.
+    static string ManagedSha256(Stream stream)
+    {
+        using var sha256 = SHA256.Create();
+        return Convert.ToHexString(sha256.ComputeHash(stream)).ToLowerInvariant();
+    }
+
+    // The native code polls the token through the progress callback and stops with
+    // BsDiffStatusType.Cancelled once cancellation is requested.
+    static snap_bsdiff_progress_delegate CreateProgressDelegate(CancellationToken cancellationToken) =>
+        cancellationToken.CanBeCanceled ? (_, _, _) => cancellationToken.IsCancellationRequested ? 1 : 0 : null;
+
+    static BsDiffProgress CreateProgress(snap_bsdiff_progress_delegate progressDelegate) => new()
+    {
+        report = progressDelegate == null ? 0 : Marshal.GetFunctionPointerForDelegate(progressDelegate)
+    };
+
+    static void ThrowIfCancelled(BsDiffStatusType status, CancellationToken cancellationToken)
+    {
+        if (status == BsDiffStatusType.Cancelled)
         {
-            fixed (byte* olderStreamPtr = olderStream.GetBuffer())
-            fixed (byte* patchStreamPtr = patchStream.GetBuffer())
+            throw new OperationCanceledException(cancellationToken);
+        }
+    }
+
+    // Diffs every item on a native thread pool. Patches of items that succeeded are written to
+    // their patch stream, the status of every item is returned in order. Items run largest
+    // first, and maxMemoryBytes, when not 0, caps the summed estimate of running items.
+    public BsDiffStatusType[] DiffBatch(IReadOnlyList<BsDiffBatchItem> items, uint threadCount = 0, ulong maxMemoryBytes = 0, CancellationToken cancellationToken = default)
+    {
+        ArgumentNullException.ThrowIfNull(items);
+
+        var handles = new List<GCHandle>(items.Count * 2);
+        var ctxs = new BsDiffCtx[items.Count];
+        var stats = new BsDiffStats[items.Count];
+        var progressDelegate = CreateProgressDelegate(cancellationToken);
+
+        nint Pin(MemoryStream stream)
+        {
+            var handle = GCHandle.Alloc(stream.GetBuffer(), GCHandleType.Pinned);
+            handles.Add(handle);
+            return handle.AddrOfPinnedObject();
+        }
+
+        try
+        {
+            for (var i = 0; i < items.Count; i++)
             {
-                void LogError(void* opaque, char* message)
+                var item = items[i];
+                ArgumentNullException.ThrowIfNull(item);
+
+                ctxs[i] = new BsDiffCtx
                 {
-                    var messageStr = message == null ? null : Marshal.PtrToStringUTF8((nint)message);
-                    if (messageStr == null) return;
-                    Console.WriteLine(messageStr);
+                    log_error = Marshal.GetFunctionPointerForDelegate(StreamLogErrorDelegate),
+                    older = Pin(item.OlderStream),
+                    older_size = (nuint)item.OlderStream.Length,
+                    newer = Pin(item.NewerStream),
+                    newer_size = (nuint)item.NewerStream.Length,
+                    index = item.Options?.Index?.Handle ?? 0,
+                    packer = item.Options?.Packer ?? default,
+                    max_memory_bytes = item.Options?.MaxMemoryBytes ?? 0,
+                    filter = item.Options?.Filter ?? BsDiffFilterType.None,
+                    engine = item.Options?.Engine ?? BsDiffEngineType.Prematch,
+                    progress = CreateProgress(progressDelegate),
+                    cache = new BsDiffCacheOptions
+                    {
+                        path = Marshal.StringToCoTaskMemUTF8(item.Options?.CacheDirectory),
+                        max_bytes = item.Options?.CacheMaxBytes ?? 0
+                    }
+                };
+            }
+
+            unsafe
+            {
+                fixed (BsDiffCtx* itemsPtr = ctxs)
+                fixed (BsDiffStats* statsPtr = stats)
+                {
+                    for (var i = 0; i < ctxs.Length; i++)
+                    {
+                        itemsPtr[i].stats = (nint)(statsPtr + i);
+                    }
+
+                    var ctx = new BsDiffBatchCtx
+                    {
+                        items = (nint)itemsPtr,
+                        items_count = (nuint)ctxs.Length,
+                        thread_count = threadCount,
+                        max_memory_bytes = maxMemoryBytes
+                    };
+
+                    snap_bsdiff_diff_batch.ThrowIfDangling();
+                    snap_bsdiff_diff_batch.Invoke(ref ctx);
+                    GC.KeepAlive(progressDelegate);
+
+                    if (ctx.status != BsDiffStatusType.Success)
+                    {
+                        throw new Exception($"Failed to execute bsdiff batch. Error code: {ctx.status}");
+                    }
                 }
-                
-                var logErrorDelegate = Marshal.GetFunctionPointerForDelegate(LogError);
+            }
 
-                var ctx = new BsDiffPatchCtx
+            var statuses = new BsDiffStatusType[ctxs.Length];
+            for (var i = 0; i < ctxs.Length; i++)
+            {
+                ThrowIfCancelled(ctxs[i].status, cancellationToken);
+                statuses[i] = ctxs[i].status;
+                if (statuses[i] == BsDiffStatusType.Success)
                 {
-                    log_error = logErrorDelegate,
-                    older = (nint)olderStreamPtr,
-                    older_size = (nuint)olderStream.Length,
-                    patch = (nint)patchStreamPtr,
-                    patch_size = (nuint)patchStream.Length
+                    WriteNative(ctxs[i].patch, ctxs[i].patch_size, items[i].PatchStream);
+                    items[i].Stats = stats[i];
+                    items[i].CacheHit = ctxs[i].cache_hit != 0;
+                }
+            }
+
+            return statuses;
+        }
+        finally
+        {
+            for (var i = 0; i < ctxs.Length; i++)
+            {
+                Marshal.FreeCoTaskMem(ctxs[i].cache.path);
+
+                if (ctxs[i].patch != 0)
+                {
+                    snap_bsdiff_diff_free.ThrowIfDangling();
+                    snap_bsdiff_diff_free.Invoke(ref ctxs[i]);
+                }
+            }
+
+            foreach (var handle in handles)
+            {
+                handle.Free();
+            }
+        }
+    }
+
+    // Applies every item on a native thread pool. The new file of items that succeeded is written
+    // to their output stream, the status of every item is returned in order. maxMemoryBytes, when
+    // not 0, caps the summed size of older and newer of running items.
+    public BsDiffStatusType[] PatchBatch(IReadOnlyList<BsPatchBatchItem> items, uint threadCount = 0, ulong maxMemoryBytes = 0, CancellationToken cancellationToken = default)
+    {
+        ArgumentNullException.ThrowIfNull(items);
+
+        var handles = new List<GCHandle>(items.Count * 2);
+        var ctxs = new BsDiffPatchCtx[items.Count];
+        var progressDelegate = CreateProgressDelegate(cancellationToken);
+
+        nint Pin(MemoryStream stream)
+        {
+            var handle = GCHandle.Alloc(stream.GetBuffer(), GCHandleType.Pinned);
+            handles.Add(handle);
+            return handle.AddrOfPinnedObject();
+        }
+
+        try
+        {
+            for (var i = 0; i < items.Count; i++)
+            {
+                var item = items[i];
+                ArgumentNullException.ThrowIfNull(item);
+
+                ctxs[i] = new BsDiffPatchCtx
+                {
+                    log_error = Marshal.GetFunctionPointerForDelegate(StreamLogErrorDelegate),
+                    older = Pin(item.OlderStream),
+                    older_size = (nuint)item.OlderStream.Length,
+                    patch = Pin(item.PatchStream),
+                    patch_size = (nuint)item.PatchStream.Length,
+                    progress = CreateProgress(progressDelegate)
                 };
+            }
 
-                bool success = default;
-                try
+            unsafe
+            {
+                fixed (BsDiffPatchCtx* itemsPtr = ctxs)
                 {
-                    snap_bsdiff_patch.ThrowIfDangling(); 
-                    success = snap_bsdiff_patch.Invoke(ref ctx) == 1;
-                    
-                    if (!success)
+                    var ctx = new BsPatchBatchCtx
                     {
-                        throw new Exception($"Failed to execute bspatch. Error code: {ctx.status}");
+                        items = (nint)itemsPtr,
+                        items_count = (nuint)ctxs.Length,
+                        thread_count = threadCount,
+                        max_memory_bytes = maxMemoryBytes
+                    };
+
+                    snap_bsdiff_patch_batch.ThrowIfDangling();
+                    snap_bsdiff_patch_batch.Invoke(ref ctx);
+                    GC.KeepAlive(progressDelegate);
+
+                    if (ctx.status != BsDiffStatusType.Success)
+                    {
+                        throw new Exception($"Failed to execute bspatch batch. Error code: {ctx.status}");
                     }
-                
-                    var offset = 0;
-                    var bytesRemaining = ctx.newer_size;
+                }
+            }
 
-                    while (bytesRemaining > 0)
+            var statuses = new BsDiffStatusType[ctxs.Length];
+            for (var i = 0; i < ctxs.Length; i++)
+            {
+                ThrowIfCancelled(ctxs[i].status, cancellationToken);
+                statuses[i] = ctxs[i].status;
+                if (statuses[i] == BsDiffStatusType.Success)
+                {
+                    WriteNative(ctxs[i].newer, ctxs[i].newer_size, items[i].OutputStream);
+                    items[i].Sha256Checksum = NewerSha256(ctxs[i]);
+                }
+            }
+
+            return statuses;
+        }
+        finally
+        {
+            for (var i = 0; i < ctxs.Length; i++)
+            {
+                if (ctxs[i].newer != 0)
+                {
+                    snap_bsdiff_patch_free.ThrowIfDangling();
+                    snap_bsdiff_patch_free.Invoke(ref ctxs[i]);
+                }
+            }
+
+            foreach (var handle in handles)
+            {
+                handle.Free();
+            }
+        }
+    }
+
+    // Sorts olderStream once and writes the suffix array to indexPath, see OpenIndex.
+    public void BuildIndex(MemoryStream olderStream, string indexPath, uint threadCount = 0)
+    {
+        ArgumentNullException.ThrowIfNull(olderStream);
+        ArgumentNullException.ThrowIfNull(indexPath);
+
+        var indexPathPtr = Marshal.StringToCoTaskMemUTF8(indexPath);
+        try
+        {
+            unsafe
+            {
+                fixed (byte* olderStreamPtr = olderStream.GetBuffer())
+                {
+                    var ctx = new BsDiffIndexCtx
                     {
-                        var sliceSize = bytesRemaining <= int.MaxValue ? (int) bytesRemaining : int.MaxValue;
-                        outputStream.Write(new ReadOnlySpan<byte>((void*)(ctx.newer + offset), sliceSize));
-                        offset += sliceSize;
-                        bytesRemaining -= (nuint)sliceSize;
+                        log_error = Marshal.GetFunctionPointerForDelegate(StreamLogErrorDelegate),
+                        older = (nint)olderStreamPtr,
+                        older_size = (nuint)olderStream.Length,
+                        index_path = indexPathPtr,
+                        thread_count = threadCount
+                    };
+
+                    snap_bsdiff_index_build.ThrowIfDangling();
+                    if (snap_bsdiff_index_build.Invoke(ref ctx) != 1)
+                    {
+                        throw new Exception($"Failed to build bsdiff index. Error code: {ctx.status}");
                     }
                 }
-                finally
+            }
+        }
+        finally
+        {
+            Marshal.FreeCoTaskMem(indexPathPtr);
+        }
+    }
+
+    // Maps an index written by BuildIndex. Fails unless it was built from the same contents
+    // as olderStream.
+    public BsDiffIndex OpenIndex(MemoryStream olderStream, string indexPath)
+    {
+        ArgumentNullException.ThrowIfNull(olderStream);
+        ArgumentNullException.ThrowIfNull(indexPath);
+
+        var indexPathPtr = Marshal.StringToCoTaskMemUTF8(indexPath);
+        try
+        {
+            unsafe
+            {
+                fixed (byte* olderStreamPtr = olderStream.GetBuffer())
                 {
-                    if (success)
+                    var ctx = new BsDiffIndexCtx
                     {
-                        snap_bsdiff_patch_free.ThrowIfDangling();
-                        snap_bsdiff_patch_free.Invoke(ref ctx);
+                        log_error = Marshal.GetFunctionPointerForDelegate(StreamLogErrorDelegate),
+                        older = (nint)olderStreamPtr,
+                        older_size = (nuint)olderStream.Length,
+                        index_path = indexPathPtr
+                    };
+
+                    snap_bsdiff_index_open.ThrowIfDangling();
+                    if (snap_bsdiff_index_open.Invoke(ref ctx) != 1)
+                    {
+                        throw new Exception($"Failed to open bsdiff index. Error code: {ctx.status}");
                     }
+
+                    return new BsDiffIndex(ctx.index, CloseIndex);
+                }
+            }
+        }
+        finally
+        {
+            Marshal.FreeCoTaskMem(indexPathPtr);
+        }
+    }
+
+    void CloseIndex(nint index)
+    {
+        var ctx = new BsDiffIndexCtx
+        {
+            index = index
+        };
+
+        snap_bsdiff_index_close.ThrowIfDangling();
+        snap_bsdiff_index_close.Invoke(ref ctx);
+    }
+
+    static unsafe void WriteNative(nint data, nuint size, Stream stream)
+    {
+        var offset = 0;
+        var bytesRemaining = size;
+
+        while (bytesRemaining > 0)
+        {
+            var sliceSize = bytesRemaining <= int.MaxValue ? (int) bytesRemaining : int.MaxValue;
+            stream.Write(new ReadOnlySpan<byte>((void*)(data + offset), sliceSize));
+            offset += sliceSize;
+            bytesRemaining -= (nuint)sliceSize;
+        }
+    }
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    delegate void snap_bsdiff_stream_log_error_delegate(nint opaque, nint message);
+    static readonly snap_bsdiff_stream_log_error_delegate StreamLogErrorDelegate = StreamLogError;
+
+    static void StreamLogError(nint opaque, nint message)
+    {
+        var messageStr = message == 0 ? null : Marshal.PtrToStringUTF8(message);
+        if (messageStr == null) return;
+        Console.WriteLine(messageStr);
+    }
+
+    // Exposes a managed stream through the native stream callbacks. The delegates are kept
+    // alive by this instance, so it has to outlive the native call. Exceptions never cross
+    // into native code, they are kept and surface as the inner exception of the failed call.
+    sealed class StreamCallbacks
+    {
+        readonly Stream _stream;
+        readonly snap_bsdiff_stream_read_delegate _read;
+        readonly snap_bsdiff_stream_write_delegate _write;
+        readonly snap_bsdiff_stream_seek_delegate _seek;
+        readonly snap_bsdiff_stream_tell_delegate _tell;
+
+        public Exception Exception { get; private set; }
+
+        public BsDiffStream Stream => new()
+        {
+            read = _stream.CanRead ? Marshal.GetFunctionPointerForDelegate(_read) : 0,
+            write = _stream.CanWrite ? Marshal.GetFunctionPointerForDelegate(_write) : 0,
+            seek = _stream.CanSeek ? Marshal.GetFunctionPointerForDelegate(_seek) : 0,
+            tell = _stream.CanSeek ? Marshal.GetFunctionPointerForDelegate(_tell) : 0
+        };
+
+        public StreamCallbacks(Stream stream)
+        {
+            _stream = stream;
+            _read = Read;
+            _write = Write;
+            _seek = Seek;
+            _tell = Tell;
+        }
+
+        unsafe int Read(nint opaque, nint buffer, nuint size, out nuint bytesRead)
+        {
+            bytesRead = 0;
+            try
+            {
+                var count = size <= int.MaxValue ? (int)size : int.MaxValue;
+                var read = _stream.Read(new Span<byte>((void*)buffer, count));
+                bytesRead = (nuint)read;
+                return (int)(read == 0 && count > 0 ? BsDiffStatusType.EndOfFile : BsDiffStatusType.Success);
+            }
+            catch (Exception e)
+            {
+                Exception = e;
+                return (int)BsDiffStatusType.FileError;
+            }
+        }
+
+        unsafe int Write(nint opaque, nint buffer, nuint size)
+        {
+            try
+            {
+                var offset = 0;
+                var bytesRemaining = size;
+                while (bytesRemaining > 0)
+                {
+                    var sliceSize = bytesRemaining <= int.MaxValue ? (int)bytesRemaining : int.MaxValue;
+                    _stream.Write(new ReadOnlySpan<byte>((void*)(buffer + offset), sliceSize));
+                    offset += sliceSize;
+                    bytesRemaining -= (nuint)sliceSize;
                 }
+                return (int)BsDiffStatusType.Success;
+            }
+            catch (Exception e)
+            {
+                Exception = e;
+                return (int)BsDiffStatusType.FileError;
+            }
+        }
+
+        int Seek(nint opaque, long offset, BsDiffSeekOrigin origin)
+        {
+            try
+            {
+                _stream.Seek(offset, origin switch
+                {
+                    BsDiffSeekOrigin.Begin => SeekOrigin.Begin,
+                    BsDiffSeekOrigin.Current => SeekOrigin.Current,
+                    BsDiffSeekOrigin.End => SeekOrigin.End,
+                    _ => throw new ArgumentOutOfRangeException(nameof(origin), origin, null)
+                });
+                return (int)BsDiffStatusType.Success;
+            }
+            catch (Exception e)
+            {
+                Exception = e;
+                return (int)BsDiffStatusType.FileError;
+            }
+        }
+
+        int Tell(nint opaque, out long position)
+        {
+            position = 0;
+            try
+            {
+                position = _stream.Position;
+                return (int)BsDiffStatusType.Success;
+            }
+            catch (Exception e)
+            {
+                Exception = e;
+                return (int)BsDiffStatusType.FileError;
             }
         }
     }
@@ -314,6 +1992,26 @@ internal sealed class LibBsDiff : IBsdiffLib
             snap_bsdiff_diff_free.Unref();
             snap_bsdiff_patch.Unref();
             snap_bsdiff_patch_free.Unref();
+            snap_bsdiff_diff_stream.Unref();
+            snap_bsdiff_patch_stream.Unref();
+            snap_bsdiff_diff_batch.Unref();
+            snap_bsdiff_patch_batch.Unref();
+            snap_bsdiff_index_build.Unref();
+            snap_bsdiff_index_open.Unref();
+            snap_bsdiff_index_close.Unref();
+            snap_bsdiff_diff_files.Unref();
+            snap_bsdiff_patch_files.Unref();
+            snap_bsdiff_compose.Unref();
+            snap_bsdiff_compose_free.Unref();
+            snap_bsdiff_sha256_init.Unref();
+            snap_bsdiff_sha256_update.Unref();
+            snap_bsdiff_sha256_final.Unref();
+            snap_bsdiff_sha256_batch.Unref();
+            snap_bsdiff_chunk.Unref();
+            snap_bsdiff_chunk_free.Unref();
+            snap_bsdiff_diff_async.Unref();
+            snap_bsdiff_patch_async.Unref();
+            snap_bsdiff_async_close.Unref();
         }
 
         if (_osPlatform == OSPlatform.Windows)
@@ -361,6 +2059,95 @@ internal sealed class LibBsDiff : IBsdiffLib
         public static extern int dlclose(nint hModule);
     }
 
+    // Everything a native async call touches until it completes: the ctx lives in native
+    // memory, the buffers stay pinned and the progress delegate referenced. Disposing is only
+    // safe once Completion has completed or the call failed to start.
+    sealed class AsyncCall : IDisposable
+    {
+        readonly Delegate<snap_bsdiff_async_close_delegate> _close;
+        readonly snap_bsdiff_progress_delegate _progressDelegate;
+        readonly List<GCHandle> _pinned = new();
+        readonly TaskCompletionSource<int> _completion = new(TaskCreationOptions.RunContinuationsAsynchronously);
+        GCHandle _self;
+
+        public List<nint> Allocations { get; } = new();
+        public nint Handle { get; set; }
+        public Task<int> Completion => _completion.Task;
+        public BsDiffProgress Progress => CreateProgress(_progressDelegate);
+        public BsDiffCompletion Callback => new()
+        {
+            callback = Marshal.GetFunctionPointerForDelegate(CompletionDelegate),
+            opaque = GCHandle.ToIntPtr(_self)
+        };
+
+        public AsyncCall(Delegate<snap_bsdiff_async_close_delegate> close, snap_bsdiff_progress_delegate progressDelegate)
+        {
+            _close = close;
+            _progressDelegate = progressDelegate;
+            _self = GCHandle.Alloc(this);
+        }
+
+        public static void Complete(nint opaque, int result) =>
+            ((AsyncCall)GCHandle.FromIntPtr(opaque).Target)._completion.TrySetResult(result);
+
+        public nint Pin(byte[] buffer)
+        {
+            var handle = GCHandle.Alloc(buffer, GCHandleType.Pinned);
+            _pinned.Add(handle);
+            return handle.AddrOfPinnedObject();
+        }
+
+        public unsafe T* Allocate<T>() where T : unmanaged
+        {
+            var ptr = NativeMemory.AllocZeroed((nuint)sizeof(T));
+            Allocations.Add((nint)ptr);
+            return (T*)ptr;
+        }
+
+        // A null terminated UTF-8 copy of value, 0 for null.
+        public unsafe nint AllocateUtf8(string value)
+        {
+            if (value == null)
+            {
+                return 0;
+            }
+
+            var byteCount = Encoding.UTF8.GetByteCount(value);
+            var ptr = (byte*)NativeMemory.AllocZeroed((nuint)byteCount + 1);
+            Allocations.Add((nint)ptr);
+            Encoding.UTF8.GetBytes(value, new Span<byte>(ptr, byteCount));
+            return (nint)ptr;
+        }
+
+        public unsafe void Dispose()
+        {
+            if (Handle != 0)
+            {
+                var ctx = new BsDiffAsyncHandleCtx { handle = Handle };
+                _close.ThrowIfDangling();
+                _close.Invoke(ref ctx);
+                Handle = 0;
+            }
+
+            foreach (var ptr in Allocations)
+            {
+                NativeMemory.Free((void*)ptr);
+            }
+            Allocations.Clear();
+
+            foreach (var handle in _pinned)
+            {
+                handle.Free();
+            }
+            _pinned.Clear();
+
+            if (_self.IsAllocated)
+            {
+                _self.Free();
+            }
+        }
+    }
+
     [SuppressMessage("ReSharper", "MemberCanBePrivate.Local")]
     sealed class Delegate<T> where T: Delegate
     {
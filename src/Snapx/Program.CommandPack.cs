@@ -200,6 +200,7 @@ internal partial class Program
             SnapApp = snapApp,
             NuspecBaseDirectory = artifactsDirectory,
             PackagesDirectory = packagesDirectory,
+            BsDiffCacheDirectory = BuildBsDiffCacheDirectory(filesystem, workingDirectory),
             SnapAppsReleases = snapAppsReleases
         };
 
@@ -144,10 +144,9 @@ internal partial class Program
             workingDirectory += snapOs.Filesystem.DirectorySeparator;
         }
            
-        var snapCryptoProvider = new SnapCryptoProvider();
-         
         var libPal = new LibPal();
         var bsdiffLib = new LibBsDiff();
+        var snapCryptoProvider = new SnapCryptoProvider(bsdiffLib);
         var snapAppReader = new SnapAppReader();
         var snapAppWriter = new SnapAppWriter();
         var snapBinaryPatcher = new SnapBinaryPatcher(bsdiffLib);
@@ -531,6 +530,14 @@ internal partial class Program
             filesystem.PathCombine(workingDirectory, snapAppsGeneric.Artifacts.ExpandProperties(properties));           
     }
 
+    static string BuildBsDiffCacheDirectory([NotNull] ISnapFilesystem filesystem, [NotNull] string workingDirectory)
+    {
+        if (filesystem == null) throw new ArgumentNullException(nameof(filesystem));
+        if (workingDirectory == null) throw new ArgumentNullException(nameof(workingDirectory));
+
+        return filesystem.PathCombine(workingDirectory, ".snapx", "cache", "bsdiff");
+    }
+
     static string BuildPackagesDirectory([NotNull] ISnapFilesystem filesystem, [NotNull] string workingDirectory)
     {
         if (filesystem == null) throw new ArgumentNullException(nameof(filesystem));